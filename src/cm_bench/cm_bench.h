@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __CM_BENCH_H__
+#define __CM_BENCH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cm_atomic.h"
+#include "cm_hash.h"
+#include "cm_thread.h"
+#include "cm_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Helpers shared by the bench_<name> programs. Each of them is one cm_bench_<name>.c linked against
+ * cbb_static, takes one optional count argument and prints a table to stdout.
+ */
+typedef struct st_bench_worker {
+    void *ctx;
+    uint32 id;
+    thread_t thread;
+} bench_worker_t;
+
+#define BENCH_NO_MAX ((uint64)0xFFFFFFFF)
+
+// never 0, so it can divide
+static inline uint64 bench_elapsed_usec(uint64 begin)
+{
+    uint64 elapsed = cm_monotonic_usec() - begin;
+    return (elapsed == 0) ? 1 : elapsed;
+}
+
+// the optional first argument, in [min, max] with max BENCH_NO_MAX for no bound, prints the usage otherwise
+static inline status_t bench_parse_arg(int argc, char **argv, const char *what, uint64 min, uint64 max, uint64 *val)
+{
+    char *end = NULL;
+
+    if (argc <= 1) {
+        return CM_SUCCESS;
+    }
+    uint64 arg = strtoull(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0' || arg < min || arg > max) {
+        if (max == BENCH_NO_MAX) {
+            (void)printf("usage: %s [<%s, at least %llu>]\n", argv[0], what, (unsigned long long)min);
+        } else {
+            (void)printf("usage: %s [<%s, %llu to %llu>]\n", argv[0], what, (unsigned long long)min,
+                (unsigned long long)max);
+        }
+        return CM_ERROR;
+    }
+    *val = arg;
+    return CM_SUCCESS;
+}
+
+static inline status_t bench_malloc(void *ctx, uint32 size, void **buf)
+{
+    *buf = malloc(size);
+    return (*buf == NULL) ? CM_ERROR : CM_SUCCESS;
+}
+
+static inline void bench_free(void *ctx, void *buf)
+{
+    free(buf);
+}
+
+#define BENCH_ALLOCATOR { bench_malloc, bench_free, NULL }
+
+static inline void bench_wait_go(atomic32_t *go)
+{
+    while (cm_atomic32_get(go) == 0) {
+        cm_spin_sleep();
+    }
+}
+
+/*
+ * Starts pairs threads on producer and pairs on consumer, worker i and worker i + pairs get id i.
+ * They should wait for go, so none of them runs before the last one is started. Returns the number
+ * of threads started.
+ */
+static inline uint32 bench_start_pairs(bench_worker_t *workers, uint32 pairs, thread_entry_t producer,
+    thread_entry_t consumer, void *ctx)
+{
+    for (uint32 i = 0; i < 2 * pairs; i++) {
+        workers[i].ctx = ctx;
+        workers[i].id = i % pairs;
+        if (cm_create_thread(i < pairs ? producer : consumer, 0, &workers[i], &workers[i].thread) != CM_SUCCESS) {
+            return i;
+        }
+    }
+    return 2 * pairs;
+}
+
+static inline void bench_join(bench_worker_t *workers, uint32 started)
+{
+    for (uint32 i = 0; i < started; i++) {
+        cm_close_thread(&workers[i].thread);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
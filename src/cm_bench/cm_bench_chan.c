@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench_chan.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench_chan.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "cm_bench.h"
+#include "cm_chan.h"
+
+/* N senders and N receivers on one chan, the locked chan against the lock free and the spsc variants */
+#define BENCH_DEFAULT_MSGS (uint32)(1 << 21)
+#define BENCH_MAX_THREADS  8
+#define BENCH_MAX_BATCH    32
+#define BENCH_CHAN_SIZE    1024
+
+typedef struct st_bench_msg {
+    uint64 seq;
+    uint64 check;
+} bench_msg_t;
+
+typedef struct st_bench_chan_ctx {
+    chan_t *chan;
+    uint32 per_thread;
+    uint32 batch;
+    atomic32_t go;
+    atomic_t sum;
+    bool32 failed;
+} bench_chan_ctx_t;
+
+static void bench_sender(thread_t *thread)
+{
+    bench_worker_t *worker = (bench_worker_t *)thread->argument;
+    bench_chan_ctx_t *ctx = (bench_chan_ctx_t *)worker->ctx;
+    bench_msg_t msgs[BENCH_MAX_BATCH];
+    uint64 base = (uint64)worker->id * ctx->per_thread;
+    uint32 sent;
+
+    bench_wait_go(&ctx->go);
+    for (uint32 i = 0; i < ctx->per_thread;) {
+        uint32 count = MIN(ctx->batch, ctx->per_thread - i);
+        for (uint32 j = 0; j < count; j++) {
+            msgs[j].seq = base + i + j + 1;
+            msgs[j].check = msgs[j].seq * 3;
+        }
+        status_t ret = (ctx->batch == 1) ? cm_chan_send(ctx->chan, &msgs[0]) :
+            cm_chan_send_batch(ctx->chan, msgs, count, &sent, CM_INFINITE_TIMEOUT);
+        if (ret != CM_SUCCESS) {
+            ctx->failed = CM_TRUE;
+            return;
+        }
+        i += count;
+    }
+}
+
+// every receiver takes as many messages as one sender sends
+static void bench_receiver(thread_t *thread)
+{
+    bench_worker_t *worker = (bench_worker_t *)thread->argument;
+    bench_chan_ctx_t *ctx = (bench_chan_ctx_t *)worker->ctx;
+    bench_msg_t msgs[BENCH_MAX_BATCH];
+    uint64 sum = 0;
+    uint32 recvd = 1;
+
+    bench_wait_go(&ctx->go);
+    for (uint32 i = 0; i < ctx->per_thread; i += recvd) {
+        uint32 count = MIN(ctx->batch, ctx->per_thread - i);
+        status_t ret = (ctx->batch == 1) ? cm_chan_recv(ctx->chan, &msgs[0]) :
+            cm_chan_recv_batch(ctx->chan, msgs, count, &recvd, CM_INFINITE_TIMEOUT);
+        if (ret != CM_SUCCESS) {
+            ctx->failed = CM_TRUE;
+            return;
+        }
+        for (uint32 j = 0; j < recvd; j++) {
+            if (msgs[j].check != msgs[j].seq * 3) {
+                ctx->failed = CM_TRUE;
+            }
+            sum += msgs[j].seq;
+        }
+    }
+    (void)cm_atomic_add(&ctx->sum, (int64)sum);
+}
+
+static status_t bench_chan_run(bench_chan_ctx_t *ctx, uint32 flags, uint32 threads, double *mmsgs)
+{
+    bench_worker_t workers[2 * BENCH_MAX_THREADS];
+
+    ctx->chan = cm_chan_new_ex(BENCH_CHAN_SIZE, (uint32)sizeof(bench_msg_t), flags);
+    if (ctx->chan == NULL) {
+        return CM_ERROR;
+    }
+    ctx->go = 0;
+    ctx->sum = 0;
+    ctx->failed = CM_FALSE;
+
+    uint32 started = bench_start_pairs(workers, threads, bench_sender, bench_receiver, ctx);
+    uint64 begin = cm_monotonic_usec();
+    (void)cm_atomic32_inc(&ctx->go);
+    if (started < 2 * threads) {
+        // blocked senders and receivers give up once the chan is closed
+        ctx->failed = CM_TRUE;
+        cm_chan_close(ctx->chan);
+    }
+    bench_join(workers, started);
+    uint64 elapsed = bench_elapsed_usec(begin);
+    cm_chan_free(ctx->chan);
+
+    uint64 total = (uint64)threads * ctx->per_thread;
+    if (ctx->failed || (uint64)cm_atomic_get(&ctx->sum) != total * (total + 1) / 2) {
+        return CM_ERROR;
+    }
+    *mmsgs = (double)total / (double)elapsed;
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32 thread_counts[] = { 1, 2, 4, BENCH_MAX_THREADS };
+    static const uint32 batches[] = { 1, BENCH_MAX_BATCH };
+    bench_chan_ctx_t ctx;
+    uint64 msgs = BENCH_DEFAULT_MSGS;
+    double locked;
+    double lock_free;
+    double spsc;
+
+    CM_RETURN_IFERR(bench_parse_arg(argc, argv, "messages per run", BENCH_MAX_THREADS, BENCH_NO_MAX, &msgs));
+    (void)printf("%-8s %-6s %14s %14s %14s\n", "threads", "batch", "lock Mmsg/s", "mpmc Mmsg/s", "spsc Mmsg/s");
+    for (uint32 b = 0; b < ELEMENT_COUNT(batches); b++) {
+        for (uint32 i = 0; i < ELEMENT_COUNT(thread_counts); i++) {
+            ctx.per_thread = (uint32)msgs / thread_counts[i];
+            ctx.batch = batches[b];
+            spsc = 0;
+            if (bench_chan_run(&ctx, 0, thread_counts[i], &locked) != CM_SUCCESS ||
+                bench_chan_run(&ctx, CHAN_FLAG_LOCK_FREE, thread_counts[i], &lock_free) != CM_SUCCESS ||
+                (thread_counts[i] == 1 && bench_chan_run(&ctx, CHAN_FLAG_SPSC, 1, &spsc) != CM_SUCCESS)) {
+                (void)printf("run with %u senders and receivers failed\n", thread_counts[i]);
+                return CM_ERROR;
+            }
+            (void)printf("%-8u %-6u %14.2f %14.2f %14.2f\n", thread_counts[i], batches[b], locked, lock_free, spsc);
+        }
+    }
+    return CM_SUCCESS;
+}
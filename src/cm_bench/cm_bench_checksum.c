@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench_checksum.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench_checksum.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "cm_bench.h"
+#include "cm_checksum.h"
+
+/* CRC32C GB/s from 64 B to 1 MB, the kernel cm_get_checksum resolves to against one sse4.2 stream and the table */
+#define BENCH_MAX_LEN       (uint32)(1 << 20)
+#define BENCH_BYTES_PER_RUN ((uint64)1 << 30)
+
+typedef uint32 (*bench_crc_func_t)(const void *data, uint32 len);
+
+static double bench_crc_gbps(bench_crc_func_t func, const uint8 *buf, uint32 len, uint64 bytes, uint32 *sink)
+{
+    uint64 rounds = bytes / len;
+    uint64 begin = cm_monotonic_usec();
+
+    for (uint64 i = 0; i < rounds; i++) {
+        *sink += func(buf, len);
+    }
+    return (double)(rounds * len) / (double)bench_elapsed_usec(begin) / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64 bytes = BENCH_BYTES_PER_RUN;
+    uint32 sink = 0;
+    bool32 has_sse42 = cm_crc32c_sse42_available();
+
+    CM_RETURN_IFERR(bench_parse_arg(argc, argv, "bytes per size", BENCH_MAX_LEN, BENCH_NO_MAX, &bytes));
+    uint8 *buf = (uint8 *)malloc(BENCH_MAX_LEN);
+    if (buf == NULL) {
+        return CM_ERROR;
+    }
+    for (uint32 i = 0; i < BENCH_MAX_LEN; i++) {
+        buf[i] = (uint8)rand();
+    }
+    if (cm_get_checksum(buf, BENCH_MAX_LEN) != cm_get_crc32_sb8(buf, BENCH_MAX_LEN)) {
+        (void)printf("resolved kernel does not match the table kernel\n");
+        free(buf);
+        return CM_ERROR;
+    }
+
+    (void)printf("%-8s %12s %12s %12s\n", "bytes", "GB/s", "sse42 GB/s", "table GB/s");
+    for (uint32 len = 64; len <= BENCH_MAX_LEN; len <<= 2) {
+        double resolved = bench_crc_gbps(cm_get_checksum, buf, len, bytes, &sink);
+        double sse42 = has_sse42 ? bench_crc_gbps(cm_get_crc32_sse42, buf, len, bytes, &sink) : 0;
+        double table = bench_crc_gbps(cm_get_crc32_sb8, buf, len, bytes / 4, &sink);
+        (void)printf("%-8u %12.2f %12.2f %12.2f\n", len, resolved, sse42, table);
+    }
+    (void)printf("checksum %08x\n", sink);
+    free(buf);
+    return CM_SUCCESS;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench_json.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench_json.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "cm_bench.h"
+#include "cm_text.h"
+#include "ddes_json.h"
+
+/*
+ * json_create, the reads cm_res_mgr does and json_destory on the resource status documents CmGetResStats returns.
+ * Only the public json api is used, so building it against an older ddes_json.c compares the parsers.
+ */
+#define BENCH_DEFAULT_DOCS (uint32)20000
+#define BENCH_MAX_INSTS    64
+#define BENCH_DOC_SIZE     (uint32)SIZE_K(16)
+
+// laid out the way the cm client prints it, see cm_get_res_stat in cm_res_mgr.h
+static uint32 bench_build_stat(char *doc, uint32 insts)
+{
+    int32 len = snprintf_s(doc, BENCH_DOC_SIZE, BENCH_DOC_SIZE - 1,
+        "{\n\t\"res_name\":\t\"dss\",\n\t\"version\":\t%u,\n\t\"inst_count\":\t%u,\n\t\"inst_status\":\t[", insts * 3,
+        insts);
+    for (uint32 i = 0; i < insts && len > 0; i++) {
+        int32 n = snprintf_s(doc + len, BENCH_DOC_SIZE - (uint32)len, BENCH_DOC_SIZE - (uint32)len - 1,
+            "%s{\n\t\t\t\"node_id\":\t%u,\n\t\t\t\"res_instance_id\":\t%u,\n\t\t\t\"is_work_member\":\t%u,"
+            "\n\t\t\t\"status\":\t%u\n\t\t}", i == 0 ? "" : ", ", i + 1, i, (i % 8) != 7, 1 + (i % 5 == 4));
+        len = (n < 0) ? n : len + n;
+    }
+    if (len < 0) {
+        return 0;
+    }
+    int32 n = snprintf_s(doc + len, BENCH_DOC_SIZE - (uint32)len, BENCH_DOC_SIZE - (uint32)len - 1, "]\n}");
+    return (n < 0) ? 0 : (uint32)(len + n);
+}
+
+static status_t bench_read_stat(json_t *json, uint32 insts, uint64 *sum)
+{
+    text_t inst_count = { "inst_count", 10 };
+    text_t inst_status = { "inst_status", 11 };
+    text_t keys[] = { { "node_id", 7 }, { "res_instance_id", 15 }, { "is_work_member", 14 }, { "status", 6 } };
+    uint64 val;
+
+    if (json_get_uint64(json, &inst_count, &val) != CM_SUCCESS || val != insts) {
+        return CM_ERROR;
+    }
+    json_arr_t *arr = json_get_arr(json, &inst_status);
+    if (arr == NULL || jarr_get_size(arr) != insts) {
+        return CM_ERROR;
+    }
+    for (uint32 i = 0; i < insts; i++) {
+        json_t *inst = jarr_get_obj(arr, i);
+        if (inst == NULL) {
+            return CM_ERROR;
+        }
+        for (uint32 k = 0; k < ELEMENT_COUNT(keys); k++) {
+            CM_RETURN_IFERR(json_get_uint64(inst, &keys[k], &val));
+            *sum += val;
+        }
+    }
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32 inst_counts[] = { 2, 8, 32, BENCH_MAX_INSTS };
+    static char doc[BENCH_DOC_SIZE];
+    cm_allocator_t alloc = BENCH_ALLOCATOR;
+    uint64 docs = BENCH_DEFAULT_DOCS;
+    uint64 sum = 0;
+    json_t *json = NULL;
+
+    CM_RETURN_IFERR(bench_parse_arg(argc, argv, "documents per size", 1, BENCH_NO_MAX, &docs));
+    (void)printf("%-6s %8s %12s %10s\n", "insts", "bytes", "us/doc", "MB/s");
+    for (uint32 i = 0; i < ELEMENT_COUNT(inst_counts); i++) {
+        text_t txt = { doc, bench_build_stat(doc, inst_counts[i]) };
+        if (txt.len == 0) {
+            return CM_ERROR;
+        }
+        uint64 begin = cm_monotonic_usec();
+        for (uint32 d = 0; d < docs; d++) {
+            if (json_create(&json, &txt, &alloc) != CM_SUCCESS) {
+                (void)printf("failed to parse the document of %u instances\n", inst_counts[i]);
+                return CM_ERROR;
+            }
+            status_t ret = bench_read_stat(json, inst_counts[i], &sum);
+            json_destory(json);
+            if (ret != CM_SUCCESS) {
+                (void)printf("wrong values in the document of %u instances\n", inst_counts[i]);
+                return CM_ERROR;
+            }
+        }
+        uint64 elapsed = bench_elapsed_usec(begin);
+        (void)printf("%-6u %8u %12.2f %10.1f\n", inst_counts[i], txt.len, (double)elapsed / docs,
+            (double)txt.len * docs / (double)elapsed);
+    }
+    (void)printf("checksum %llu\n", (unsigned long long)sum);
+    return CM_SUCCESS;
+}
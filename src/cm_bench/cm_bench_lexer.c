@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench_lexer.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench_lexer.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "cm_bench.h"
+#include "ddes_lexer.h"
+
+/* lex_fetch tokens/s over a statement corpus: dml, ddl, and statements full of hints, comments and literals */
+#define BENCH_DEFAULT_ROUNDS (uint32)20000
+#define BENCH_MAX_STMTS      16
+
+typedef struct st_bench_corpus {
+    const char *name;
+    const char **stmts;
+    uint32 count;
+} bench_corpus_t;
+
+static const char *g_bench_dml[] = {
+    "select a.id, b.name, count(*) from t1 a join t2 b on a.id = b.id where a.x >= 10 and b.y <> 'abc' "
+    "group by a.id order by 2 desc",
+    "insert into tab_1 (c1, c2, c3) values (1, 'x''y', 3.5e10), (2, null, -7)",
+    "update t set c = c + 1, d = sysdate where rowid = :1 and level < 3",
+    "delete from abc where x in (select y from z where q like 'a%') -- trailing comment",
+    "select distinct o.order_id, o.status, sum(l.amount) total from orders o left join order_lines l "
+    "on l.order_id = o.order_id where o.created_at between :start and :end and o.status in ('NEW', 'PAID') "
+    "group by o.order_id, o.status having sum(l.amount) > 100.25 order by total desc limit 50 offset 100",
+    "merge into stock s using (select item_id, qty from arrivals) a on (s.item_id = a.item_id) "
+    "when matched then update set s.qty = s.qty + a.qty when not matched then insert values (a.item_id, a.qty)",
+    "select case when grade >= 90 then 'A' when grade >= 80 then 'B' else 'C' end, nvl(comment, '') "
+    "from scores where exists (select 1 from students where students.id = scores.sid) for update nowait",
+};
+
+static const char *g_bench_ddl[] = {
+    "create table foo (id bigint unsigned not null, name varchar(64), d double precision, "
+    "c character varying(10))",
+    "alter table t add column col_new integer default 0",
+    "create unique index idx_orders_1 on orders (customer_id asc, created_at desc) tablespace users "
+    "initrans 4 pctfree 10 parallel 8",
+    "create or replace view v_open as select * from orders where status <> 'CLOSED' with check option",
+    "grant select, insert, update on orders to app_user with grant option",
+};
+
+static const char *g_bench_misc[] = {
+    "/*+ index(t idx_1) use_nl(t s) leading(t s) */ select * from t, s where t.a = s.a and t.a between 1 and 10",
+    "select interval '1' day, skip_triggers, skip_quote_names, SKIP_TRIGGERS from dual",
+    "SELECT X'0AFF', 0x1F, 1.5, .5, -3e-7, t.\"Quoted Name\" FROM T WHERE ROWNUM <= 10",
+    "/* multi line\n   comment */ select 'a long string literal with ''quotes'' and more text inside it', "
+    "\"Mixed Case Column\" from \"Schema\".\"Table\" -- the end",
+};
+
+static uint64 bench_lex_stmt(const char *stmt, uint32 len)
+{
+    lang_text_t sql;
+    lex_t lex;
+    word_t word;
+    uint64 tokens = 0;
+
+    sql.str = (char *)stmt;
+    sql.len = len;
+    sql.loc.line = 1;
+    sql.loc.column = 1;
+    lex_init(&lex, &sql);
+    for (;;) {
+        if (lex_fetch(&lex, &word) != CM_SUCCESS) {
+            return 0;
+        }
+        if (word.type == WORD_TYPE_EOF) {
+            return tokens;
+        }
+        tokens++;
+    }
+}
+
+static status_t bench_lex_corpus(const bench_corpus_t *corpus, uint32 rounds)
+{
+    uint32 lens[BENCH_MAX_STMTS];
+    uint64 bytes = 0;
+    uint64 tokens = 0;
+
+    for (uint32 i = 0; i < corpus->count; i++) {
+        lens[i] = (uint32)strlen(corpus->stmts[i]);
+        bytes += lens[i];
+        if (bench_lex_stmt(corpus->stmts[i], lens[i]) == 0) {
+            (void)printf("failed to lex: %s\n", corpus->stmts[i]);
+            return CM_ERROR;
+        }
+    }
+
+    uint64 begin = cm_monotonic_usec();
+    for (uint32 r = 0; r < rounds; r++) {
+        for (uint32 i = 0; i < corpus->count; i++) {
+            tokens += bench_lex_stmt(corpus->stmts[i], lens[i]);
+        }
+    }
+    uint64 elapsed = bench_elapsed_usec(begin);
+    (void)printf("%-6s %8u %10llu %14.2f %10.1f\n", corpus->name, corpus->count,
+        (unsigned long long)(tokens / rounds), (double)tokens / (double)elapsed, (double)(bytes * rounds) / elapsed);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const bench_corpus_t corpora[] = {
+        { "dml", g_bench_dml, ELEMENT_COUNT(g_bench_dml) },
+        { "ddl", g_bench_ddl, ELEMENT_COUNT(g_bench_ddl) },
+        { "misc", g_bench_misc, ELEMENT_COUNT(g_bench_misc) },
+    };
+    uint64 rounds = BENCH_DEFAULT_ROUNDS;
+
+    CM_RETURN_IFERR(bench_parse_arg(argc, argv, "rounds over the corpus", 1, BENCH_NO_MAX, &rounds));
+    (void)printf("%-6s %8s %10s %14s %10s\n", "corpus", "stmts", "tokens", "Mtokens/s", "MB/s");
+    for (uint32 i = 0; i < ELEMENT_COUNT(corpora); i++) {
+        CM_RETURN_IFERR(bench_lex_corpus(&corpora[i], (uint32)rounds));
+    }
+    return CM_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench_mes_queue.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench_mes_queue.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "cm_bench.h"
+#include "mes_queue.h"
+
+/* N producers and N consumers on one mes_msgqueue_t, the spinlock list alone against ring plus list */
+#define BENCH_DEFAULT_ITEMS (uint32)(1 << 21)
+#define BENCH_MAX_THREADS   64
+#define BENCH_RING_SIZE     1024
+
+typedef struct st_bench_queue_ctx {
+    mes_msgqueue_t queue;
+    mes_msgitem_t *items;
+    uint32 per_producer;
+    atomic32_t go;
+    atomic_t consumed;
+    uint64 total;
+} bench_queue_ctx_t;
+
+static void bench_producer(thread_t *thread)
+{
+    bench_worker_t *worker = (bench_worker_t *)thread->argument;
+    bench_queue_ctx_t *ctx = (bench_queue_ctx_t *)worker->ctx;
+    mes_msgitem_t *items = ctx->items + (uint64)worker->id * ctx->per_producer;
+
+    bench_wait_go(&ctx->go);
+    for (uint32 i = 0; i < ctx->per_producer; i++) {
+        mes_put_msgitem(&ctx->queue, &items[i]);
+    }
+}
+
+static void bench_consumer(thread_t *thread)
+{
+    bench_worker_t *worker = (bench_worker_t *)thread->argument;
+    bench_queue_ctx_t *ctx = (bench_queue_ctx_t *)worker->ctx;
+
+    bench_wait_go(&ctx->go);
+    while ((uint64)cm_atomic_get(&ctx->consumed) < ctx->total) {
+        if (mes_get_msgitem(&ctx->queue) == NULL) {
+            cm_spin_sleep();
+            continue;
+        }
+        (void)cm_atomic_inc(&ctx->consumed);
+    }
+}
+
+static status_t bench_queue_run(bench_queue_ctx_t *ctx, uint32 threads, bool32 use_ring, double *mops)
+{
+    bench_worker_t workers[2 * BENCH_MAX_THREADS];
+
+    mes_init_msgqueue(&ctx->queue);
+    if (use_ring && cm_ring_init(&ctx->queue.ring, BENCH_RING_SIZE) != CM_SUCCESS) {
+        return CM_ERROR;
+    }
+    ctx->go = 0;
+    ctx->consumed = 0;
+    ctx->total = (uint64)threads * ctx->per_producer;
+
+    uint32 started = bench_start_pairs(workers, threads, bench_producer, bench_consumer, ctx);
+    uint64 begin = cm_monotonic_usec();
+    if (started < 2 * threads) {
+        // let the started threads finish the work on their own
+        ctx->total = 0;
+    }
+    (void)cm_atomic32_inc(&ctx->go);
+    bench_join(workers, started);
+    uint64 elapsed = bench_elapsed_usec(begin);
+
+    if (use_ring) {
+        cm_ring_destroy(&ctx->queue.ring);
+    }
+    if (started < 2 * threads || (uint64)cm_atomic_get(&ctx->consumed) != ctx->total) {
+        return CM_ERROR;
+    }
+    *mops = (double)ctx->total / (double)elapsed;
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32 thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    bench_queue_ctx_t ctx;
+    uint64 items = BENCH_DEFAULT_ITEMS;
+    double list_mops;
+    double ring_mops;
+
+    CM_RETURN_IFERR(bench_parse_arg(argc, argv, "items per run", BENCH_MAX_THREADS, BENCH_NO_MAX, &items));
+    ctx.items = (mes_msgitem_t *)calloc(items, sizeof(mes_msgitem_t));
+    if (ctx.items == NULL) {
+        return CM_ERROR;
+    }
+
+    (void)printf("%-8s %14s %14s\n", "threads", "list Mops/s", "ring Mops/s");
+    for (uint32 i = 0; i < ELEMENT_COUNT(thread_counts); i++) {
+        ctx.per_producer = (uint32)items / thread_counts[i];
+        if (bench_queue_run(&ctx, thread_counts[i], CM_FALSE, &list_mops) != CM_SUCCESS ||
+            bench_queue_run(&ctx, thread_counts[i], CM_TRUE, &ring_mops) != CM_SUCCESS) {
+            (void)printf("run with %u producers and consumers failed\n", thread_counts[i]);
+            free(ctx.items);
+            return CM_ERROR;
+        }
+        (void)printf("%-8u %14.2f %14.2f\n", thread_counts[i], list_mops, ring_mops);
+    }
+    free(ctx.items);
+    return CM_SUCCESS;
+}
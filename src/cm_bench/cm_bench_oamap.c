@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_bench_oamap.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_bench/cm_bench_oamap.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "cm_bench.h"
+#include "cm_oamap.h"
+
+/*
+ * ns per insert, hit and miss of uint64 keys from 1K to 10M items. The oamap grows from empty,
+ * cm_hmap gets one bucket per item up front as its users size it.
+ */
+#define BENCH_MIN_ITEMS    (uint32)1000
+#define BENCH_MAX_ITEMS    (uint32)10000000
+#define BENCH_OPS_PER_SIZE (uint64)20000000
+#define BENCH_KEY_MUL      0x9E3779B97F4A7C15ULL
+#define BENCH_MISS_BIT     0x8000000000000000ULL
+#define BENCH_STRIDE       7919 // visits the items out of insertion order, prime to every size
+
+typedef struct st_bench_item {
+    uint64 key;
+    hash_node_t node;
+} bench_item_t;
+
+typedef struct st_bench_result {
+    double insert;
+    double hit;
+    double hit_inline;
+    double miss;
+} bench_result_t;
+
+static cm_allocator_t g_bench_alloc = BENCH_ALLOCATOR;
+static volatile uintptr_t g_bench_sink;
+
+static void *bench_item_key(void *item)
+{
+    return &((bench_item_t *)item)->key;
+}
+
+static void *bench_node_key(hash_node_t *node)
+{
+    return &((bench_item_t *)((char *)node - OFFSET_OF(bench_item_t, node)))->key;
+}
+
+static bool32 bench_key_equal(void *lkey, void *rkey)
+{
+    return *(uint64 *)lkey == *(uint64 *)rkey;
+}
+
+static uint32 bench_key_hash(void *key)
+{
+    uint64 val = *(uint64 *)key;
+    return (uint32)(val ^ (val >> 32));
+}
+
+#define BENCH_ITEM_KEY(item)        (&((bench_item_t *)(item))->key)
+#define BENCH_KEY_HASH(key)         ((uint32)(*(key) ^ (*(key) >> 32)))
+#define BENCH_KEY_EQUAL(lkey, rkey) (*(uint64 *)(lkey) == *(rkey))
+CM_OAMAP_DEFINE_FIND(bench_oamap_find, const uint64 *, BENCH_KEY_HASH, BENCH_ITEM_KEY, BENCH_KEY_EQUAL)
+
+static oamap_funcs_t g_bench_oamap_funcs = { bench_item_key, bench_key_equal, bench_key_hash };
+static hash_funcs_t g_bench_hmap_funcs = { bench_node_key, bench_key_equal, bench_key_hash };
+
+static inline uint32 bench_pos(uint32 i, uint32 count)
+{
+    return (uint32)((uint64)i * BENCH_STRIDE % count);
+}
+
+static inline double bench_ns(uint64 begin, uint64 ops)
+{
+    return (double)bench_elapsed_usec(begin) * 1000.0 / (double)ops;
+}
+
+static status_t bench_run_oamap(bench_item_t *items, uint32 count, uint32 reps, bench_result_t *res)
+{
+    oamap_t map;
+    void *exist = NULL;
+    uint64 ops = (uint64)count * reps;
+    uint64 begin = cm_monotonic_usec();
+
+    for (uint32 r = 0; r < reps; r++) {
+        CM_RETURN_IFERR(cm_oamap_init(&map, &g_bench_alloc, 0));
+        for (uint32 i = 0; i < count; i++) {
+            if (cm_oamap_insert(&map, &g_bench_oamap_funcs, &items[i], &exist) != CM_SUCCESS) {
+                cm_oamap_destroy(&map);
+                return CM_ERROR;
+            }
+        }
+        if (r + 1 < reps) {
+            cm_oamap_destroy(&map);
+        }
+    }
+    res->insert = bench_ns(begin, ops);
+
+    begin = cm_monotonic_usec();
+    for (uint32 r = 0; r < reps; r++) {
+        for (uint32 i = 0; i < count; i++) {
+            g_bench_sink += (uintptr_t)cm_oamap_find(&map, &g_bench_oamap_funcs, &items[bench_pos(i, count)].key);
+        }
+    }
+    res->hit = bench_ns(begin, ops);
+
+    begin = cm_monotonic_usec();
+    for (uint32 r = 0; r < reps; r++) {
+        for (uint32 i = 0; i < count; i++) {
+            g_bench_sink += (uintptr_t)bench_oamap_find(&map, &items[bench_pos(i, count)].key);
+        }
+    }
+    res->hit_inline = bench_ns(begin, ops);
+
+    begin = cm_monotonic_usec();
+    for (uint32 r = 0; r < reps; r++) {
+        for (uint32 i = 0; i < count; i++) {
+            uint64 key = items[bench_pos(i, count)].key | BENCH_MISS_BIT;
+            g_bench_sink += (uintptr_t)cm_oamap_find(&map, &g_bench_oamap_funcs, &key);
+        }
+    }
+    res->miss = bench_ns(begin, ops);
+    cm_oamap_destroy(&map);
+    return CM_SUCCESS;
+}
+
+static status_t bench_run_hmap(bench_item_t *items, uint32 count, uint32 reps, bench_result_t *res)
+{
+    hash_map_t map;
+    uint64 ops = (uint64)count * reps;
+    uint64 begin = cm_monotonic_usec();
+
+    for (uint32 r = 0; r < reps; r++) {
+        CM_RETURN_IFERR(cm_hmap_init(&map, &g_bench_alloc, count));
+        for (uint32 i = 0; i < count; i++) {
+            (void)cm_hmap_insert(&map, &g_bench_hmap_funcs, &items[i].node);
+        }
+        if (r + 1 < reps) {
+            g_bench_alloc.f_free(g_bench_alloc.mem_ctx, map.buckets);
+        }
+    }
+    res->insert = bench_ns(begin, ops);
+
+    begin = cm_monotonic_usec();
+    for (uint32 r = 0; r < reps; r++) {
+        for (uint32 i = 0; i < count; i++) {
+            g_bench_sink += (uintptr_t)cm_hmap_find(&map, &g_bench_hmap_funcs, &items[bench_pos(i, count)].key);
+        }
+    }
+    res->hit = bench_ns(begin, ops);
+    res->hit_inline = 0;
+
+    begin = cm_monotonic_usec();
+    for (uint32 r = 0; r < reps; r++) {
+        for (uint32 i = 0; i < count; i++) {
+            uint64 key = items[bench_pos(i, count)].key | BENCH_MISS_BIT;
+            g_bench_sink += (uintptr_t)cm_hmap_find(&map, &g_bench_hmap_funcs, &key);
+        }
+    }
+    res->miss = bench_ns(begin, ops);
+    g_bench_alloc.f_free(g_bench_alloc.mem_ctx, map.buckets);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    uint64 max_items = BENCH_MAX_ITEMS;
+    bench_result_t oamap;
+    bench_result_t hmap;
+
+    CM_RETURN_IFERR(bench_parse_arg(argc, argv, "max items", BENCH_MIN_ITEMS, BENCH_MAX_ITEMS, &max_items));
+    bench_item_t *items = (bench_item_t *)malloc(max_items * sizeof(bench_item_t));
+    if (items == NULL) {
+        return CM_ERROR;
+    }
+    // keys never have the top bit set, so setting it makes a key that misses
+    for (uint32 i = 0; i < max_items; i++) {
+        items[i].key = ((uint64)i * BENCH_KEY_MUL + 1) & ~BENCH_MISS_BIT;
+        items[i].node.next = NULL;
+    }
+
+    (void)printf("%-9s | %-32s | %-24s\n", "", "oamap ns/op", "cm_hmap ns/op");
+    (void)printf("%-9s | %7s %7s %7s %7s | %7s %7s %7s\n", "items", "insert", "hit", "inline", "miss", "insert", "hit",
+        "miss");
+    for (uint32 count = BENCH_MIN_ITEMS; count <= max_items; count *= 10) {
+        uint32 reps = (uint32)MAX(BENCH_OPS_PER_SIZE / count, 1);
+        if (bench_run_oamap(items, count, reps, &oamap) != CM_SUCCESS ||
+            bench_run_hmap(items, count, reps, &hmap) != CM_SUCCESS) {
+            (void)printf("run with %u items failed\n", count);
+            free(items);
+            return CM_ERROR;
+        }
+        (void)printf("%-9u | %7.1f %7.1f %7.1f %7.1f | %7.1f %7.1f %7.1f\n", count, oamap.insert, oamap.hit,
+            oamap.hit_inline, oamap.miss, hmap.insert, hmap.hit, hmap.miss);
+        if (count > max_items / 10) {
+            break;
+        }
+    }
+    free(items);
+    return CM_SUCCESS;
+}
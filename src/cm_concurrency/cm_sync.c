@@ -25,8 +25,12 @@
 #include "cm_error.h"
 #ifndef WIN32
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
 #endif
 #include "cm_date_to_text.h"
+#include "cm_memory.h"
 
 int32 cm_event_init(cm_event_t *event)
 {
@@ -149,3 +153,57 @@ void cm_event_notify(cm_event_t *event)
     (void)pthread_mutex_unlock(&event->lock);
 #endif
 }
+
+void cm_park_init(cm_park_t *park)
+{
+    park->seq = 0;
+    park->waiters = 0;
+    park->shared = CM_FALSE;
+}
+
+void cm_park_init_shared(cm_park_t *park)
+{
+    cm_park_init(park);
+    park->shared = CM_TRUE;
+}
+
+uint32 cm_park_prepare(cm_park_t *park)
+{
+    uint32 seq = (uint32)cm_atomic32_get(&park->seq);
+    (void)cm_atomic32_inc(&park->waiters);
+    return seq;
+}
+
+void cm_park_cancel(cm_park_t *park)
+{
+    (void)cm_atomic32_dec(&park->waiters);
+}
+
+void cm_park_wait(cm_park_t *park, uint32 seq, uint32 timeout)
+{
+#ifdef WIN32
+    if ((uint32)cm_atomic32_get(&park->seq) == seq) {
+        Sleep(1);
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = timeout / MILLISECS_PER_SECOND;
+    ts.tv_nsec = ((long)timeout % (long)MILLISECS_PER_SECOND) * NANOSECS_PER_MILLISECS_LL;
+    // returns at once if a waker bumped seq after prepare
+    (void)syscall(SYS_futex, &park->seq, park->shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+#endif
+    (void)cm_atomic32_dec(&park->waiters);
+}
+
+void cm_park_wake(cm_park_t *park, uint32 count)
+{
+    CM_MFENCE;
+    if (cm_atomic32_get(&park->waiters) == 0) {
+        return;
+    }
+    (void)cm_atomic32_inc(&park->seq);
+#ifndef WIN32
+    (void)syscall(SYS_futex, &park->seq, park->shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, (int32)count, NULL, NULL,
+        0);
+#endif
+}
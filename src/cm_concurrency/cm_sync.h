@@ -26,6 +26,7 @@
 #define __CM_SYNC_H__
 
 #include "cm_defs.h"
+#include "cm_atomic.h"
 
 #ifdef WIN32
 #include <windows.h>
@@ -59,6 +60,25 @@ void cm_event_wait(cm_event_t *event);
 void cm_get_timespec(struct timespec *tim, uint32 timeout);
 #endif
 
+/*
+ * Parking spot for idle threads, wakers only pay a syscall when someone is parked.
+ * A waiter calls cm_park_prepare, re-checks its condition, then either cm_park_cancel
+ * or cm_park_wait with the returned sequence. Wakeups between prepare and wait are not lost.
+ */
+typedef struct st_cm_park {
+    atomic32_t seq;
+    atomic32_t waiters;
+    bool32 shared; // lives in memory mapped by several processes
+} cm_park_t;
+
+void cm_park_init(cm_park_t *park);
+void cm_park_init_shared(cm_park_t *park);
+uint32 cm_park_prepare(cm_park_t *park);
+void cm_park_cancel(cm_park_t *park);
+// timeout's unit is milliseconds
+void cm_park_wait(cm_park_t *park, uint32 seq, uint32 timeout);
+void cm_park_wake(cm_park_t *park, uint32 count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,8 @@
 #include "cm_thread_pool.h"
 #include "cm_log.h"
 #include "cm_error.h"
+#include "cm_memory.h"
+#include "cm_timer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -194,6 +196,395 @@ void cm_release_pooling_thread(pooling_thread_t *thread)
     thread->status = THREAD_STATUS_IDLE;
 }
 
+static thread_local_var cm_task_worker_t *g_task_worker = NULL;
+
+static status_t cm_task_deque_init(cm_task_deque_t *deque, uint32 size)
+{
+    uint32 cap = 1;
+    while (cap < size) {
+        cap <<= 1;
+    }
+    deque->tasks = (cm_task_t **)malloc(sizeof(cm_task_t *) * cap);
+    if (deque->tasks == NULL) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, (uint64)sizeof(cm_task_t *) * cap, "task deque");
+        return CM_ERROR;
+    }
+    deque->mask = cap - 1;
+    deque->top = 0;
+    deque->bottom = 0;
+    return CM_SUCCESS;
+}
+
+static inline int64 cm_task_deque_size(cm_task_deque_t *deque)
+{
+    int64 size = cm_atomic_get(&deque->bottom) - cm_atomic_get(&deque->top);
+    return size > 0 ? size : 0;
+}
+
+// owner only
+static inline bool32 cm_task_deque_push(cm_task_deque_t *deque, cm_task_t *task)
+{
+    int64 b = cm_atomic_get(&deque->bottom);
+    if (b - cm_atomic_get(&deque->top) > (int64)deque->mask) {
+        return CM_FALSE;
+    }
+    deque->tasks[b & deque->mask] = task;
+    CM_WMB;
+    (void)cm_atomic_set(&deque->bottom, b + 1);
+    return CM_TRUE;
+}
+
+// owner only
+static inline cm_task_t *cm_task_deque_pop(cm_task_deque_t *deque)
+{
+    // the locked decrement orders the bottom store before the top load
+    int64 b = cm_atomic_dec(&deque->bottom);
+    int64 t = cm_atomic_get(&deque->top);
+    if (t > b) {
+        (void)cm_atomic_set(&deque->bottom, b + 1);
+        return NULL;
+    }
+
+    cm_task_t *task = deque->tasks[b & deque->mask];
+    if (t == b) {
+        // last one, race with thieves for it
+        if (!cm_atomic_cas(&deque->top, t, t + 1)) {
+            task = NULL;
+        }
+        (void)cm_atomic_set(&deque->bottom, b + 1);
+    }
+    return task;
+}
+
+static inline cm_task_t *cm_task_deque_steal(cm_task_deque_t *deque)
+{
+    int64 t = cm_atomic_get(&deque->top);
+    CM_RMB;
+    int64 b = cm_atomic_get(&deque->bottom);
+    if (t >= b) {
+        return NULL;
+    }
+    cm_task_t *task = deque->tasks[t & deque->mask];
+    if (!cm_atomic_cas(&deque->top, t, t + 1)) {
+        return NULL;
+    }
+    return task;
+}
+
+static void cm_task_enqueue_shared(cm_task_pool_t *pool, cm_task_t *task)
+{
+    if (cm_ring_push(&pool->queue, task)) {
+        return;
+    }
+    cm_spin_lock(&pool->overflow_lock, NULL);
+    cm_bilist_add_tail(&task->link, &pool->overflow);
+    cm_spin_unlock(&pool->overflow_lock);
+}
+
+static cm_task_t *cm_task_dequeue_shared(cm_task_pool_t *pool)
+{
+    cm_task_t *task = (cm_task_t *)cm_ring_pop(&pool->queue);
+    if (task != NULL || cm_bilist_empty(&pool->overflow)) {
+        return task;
+    }
+    cm_spin_lock(&pool->overflow_lock, NULL);
+    bilist_node_t *node = cm_bilist_head(&pool->overflow);
+    if (node != NULL) {
+        cm_bilist_del_head(&pool->overflow);
+        task = BILIST_NODE_OF(cm_task_t, node, link);
+    }
+    cm_spin_unlock(&pool->overflow_lock);
+    return task;
+}
+
+static cm_task_t *cm_task_steal(cm_task_worker_t *worker)
+{
+    cm_task_pool_t *pool = worker->pool;
+    for (uint32 i = 1; i < pool->count; i++) {
+        cm_task_worker_t *victim = &pool->workers[(worker->id + i) % pool->count];
+        cm_task_t *task = cm_task_deque_steal(&victim->deque);
+        if (task != NULL) {
+            worker->steals++;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static inline cm_task_t *cm_task_next(cm_task_worker_t *worker)
+{
+    cm_task_t *task = cm_task_deque_pop(&worker->deque);
+    if (task == NULL) {
+        task = cm_task_dequeue_shared(worker->pool);
+    }
+    if (task == NULL) {
+        task = cm_task_steal(worker);
+    }
+    return task;
+}
+
+static bool32 cm_task_pool_has_work(cm_task_pool_t *pool)
+{
+    if (cm_ring_count(&pool->queue) > 0 || !cm_bilist_empty(&pool->overflow)) {
+        return CM_TRUE;
+    }
+    for (uint32 i = 0; i < pool->count; i++) {
+        if (cm_task_deque_size(&pool->workers[i].deque) > 0) {
+            return CM_TRUE;
+        }
+    }
+    return CM_FALSE;
+}
+
+static void cm_task_run(cm_task_worker_t *worker, cm_task_t *task)
+{
+    cm_task_pool_t *pool = worker->pool;
+    uint64 start = cm_monotonic_usec();
+    uint64 wait = start > task->submit_usec ? start - task->submit_usec : 0;
+
+    task->action(task->param);
+    if (task->done != NULL) {
+        task->done(task);
+    }
+
+    worker->run_usecs += cm_monotonic_usec() - start;
+    worker->wait_usecs += wait;
+    worker->max_wait_usecs = MAX(worker->max_wait_usecs, wait);
+    worker->finished++;
+
+    // the task may be freed by its waiter from here on
+    task->finished = CM_TRUE;
+    CM_MFENCE;
+    if (cm_atomic32_get(&pool->done_park.waiters) > 0) {
+        cm_park_wake(&pool->done_park, INT32_MAX);
+    }
+}
+
+#ifndef WIN32
+static void cm_task_bind_cpu(cm_task_worker_t *worker)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        LOG_RUN_WAR("[task pool] bind worker %u to cpu %u failed, errno %d", worker->id, worker->cpu, errno);
+    }
+}
+#endif
+
+static void cm_task_worker_entry(thread_t *obj)
+{
+    cm_task_worker_t *worker = (cm_task_worker_t *)obj->argument;
+    cm_task_pool_t *pool = worker->pool;
+
+    cm_set_thread_name("task_worker");
+#ifndef WIN32
+    if (worker->cpu != CM_INVALID_ID32) {
+        cm_task_bind_cpu(worker);
+    }
+#endif
+    g_task_worker = worker;
+
+    for (;;) {
+        cm_task_t *task = cm_task_next(worker);
+        if (task != NULL) {
+            cm_task_run(worker, task);
+            continue;
+        }
+
+        uint32 seq = cm_park_prepare(&pool->park);
+        if (cm_task_pool_has_work(pool)) {
+            cm_park_cancel(&pool->park);
+            continue;
+        }
+        if (pool->closed) {
+            cm_park_cancel(&pool->park);
+            break;
+        }
+        cm_park_wait(&pool->park, seq, CM_TASK_PARK_TIMEOUT);
+    }
+    g_task_worker = NULL;
+}
+
+static inline void cm_task_pool_wake(cm_task_pool_t *pool, uint32 count)
+{
+    CM_MFENCE;
+    if (cm_atomic32_get(&pool->park.waiters) > 0) {
+        cm_park_wake(&pool->park, count);
+    }
+}
+
+static void cm_task_pool_free(cm_task_pool_t *pool)
+{
+    if (pool->workers != NULL) {
+        for (uint32 i = 0; i < pool->count; i++) {
+            CM_FREE_PTR(pool->workers[i].deque.tasks);
+        }
+        CM_FREE_PTR(pool->workers);
+    }
+    cm_ring_destroy(&pool->queue);
+    pool->count = 0;
+}
+
+status_t cm_task_pool_create(cm_task_pool_t *pool, const cm_task_pool_attr_t *attr)
+{
+    uint32 queue_size = attr->queue_size == 0 ? CM_TASK_QUEUE_SIZE : attr->queue_size;
+    uint32 deque_size = attr->deque_size == 0 ? CM_TASK_DEQUE_SIZE : attr->deque_size;
+    uint32 i;
+
+    if (attr->workers == 0) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "task pool workers");
+        return CM_ERROR;
+    }
+    errno_t err = memset_s(pool, sizeof(cm_task_pool_t), 0, sizeof(cm_task_pool_t));
+    if (err != EOK) {
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, err);
+        return CM_ERROR;
+    }
+    GS_INIT_SPIN_LOCK(pool->overflow_lock);
+    cm_bilist_init(&pool->overflow);
+    cm_park_init(&pool->park);
+    cm_park_init(&pool->done_park);
+    if (cm_ring_init(&pool->queue, queue_size) != CM_SUCCESS) {
+        return CM_ERROR;
+    }
+
+    uint32 size = (uint32)(attr->workers * sizeof(cm_task_worker_t));
+    pool->workers = (cm_task_worker_t *)malloc(size);
+    if (pool->workers == NULL) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, (uint64)size, "task pool workers");
+        cm_task_pool_free(pool);
+        return CM_ERROR;
+    }
+    err = memset_s(pool->workers, size, 0, size);
+    if (err != EOK) {
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, err);
+        cm_task_pool_free(pool);
+        return CM_ERROR;
+    }
+    pool->count = attr->workers;
+    for (i = 0; i < pool->count; i++) {
+        cm_task_worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->id = i;
+        worker->cpu = (attr->cpus != NULL && attr->cpu_count > 0) ? attr->cpus[i % attr->cpu_count] : CM_INVALID_ID32;
+        if (cm_task_deque_init(&worker->deque, deque_size) != CM_SUCCESS) {
+            cm_task_pool_free(pool);
+            return CM_ERROR;
+        }
+    }
+
+    for (i = 0; i < pool->count; i++) {
+        if (cm_create_thread(cm_task_worker_entry, attr->stack_size, &pool->workers[i], &pool->workers[i].thread) !=
+            CM_SUCCESS) {
+            break;
+        }
+    }
+    if (i < pool->count) {
+        pool->closed = CM_TRUE;
+        cm_task_pool_wake(pool, INT32_MAX);
+        for (uint32 j = 0; j < i; j++) {
+            cm_close_thread(&pool->workers[j].thread);
+        }
+        cm_task_pool_free(pool);
+        return CM_ERROR;
+    }
+    return CM_SUCCESS;
+}
+
+void cm_task_pool_destroy(cm_task_pool_t *pool)
+{
+    if (pool->workers == NULL) {
+        return;
+    }
+    pool->closed = CM_TRUE;
+    cm_task_pool_wake(pool, INT32_MAX);
+    for (uint32 i = 0; i < pool->count; i++) {
+        cm_close_thread(&pool->workers[i].thread);
+    }
+    cm_task_pool_free(pool);
+}
+
+static inline void cm_task_enqueue(cm_task_pool_t *pool, cm_task_worker_t *worker, cm_task_t *task, uint64 now)
+{
+    task->submit_usec = now;
+    task->finished = CM_FALSE;
+    if (worker == NULL || !cm_task_deque_push(&worker->deque, task)) {
+        cm_task_enqueue_shared(pool, task);
+    }
+}
+
+status_t cm_task_pool_submit(cm_task_pool_t *pool, cm_task_t *task)
+{
+    return cm_task_pool_submit_batch(pool, &task, 1);
+}
+
+status_t cm_task_pool_submit_batch(cm_task_pool_t *pool, cm_task_t **tasks, uint32 count)
+{
+    if (pool->closed || pool->workers == NULL) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "task pool closed");
+        return CM_ERROR;
+    }
+
+    // tasks submitted by a task stay on its worker unless someone steals them
+    cm_task_worker_t *worker = (g_task_worker != NULL && g_task_worker->pool == pool) ? g_task_worker : NULL;
+    uint64 now = cm_monotonic_usec();
+    for (uint32 i = 0; i < count; i++) {
+        cm_task_enqueue(pool, worker, tasks[i], now);
+    }
+    (void)cm_atomic_add(&pool->submitted, (int64)count);
+    cm_task_pool_wake(pool, count);
+    return CM_SUCCESS;
+}
+
+status_t cm_task_wait(cm_task_pool_t *pool, cm_task_t *task, uint32 timeout_ms)
+{
+    uint64 deadline = cm_monotonic_usec() + (uint64)timeout_ms * MICROSECS_PER_MILLISEC;
+
+    while (!task->finished) {
+        uint32 seq = cm_park_prepare(&pool->done_park);
+        if (task->finished) {
+            cm_park_cancel(&pool->done_park);
+            break;
+        }
+        uint64 now = cm_monotonic_usec();
+        if (timeout_ms != CM_INFINITE_TIMEOUT && now >= deadline) {
+            cm_park_cancel(&pool->done_park);
+            return CM_TIMEDOUT;
+        }
+        uint32 wait_ms = timeout_ms == CM_INFINITE_TIMEOUT ?
+            CM_TASK_PARK_TIMEOUT : (uint32)((deadline - now + MICROSECS_PER_MILLISEC - 1) / MICROSECS_PER_MILLISEC);
+        cm_park_wait(&pool->done_park, seq, wait_ms);
+    }
+    return CM_SUCCESS;
+}
+
+void cm_task_pool_get_stat(cm_task_pool_t *pool, cm_task_pool_stat_t *stat)
+{
+    uint64 wait_usecs = 0;
+    uint64 run_usecs = 0;
+
+    (void)memset_s(stat, sizeof(cm_task_pool_stat_t), 0, sizeof(cm_task_pool_stat_t));
+    for (uint32 i = 0; i < pool->count; i++) {
+        cm_task_worker_t *worker = &pool->workers[i];
+        stat->finished += worker->finished;
+        stat->steals += worker->steals;
+        stat->max_wait_usecs = MAX(stat->max_wait_usecs, worker->max_wait_usecs);
+        wait_usecs += worker->wait_usecs;
+        run_usecs += worker->run_usecs;
+    }
+    stat->submitted = (uint64)cm_atomic_get(&pool->submitted);
+    stat->queued = (uint64)cm_ring_count(&pool->queue);
+    for (uint32 i = 0; i < pool->count; i++) {
+        stat->queued += (uint64)cm_task_deque_size(&pool->workers[i].deque);
+    }
+    stat->queued += pool->overflow.count;
+    if (stat->finished > 0) {
+        stat->avg_wait_usecs = wait_usecs / stat->finished;
+        stat->avg_run_usecs = run_usecs / stat->finished;
+    }
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,8 @@
 #include "cm_sync.h"
 #include "cm_debug.h"
 #include "cm_spinlock.h"
+#include "cm_bilist.h"
+#include "cm_ring.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +73,107 @@ status_t cm_get_idle_pooling_thread(cm_thread_pool_t *pool, pooling_thread_t **t
 void cm_dispatch_pooling_thread(pooling_thread_t *thread, void *task);
 void cm_release_pooling_thread(pooling_thread_t *thread);
 
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+                 Task pool, a fixed set of workers running queued tasks
+
+    Tasks submitted from outside the pool go to a shared queue, tasks submitted
+    by a running task go to the worker's own deque. Idle workers steal from the
+    other deques before they park.
+
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+struct st_cm_task;
+typedef void (*cm_task_done_t)(struct st_cm_task *task);
+
+// owned by the submitter and must stay valid until it is finished
+typedef struct st_cm_task {
+    run_task_action action;
+    void *param;
+    cm_task_done_t done;   // optional, called by the worker after action, must not free a task being waited on
+    bilist_node_t link;    // in the overflow list when the shared queue is full
+    uint64 submit_usec;
+    volatile bool32 finished;
+} cm_task_t;
+
+#define CM_TASK_DEQUE_SIZE 1024
+#define CM_TASK_QUEUE_SIZE 4096
+#define CM_TASK_PARK_TIMEOUT 1000 // ms
+
+// Chase-Lev deque, the owner pushes and pops at bottom, thieves take from top
+typedef struct st_cm_task_deque {
+    atomic_t top;
+    char pad0[CM_RING_PAD_SIZE - sizeof(atomic_t)];
+    atomic_t bottom;
+    char pad1[CM_RING_PAD_SIZE - sizeof(atomic_t)];
+    uint32 mask;
+    cm_task_t **tasks;
+} cm_task_deque_t;
+
+typedef struct st_cm_task_worker {
+    thread_t thread;
+    struct st_cm_task_pool *pool;
+    uint32 id;
+    uint32 cpu;             // CM_INVALID_ID32 if not bound
+    cm_task_deque_t deque;
+    // written by the worker only
+    uint64 finished;
+    uint64 steals;
+    uint64 wait_usecs;
+    uint64 max_wait_usecs;
+    uint64 run_usecs;
+} cm_task_worker_t;
+
+typedef struct st_cm_task_pool_attr {
+    uint32 workers;
+    uint32 stack_size;      // 0 for the default
+    uint32 queue_size;      // shared queue, 0 for CM_TASK_QUEUE_SIZE
+    uint32 deque_size;      // per worker, 0 for CM_TASK_DEQUE_SIZE
+    const uint32 *cpus;     // optional, worker i is bound to cpus[i % cpu_count]
+    uint32 cpu_count;
+} cm_task_pool_attr_t;
+
+typedef struct st_cm_task_pool {
+    cm_task_worker_t *workers;
+    uint32 count;
+    volatile bool32 closed;
+    cm_ring_t queue;
+    spinlock_t overflow_lock;
+    bilist_t overflow;
+    cm_park_t park;         // idle workers
+    cm_park_t done_park;    // threads in cm_task_wait
+    atomic_t submitted;
+} cm_task_pool_t;
+
+typedef struct st_cm_task_pool_stat {
+    uint64 submitted;
+    uint64 finished;
+    uint64 queued;          // submitted but not started yet
+    uint64 steals;
+    uint64 avg_wait_usecs;  // from submit to start
+    uint64 max_wait_usecs;
+    uint64 avg_run_usecs;
+} cm_task_pool_stat_t;
+
+static inline void cm_task_init(cm_task_t *task, run_task_action action, void *param, cm_task_done_t done)
+{
+    task->action = action;
+    task->param = param;
+    task->done = done;
+    task->link.prev = NULL;
+    task->link.next = NULL;
+    task->submit_usec = 0;
+    task->finished = CM_FALSE;
+}
+
+status_t cm_task_pool_create(cm_task_pool_t *pool, const cm_task_pool_attr_t *attr);
+// finishes the queued tasks before the workers exit
+void cm_task_pool_destroy(cm_task_pool_t *pool);
+status_t cm_task_pool_submit(cm_task_pool_t *pool, cm_task_t *task);
+status_t cm_task_pool_submit_batch(cm_task_pool_t *pool, cm_task_t **tasks, uint32 count);
+// returns CM_TIMEDOUT if the task is not finished in time
+status_t cm_task_wait(cm_task_pool_t *pool, cm_task_t *task, uint32 timeout_ms);
+void cm_task_pool_get_stat(cm_task_pool_t *pool, cm_task_pool_stat_t *stat);
+
 #ifdef __cplusplus
 }
 #endif
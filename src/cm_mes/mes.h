@@ -67,6 +67,16 @@ void mes_set_msg_enqueue(unsigned int command, unsigned int is_enqueue);
  */
 void mes_register_proc_func(mes_message_proc_t proc);
 
+/*
+ * @brief register the processing of large messages, called like mes_message_proc_t once the whole body arrived.
+ * @param proc - callback function, must call mes_release_large_message when done
+ * @param buf_alloc - optional, gives the buffer a body is received into, not called under any mes lock
+ * @param buf_free - optional, takes back a buf_alloc buffer whose message was dropped before it completed
+ * @return
+ */
+void mes_register_large_proc_func(mes_large_message_proc_t proc, mes_large_buf_alloc_t buf_alloc,
+    mes_large_buf_free_t buf_free);
+
 /*
  * @brief Registering the cmd callback function.
           Notify the process to receive messages from the peer end.
@@ -107,6 +117,24 @@ void mes_notify_broadcast_msg_recv_with_errcode(mes_message_t *msg);
  */
 void mes_set_command_task_group(unsigned char command, mes_task_group_id_t group_id);
 
+/*
+ * @brief Set the group corresponding to each cmd and whether idle work threads of other groups may process it.
+ * @param command - command
+ * @param group_id -  group id.
+ * @param can_steal - 1: idle work threads of other groups may process the command when task_steal_batch is set,
+ *                    with their own work thread index. Commands are never stolen by default
+ * @return
+ */
+void mes_set_command_task_group_ex(unsigned char command, mes_task_group_id_t group_id, unsigned int can_steal);
+
+/*
+ * @brief set the priority lane of a command, high priority commands use their own channels and task queues.
+ * @param command - command.
+ * @param priority - MES_PRIORITY_NORMAL by default.
+ * @return
+ */
+void mes_set_command_priority(unsigned char command, mes_priority_t priority);
+
 /*
  * @brief Connecting to the instance
  * @param inst_id -  the instance id.
@@ -208,6 +236,23 @@ int mes_send_data3(const mes_message_head_t *head, unsigned int head_size, const
 int mes_send_data4(const mes_message_head_t *head, unsigned int head_size, const void *body1, unsigned int len1,
     const void *body2, unsigned int len2);
 
+/*
+ * @brief send a message whose body is larger than a message buffer, without copying the body.
+ * @param head - message head, size is ignored.
+ * @param body - caller buffers holding the body in order, in use until the function returns.
+ * @param cnt - number of body buffers.
+ * @return CM_SUCCESS - success;otherwise: failed
+ */
+int mes_send_large_data(const mes_message_head_t *head, const mes_buffer_t *body, unsigned int cnt);
+
+/*
+ * @brief release the buffers of a large message given to mes_large_message_proc_t,
+ * a user_buf from mes_large_buf_alloc_t stays with the caller.
+ * @param msg - large message.
+ * @return
+ */
+void mes_release_large_message(mes_large_message_t *msg);
+
 /*
  * @brief recv msg
  * @param sid -  Session ID
@@ -404,6 +449,50 @@ uint64 mes_get_elapsed_time(unsigned int cmd, mes_time_stat_t type);
  */
 uint64 mes_get_elapsed_count(unsigned int cmd, mes_time_stat_t type);
 
+/*
+ * @brief Obtain the latency percentile of a command stage, merged over all threads.
+ * @param cmd - command.
+ * @param type - time type.
+ * @param percentile - percentile in (0, 100], e.g. 50 or 99.
+ * @return upper bound of the latency in microseconds, 0 if there is no sample.
+ */
+uint64 mes_get_elapsed_percentile(unsigned int cmd, mes_time_stat_t type, double percentile);
+
+/*
+ * @brief Obtain the latency distribution of a command stage, merged over all threads.
+ * @param cmd - command.
+ * @param type - time type.
+ * @param stat - count, sum and p50/p90/p99/p999/max in microseconds.
+ * @return CM_SUCCESS - success;otherwise: failed
+ */
+int mes_get_latency_stat(unsigned int cmd, mes_time_stat_t type, mes_latency_stat_t *stat);
+
+/*
+ * @brief Same as mes_get_latency_stat, and resets the distribution so the next call covers a new interval.
+ * mes_get_elapsed_time and mes_get_elapsed_count keep counting since mes_init.
+ * @param cmd - command.
+ * @param type - time type.
+ * @param stat - count, sum and p50/p90/p99/p999/max in microseconds since the last snapshot.
+ * @return CM_SUCCESS - success;otherwise: failed
+ */
+int mes_snapshot_latency_stat(unsigned int cmd, mes_time_stat_t type, mes_latency_stat_t *stat);
+
+/*
+ * @brief Obtain the per-thread buffer cache statistics of a buffer pool.
+ * @param pool_no - buffer pool number.
+ * @param stat - cache statistics.
+ * @return CM_SUCCESS - success;otherwise: failed
+ */
+int mes_get_buf_cache_stat(unsigned int pool_no, mes_buf_cache_stat_t *stat);
+
+/*
+ * @brief Get the work stealing and queue depth statistics of a task group.
+ * @param group_id -  group id.
+ * @param stat - output statistics
+ * @return CM_SUCCESS - success;otherwise: failed
+ */
+int mes_get_task_group_stat(mes_task_group_id_t group_id, mes_task_group_stat_t *stat);
+
 /*
  * @brief Register the callback function of the decrypt password.
  * @param proc -  callback function
@@ -173,16 +173,21 @@ static inline void mes_protect_when_brcast_timeout(mes_waiting_room_t *room, uin
 
 #endif
 
-static void mes_consume_time_init(const mes_profile_t *profile)
+// waits out the rest of a monotonic deadline in one go, so clock steps and late wakeups do not skew timeouts
+static bool32 mes_mutex_lock_until(mes_mutex_t *mutex, uint64 deadline)
 {
-    for (uint32 j = 0; j < CM_MAX_MES_MSG_CMD; j++) {
-        g_mes_elapsed_stat.time_consume_stat[j].cmd = j;
-        for (int i = 0; i < MES_TIME_CEIL; i++) {
-            g_mes_elapsed_stat.time_consume_stat[j].time[i] = 0;
-            g_mes_elapsed_stat.time_consume_stat[j].count[i] = 0;
-            GS_INIT_SPIN_LOCK(g_mes_elapsed_stat.time_consume_stat[j].lock[i]);
-        }
+    uint64 now = cm_monotonic_usec();
+    uint32 remain = 0;
+
+    if (now < deadline) {
+        remain = (uint32)((deadline - now + MICROSECS_PER_MILLISEC - 1) / MICROSECS_PER_MILLISEC);
     }
+    return mes_mutex_timed_lock(mutex, remain);
+}
+
+static void mes_consume_time_init(const mes_profile_t *profile)
+{
+    mes_latency_init();
     g_mes_elapsed_stat.mes_elapsed_switch = profile->mes_elapsed_switch;
     return;
 }
@@ -196,7 +201,6 @@ static void mes_init_stat(const mes_profile_t *profile)
         g_mes_stat.mes_commond_stat[i].recv_count = 0;
         g_mes_stat.mes_commond_stat[i].local_count = 0;
         g_mes_stat.mes_commond_stat[i].occupy_buf = 0;
-        GS_INIT_SPIN_LOCK(g_mes_stat.mes_commond_stat[i].lock);
     }
     mes_consume_time_init(profile);
     return;
@@ -205,9 +209,7 @@ static void mes_init_stat(const mes_profile_t *profile)
 static inline void mes_send_stat(uint32 cmd)
 {
     if (g_mes_stat.mes_elapsed_switch) {
-        cm_spin_lock(&(g_mes_stat.mes_commond_stat[cmd].lock), NULL);
         (void)cm_atomic_inc(&(g_mes_stat.mes_commond_stat[cmd].send_count));
-        cm_spin_unlock(&(g_mes_stat.mes_commond_stat[cmd].lock));
     }
     return;
 }
@@ -215,10 +217,8 @@ static inline void mes_send_stat(uint32 cmd)
 void mes_local_stat(uint32 cmd)
 {
     if (g_mes_stat.mes_elapsed_switch) {
-        cm_spin_lock(&(g_mes_stat.mes_commond_stat[cmd].lock), NULL);
         (void)cm_atomic_inc(&(g_mes_stat.mes_commond_stat[cmd].local_count));
         (void)cm_atomic32_inc(&(g_mes_stat.mes_commond_stat[cmd].occupy_buf));
-        cm_spin_unlock(&(g_mes_stat.mes_commond_stat[cmd].lock));
     }
     return;
 }
@@ -226,10 +226,8 @@ void mes_local_stat(uint32 cmd)
 static inline void mes_recv_message_stat(const mes_message_t *msg)
 {
     if (g_mes_stat.mes_elapsed_switch) {
-        cm_spin_lock(&(g_mes_stat.mes_commond_stat[msg->head->cmd].lock), NULL);
         (void)cm_atomic_inc(&(g_mes_stat.mes_commond_stat[msg->head->cmd].recv_count));
         (void)cm_atomic32_inc(&(g_mes_stat.mes_commond_stat[msg->head->cmd].occupy_buf));
-        cm_spin_unlock(&(g_mes_stat.mes_commond_stat[msg->head->cmd].lock));
     }
     return;
 }
@@ -294,13 +292,6 @@ static int mes_send_inter_buffer_list(mes_bufflist_t *buff_list)
     return CM_SUCCESS;
 }
 
-static inline void mes_append_bufflist(mes_bufflist_t *buff_list, const void *buff, uint32 len)
-{
-    buff_list->buffers[buff_list->cnt].buf = (char *)buff;
-    buff_list->buffers[buff_list->cnt].len = len;
-    buff_list->cnt = buff_list->cnt + 1;
-}
-
 static void mes_clean_session_mutex(uint32 ceil)
 {
     if (!MES_GLOBAL_INST_MSG.mes_ctx.creatWaitRoom) {
@@ -376,7 +367,6 @@ static int mes_set_group_task_num(mes_task_group_id_t group_id, uint32 task_num)
     }
 
     task_group->push_cursor = 0;
-    task_group->pop_cursor = 0;
     task_group->group_id = group_id;
     task_group->task_num = (uint8)task_num;
     task_group->start_task_idx = (uint8)MES_GLOBAL_INST_MSG.mq_ctx.group.assign_task_idx;
@@ -493,7 +483,23 @@ static int mes_set_profile(mes_profile_t *profile)
 
     MES_GLOBAL_INST_MSG.profile.pipe_type = profile->pipe_type;
     MES_GLOBAL_INST_MSG.profile.conn_created_during_init = profile->conn_created_during_init;
+    MES_GLOBAL_INST_MSG.profile.buf_cache_count = profile->buf_cache_count;
+    MES_GLOBAL_INST_MSG.profile.task_wait_mode = profile->task_wait_mode;
+    MES_GLOBAL_INST_MSG.profile.task_spin_count = profile->task_spin_count;
+    MES_GLOBAL_INST_MSG.profile.send_coalesce_us = profile->send_coalesce_us;
+    MES_GLOBAL_INST_MSG.profile.recv_buf_size = profile->recv_buf_size;
+    MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt = MIN(profile->reactor_thread_cnt, MES_MAX_REACTOR_NUM);
+    MES_GLOBAL_INST_MSG.profile.task_queue_size = MIN(profile->task_queue_size, CM_RING_MAX_CAPACITY);
+    MES_GLOBAL_INST_MSG.profile.task_steal_batch = MIN(profile->task_steal_batch, MES_MAX_STEAL_BATCH);
+    ret = mes_large_set_profile(profile);
+    if (ret != CM_SUCCESS) {
+        return ret;
+    }
     mes_set_channel_num(profile->channel_cnt);
+    // at least one channel stays for the other lanes
+    MES_GLOBAL_INST_MSG.profile.priority_channel_cnt =
+        MIN(profile->priority_channel_cnt, MES_GLOBAL_INST_MSG.profile.channel_cnt - 1);
+    MES_GLOBAL_INST_MSG.profile.priority_weight = profile->priority_weight;
     mes_set_work_thread_num(profile->work_thread_cnt);
 
     ret = memcpy_sp(MES_GLOBAL_INST_MSG.profile.task_group, sizeof(MES_GLOBAL_INST_MSG.profile.task_group),
@@ -626,8 +632,11 @@ static int mes_init_group_task(void)
 
 static int mes_init_resource(void)
 {
-    int ret;
-    mes_init_msg_queue();
+    int ret = mes_init_msg_queue();
+    if (ret != CM_SUCCESS) {
+        LOG_RUN_ERR("[mes] mes init msg queue failed.");
+        return ret;
+    }
     (void)mes_register_func();
 
     ret = mes_init_group_task();
@@ -677,6 +686,7 @@ static void mes_destroy_resource(void)
 {
     mes_destory_message_pool();
     mes_free_channels();
+    mes_free_msg_queue();
     mes_destroy_msgitem_pool();
     mes_clean_session_mutex(CM_MAX_MES_ROOMS);
     mes_close_libdl();
@@ -690,10 +700,19 @@ void mes_process_message(mes_msgqueue_t *my_queue, uint32 recv_idx, mes_message_
     mes_msgitem_t *msgitem;
 
     mes_recv_message_stat(msg);
+    if (SECUREC_UNLIKELY((msg->head->flags & MES_FLAG_LARGE_MSG) != 0) && !mes_large_recv_fragment(msg)) {
+        return;
+    }
+
     if (MES_GLOBAL_INST_MSG.is_enqueue[msg->head->cmd]) {
         msgitem = MES_ALLOC_MSGITEM(my_queue);
         if (msgitem == NULL) {
-            mes_release_message_buf(msg);
+            if (SECUREC_UNLIKELY((msg->head->flags & MES_FLAG_LARGE_MSG) != 0)) {
+                // reassembled by mes_large_recv_fragment, not a pool buffer
+                mes_release_large_message((mes_large_message_t *)msg->buffer);
+            } else {
+                mes_release_message_buf(msg);
+            }
             LOG_RUN_ERR("[mes]: alloc msgitem failed.");
             return;
         }
@@ -704,7 +723,7 @@ void mes_process_message(mes_msgqueue_t *my_queue, uint32 recv_idx, mes_message_
         mes_consume_with_time(msg->head->cmd, MES_TIME_PUT_QUEUE, start_time);
         return;
     }
-    MES_GLOBAL_INST_MSG.proc((MES_GLOBAL_INST_MSG.profile.work_thread_cnt + recv_idx), msg);
+    mes_dispatch_message((MES_GLOBAL_INST_MSG.profile.work_thread_cnt + recv_idx), msg);
     mes_consume_with_time(msg->head->cmd, MES_TIME_PROC_FUN, start_time);
     return;
 }
@@ -762,6 +781,11 @@ static void mes_close_work_thread(void)
         return;
     }
 
+    for (uint32 loop = 0; loop < MES_GLOBAL_INST_MSG.profile.work_thread_cnt; loop++) {
+        cm_close_thread_nowait(&MES_GLOBAL_INST_MSG.mq_ctx.tasks[loop].thread);
+    }
+    mes_wakeup_task_groups();
+
     for (uint32 loop = 0; loop < MES_GLOBAL_INST_MSG.profile.work_thread_cnt; loop++) {
         cm_close_thread(&MES_GLOBAL_INST_MSG.mq_ctx.tasks[loop].thread);
     }
@@ -919,7 +943,10 @@ void mes_uninit(void)
 {
     mes_close_listen_thread();
     mes_close_work_thread();
+    mes_stop_flusher();
     mes_stop_channels();
+    mes_stop_reactors();
+    mes_large_clean();
     mes_destroy_resource();
     mes_deinit_ssl();
     (void)memset_s(&MES_GLOBAL_INST_MSG, sizeof(mes_instance_t), 0, sizeof(mes_instance_t));
@@ -946,6 +973,7 @@ int mes_init(mes_profile_t *profile)
         if (ret != CM_SUCCESS) {
             break;
         }
+        mes_large_init();
 
         ret = (int)mes_init_ssl();
         if (ret != CM_SUCCESS) {
@@ -984,6 +1012,15 @@ void mes_register_proc_func(mes_message_proc_t proc)
     return;
 }
 
+void mes_register_large_proc_func(mes_large_message_proc_t proc, mes_large_buf_alloc_t buf_alloc,
+    mes_large_buf_free_t buf_free)
+{
+    MES_GLOBAL_INST_MSG.large_proc = proc;
+    MES_GLOBAL_INST_MSG.large_buf_alloc = buf_alloc;
+    MES_GLOBAL_INST_MSG.large_buf_free = buf_free;
+    return;
+}
+
 void mes_set_msg_enqueue(unsigned int command, unsigned int is_enqueue)
 {
     MES_GLOBAL_INST_MSG.is_enqueue[command] = is_enqueue;
@@ -1380,13 +1417,12 @@ int mes_send_data4(const mes_message_head_t *head, unsigned int head_size, const
 int mes_allocbuf_and_recv_data(unsigned short sid, mes_message_t *msg, unsigned int timeout)
 {
     uint64 start_stat_time = cm_get_time_usec();
-    uint32 wait_time = 0;
+    uint64 deadline = cm_monotonic_usec() + (uint64)timeout * MICROSECS_PER_MILLISEC;
     mes_waiting_room_t *room = &MES_GLOBAL_INST_MSG.mes_ctx.waiting_rooms[sid];
 
     for (;;) {
-        if (!mes_mutex_timed_lock(&room->mutex, MES_WAIT_TIMEOUT)) {
-            wait_time += MES_WAIT_TIMEOUT;
-            if (wait_time >= timeout) {
+        if (!mes_mutex_lock_until(&room->mutex, deadline)) {
+            if (cm_monotonic_usec() >= deadline) {
                 mes_protect_when_timeout(
                     room); // when timeout the ack msg may reach, so need do some check and protect.
                 LOG_DEBUG_WAR("recv data rsn %llu ", room->rsn);
@@ -1501,16 +1537,15 @@ void mes_broadcast2(unsigned int sid, uint64 inst_bits, mes_message_head_t *head
 int mes_wait_acks(unsigned int sid, unsigned int timeout)
 {
     mes_waiting_room_t *room = &MES_GLOBAL_INST_MSG.mes_ctx.waiting_rooms[sid];
-    uint32 wait_time = 0;
+    uint64 deadline = cm_monotonic_usec() + (uint64)timeout * MICROSECS_PER_MILLISEC;
 
     for (;;) {
         if (room->req_count == 0) {
             break;
         }
 
-        if (!mes_mutex_timed_lock(&room->broadcast_mutex, MES_WAIT_TIMEOUT)) {
-            wait_time += MES_WAIT_TIMEOUT;
-            if (wait_time >= timeout) {
+        if (!mes_mutex_lock_until(&room->broadcast_mutex, deadline)) {
+            if (cm_monotonic_usec() >= deadline) {
                 room->ack_count = 0; // invalid broadcast ack
                 mes_protect_when_brcast_timeout(room, 0);
                 LOG_RUN_WAR("[mes]timeout rsn=%llu, check rsn=%llu, sid=%u, ack_count=%d, req_count=%d", room->rsn,
@@ -1530,7 +1565,7 @@ int mes_wait_acks(unsigned int sid, unsigned int timeout)
 
 int mes_wait_acks2(unsigned int sid, unsigned int timeout, uint64 *succ_insts)
 {
-    uint32 wait_time = 0;
+    uint64 deadline = cm_monotonic_usec() + (uint64)timeout * MICROSECS_PER_MILLISEC;
     int32  ret = CM_SUCCESS;
 
     mes_waiting_room_t *room = &MES_GLOBAL_INST_MSG.mes_ctx.waiting_rooms[sid];
@@ -1540,9 +1575,8 @@ int mes_wait_acks2(unsigned int sid, unsigned int timeout, uint64 *succ_insts)
             break;
         }
 
-        if (!mes_mutex_timed_lock(&room->broadcast_mutex, MES_WAIT_TIMEOUT)) {
-            wait_time += MES_WAIT_TIMEOUT;
-            if (wait_time >= timeout) {
+        if (!mes_mutex_lock_until(&room->broadcast_mutex, deadline)) {
+            if (cm_monotonic_usec() >= deadline) {
                 room->ack_count = 0; // invalid broadcast ack
                 mes_protect_when_brcast_timeout(room, 0);
                 LOG_RUN_WAR("[mes]timeout rsn=%llu, check rsn=%llu, sid=%d, ack_count=%d, req_count=%d", room->rsn,
@@ -1585,7 +1619,7 @@ int mes_wait_acks_and_recv_msg2(unsigned int sid, unsigned int timeout, uint64 s
     uint64 start_stat_time = 0;
     mes_get_consume_time_start(&start_stat_time);
     mes_waiting_room_t *room = &MES_GLOBAL_INST_MSG.mes_ctx.waiting_rooms[sid];
-    uint32 wait_time = 0;
+    uint64 deadline = cm_monotonic_usec() + (uint64)timeout * MICROSECS_PER_MILLISEC;
 
     (void)memset_sp(recv_msg, sizeof(char *) * MES_MAX_INSTANCES, 0, sizeof(char *) * MES_MAX_INSTANCES);
 
@@ -1594,9 +1628,8 @@ int mes_wait_acks_and_recv_msg2(unsigned int sid, unsigned int timeout, uint64 s
             break;
         }
 
-        if (!mes_mutex_timed_lock(&room->broadcast_mutex, MES_WAIT_TIMEOUT)) {
-            wait_time += MES_WAIT_TIMEOUT;
-            if (wait_time >= timeout) {
+        if (!mes_mutex_lock_until(&room->broadcast_mutex, deadline)) {
+            if (cm_monotonic_usec() >= deadline) {
                 overtime_proc_func(success_inst, recv_msg);
                 mes_protect_when_brcast_timeout(room, success_inst);
                 LOG_RUN_WAR("[mes]timeout rsn=%llu, check rsn=%llu, sid=%u, ack_count=%d, req_count=%d", room->rsn,
@@ -1669,6 +1702,40 @@ void mes_set_command_task_group(unsigned char command, mes_task_group_id_t group
     MES_GLOBAL_INST_MSG.mq_ctx.command_attr[command].group_id = group_id;
 }
 
+void mes_set_command_task_group_ex(unsigned char command, mes_task_group_id_t group_id, unsigned int can_steal)
+{
+    MES_GLOBAL_INST_MSG.mq_ctx.command_attr[command].group_id = group_id;
+    MES_GLOBAL_INST_MSG.mq_ctx.command_attr[command].stealable = (can_steal != 0);
+}
+
+void mes_set_command_priority(unsigned char command, mes_priority_t priority)
+{
+    if (priority >= MES_PRIORITY_CEIL) {
+        LOG_RUN_ERR("[mes]: invalid priority %d of command %hhu.", priority, command);
+        return;
+    }
+    MES_GLOBAL_INST_MSG.mq_ctx.command_attr[command].priority = (uint8)priority;
+    if (priority != MES_PRIORITY_NORMAL) {
+        MES_GLOBAL_INST_MSG.mq_ctx.lane_enabled = CM_TRUE;
+    }
+}
+
+int mes_get_task_group_stat(mes_task_group_id_t group_id, mes_task_group_stat_t *stat)
+{
+    mes_task_group_t *group = NULL;
+
+    if (stat == NULL || group_id >= MES_TASK_GROUP_ALL) {
+        return ERR_MES_PARAM_INVAIL;
+    }
+
+    group = &MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[group_id];
+    stat->steal_in = (unsigned long long)cm_atomic_get(&group->steal_in);
+    stat->steal_out = (unsigned long long)cm_atomic_get(&group->steal_out);
+    stat->queue_depth = mes_get_group_depth(group);
+    stat->max_queue_depth = group->max_depth;
+    return CM_SUCCESS;
+}
+
 void mes_release_message_buf(mes_message_t *msg_buf)
 {
     if (msg_buf == NULL || msg_buf->buffer == NULL) {
@@ -1724,12 +1791,41 @@ void mes_set_elapsed_switch(unsigned char elapsed_switch)
 
 uint64 mes_get_elapsed_time(unsigned int cmd, mes_time_stat_t type)
 {
-    return g_mes_elapsed_stat.time_consume_stat[cmd].time[type];
+    return mes_latency_total_sum(cmd, type);
 }
 
 uint64 mes_get_elapsed_count(unsigned int cmd, mes_time_stat_t type)
 {
-    return (uint64)g_mes_elapsed_stat.time_consume_stat[cmd].count[type];
+    return mes_latency_total_count(cmd, type);
+}
+
+uint64 mes_get_elapsed_percentile(unsigned int cmd, mes_time_stat_t type, double percentile)
+{
+    return mes_latency_percentile(cmd, type, percentile);
+}
+
+int mes_get_latency_stat(unsigned int cmd, mes_time_stat_t type, mes_latency_stat_t *stat)
+{
+    return mes_latency_collect(cmd, type, CM_FALSE, stat);
+}
+
+int mes_snapshot_latency_stat(unsigned int cmd, mes_time_stat_t type, mes_latency_stat_t *stat)
+{
+    return mes_latency_collect(cmd, type, CM_TRUE, stat);
+}
+
+int mes_get_buf_cache_stat(unsigned int pool_no, mes_buf_cache_stat_t *stat)
+{
+    if (stat == NULL || pool_no >= MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.count) {
+        return ERR_MES_PARAM_INVAIL;
+    }
+
+    mes_buf_cache_counter_t *counter = &MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.chunk[pool_no].cache_stat;
+    stat->alloc_hit = (uint64)cm_atomic_get(&counter->alloc_hit);
+    stat->alloc_refill = (uint64)cm_atomic_get(&counter->alloc_refill);
+    stat->free_hit = (uint64)cm_atomic_get(&counter->free_hit);
+    stat->free_drain = (uint64)cm_atomic_get(&counter->free_drain);
+    return CM_SUCCESS;
 }
 
 int mes_register_decrypt_pwd(usr_cb_decrypt_pwd_t proc)
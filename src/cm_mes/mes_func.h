@@ -37,6 +37,8 @@
 #include "mes_msg_pool.h"
 #include "mes_rdma_rpc.h"
 #include "cm_rwlock.h"
+#include "mes_latency.h"
+#include "mes_large.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,7 +52,7 @@ extern "C" {
     (uint32)(SIZE_K(32) + MES_MESSAGE_TINY_SIZE) /* biggest: pcr page ack: head + ack + page */
 #define MES_MIN_TASK_NUM (1)
 #define MES_MAX_TASK_NUM (128)
-#define MES_WAIT_TIMEOUT (5) // ms
+#define MES_MAX_REACTOR_NUM (16)
 
 #define MES_LOG_WAR_HEAD_EX(head, message)                                                             \
     do {                                                                                               \
@@ -122,8 +124,25 @@ typedef struct st_mes_channel {
     atomic_t recv_count;
     mes_msgqueue_t msg_queue;
     date_t last_send_time;
+    char *coalesce_buf; // small messages waiting for the flusher thread, protected by send_lock
+    uint32 coalesce_len;
+    char *recv_buf; // batched receive buffer, protected by recv_lock
+    uint32 recv_buf_size;
+    uint32 recv_read_pos;
+    uint32 recv_write_pos;
+    char *recv_frame;      // pool buffer of a partial frame received in place, protected by recv_lock
+    uint32 recv_frame_pos; // bytes of recv_frame received so far
+    volatile bool8 connect_enabled; // reactor mode only, channel is maintained by the connector thread
+    atomic32_t large_senders; // threads sending a large message on the channel
+    atomic32_t send_waiters;  // small messages waiting for send_lock while large_senders is not 0
 } mes_channel_t;
 
+typedef struct st_mes_reactor {
+    thread_t thread;
+    int epfd;
+    uint32 id;
+} mes_reactor_t;
+
 typedef struct st_mes_waiting_room {
     mes_mutex_t mutex;           // msg ack wake up mes_recv
     mes_mutex_t broadcast_mutex; // broadcast acks wake up mes_wait_acks
@@ -147,6 +166,8 @@ typedef struct st_mes_conn {
 
 typedef struct st_mes_pool {
     uint32 count;
+    uint32 cache_count; // per-thread buffer cache depth, 0 means disabled
+    uint32 cache_gen;   // invalidates thread caches filled from a destroyed pool
     mes_buf_chunk_t chunk[MES_MAX_BUFFPOOL_NUM];
 } mes_pool_t;
 
@@ -157,13 +178,20 @@ typedef struct st_mes_context {
     mes_conn_t conn_arr[CM_MAX_INSTANCES];
     mes_waiting_room_t waiting_rooms[CM_MAX_MES_ROOMS];
     uint32 work_thread_idx[CM_MES_MAX_TASK_NUM];
+    mes_reactor_t reactors[MES_MAX_REACTOR_NUM];
+    thread_t connector;
+    thread_t flusher;
+    cm_event_t flusher_event;
+    cm_timer_node_t heartbeat_timer;
 
     uint32 startLsnr : 1;
     uint32 startChannelsTh : 1;
     uint32 creatMsgPool : 1;
     uint32 creatWaitRoom : 1;
     uint32 startWorkTh : 1;
-    uint32 reserve : 27;
+    uint32 startReactorTh : 1;
+    uint32 startFlushTh : 1;
+    uint32 reserve : 25;
 } mes_context_t;
 
 typedef struct st_mes_instance {
@@ -171,6 +199,9 @@ typedef struct st_mes_instance {
     mes_context_t mes_ctx;
     mq_context_t mq_ctx;
     mes_message_proc_t proc;
+    mes_large_message_proc_t large_proc;
+    mes_large_buf_alloc_t large_buf_alloc;
+    mes_large_buf_free_t large_buf_free;
     bool32 is_enqueue[CM_MAX_MES_MSG_CMD];
     ssl_ctx_t  *ssl_acceptor_fd;
     ssl_ctx_t  *ssl_connector_fd;
@@ -209,30 +240,54 @@ extern mes_instance_t g_cbb_mes;
 #define MES_GLOBAL_INST_MSG g_cbb_mes
 #define MES_SESSION_TO_CHANNEL_ID(sid) (uint8)((sid) % MES_GLOBAL_INST_MSG.profile.channel_cnt)
 
+// high priority commands go over the last priority_channel_cnt channels of the peer
+static inline uint8 mes_get_send_channel_id(const mes_message_head_t *head)
+{
+    uint32 high_cnt = MES_GLOBAL_INST_MSG.profile.priority_channel_cnt;
+    // heartbeats carry the channel itself in src_sid
+    if (high_cnt == 0 || head->cmd == MES_HEARTBEAT_CMD) {
+        return MES_SESSION_TO_CHANNEL_ID(head->src_sid);
+    }
+
+    uint32 normal_cnt = MES_GLOBAL_INST_MSG.profile.channel_cnt - high_cnt;
+    if (MES_GLOBAL_INST_MSG.mq_ctx.command_attr[head->cmd].priority == MES_PRIORITY_HIGH) {
+        return (uint8)(normal_cnt + head->src_sid % high_cnt);
+    }
+    return (uint8)(head->src_sid % normal_cnt);
+}
+
 bool32 mes_connection_ready(uint32 inst_id);
 int mes_send_bufflist(mes_bufflist_t *buff_list);
 
 void mes_process_message(mes_msgqueue_t *my_queue, uint32 recv_idx, mes_message_t *msg);
 
+static inline void mes_append_bufflist(mes_bufflist_t *buff_list, const void *buff, uint32 len)
+{
+    buff_list->buffers[buff_list->cnt].buf = (char *)buff;
+    buff_list->buffers[buff_list->cnt].len = len;
+    buff_list->cnt = buff_list->cnt + 1;
+}
+
+static inline void mes_dispatch_message(uint32 work_thread, mes_message_t *msg)
+{
+    if (SECUREC_UNLIKELY((msg->head->flags & MES_FLAG_LARGE_MSG) != 0)) {
+        mes_large_dispatch(work_thread, msg);
+        return;
+    }
+    MES_GLOBAL_INST_MSG.proc(work_thread, msg);
+}
+
 typedef struct st_mes_commond_stat {
     uint32 cmd;
     int64 send_count;
     int64 recv_count;
     int64 local_count;
     atomic32_t occupy_buf;
-    spinlock_t lock;
 } mes_commond_stat_t;
 
-typedef struct st_mes_time_consume {
-    uint32 cmd; // command
-    uint64 time[MES_TIME_CEIL];
-    int64 count[MES_TIME_CEIL];
-    spinlock_t lock[MES_TIME_CEIL];
-} mes_time_consume_t;
-
+// the samples go to the sharded histograms of mes_latency.c, the totals are merged from them
 typedef struct st_mes_elapsed_stat {
     bool32 mes_elapsed_switch;
-    mes_time_consume_t time_consume_stat[CM_MAX_MES_MSG_CMD];
 } mes_elapsed_stat_t;
 
 typedef struct st_mes_stat {
@@ -263,14 +318,23 @@ static inline void mes_get_consume_time_start(uint64 *stat_time)
     return;
 }
 
+static inline void mes_add_elapsed_time(uint32 cmd, mes_time_stat_t type, uint64 elapsed_time)
+{
+    mes_latency_record(cmd, type, elapsed_time);
+}
+
 static inline void mes_consume_with_time(uint32 cmd, mes_time_stat_t type, uint64 start_time)
 {
     if (g_mes_elapsed_stat.mes_elapsed_switch) {
-        uint64 elapsed_time = cm_get_time_usec() - start_time;
-        cm_spin_lock(&(g_mes_elapsed_stat.time_consume_stat[cmd].lock[type]), NULL);
-        g_mes_elapsed_stat.time_consume_stat[cmd].time[type] += elapsed_time;
-        cm_atomic_inc(&(g_mes_elapsed_stat.time_consume_stat[cmd].count[type]));
-        cm_spin_unlock(&(g_mes_elapsed_stat.time_consume_stat[cmd].lock[type]));
+        mes_add_elapsed_time(cmd, type, cm_get_time_usec() - start_time);
+    }
+    return;
+}
+
+static inline void mes_queue_wait_stat(uint32 cmd, uint64 enqueue_time)
+{
+    if (g_mes_elapsed_stat.mes_elapsed_switch && enqueue_time != 0) {
+        mes_add_elapsed_time(cmd, MES_TIME_QUEUE_WAIT, cm_get_time_usec() - enqueue_time);
     }
     return;
 }
@@ -278,9 +342,7 @@ static inline void mes_consume_with_time(uint32 cmd, mes_time_stat_t type, uint6
 static inline void mes_elapsed_stat(uint32 cmd, mes_time_stat_t type)
 {
     if (g_mes_elapsed_stat.mes_elapsed_switch) {
-        cm_spin_lock(&(g_mes_elapsed_stat.time_consume_stat[cmd].lock[type]), NULL);
-        cm_atomic_inc(&(g_mes_elapsed_stat.time_consume_stat[cmd].count[type]));
-        cm_spin_unlock(&(g_mes_elapsed_stat.time_consume_stat[cmd].lock[type]));
+        mes_latency_record(cmd, type, 0); // counted without a time
     }
     return;
 }
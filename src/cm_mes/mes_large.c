@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * mes_large.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_mes/mes_large.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "mes_large.h"
+#include "mes.h"
+#include "mes_func.h"
+#include "cm_spinlock.h"
+#include "cm_timer.h"
+
+typedef struct st_mes_large_recv {
+    mes_large_message_t msg; // must be the first member, the message is handed out as the whole entry
+    uint32 msg_id;
+    uint32 chunk_capacity;
+    uint64 received;
+    date_t last_time;
+    bool32 own_buf; // user_buf was allocated here because the pool buffers held by messages reached held_max
+} mes_large_recv_t;
+
+// each slot has its own lock, so copying into one message does not hold up the others
+typedef struct st_mes_large_slot {
+    spinlock_t lock;
+    mes_large_recv_t *volatile entry; // read without the lock only to skip free slots
+} mes_large_slot_t;
+
+typedef struct st_mes_large_ctx {
+    mes_large_slot_t slots[MES_LARGE_MAX_PENDING];
+    atomic32_t inst_pending[MES_MAX_INSTANCES];
+    atomic_t held_bytes; // frames kept in the chunks of received messages until they are released
+    uint64 held_max;
+    cm_timer_node_t expire_timer;
+} mes_large_ctx_t;
+
+static mes_large_ctx_t g_mes_large_ctx = { 0 };
+static atomic32_t g_mes_large_msg_id = 0;
+
+static inline void mes_release_large_chunk(char *chunk)
+{
+    mes_message_t msg;
+    MES_MESSAGE_ATTACH(&msg, chunk - MES_LARGE_FRAG_HEAD_SIZE);
+    mes_release_message_buf(&msg);
+}
+
+static void mes_large_release_chunks(mes_large_message_t *msg)
+{
+    uint64 frames = 0;
+
+    for (uint32 i = 0; i < msg->chunk_cnt; i++) {
+        mes_release_large_chunk(msg->chunks[i].buf);
+        frames += msg->chunks[i].len + MES_LARGE_FRAG_HEAD_SIZE;
+    }
+    (void)cm_atomic_add(&g_mes_large_ctx.held_bytes, -(int64)frames);
+    msg->chunk_cnt = 0;
+    CM_FREE_PTR(msg->chunks);
+}
+
+// every mes_large_message_t handed out is the head of a mes_large_recv_t
+void mes_release_large_message(mes_large_message_t *msg)
+{
+    if (msg == NULL) {
+        return;
+    }
+    mes_large_recv_t *entry = (mes_large_recv_t *)msg;
+    mes_large_release_chunks(msg);
+    if (entry->own_buf) {
+        CM_FREE_PTR(msg->user_buf);
+    }
+    free(entry);
+}
+
+// pick the slices of the caller buffers that go into the next fragment
+static uint32 mes_large_fill_frag(mes_bufflist_t *list, const mes_buffer_t *body, unsigned int cnt, uint32 *idx,
+    uint32 *pos)
+{
+    uint32 len = 0;
+
+    while (*idx < cnt && list->cnt < MES_MAX_BUFFERLIST && len < MES_LARGE_FRAG_BODY_SIZE) {
+        uint32 size = MIN(body[*idx].len - *pos, MES_LARGE_FRAG_BODY_SIZE - len);
+        if (size > 0) {
+            mes_append_bufflist(list, body[*idx].buf + *pos, size);
+            len += size;
+            *pos += size;
+        }
+        if (*pos == body[*idx].len) {
+            (*idx)++;
+            *pos = 0;
+        }
+    }
+    return len;
+}
+
+// let small messages blocked on the channel go out before the next fragment
+static inline void mes_large_yield(mes_channel_t *channel)
+{
+    for (uint32 i = 0; i < MES_LARGE_YIELD_SPINS && cm_atomic32_get(&channel->send_waiters) > 0; i++) {
+        cm_spin_sleep();
+    }
+}
+
+int mes_send_large_data(const mes_message_head_t *head, const mes_buffer_t *body, unsigned int cnt)
+{
+    int ret = CM_SUCCESS;
+    uint64 total = 0;
+    uint64 start_stat_time = 0;
+    uint32 idx = 0;
+    uint32 pos = 0;
+    mes_bufflist_t list;
+    mes_message_head_t frag_head;
+    mes_large_frag_t frag;
+
+    if (head == NULL || body == NULL || cnt == 0) {
+        return ERR_MES_PARAM_NULL;
+    }
+    if (MES_GLOBAL_INST_MSG.profile.large_msg_max_size == 0 || head->dst_inst == MES_GLOBAL_INST_MSG.profile.inst_id) {
+        MES_LOG_ERR_HEAD_EX(head, "large message is disabled or sent to local instance");
+        return ERR_MES_PARAM_INVAIL;
+    }
+    for (uint32 i = 0; i < cnt; i++) {
+        total += body[i].len;
+    }
+    if (total == 0 || total > MES_GLOBAL_INST_MSG.profile.large_msg_max_size) {
+        MES_LOG_ERR_HEAD_EX(head, "large message length invalid");
+        return ERR_MES_MSG_TOO_LARGE;
+    }
+
+    frag_head = *head;
+    frag_head.flags |= MES_FLAG_LARGE_MSG;
+    frag.total_size = total;
+    frag.offset = 0;
+    frag.msg_id = (uint32)cm_atomic32_inc(&g_mes_large_msg_id);
+    frag.reserved = 0;
+
+    mes_channel_t *channel =
+        &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][mes_get_send_channel_id(head)];
+    mes_get_consume_time_start(&start_stat_time);
+    (void)cm_atomic32_inc(&channel->large_senders);
+    while (frag.offset < total) {
+        list.cnt = 0;
+        mes_append_bufflist(&list, &frag_head, sizeof(mes_message_head_t));
+        mes_append_bufflist(&list, &frag, sizeof(mes_large_frag_t));
+        uint32 len = mes_large_fill_frag(&list, body, cnt, &idx, &pos);
+        frag_head.size = (uint16)(MES_LARGE_FRAG_HEAD_SIZE + len);
+
+        ret = mes_send_bufflist(&list);
+        if (ret != CM_SUCCESS) {
+            MES_LOG_ERR_HEAD_EX(head, "send large message fragment failed");
+            break;
+        }
+        frag.offset += len;
+        mes_large_yield(channel);
+    }
+    (void)cm_atomic32_dec(&channel->large_senders);
+
+    if (ret == CM_SUCCESS) {
+        mes_consume_with_time(head->cmd, MES_TIME_TEST_SEND, start_stat_time);
+    }
+    return ret;
+}
+
+static inline uint32 mes_large_slot_hash(uint8 src_inst, uint32 msg_id)
+{
+    return (msg_id ^ ((uint32)src_inst << 4)) % MES_LARGE_MAX_PENDING;
+}
+
+// slot locked by the caller, the entry goes to mes_large_abort once the slot is unlocked
+static mes_large_recv_t *mes_large_detach(mes_large_slot_t *slot)
+{
+    mes_large_recv_t *entry = slot->entry;
+    slot->entry = NULL;
+    (void)cm_atomic32_dec(&g_mes_large_ctx.inst_pending[entry->msg.head.src_inst]);
+    return entry;
+}
+
+// a message dropped before it completed, a buffer from large_buf_alloc goes back to the caller
+static void mes_large_abort(mes_large_recv_t *entry)
+{
+    if (entry->msg.user_buf != NULL && !entry->own_buf) {
+        if (MES_GLOBAL_INST_MSG.large_buf_free != NULL) {
+            MES_GLOBAL_INST_MSG.large_buf_free(&entry->msg.head, entry->msg.user_buf, entry->msg.size);
+        }
+        entry->msg.user_buf = NULL;
+    }
+    mes_release_large_message(&entry->msg);
+}
+
+// peers that went away leave their unfinished messages behind, slots busy with a fragment are skipped
+static void mes_large_drop_expired(void *arg)
+{
+    date_t now = g_timer()->now;
+
+    for (uint32 i = 0; i < MES_LARGE_MAX_PENDING; i++) {
+        mes_large_slot_t *slot = &g_mes_large_ctx.slots[i];
+        mes_large_recv_t *expired = NULL;
+        if (slot->entry == NULL || !cm_spin_try_lock(&slot->lock)) {
+            continue;
+        }
+        if (slot->entry != NULL && now - slot->entry->last_time > MES_LARGE_RECV_TIMEOUT * MICROSECS_PER_SECOND) {
+            expired = mes_large_detach(slot);
+        }
+        cm_spin_unlock(&slot->lock);
+        if (expired != NULL) {
+            LOG_RUN_WAR("[mes]drop unfinished large message %u from instance %hhu", expired->msg_id,
+                expired->msg.head.src_inst);
+            mes_large_abort(expired);
+        }
+    }
+}
+
+int mes_large_set_profile(const mes_profile_t *profile)
+{
+    const mes_buffer_pool_attr_t *attr = &profile->buffer_pool_attr;
+
+    MES_GLOBAL_INST_MSG.profile.large_msg_max_size = profile->large_msg_max_size;
+    g_mes_large_ctx.held_max = 0;
+    if (profile->large_msg_max_size == 0) {
+        return CM_SUCCESS;
+    }
+    // fragments are whole frames, they come from the first pool whose buffers fit one, as mes_alloc_buf_item does
+    for (uint32 i = 0; i < attr->pool_count; i++) {
+        if (attr->buf_attr[i].size >= MES_MESSAGE_BUFFER_SIZE) {
+            g_mes_large_ctx.held_max = (uint64)attr->buf_attr[i].size * attr->buf_attr[i].count / MES_LARGE_POOL_SHARE;
+            break;
+        }
+    }
+    if (g_mes_large_ctx.held_max < MES_MESSAGE_BUFFER_SIZE) {
+        LOG_RUN_ERR("[mes] large_msg_max_size %u needs a buffer pool of at least %u buffers of %u bytes.",
+            profile->large_msg_max_size, MES_LARGE_POOL_SHARE, (uint32)MES_MESSAGE_BUFFER_SIZE);
+        return ERR_MES_PARAM_INVAIL;
+    }
+    LOG_RUN_INF("[mes] unfinished large messages hold at most %llu bytes of pool buffers.", g_mes_large_ctx.held_max);
+    return CM_SUCCESS;
+}
+
+void mes_large_init(void)
+{
+    cm_timer_node_init(&g_mes_large_ctx.expire_timer, mes_large_drop_expired, NULL);
+    if (MES_GLOBAL_INST_MSG.profile.large_msg_max_size > 0) {
+        cm_timer_schedule(&g_mes_large_ctx.expire_timer, MES_LARGE_EXPIRE_INTERVAL * MILLISECS_PER_SECOND,
+            MES_LARGE_EXPIRE_INTERVAL * MILLISECS_PER_SECOND);
+    }
+}
+
+// returns the slot of the message locked, NULL if it is not being received
+static mes_large_slot_t *mes_large_find_slot(uint8 src_inst, uint32 msg_id)
+{
+    uint32 start = mes_large_slot_hash(src_inst, msg_id);
+
+    for (uint32 i = 0; i < MES_LARGE_MAX_PENDING; i++) {
+        mes_large_slot_t *slot = &g_mes_large_ctx.slots[(start + i) % MES_LARGE_MAX_PENDING];
+        if (slot->entry == NULL) {
+            continue;
+        }
+        cm_spin_lock(&slot->lock, NULL);
+        if (slot->entry != NULL && slot->entry->msg_id == msg_id && slot->entry->msg.head.src_inst == src_inst) {
+            return slot;
+        }
+        cm_spin_unlock(&slot->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Claim a free slot for the first fragment of a message and return it locked. One instance may have at most
+ * MES_LARGE_MAX_PENDING_PER_INST messages in flight, so a single peer cannot take all the slots.
+ */
+static mes_large_slot_t *mes_large_new_recv(const mes_message_head_t *head, const mes_large_frag_t *frag)
+{
+    atomic32_t *inst_pending = &g_mes_large_ctx.inst_pending[head->src_inst];
+
+    if (cm_atomic32_inc(inst_pending) > MES_LARGE_MAX_PENDING_PER_INST) {
+        (void)cm_atomic32_dec(inst_pending);
+        return NULL;
+    }
+
+    mes_large_recv_t *entry = (mes_large_recv_t *)malloc(sizeof(mes_large_recv_t));
+    if (entry == NULL) {
+        (void)cm_atomic32_dec(inst_pending);
+        return NULL;
+    }
+    (void)memset_s(entry, sizeof(mes_large_recv_t), 0, sizeof(mes_large_recv_t));
+    entry->msg.head = *head;
+    entry->msg.size = frag->total_size;
+    entry->msg_id = frag->msg_id;
+    entry->last_time = g_timer()->now;
+    // the allocator is the caller's code, it does not run under a slot lock
+    if (MES_GLOBAL_INST_MSG.large_buf_alloc != NULL) {
+        entry->msg.user_buf = MES_GLOBAL_INST_MSG.large_buf_alloc(head, frag->total_size);
+    }
+
+    uint32 start = mes_large_slot_hash(head->src_inst, frag->msg_id);
+    for (uint32 i = 0; i < MES_LARGE_MAX_PENDING; i++) {
+        mes_large_slot_t *slot = &g_mes_large_ctx.slots[(start + i) % MES_LARGE_MAX_PENDING];
+        if (slot->entry != NULL) {
+            continue;
+        }
+        cm_spin_lock(&slot->lock, NULL);
+        if (slot->entry == NULL) {
+            slot->entry = entry;
+            return slot;
+        }
+        cm_spin_unlock(&slot->lock);
+    }
+    (void)cm_atomic32_dec(inst_pending);
+    mes_large_abort(entry);
+    return NULL;
+}
+
+// the chained pool buffers reached held_max, gather them into one heap buffer and copy the rest of the message there
+static int mes_large_move_to_heap(mes_large_recv_t *entry)
+{
+    char *buf = (char *)malloc(entry->msg.size);
+    if (buf == NULL) {
+        return ERR_MES_MALLOC_FAIL;
+    }
+    uint64 pos = 0;
+    for (uint32 i = 0; i < entry->msg.chunk_cnt; i++) {
+        if (memcpy_s(buf + pos, entry->msg.size - pos, entry->msg.chunks[i].buf, entry->msg.chunks[i].len) != EOK) {
+            free(buf);
+            return ERR_MES_MEMORY_COPY_FAIL;
+        }
+        pos += entry->msg.chunks[i].len;
+    }
+    mes_large_release_chunks(&entry->msg);
+    entry->chunk_capacity = 0;
+    entry->msg.user_buf = buf;
+    entry->own_buf = CM_TRUE;
+    return CM_SUCCESS;
+}
+
+static int mes_large_add_chunk(mes_large_recv_t *entry, mes_message_t *msg, uint32 len)
+{
+    char *data = msg->buffer + MES_LARGE_FRAG_HEAD_SIZE;
+    int64 frame = (int64)len + MES_LARGE_FRAG_HEAD_SIZE;
+
+    if (entry->msg.user_buf == NULL &&
+        (uint64)cm_atomic_add(&g_mes_large_ctx.held_bytes, frame) > g_mes_large_ctx.held_max) {
+        (void)cm_atomic_add(&g_mes_large_ctx.held_bytes, -frame);
+        int ret = mes_large_move_to_heap(entry);
+        if (ret != CM_SUCCESS) {
+            mes_release_message_buf(msg);
+            return ret;
+        }
+    }
+
+    if (entry->msg.user_buf != NULL) {
+        errno_t errcode = memcpy_s(entry->msg.user_buf + entry->received, entry->msg.size - entry->received, data, len);
+        mes_release_message_buf(msg);
+        return (errcode == EOK) ? CM_SUCCESS : ERR_MES_MEMORY_COPY_FAIL;
+    }
+
+    if (entry->msg.chunk_cnt == entry->chunk_capacity) {
+        uint32 capacity = (entry->chunk_capacity == 0) ?
+            (uint32)((entry->msg.size + MES_LARGE_FRAG_BODY_SIZE - 1) / MES_LARGE_FRAG_BODY_SIZE) :
+            entry->chunk_capacity * 2;
+        mes_buffer_t *chunks = (mes_buffer_t *)realloc(entry->msg.chunks, capacity * sizeof(mes_buffer_t));
+        if (chunks == NULL) {
+            (void)cm_atomic_add(&g_mes_large_ctx.held_bytes, -frame);
+            mes_release_message_buf(msg);
+            return ERR_MES_MALLOC_FAIL;
+        }
+        entry->msg.chunks = chunks;
+        entry->chunk_capacity = capacity;
+    }
+    entry->msg.chunks[entry->msg.chunk_cnt].buf = data;
+    entry->msg.chunks[entry->msg.chunk_cnt].len = len;
+    entry->msg.chunk_cnt++;
+    return CM_SUCCESS;
+}
+
+/*
+ * Take one fragment off the receive path. The pool buffer is kept in the chain of its message,
+ * returns true with msg pointing to the whole message once the last fragment arrived.
+ */
+bool32 mes_large_recv_fragment(mes_message_t *msg)
+{
+    mes_large_frag_t frag;
+    mes_message_head_t head = *msg->head;
+    mes_large_recv_t *entry = NULL;
+
+    if (SECUREC_UNLIKELY(head.size < MES_LARGE_FRAG_HEAD_SIZE)) {
+        MES_LOG_ERR_HEAD_EX(&head, "large message fragment too short");
+        mes_release_message_buf(msg);
+        return CM_FALSE;
+    }
+    errno_t errcode = memcpy_s(&frag, sizeof(mes_large_frag_t), msg->buffer + sizeof(mes_message_head_t),
+        sizeof(mes_large_frag_t));
+    if (SECUREC_UNLIKELY(errcode != EOK)) {
+        mes_release_message_buf(msg);
+        return CM_FALSE;
+    }
+    uint32 len = head.size - MES_LARGE_FRAG_HEAD_SIZE;
+
+    mes_large_slot_t *slot = mes_large_find_slot(head.src_inst, frag.msg_id);
+    if (slot == NULL) {
+        if (frag.offset == 0 && frag.total_size <= MES_GLOBAL_INST_MSG.profile.large_msg_max_size) {
+            slot = mes_large_new_recv(&head, &frag);
+        }
+        if (slot == NULL) {
+            LOG_RUN_ERR_INHIBIT(LOG_INHIBIT_LEVEL4, "[mes]drop large message %u fragment from instance %hhu, "
+                "offset %llu, size %llu", frag.msg_id, head.src_inst, frag.offset, frag.total_size);
+            mes_release_message_buf(msg);
+            return CM_FALSE;
+        }
+    }
+    entry = slot->entry;
+
+    // fragments of a message come in order over one channel, anything else means the stream broke
+    bool32 in_order = (frag.offset == entry->received && frag.offset + len <= entry->msg.size);
+    if (!in_order || mes_large_add_chunk(entry, msg, len) != CM_SUCCESS) {
+        LOG_RUN_ERR("[mes]large message %u from instance %hhu broken at offset %llu", frag.msg_id, head.src_inst,
+            frag.offset);
+        if (!in_order) {
+            mes_release_message_buf(msg);
+        }
+        entry = mes_large_detach(slot);
+        cm_spin_unlock(&slot->lock);
+        mes_large_abort(entry);
+        return CM_FALSE;
+    }
+    entry->received += len;
+    entry->last_time = g_timer()->now;
+    if (entry->received < entry->msg.size) {
+        cm_spin_unlock(&slot->lock);
+        return CM_FALSE;
+    }
+
+    slot->entry = NULL;
+    cm_spin_unlock(&slot->lock);
+    (void)cm_atomic32_dec(&g_mes_large_ctx.inst_pending[head.src_inst]);
+
+    msg->head = &entry->msg.head;
+    msg->buffer = (char *)entry;
+    return CM_TRUE;
+}
+
+void mes_large_dispatch(uint32 work_thread, mes_message_t *msg)
+{
+    mes_large_message_t *large = (mes_large_message_t *)msg->buffer;
+
+    if (MES_GLOBAL_INST_MSG.large_proc == NULL) {
+        MES_LOG_ERR_HEAD_EX(msg->head, "no large message proc registered");
+        mes_release_large_message(large);
+        return;
+    }
+    MES_GLOBAL_INST_MSG.large_proc(work_thread, large);
+}
+
+void mes_large_clean(void)
+{
+    cm_timer_cancel(&g_mes_large_ctx.expire_timer);
+    for (uint32 i = 0; i < MES_LARGE_MAX_PENDING; i++) {
+        mes_large_slot_t *slot = &g_mes_large_ctx.slots[i];
+        mes_large_recv_t *entry = NULL;
+        cm_spin_lock(&slot->lock, NULL);
+        if (slot->entry != NULL) {
+            entry = mes_large_detach(slot);
+        }
+        cm_spin_unlock(&slot->lock);
+        if (entry != NULL) {
+            mes_large_abort(entry);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * mes_large.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_mes/mes_large.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __MES_LARGE_H__
+#define __MES_LARGE_H__
+
+#include "mes_type.h"
+#include "cm_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A large message goes out as a run of ordinary frames flagged with MES_FLAG_LARGE_MSG,
+ * each one carrying this header right after the message head and a piece of the body.
+ */
+typedef struct st_mes_large_frag {
+    uint64 total_size; // body size of the whole message
+    uint64 offset;     // position of this piece in the body
+    uint32 msg_id;     // unique per sending instance
+    uint32 reserved;
+} mes_large_frag_t;
+
+#define MES_LARGE_FRAG_HEAD_SIZE ((uint32)(sizeof(mes_message_head_t) + sizeof(mes_large_frag_t)))
+#define MES_LARGE_FRAG_BODY_SIZE (MES_MESSAGE_BUFFER_SIZE - MES_LARGE_FRAG_HEAD_SIZE)
+#define MES_LARGE_FRAG_MAX_SLICE (MES_MAX_BUFFERLIST - 2) // caller buffers one fragment may gather from
+#define MES_LARGE_MAX_PENDING (64)        // messages being reassembled at the same time
+#define MES_LARGE_MAX_PENDING_PER_INST (8) // of them from one instance
+#define MES_LARGE_RECV_TIMEOUT (60)       // seconds, an unfinished message is dropped after that
+#define MES_LARGE_YIELD_SPINS (64)        // sleeps a large sender gives to waiting small messages per fragment
+#define MES_LARGE_EXPIRE_INTERVAL (5)     // seconds between two sweeps for unfinished messages
+#define MES_LARGE_POOL_SHARE (4)          // chained fragments hold at most 1/4 of the pool buffers that fit a frame
+
+int mes_large_set_profile(const mes_profile_t *profile);
+void mes_large_init(void);
+bool32 mes_large_recv_fragment(mes_message_t *msg);
+void mes_large_dispatch(uint32 work_thread, mes_message_t *msg);
+void mes_large_clean(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * mes_latency.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_mes/mes_latency.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "mes_latency.h"
+#include "cm_thread.h"
+#include "cm_error.h"
+
+#define MES_PERCENTILE_BASE (100.0)
+
+static mes_latency_stat_ctx_t g_mes_latency_stat;
+static atomic32_t g_mes_latency_shard_seq = 0;
+static thread_local_var int32 g_mes_latency_shard = -1;
+
+void mes_latency_init(void)
+{
+    for (uint32 i = 0; i < MES_HIST_SHARDS; i++) {
+        for (uint32 j = 0; j < CM_MAX_MES_MSG_CMD; j++) {
+            CM_FREE_PTR(g_mes_latency_stat.hist[i][j]);
+        }
+    }
+    for (uint32 i = 0; i < CM_MAX_MES_MSG_CMD; i++) {
+        for (uint32 j = 0; j < MES_TIME_CEIL; j++) {
+            g_mes_latency_stat.retired_sum[i][j] = 0;
+            g_mes_latency_stat.retired_count[i][j] = 0;
+        }
+    }
+}
+
+static inline uint32 mes_latency_bucket(uint64 value)
+{
+    uint32 exp;
+
+    if (value < MES_HIST_SUB_COUNT) {
+        return (uint32)value;
+    }
+#ifdef WIN32
+    exp = 0;
+    for (uint64 v = value >> 1; v != 0; v >>= 1) {
+        exp++;
+    }
+#else
+    exp = (uint32)(63 - __builtin_clzll(value));
+#endif
+    if (exp > MES_HIST_MAX_EXP) {
+        return MES_HIST_BUCKETS - 1;
+    }
+    return (exp - MES_HIST_SUB_BITS + 1) * MES_HIST_SUB_COUNT +
+        (uint32)((value >> (exp - MES_HIST_SUB_BITS)) & (MES_HIST_SUB_COUNT - 1));
+}
+
+// the largest value counted by a bucket
+static inline uint64 mes_latency_bucket_bound(uint32 bucket)
+{
+    uint32 group = bucket / MES_HIST_SUB_COUNT;
+    uint32 sub = bucket % MES_HIST_SUB_COUNT;
+
+    if (group == 0) {
+        return sub;
+    }
+    uint32 exp = group + MES_HIST_SUB_BITS - 1;
+    return ((uint64)1 << exp) + ((uint64)(sub + 1) << (exp - MES_HIST_SUB_BITS)) - 1;
+}
+
+static mes_latency_hist_t *mes_latency_get_hist(uint32 cmd)
+{
+    if (SECUREC_UNLIKELY(g_mes_latency_shard < 0)) {
+        g_mes_latency_shard = (int32)((uint32)cm_atomic32_inc(&g_mes_latency_shard_seq) % MES_HIST_SHARDS);
+    }
+
+    mes_latency_hist_t *volatile *slot = &g_mes_latency_stat.hist[g_mes_latency_shard][cmd];
+    if (SECUREC_LIKELY(*slot != NULL)) {
+        return *slot;
+    }
+
+    mes_latency_hist_t *hist = (mes_latency_hist_t *)malloc(sizeof(mes_latency_hist_t));
+    if (hist == NULL) {
+        return NULL;
+    }
+    if (memset_s(hist, sizeof(mes_latency_hist_t), 0, sizeof(mes_latency_hist_t)) != EOK) {
+        free(hist);
+        return NULL;
+    }
+    if (!cm_atomic_cas((atomic_t *)slot, 0, (int64)(uintptr_t)hist)) {
+        free(hist);
+    }
+    return *slot;
+}
+
+static inline void mes_latency_update_max(atomic_t *max, uint64 value)
+{
+    int64 old = cm_atomic_get(max);
+    while ((int64)value > old && !cm_atomic_cas(max, old, (int64)value)) {
+        old = cm_atomic_get(max);
+    }
+}
+
+void mes_latency_record(uint32 cmd, mes_time_stat_t type, uint64 elapsed)
+{
+    mes_latency_hist_t *hist = mes_latency_get_hist(cmd);
+    if (hist == NULL) {
+        return;
+    }
+
+    (void)cm_atomic_inc(&hist->bucket[type][mes_latency_bucket(elapsed)]);
+    (void)cm_atomic_add(&hist->sum[type], (int64)elapsed);
+    mes_latency_update_max(&hist->max[type], elapsed);
+}
+
+// read a counter, optionally taking it away so that no sample is lost between two snapshots
+static inline uint64 mes_latency_take(atomic_t *val, bool32 reset)
+{
+    int64 old = cm_atomic_get(val);
+    while (reset && !cm_atomic_cas(val, old, 0)) {
+        old = cm_atomic_get(val);
+    }
+    return (uint64)old;
+}
+
+static uint64 mes_latency_rank_value(const uint64 *count, uint64 total, double percentile, uint64 max)
+{
+    uint64 seen = 0;
+    uint64 rank = (uint64)((double)total * percentile / MES_PERCENTILE_BASE);
+
+    if ((double)rank * MES_PERCENTILE_BASE < (double)total * percentile) {
+        rank++;
+    }
+    for (uint32 i = 0; i < MES_HIST_BUCKETS; i++) {
+        seen += count[i];
+        if (seen >= rank) {
+            return MIN(mes_latency_bucket_bound(i), max);
+        }
+    }
+    return max;
+}
+
+int mes_latency_collect(uint32 cmd, mes_time_stat_t type, bool32 reset, mes_latency_stat_t *stat)
+{
+    uint64 count[MES_HIST_BUCKETS] = { 0 };
+    mes_latency_hist_t *hist = NULL;
+
+    if (stat == NULL || cmd >= CM_MAX_MES_MSG_CMD || type >= MES_TIME_CEIL) {
+        return ERR_MES_PARAM_INVAIL;
+    }
+
+    (void)memset_s(stat, sizeof(mes_latency_stat_t), 0, sizeof(mes_latency_stat_t));
+    for (uint32 i = 0; i < MES_HIST_SHARDS; i++) {
+        hist = g_mes_latency_stat.hist[i][cmd];
+        if (hist == NULL) {
+            continue;
+        }
+        for (uint32 j = 0; j < MES_HIST_BUCKETS; j++) {
+            uint64 value = mes_latency_take(&hist->bucket[type][j], reset);
+            count[j] += value;
+            stat->count += value;
+        }
+        stat->sum += mes_latency_take(&hist->sum[type], reset);
+        uint64 max = mes_latency_take(&hist->max[type], reset);
+        stat->max = MAX(stat->max, max);
+    }
+    if (reset) {
+        (void)cm_atomic_add(&g_mes_latency_stat.retired_sum[cmd][type], (int64)stat->sum);
+        (void)cm_atomic_add(&g_mes_latency_stat.retired_count[cmd][type], (int64)stat->count);
+    }
+
+    if (stat->count == 0) {
+        return CM_SUCCESS;
+    }
+    stat->p50 = mes_latency_rank_value(count, stat->count, 50.0, stat->max);
+    stat->p90 = mes_latency_rank_value(count, stat->count, 90.0, stat->max);
+    stat->p99 = mes_latency_rank_value(count, stat->count, 99.0, stat->max);
+    stat->p999 = mes_latency_rank_value(count, stat->count, 99.9, stat->max);
+    return CM_SUCCESS;
+}
+
+uint64 mes_latency_percentile(uint32 cmd, mes_time_stat_t type, double percentile)
+{
+    uint64 count[MES_HIST_BUCKETS] = { 0 };
+    uint64 total = 0;
+    uint64 max = 0;
+    mes_latency_hist_t *hist = NULL;
+
+    if (cmd >= CM_MAX_MES_MSG_CMD || type >= MES_TIME_CEIL || percentile <= 0 || percentile > MES_PERCENTILE_BASE) {
+        return 0;
+    }
+
+    for (uint32 i = 0; i < MES_HIST_SHARDS; i++) {
+        hist = g_mes_latency_stat.hist[i][cmd];
+        if (hist == NULL) {
+            continue;
+        }
+        for (uint32 j = 0; j < MES_HIST_BUCKETS; j++) {
+            uint64 value = (uint64)cm_atomic_get(&hist->bucket[type][j]);
+            count[j] += value;
+            total += value;
+        }
+        uint64 shard_max = (uint64)cm_atomic_get(&hist->max[type]);
+        max = MAX(max, shard_max);
+    }
+    return (total == 0) ? 0 : mes_latency_rank_value(count, total, percentile, max);
+}
+
+uint64 mes_latency_total_sum(uint32 cmd, mes_time_stat_t type)
+{
+    if (cmd >= CM_MAX_MES_MSG_CMD || type >= MES_TIME_CEIL) {
+        return 0;
+    }
+    uint64 sum = (uint64)cm_atomic_get(&g_mes_latency_stat.retired_sum[cmd][type]);
+    for (uint32 i = 0; i < MES_HIST_SHARDS; i++) {
+        mes_latency_hist_t *hist = g_mes_latency_stat.hist[i][cmd];
+        if (hist != NULL) {
+            sum += (uint64)cm_atomic_get(&hist->sum[type]);
+        }
+    }
+    return sum;
+}
+
+// every sample lands in one bucket, so the buckets add up to the number of samples
+uint64 mes_latency_total_count(uint32 cmd, mes_time_stat_t type)
+{
+    if (cmd >= CM_MAX_MES_MSG_CMD || type >= MES_TIME_CEIL) {
+        return 0;
+    }
+    uint64 count = (uint64)cm_atomic_get(&g_mes_latency_stat.retired_count[cmd][type]);
+    for (uint32 i = 0; i < MES_HIST_SHARDS; i++) {
+        mes_latency_hist_t *hist = g_mes_latency_stat.hist[i][cmd];
+        if (hist == NULL) {
+            continue;
+        }
+        for (uint32 j = 0; j < MES_HIST_BUCKETS; j++) {
+            count += (uint64)cm_atomic_get(&hist->bucket[type][j]);
+        }
+    }
+    return count;
+}
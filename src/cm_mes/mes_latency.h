@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * mes_latency.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_mes/mes_latency.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __MES_LATENCY_H__
+#define __MES_LATENCY_H__
+
+#include "mes_type.h"
+#include "cm_defs.h"
+#include "cm_atomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Log-linear buckets: values below MES_HIST_SUB_COUNT us are exact, every power of two above is
+ * split into MES_HIST_SUB_COUNT buckets, so a bucket bound is at most 1/8 above the real value.
+ */
+#define MES_HIST_SUB_BITS (3)
+#define MES_HIST_SUB_COUNT (1 << MES_HIST_SUB_BITS)
+#define MES_HIST_MAX_EXP (31) // about 36 minutes, larger values fall into the last bucket
+#define MES_HIST_BUCKETS ((MES_HIST_MAX_EXP - MES_HIST_SUB_BITS + 2) * MES_HIST_SUB_COUNT)
+#define MES_HIST_SHARDS (16)  // threads are spread over the shards, reads merge all of them
+
+typedef struct st_mes_latency_hist {
+    atomic_t sum[MES_TIME_CEIL];
+    atomic_t max[MES_TIME_CEIL];
+    atomic_t bucket[MES_TIME_CEIL][MES_HIST_BUCKETS];
+} mes_latency_hist_t;
+
+// histograms of one shard are allocated on the first sample of each command
+typedef struct st_mes_latency_stat_ctx {
+    mes_latency_hist_t *volatile hist[MES_HIST_SHARDS][CM_MAX_MES_MSG_CMD];
+    // what resetting collects took away from the shards, the totals keep counting since init
+    atomic_t retired_sum[CM_MAX_MES_MSG_CMD][MES_TIME_CEIL];
+    atomic_t retired_count[CM_MAX_MES_MSG_CMD][MES_TIME_CEIL];
+} mes_latency_stat_ctx_t;
+
+void mes_latency_init(void);
+void mes_latency_record(uint32 cmd, mes_time_stat_t type, uint64 elapsed);
+int mes_latency_collect(uint32 cmd, mes_time_stat_t type, bool32 reset, mes_latency_stat_t *stat);
+uint64 mes_latency_percentile(uint32 cmd, mes_time_stat_t type, double percentile);
+uint64 mes_latency_total_sum(uint32 cmd, mes_time_stat_t type);
+uint64 mes_latency_total_count(uint32 cmd, mes_time_stat_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
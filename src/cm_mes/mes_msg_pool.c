@@ -27,6 +27,11 @@
 
 #define RECV_MSG_POOL_FC_THRESHOLD 10
 
+static thread_local_var mes_buf_cache_t g_mes_buf_cache[MES_MAX_BUFFPOOL_NUM];
+// only MES threads, which give their buffers back before they idle or exit, use the cache
+static thread_local_var bool32 g_mes_buf_cache_attached = CM_FALSE;
+static uint32 g_mes_buf_cache_gen = 0;
+
 static mes_buf_chunk_t *mes_get_buffer_chunk(uint32 len)
 {
     mes_buf_chunk_t *chunk;
@@ -156,6 +161,7 @@ int mes_create_buffer_chunk(mes_buf_chunk_t *chunk, uint32 chunk_no, uint32 queu
     chunk->buf_size = buf_attr->size;
     chunk->queue_num = (uint8)queue_num;
     chunk->current_no = 0;
+    chunk->cache_free = 0;
 
     mes_set_buffer_queue_count(chunk, queue_num, buf_attr->count);
 
@@ -198,6 +204,19 @@ void mes_destory_buffer_chunk(mes_buf_chunk_t *chunk)
     return;
 }
 
+static void mes_set_buf_cache_count(mes_pool_t *pool, uint32 cache_count)
+{
+    if (cache_count > MES_MAX_BUF_CACHE_COUNT) {
+        LOG_RUN_WAR("[mes]: buf_cache_count %u exceed max %d.", cache_count, MES_MAX_BUF_CACHE_COUNT);
+        cache_count = MES_MAX_BUF_CACHE_COUNT;
+    }
+    pool->cache_count = cache_count;
+    pool->cache_gen = ++g_mes_buf_cache_gen;
+    if (pool->cache_gen == 0) {
+        pool->cache_gen = ++g_mes_buf_cache_gen;
+    }
+}
+
 int mes_init_message_pool(void)
 {
     int ret;
@@ -220,6 +239,7 @@ int mes_init_message_pool(void)
     }
 
     MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.count = MES_GLOBAL_INST_MSG.profile.buffer_pool_attr.pool_count;
+    mes_set_buf_cache_count(&MES_GLOBAL_INST_MSG.mes_ctx.msg_pool, MES_GLOBAL_INST_MSG.profile.buf_cache_count);
     MES_GLOBAL_INST_MSG.mes_ctx.creatMsgPool = CM_TRUE;
     return CM_SUCCESS;
 }
@@ -234,10 +254,174 @@ void mes_destory_message_pool(void)
         mes_destory_buffer_chunk(&MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.chunk[i]);
     }
 
+    MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_count = 0;
     MES_GLOBAL_INST_MSG.mes_ctx.creatMsgPool = CM_FALSE;
     return;
 }
 
+static inline mes_buf_cache_t *mes_get_buf_cache(const mes_buf_chunk_t *chunk)
+{
+    mes_buf_cache_t *cache = &g_mes_buf_cache[chunk->chunk_no];
+    if (SECUREC_UNLIKELY(cache->gen != MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_gen)) {
+        // buffers cached from a destroyed pool went away with it
+        cache->gen = MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_gen;
+        cache->count = 0;
+        cache->alloc_hit = 0;
+        cache->free_hit = 0;
+        cache->reported = 0;
+    }
+    return cache;
+}
+
+// batched like the hit counters, cache_free lags behind by at most cache_count per thread
+static inline void mes_report_buf_cache(mes_buf_chunk_t *chunk, mes_buf_cache_t *cache)
+{
+    if (cache->count != cache->reported) {
+        (void)cm_atomic32_add(&chunk->cache_free, (int32)cache->count - (int32)cache->reported);
+        cache->reported = cache->count;
+    }
+}
+
+static inline uint32 mes_get_buf_cache_batch(void)
+{
+    uint32 batch = MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_count / 2;
+    return batch == 0 ? 1 : batch;
+}
+
+static void mes_flush_buf_cache_stat(mes_buf_chunk_t *chunk, mes_buf_cache_t *cache)
+{
+    if (cache->alloc_hit > 0) {
+        (void)cm_atomic_add(&chunk->cache_stat.alloc_hit, (int64)cache->alloc_hit);
+        cache->alloc_hit = 0;
+    }
+    if (cache->free_hit > 0) {
+        (void)cm_atomic_add(&chunk->cache_stat.free_hit, (int64)cache->free_hit);
+        cache->free_hit = 0;
+    }
+}
+
+static uint32 mes_take_buf_batch(mes_buf_queue_t *queue, mes_buffer_item_t **items, uint32 batch)
+{
+    uint32 count = 0;
+
+    cm_spin_lock(&queue->lock, NULL);
+    while (count < batch && queue->count > 0) {
+        items[count] = queue->first;
+        queue->first = queue->first->next;
+        queue->count--;
+        count++;
+    }
+    if (queue->count == 0) {
+        queue->first = NULL;
+        queue->last = NULL;
+    }
+    cm_spin_unlock(&queue->lock);
+
+    for (uint32 i = 0; i < count; i++) {
+        items[i]->next = NULL;
+    }
+    return count;
+}
+
+static mes_buffer_item_t *mes_alloc_buf_from_cache(mes_buf_chunk_t *chunk)
+{
+    mes_buf_cache_t *cache = mes_get_buf_cache(chunk);
+
+    if (SECUREC_LIKELY(cache->count > 0)) {
+        cache->alloc_hit++;
+        return cache->items[--cache->count];
+    }
+
+    uint32 batch = mes_get_buf_cache_batch();
+    for (uint32 i = 0; i < chunk->queue_num && cache->count == 0; i++) {
+        cache->count = mes_take_buf_batch(mes_get_buffer_queue(chunk), cache->items, batch);
+    }
+
+    if (cache->count == 0) {
+        return NULL;
+    }
+
+    (void)cm_atomic_inc(&chunk->cache_stat.alloc_refill);
+    mes_flush_buf_cache_stat(chunk, cache);
+    mes_buffer_item_t *buf_item = cache->items[--cache->count];
+    mes_report_buf_cache(chunk, cache);
+    return buf_item;
+}
+
+static void mes_drain_buf_cache(mes_buf_chunk_t *chunk, mes_buf_cache_t *cache, mes_buf_queue_t *queue,
+    uint32 batch)
+{
+    mes_buffer_item_t *first = cache->items[0];
+    mes_buffer_item_t *last = cache->items[batch - 1];
+
+    // give back the coldest buffers, they are re-homed to the queue they join
+    for (uint32 i = 0; i < batch; i++) {
+        cache->items[i]->queue_no = queue->queue_no;
+        cache->items[i]->next = (i + 1 < batch) ? cache->items[i + 1] : NULL;
+    }
+
+    cm_spin_lock(&queue->lock, NULL);
+    if (queue->count > 0) {
+        queue->last->next = first;
+    } else {
+        queue->first = first;
+    }
+    queue->last = last;
+    queue->count += batch;
+    cm_spin_unlock(&queue->lock);
+
+    cache->count -= batch;
+    for (uint32 i = 0; i < cache->count; i++) {
+        cache->items[i] = cache->items[i + batch];
+    }
+
+    (void)cm_atomic_inc(&chunk->cache_stat.free_drain);
+    mes_flush_buf_cache_stat(chunk, cache);
+    mes_report_buf_cache(chunk, cache);
+}
+
+static void mes_free_buf_to_cache(mes_buf_chunk_t *chunk, mes_buffer_item_t *buf_item)
+{
+    mes_buf_cache_t *cache = mes_get_buf_cache(chunk);
+
+    if (SECUREC_UNLIKELY(cache->count >= MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_count)) {
+        mes_drain_buf_cache(chunk, cache, &chunk->queues[buf_item->queue_no], mes_get_buf_cache_batch());
+    }
+
+    buf_item->next = NULL;
+    cache->items[cache->count++] = buf_item;
+    cache->free_hit++;
+}
+
+void mes_attach_buf_cache(void)
+{
+    g_mes_buf_cache_attached = CM_TRUE;
+}
+
+void mes_return_buf_cache(void)
+{
+    mes_pool_t *pool = &MES_GLOBAL_INST_MSG.mes_ctx.msg_pool;
+
+    if (!g_mes_buf_cache_attached || pool->cache_count == 0) {
+        return;
+    }
+
+    for (uint32 i = 0; i < pool->count; i++) {
+        mes_buf_cache_t *cache = &g_mes_buf_cache[i];
+        if (cache->gen != pool->cache_gen || cache->count == 0) {
+            continue;
+        }
+        mes_buf_chunk_t *chunk = &pool->chunk[i];
+        mes_drain_buf_cache(chunk, cache, mes_get_buffer_queue(chunk), cache->count);
+    }
+}
+
+void mes_detach_buf_cache(void)
+{
+    mes_return_buf_cache();
+    g_mes_buf_cache_attached = CM_FALSE;
+}
+
 char *mes_alloc_buf_item(uint32 len)
 {
     mes_buf_chunk_t *chunk = NULL;
@@ -251,6 +435,13 @@ char *mes_alloc_buf_item(uint32 len)
         return NULL;
     }
 
+    if (g_mes_buf_cache_attached && MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_count > 0) {
+        buf_node = mes_alloc_buf_from_cache(chunk);
+        if (buf_node != NULL) {
+            return buf_node->data;
+        }
+    }
+
     do {
         queue = mes_get_buffer_queue(chunk);
         cm_spin_lock(&queue->lock, NULL);
@@ -279,12 +470,24 @@ char *mes_alloc_buf_item(uint32 len)
     return buf_node->data;
 }
 
+// free buffers of a chunk, read without the queue locks
+static uint32 mes_get_chunk_free_count(mes_buf_chunk_t *chunk)
+{
+    int64 count = cm_atomic32_get(&chunk->cache_free);
+
+    for (uint32 i = 0; i < chunk->queue_num; i++) {
+        count += chunk->queues[i].count;
+    }
+    return (uint32)MAX(count, 0);
+}
+
+/*
+ * Wait while no more than 1/(RECV_MSG_POOL_FC_THRESHOLD + 1) of the chunk is free, then allocate
+ * like mes_alloc_buf_item. Free buffers in the thread caches count, and the caller's own cache is used.
+ */
 char *mes_alloc_buf_item_fc(uint32 len)
 {
     mes_buf_chunk_t *chunk = NULL;
-    mes_buf_queue_t *queue = NULL;
-    mes_buffer_item_t *buf_node = NULL;
-    uint32 find_times = 0;
 
     chunk = mes_get_buffer_chunk(len);
     if (chunk == NULL) {
@@ -292,43 +495,19 @@ char *mes_alloc_buf_item_fc(uint32 len)
         return NULL;
     }
 
-    uint32_t count = MES_GLOBAL_INST_MSG.profile.buffer_pool_attr.buf_attr[chunk->chunk_no].count / chunk->queue_num;
-
-    do {
-        queue = mes_get_buffer_queue(chunk);
-        cm_spin_lock(&queue->lock, NULL);
-        if (count / queue->count <= RECV_MSG_POOL_FC_THRESHOLD) {
-            buf_node = queue->first;
-            queue->count--;
-            if (queue->count == 0) {
-                queue->first = NULL;
-                queue->last = NULL;
-            } else {
-                queue->first = buf_node->next;
-            }
-            buf_node->next = NULL;
-            cm_spin_unlock(&queue->lock);
-            break;
-        } else {
-            cm_spin_unlock(&queue->lock);
-            find_times++;
-            if ((find_times % chunk->queue_num) == 0) {
-                LOG_RUN_WAR_INHIBIT(LOG_INHIBIT_LEVEL5, "[mes]: There is no buffer, sleep and try again.");
-                cm_sleep(1);
-            }
-        }
-    } while (buf_node == NULL);
-
-    return buf_node->data;
+    uint64 total = MES_GLOBAL_INST_MSG.profile.buffer_pool_attr.buf_attr[chunk->chunk_no].count;
+    while ((uint64)mes_get_chunk_free_count(chunk) * (RECV_MSG_POOL_FC_THRESHOLD + 1) <= total) {
+        LOG_RUN_WAR_INHIBIT(LOG_INHIBIT_LEVEL5, "[mes]: There is no buffer, sleep and try again.");
+        cm_sleep(1);
+    }
+    return mes_alloc_buf_item(len);
 }
 
 static void mes_release_buf_stat(const char *msg_buf)
 {
     if (g_mes_stat.mes_elapsed_switch) {
         mes_message_head_t *head = (mes_message_head_t *)msg_buf;
-        cm_spin_lock(&(g_mes_stat.mes_commond_stat[head->cmd].lock), NULL);
         cm_atomic32_dec(&(g_mes_stat.mes_commond_stat[head->cmd].occupy_buf));
-        cm_spin_unlock(&(g_mes_stat.mes_commond_stat[head->cmd].lock));
         mes_elapsed_stat(head->cmd, MES_TIME_PUT_BUF);
     }
     return;
@@ -344,6 +523,12 @@ void mes_free_buf_item(char *buffer)
     mes_buf_chunk_t *chunk = &MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.chunk[buf_item->chunk_no];
     mes_buf_queue_t *queue = &chunk->queues[buf_item->queue_no];
 
+    if (g_mes_buf_cache_attached && MES_GLOBAL_INST_MSG.mes_ctx.msg_pool.cache_count > 0) {
+        mes_release_buf_stat(buffer);
+        mes_free_buf_to_cache(chunk, buf_item);
+        return;
+    }
+
     cm_spin_lock(&queue->lock, NULL);
     if (queue->count > 0) {
         queue->last->next = buf_item;
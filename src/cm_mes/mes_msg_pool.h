@@ -28,6 +28,7 @@
 #include "mes_type.h"
 #include "cm_defs.h"
 #include "cm_spinlock.h"
+#include "cm_atomic.h"
 #include "cm_error.h"
 
 #ifdef __cplusplus
@@ -35,6 +36,7 @@ extern "C" {
 #endif
 
 #define MES_MAX_BUFFER_QUEUE_NUM (0xFF)
+#define MES_MAX_BUF_CACHE_COUNT (64)
 
 typedef struct st_mes_buffer_item {
     struct st_mes_buffer_item *next;
@@ -62,6 +64,23 @@ typedef struct st_mes_buf_queue {
     char *addr;
 } mes_buf_queue_t;
 
+typedef struct st_mes_buf_cache_counter {
+    atomic_t alloc_hit;
+    atomic_t alloc_refill;
+    atomic_t free_hit;
+    atomic_t free_drain;
+} mes_buf_cache_counter_t;
+
+// per-thread magazine of free buffers, refilled from and drained to the chunk queues in batches
+typedef struct st_mes_buf_cache {
+    uint32 gen;
+    uint32 count;
+    uint32 alloc_hit;
+    uint32 free_hit;
+    uint32 reported; // count last added to cache_free of the chunk
+    mes_buffer_item_t *items[MES_MAX_BUF_CACHE_COUNT];
+} mes_buf_cache_t;
+
 typedef struct st_mes_buf_chunk {
     uint32 buf_size;
     uint8 chunk_no;
@@ -69,6 +88,8 @@ typedef struct st_mes_buf_chunk {
     volatile uint8 current_no;
     uint8 reserved;
     mes_buf_queue_t *queues;
+    mes_buf_cache_counter_t cache_stat;
+    atomic32_t cache_free; // free buffers in thread caches, brought up to date on every refill and drain
 } mes_buf_chunk_t;
 
 typedef struct st_message_pool {
@@ -94,6 +115,13 @@ void mes_destory_buffer_chunk(mes_buf_chunk_t *chunk);
 char *mes_alloc_buf_item(uint32 len);
 char *mes_alloc_buf_item_fc(uint32 len);
 void mes_free_buf_item(char *buffer);
+/*
+ * The per-thread buffer cache is used by attached threads only. They give the cached buffers back
+ * before they idle for long and detach before they exit, so that no buffer is stranded.
+ */
+void mes_attach_buf_cache(void);
+void mes_return_buf_cache(void);
+void mes_detach_buf_cache(void);
 
 #ifdef __cplusplus
 }
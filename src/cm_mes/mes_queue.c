@@ -29,6 +29,16 @@
 
 #define MSG_QUEUE_THRESHOLD 100
 
+// where a work thread continues in its group, kept on the stack of each work thread
+typedef struct st_mes_task_cursor {
+    uint32 pop_cursor;
+    uint32 served[MES_PRIORITY_CEIL]; // messages taken from each lane since the lane below got one
+} mes_task_cursor_t;
+
+static const mes_priority_t g_mes_lane_order[MES_PRIORITY_CEIL] = {
+    MES_PRIORITY_HIGH, MES_PRIORITY_NORMAL, MES_PRIORITY_LOW
+};
+
 static int mes_alloc_msgitems_by_freelist(mes_msgitem_pool_t *pool, mes_msgqueue_t *msgitems)
 {
     if (pool->free_list.count < MSG_ITEM_BATCH_SIZE) {
@@ -54,10 +64,30 @@ static int mes_alloc_msgitems_by_freelist(mes_msgitem_pool_t *pool, mes_msgqueue
     return CM_SUCCESS;
 }
 
+static bool32 mes_alloc_msgitems_by_ring(mes_msgitem_pool_t *pool, mes_msgqueue_t *msgitems)
+{
+    mes_msgitem_t *item = (mes_msgitem_t *)cm_ring_pop(&pool->free_ring);
+    if (item == NULL) {
+        return CM_FALSE;
+    }
+
+    msgitems->first = item;
+    for (uint32 loop = 0; loop < MSG_ITEM_BATCH_SIZE - 1; loop++) {
+        item = item->next;
+    }
+    msgitems->last = item;
+    msgitems->count = MSG_ITEM_BATCH_SIZE;
+    return CM_TRUE;
+}
+
 int mes_alloc_msgitems(mes_msgitem_pool_t *pool, mes_msgqueue_t *msgitems)
 {
     mes_msgitem_t *item;
 
+    if (cm_ring_inited(&pool->free_ring) && mes_alloc_msgitems_by_ring(pool, msgitems)) {
+        return CM_SUCCESS;
+    }
+
     cm_spin_lock(&pool->free_list.lock, NULL);
     if (pool->free_list.count == 0) {
         cm_spin_unlock(&pool->free_list.lock);
@@ -194,6 +224,11 @@ void mes_free_msgitem_pool(mes_msgitem_pool_t *pool)
 
 void mes_put_msgitem(mes_msgqueue_t *queue, mes_msgitem_t *msgitem)
 {
+    // once the ring overflowed, items follow the older ones into the list until it drains
+    if (cm_ring_inited(&queue->ring) && queue->count == 0 && cm_ring_push(&queue->ring, msgitem)) {
+        return;
+    }
+
     cm_spin_lock(&queue->lock, NULL);
     if (queue->count == 0) {
         queue->first = msgitem;
@@ -208,7 +243,57 @@ void mes_put_msgitem(mes_msgqueue_t *queue, mes_msgitem_t *msgitem)
     cm_spin_unlock(&queue->lock);
 }
 
-void mes_init_msg_queue(void)
+static int mes_init_msg_ring(void)
+{
+    mes_task_group_t *group = NULL;
+    uint32 size = MES_GLOBAL_INST_MSG.profile.task_queue_size;
+
+    if (size == 0) {
+        return CM_SUCCESS;
+    }
+
+    for (uint32 i = 0; i < MES_TASK_GROUP_ALL; i++) {
+        group = &MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i];
+        for (uint32 j = 0; j < MES_GROUP_QUEUE_NUM; j++) {
+            if (cm_ring_init(&group->queue[j].ring, size) != CM_SUCCESS) {
+                LOG_RUN_ERR("[mes]: init ring of group %u queue %u failed, size %u.", i, j, size);
+                return ERR_MES_MALLOC_FAIL;
+            }
+        }
+        for (uint32 j = 0; j < MES_PRIORITY_CEIL; j++) {
+            if (cm_ring_init(&group->lane_queue[j].ring, size) != CM_SUCCESS) {
+                LOG_RUN_ERR("[mes]: init ring of group %u lane %u failed, size %u.", i, j, size);
+                return ERR_MES_MALLOC_FAIL;
+            }
+        }
+        if (cm_ring_init(&group->steal_queue.ring, size) != CM_SUCCESS) {
+            LOG_RUN_ERR("[mes]: init ring of group %u steal queue failed, size %u.", i, size);
+            return ERR_MES_MALLOC_FAIL;
+        }
+    }
+
+    if (cm_ring_init(&MES_GLOBAL_INST_MSG.mq_ctx.pool.free_ring, MES_FREE_BATCH_RING_SIZE) != CM_SUCCESS) {
+        LOG_RUN_ERR("[mes]: init msgitem free ring failed.");
+        return ERR_MES_MALLOC_FAIL;
+    }
+    return CM_SUCCESS;
+}
+
+void mes_free_msg_queue(void)
+{
+    for (uint32 i = 0; i < MES_TASK_GROUP_ALL; i++) {
+        for (uint32 j = 0; j < MES_GROUP_QUEUE_NUM; j++) {
+            cm_ring_destroy(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i].queue[j].ring);
+        }
+        for (uint32 j = 0; j < MES_PRIORITY_CEIL; j++) {
+            cm_ring_destroy(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i].lane_queue[j].ring);
+        }
+        cm_ring_destroy(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i].steal_queue.ring);
+    }
+    cm_ring_destroy(&MES_GLOBAL_INST_MSG.mq_ctx.pool.free_ring);
+}
+
+int mes_init_msg_queue(void)
 {
     uint32 loop;
     uint32 queueIdx;
@@ -221,11 +306,21 @@ void mes_init_msg_queue(void)
         for (queueIdx = 0; queueIdx < MES_GROUP_QUEUE_NUM; queueIdx++) {
             mes_init_msgqueue(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[loop].queue[queueIdx]);
         }
+        for (queueIdx = 0; queueIdx < MES_PRIORITY_CEIL; queueIdx++) {
+            mes_init_msgqueue(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[loop].lane_queue[queueIdx]);
+        }
+        mes_init_msgqueue(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[loop].steal_queue);
+        cm_park_init(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[loop].park);
     }
 
     mes_init_msgqueue(&MES_GLOBAL_INST_MSG.mq_ctx.local_queue);
     mes_init_msgitem_pool(&MES_GLOBAL_INST_MSG.mq_ctx.pool);
-    return;
+    return mes_init_msg_ring();
+}
+
+static inline uint32 mes_get_group_queue_num(const mes_task_group_t *group)
+{
+    return group->task_num > MES_GROUP_QUEUE_NUM ? MES_GROUP_QUEUE_NUM : group->task_num;
 }
 
 mes_msgqueue_t *mes_get_command_task_queue(const mes_message_head_t *head)
@@ -234,23 +329,90 @@ mes_msgqueue_t *mes_get_command_task_queue(const mes_message_head_t *head)
     mes_task_group_id_t group_id;
     uint32 queue_id;
     uint32 queue_num;
+    mes_command_attr_t *attr = &MES_GLOBAL_INST_MSG.mq_ctx.command_attr[head->cmd];
 
-    group_id = MES_GLOBAL_INST_MSG.mq_ctx.command_attr[head->cmd].group_id;
+    group_id = attr->group_id;
     mes_task_group_t* group = &MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[group_id];
-    queue_num = group->task_num > MES_GROUP_QUEUE_NUM ? MES_GROUP_QUEUE_NUM : group->task_num;
+    if (MES_STEAL_ENABLED && attr->stealable) {
+        return &group->steal_queue;
+    }
+    if (attr->priority != MES_PRIORITY_NORMAL) {
+        return &group->lane_queue[attr->priority];
+    }
+    queue_num = mes_get_group_queue_num(group);
     queue_id = (group->push_cursor++) % queue_num;
     queue = &group->queue[queue_id];
 
     return queue;
 }
 
+static inline void mes_wakeup_task_group(mes_task_group_t *group)
+{
+    if (MES_GLOBAL_INST_MSG.profile.task_wait_mode == MES_TASK_WAIT_PARK) {
+        cm_park_wake(&group->park, 1);
+    }
+}
+
+static mes_task_group_t *mes_get_queue_task_group(const mes_msgqueue_t *queue)
+{
+    mes_task_group_t *group;
+
+    for (uint32 i = 0; i < MES_TASK_GROUP_ALL; i++) {
+        group = &MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i];
+        if (queue >= &group->queue[0] && queue <= &group->steal_queue) {
+            return group;
+        }
+    }
+    return NULL;
+}
+
+void mes_wakeup_task_groups(void)
+{
+    for (uint32 i = 0; i < MES_TASK_GROUP_ALL; i++) {
+        cm_park_wake(&MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i].park, CM_MES_MAX_TASK_NUM);
+    }
+}
+
+// all work threads of the group are busy, let a parked one of another group steal the message
+static void mes_wakeup_thief(const mes_task_group_t *group)
+{
+    mes_task_group_t *thief = NULL;
+
+    if (cm_atomic32_get((atomic32_t *)&group->park.waiters) > 0) {
+        return;
+    }
+    for (uint32 i = 0; i < MES_TASK_GROUP_ALL; i++) {
+        thief = &MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i];
+        if (thief != group && thief->is_set && cm_atomic32_get(&thief->park.waiters) > 0) {
+            cm_park_wake(&thief->park, 1);
+            return;
+        }
+    }
+}
+
+static inline void mes_put_msgitem_and_wakeup(mes_msgqueue_t *queue, mes_msgitem_t *msgitem)
+{
+    msgitem->enqueue_time = 0;
+    mes_get_consume_time_start(&msgitem->enqueue_time);
+    mes_put_msgitem(queue, msgitem);
+
+    mes_task_group_t *group = mes_get_queue_task_group(queue);
+    if (group != NULL) {
+        mes_wakeup_task_group(group);
+        if (MES_STEAL_ENABLED && queue == &group->steal_queue &&
+            MES_GLOBAL_INST_MSG.profile.task_wait_mode == MES_TASK_WAIT_PARK) {
+            mes_wakeup_thief(group);
+        }
+    }
+}
+
 void mes_put_msgitem_enqueue(mes_msgitem_t *msgitem)
 {
     mes_msgqueue_t *queue;
 
     queue = mes_get_command_task_queue(msgitem->msg.head);
 
-    mes_put_msgitem(queue, msgitem);
+    mes_put_msgitem_and_wakeup(queue, msgitem);
 
     return;
 }
@@ -269,7 +431,7 @@ int mes_put_inter_msg_in_queue(mes_message_t *msg, mes_msgqueue_t *queue)
     msgitem->msg.head = msg->head;
     msgitem->msg.buffer = msg->buffer;
 
-    mes_put_msgitem(queue, msgitem);
+    mes_put_msgitem_and_wakeup(queue, msgitem);
 
     return CM_SUCCESS;
 }
@@ -306,10 +468,32 @@ mes_task_group_t *mes_get_task_group(uint32 task_index)
     return NULL;
 }
 
-static mes_msgitem_t *mes_get_msgitem(mes_msgqueue_t *queue)
+uint32 mes_get_group_depth(const mes_task_group_t *group)
+{
+    uint32 depth = mes_msgqueue_count(&group->steal_queue);
+
+    for (uint32 i = 0; i < MES_PRIORITY_CEIL; i++) {
+        depth += mes_msgqueue_count(&group->lane_queue[i]);
+    }
+
+    for (uint32 i = 0; i < MES_GROUP_QUEUE_NUM; i++) {
+        depth += mes_msgqueue_count(&group->queue[i]);
+    }
+    return depth;
+}
+
+// items in the ring are older than the ones in the list, so the ring goes first
+mes_msgitem_t *mes_get_msgitem(mes_msgqueue_t *queue)
 {
     mes_msgitem_t *ret = NULL;
 
+    if (cm_ring_inited(&queue->ring)) {
+        ret = (mes_msgitem_t *)cm_ring_pop(&queue->ring);
+        if (ret != NULL || queue->count == 0) {
+            return ret;
+        }
+    }
+
     cm_spin_lock(&queue->lock, NULL);
     if (queue->count > 0) {
         ret = queue->first;
@@ -334,8 +518,12 @@ static mes_msgitem_t *mes_get_task_msg(mes_task_group_t *group, uint32 queue_id)
         return msgitem;
     }
 
-    if (msg_queue->count > MSG_QUEUE_THRESHOLD) {
-        LOG_RUN_INF("[mes]: group %u queue %u length num %u.", group->group_id, queue_id, msg_queue->count);
+    uint32 count = mes_msgqueue_count(msg_queue);
+    if (count > group->max_depth) {
+        group->max_depth = count;
+    }
+    if (count > MSG_QUEUE_THRESHOLD) {
+        LOG_RUN_INF("[mes]: group %u queue %u length num %u.", group->group_id, queue_id, count);
     }
 
     return msgitem;
@@ -343,6 +531,12 @@ static mes_msgitem_t *mes_get_task_msg(mes_task_group_t *group, uint32 queue_id)
 
 static void mes_free_msgitems(mes_msgitem_pool_t *pool, mes_msgqueue_t *msgitems)
 {
+    if (cm_ring_inited(&pool->free_ring) && msgitems->count == MSG_ITEM_BATCH_SIZE &&
+        cm_ring_push(&pool->free_ring, msgitems->first)) {
+        mes_init_msgqueue(msgitems);
+        return;
+    }
+
     cm_spin_lock(&pool->free_list.lock, NULL);
     if (pool->free_list.count > 0) {
         pool->free_list.last->next = msgitems->first;
@@ -357,15 +551,186 @@ static void mes_free_msgitems(mes_msgitem_pool_t *pool, mes_msgqueue_t *msgitems
     mes_init_msgqueue(msgitems);
 }
 
+static bool32 mes_task_group_has_msg(const mes_task_group_t *group, uint32 queue_num)
+{
+    if (mes_msgqueue_count(&group->steal_queue) > 0) {
+        return CM_TRUE;
+    }
+    for (uint32 i = 0; i < MES_PRIORITY_CEIL; i++) {
+        if (mes_msgqueue_count(&group->lane_queue[i]) > 0) {
+            return CM_TRUE;
+        }
+    }
+    for (uint32 i = 0; i < queue_num; i++) {
+        if (mes_msgqueue_count(&group->queue[i]) > 0) {
+            return CM_TRUE;
+        }
+    }
+    return CM_FALSE;
+}
+
+// the other group with the most waiting messages which may be stolen, only its steal queue is taken from
+static mes_task_group_t *mes_get_steal_victim(const mes_task_group_t *group)
+{
+    uint32 depth;
+    uint32 max_depth = 0;
+    mes_task_group_t *victim = NULL;
+    mes_task_group_t *candidate = NULL;
+
+    for (uint32 i = 0; i < MES_TASK_GROUP_ALL; i++) {
+        candidate = &MES_GLOBAL_INST_MSG.mq_ctx.group.task_group[i];
+        if (candidate == group || !candidate->is_set) {
+            continue;
+        }
+        depth = mes_msgqueue_count(&candidate->steal_queue);
+        if (depth > max_depth) {
+            max_depth = depth;
+            victim = candidate;
+        }
+    }
+    return victim;
+}
+
+static void mes_task_wait(thread_t *thread, mes_task_group_t *group, uint32 queue_num, uint32 *idle_rounds)
+{
+    if (MES_GLOBAL_INST_MSG.profile.task_wait_mode != MES_TASK_WAIT_PARK) {
+        mes_return_buf_cache();
+        cm_sleep(1);
+        return;
+    }
+
+    if (*idle_rounds < MES_GLOBAL_INST_MSG.profile.task_spin_count) {
+        (*idle_rounds)++;
+        fas_cpu_pause();
+        return;
+    }
+
+    uint32 seq = cm_park_prepare(&group->park);
+    if (thread->closed || mes_task_group_has_msg(group, queue_num) ||
+        (MES_STEAL_ENABLED && mes_get_steal_victim(group) != NULL)) {
+        cm_park_cancel(&group->park);
+        return;
+    }
+    mes_return_buf_cache();
+    cm_park_wait(&group->park, seq, MES_TASK_PARK_TIMEOUT);
+}
+
+static mes_msgitem_t *mes_get_normal_msg(mes_task_group_t *group, uint32 queue_num, mes_task_cursor_t *cursor)
+{
+    mes_msgitem_t *msgitem = NULL;
+    uint32 queue_id;
+
+    for (uint32 loop = 0; loop < queue_num; ++loop) {
+        queue_id = (cursor->pop_cursor + loop) % queue_num;
+        msgitem = mes_get_task_msg(group, queue_id);
+        if (msgitem != NULL) {
+            cursor->pop_cursor = queue_id + 1;
+            return msgitem;
+        }
+    }
+    return NULL;
+}
+
+// lanes from the highest priority down, a lane which used up its weight lets the lanes below go first once
+static mes_msgitem_t *mes_get_lane_msg(mes_task_group_t *group, uint32 queue_num, mes_task_cursor_t *cursor,
+    uint32 from)
+{
+    mes_msgitem_t *msgitem = NULL;
+    uint32 weight = MES_GLOBAL_INST_MSG.profile.priority_weight;
+
+    for (uint32 i = from; i < MES_PRIORITY_CEIL; i++) {
+        if (weight > 0 && cursor->served[i] >= weight) {
+            cursor->served[i] = 0;
+            msgitem = mes_get_lane_msg(group, queue_num, cursor, i + 1);
+            if (msgitem != NULL) {
+                return msgitem;
+            }
+        }
+
+        msgitem = (g_mes_lane_order[i] == MES_PRIORITY_NORMAL) ? mes_get_normal_msg(group, queue_num, cursor) :
+            mes_get_msgitem(&group->lane_queue[g_mes_lane_order[i]]);
+        if (msgitem != NULL) {
+            cursor->served[i]++;
+            return msgitem;
+        }
+    }
+    return NULL;
+}
+
+static mes_msgitem_t *mes_get_group_msg(mes_task_group_t *group, uint32 queue_num, mes_task_cursor_t *cursor)
+{
+    mes_msgitem_t *msgitem = NULL;
+
+    if (MES_STEAL_ENABLED) {
+        msgitem = mes_get_msgitem(&group->steal_queue);
+        if (msgitem != NULL) {
+            return msgitem;
+        }
+    }
+
+    if (MES_LANE_ENABLED) {
+        return mes_get_lane_msg(group, queue_num, cursor, 0);
+    }
+    return mes_get_normal_msg(group, queue_num, cursor);
+}
+
+static void mes_task_process_msg(uint32 index, mes_msgitem_t *msgitem, uint64 get_start_time,
+    mes_msgqueue_t *finished_msgitem_queue)
+{
+    uint64 start_stat_time = 0;
+
+    mes_queue_wait_stat(msgitem->msg.head->cmd, msgitem->enqueue_time);
+    mes_consume_with_time(msgitem->msg.head->cmd, MES_TIME_GET_QUEUE, get_start_time);
+    mes_get_consume_time_start(&start_stat_time);
+
+    mes_dispatch_message(index, &msgitem->msg);
+
+    mes_consume_with_time(msgitem->msg.head->cmd, MES_TIME_QUEUE_PROC, start_stat_time);
+    mes_put_msgitem_nolock(finished_msgitem_queue, msgitem);
+    if (MSG_ITEM_BATCH_SIZE == finished_msgitem_queue->count) {
+        mes_free_msgitems(&MES_GLOBAL_INST_MSG.mq_ctx.pool, finished_msgitem_queue);
+    }
+}
+
+// take a batch from the queues of the busiest other group, return the number of messages processed
+static uint32 mes_steal_task_msg(uint32 index, mes_task_group_t *group, mes_msgqueue_t *finished_msgitem_queue)
+{
+    uint32 count = 0;
+    uint64 start_stat_time = 0;
+    mes_msgitem_t *msgitems[MES_MAX_STEAL_BATCH];
+    mes_task_group_t *victim = mes_get_steal_victim(group);
+
+    if (victim == NULL) {
+        return 0;
+    }
+
+    mes_get_consume_time_start(&start_stat_time);
+    while (count < MES_GLOBAL_INST_MSG.profile.task_steal_batch &&
+        (msgitems[count] = mes_get_msgitem(&victim->steal_queue)) != NULL) {
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    (void)cm_atomic_add(&victim->steal_out, (int64)count);
+    (void)cm_atomic_add(&group->steal_in, (int64)count);
+    // run under our own index, per work thread contexts of the callers must never be shared by two threads
+    for (uint32 i = 0; i < count; i++) {
+        mes_task_process_msg(index, msgitems[i], start_stat_time, finished_msgitem_queue);
+    }
+    return count;
+}
+
 void mes_task_proc(thread_t *thread)
 {
     char thread_name[CM_MAX_THREAD_NAME_LEN];
     uint32 index = *(uint32 *)thread->argument;
     mes_msgitem_t *msgitem;
     mes_task_group_t *group;
-    uint32 loop;
-    uint32 queue_id = 0;
+    mes_task_cursor_t cursor = { 0 };
     uint32 queue_num;
+    uint32 idle_rounds = 0;
 
     PRTS_RETVOID_IFERR(sprintf_s(thread_name, CM_MAX_THREAD_NAME_LEN, "mes_task_proc_%u", index));
     cm_set_thread_name(thread_name);
@@ -385,36 +750,27 @@ void mes_task_proc(thread_t *thread)
         return;
     }
 
-    queue_num = group->task_num > MES_GROUP_QUEUE_NUM ? MES_GROUP_QUEUE_NUM : group->task_num;
+    queue_num = mes_get_group_queue_num(group);
+    // every work thread keeps its own cursor, starting from a different queue
+    cursor.pop_cursor = index - group->start_task_idx;
+    mes_attach_buf_cache();
 
     while (!thread->closed) {
         uint64 start_stat_time = 0;
         mes_get_consume_time_start(&start_stat_time);
-        queue_id = (group->pop_cursor) % queue_num;
-        msgitem = mes_get_task_msg(group, queue_id);
-
-        for (loop = 0; msgitem == NULL && loop < queue_num; ++loop) {
-            queue_id = (queue_id + 1) % queue_num;
-            msgitem = mes_get_task_msg(group, queue_id);
-        }
-
+        msgitem = mes_get_group_msg(group, queue_num, &cursor);
         if (msgitem == NULL) {
-            cm_sleep(1);
+            if (MES_STEAL_ENABLED && mes_steal_task_msg(index, group, &finished_msgitem_queue) > 0) {
+                idle_rounds = 0;
+                continue;
+            }
+            mes_task_wait(thread, group, queue_num, &idle_rounds);
             continue;
         }
 
-        group->pop_cursor = queue_id + 1;
-
-        mes_consume_with_time(msgitem->msg.head->cmd, MES_TIME_GET_QUEUE, start_stat_time);
-        mes_get_consume_time_start(&start_stat_time);
-
-        MES_GLOBAL_INST_MSG.proc(index, &msgitem->msg);
-
-        mes_consume_with_time(msgitem->msg.head->cmd, MES_TIME_QUEUE_PROC, start_stat_time);
-        mes_put_msgitem_nolock(&finished_msgitem_queue, msgitem);
-        if (MSG_ITEM_BATCH_SIZE == finished_msgitem_queue.count) {
-            mes_free_msgitems(&MES_GLOBAL_INST_MSG.mq_ctx.pool, &finished_msgitem_queue);
-        }
+        idle_rounds = 0;
+        mes_task_process_msg(index, msgitem, start_stat_time, &finished_msgitem_queue);
     }
+    mes_detach_buf_cache();
     return;
 }
@@ -30,6 +30,8 @@
 #include "cm_spinlock.h"
 #include "cm_error.h"
 #include "cm_thread.h"
+#include "cm_sync.h"
+#include "cm_ring.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,10 +42,17 @@ extern "C" {
 #define INIT_MSGITEM_BUFFER_SIZE 8192
 #define MAX_POOL_BUFFER_COUNT 8192
 #define MES_MSG_QUEUE_NUM (1)
+#define MES_FREE_BATCH_RING_SIZE (4096) // batches of MSG_ITEM_BATCH_SIZE free msgitems
+
+#define MES_TASK_PARK_TIMEOUT (100) // ms
+#define MES_MAX_STEAL_BATCH (64)
+#define MES_STEAL_ENABLED (MES_GLOBAL_INST_MSG.profile.task_steal_batch > 0)
+#define MES_LANE_ENABLED (MES_GLOBAL_INST_MSG.mq_ctx.lane_enabled)
 
 typedef struct st_mes_msgitem {
     mes_message_t msg;
     struct st_mes_msgitem *next;
+    uint64 enqueue_time;
 } mes_msgitem_t;
 
 #ifdef WIN32
@@ -56,6 +65,7 @@ typedef struct __attribute__((aligned(128))) st_mes_msgqueue
     volatile uint32 count;
     mes_msgitem_t *first;
     mes_msgitem_t *last;
+    cm_ring_t ring; // lock-free part of task queues, the list above takes the overflow
 } mes_msgqueue_t;
 
 typedef struct st_mes_msgitem_pool {
@@ -66,6 +76,7 @@ typedef struct st_mes_msgitem_pool {
     uint16 unused;
 
     mes_msgqueue_t free_list;
+    cm_ring_t free_ring; // first msgitem of each free batch, tried before free_list
 } mes_msgitem_pool_t;
 
 typedef struct st_mes_task_context {
@@ -83,8 +94,13 @@ typedef struct st_mes_task_group {
     uint8 reserved;
     mes_task_group_id_t group_id;
     mes_msgqueue_t queue[MES_GROUP_QUEUE_NUM];
+    mes_msgqueue_t lane_queue[MES_PRIORITY_CEIL]; // high and low priority commands, normal ones use queue
+    mes_msgqueue_t steal_queue; // commands which other groups may process, used only when stealing is enabled
     uint32_t push_cursor;
-    uint32_t pop_cursor;
+    cm_park_t park; // idle work threads of MES_TASK_WAIT_PARK
+    atomic_t steal_in;
+    atomic_t steal_out;
+    volatile uint32 max_depth;
 } mes_task_group_t;
 
 typedef struct st_mes_mq_group {
@@ -94,12 +110,15 @@ typedef struct st_mes_mq_group {
 
 typedef struct st_mes_command_attr {
     mes_task_group_id_t group_id;
+    bool8 stealable; // may be processed by idle work threads of other groups
+    uint8 priority; // mes_priority_t
 } mes_command_attr_t;
 
 typedef struct st_mq_context_t {
     uint32 task_num;
     mes_task_context_t tasks[CM_MES_MAX_TASK_NUM]; // mes task thread
     mes_command_attr_t command_attr[CM_MAX_MES_MSG_CMD];
+    volatile bool32 lane_enabled; // some command is not MES_PRIORITY_NORMAL
     mes_msgitem_pool_t pool;
     mes_mq_group_t group;
     mes_msgqueue_t local_queue; // used for local message
@@ -109,9 +128,15 @@ void mes_init_msgitem_pool(mes_msgitem_pool_t *pool);
 void mes_free_msgitem_pool(mes_msgitem_pool_t *pool);
 void mes_init_msgqueue(mes_msgqueue_t *queue);
 void mes_put_msgitem(mes_msgqueue_t *queue, mes_msgitem_t *msgitem);
+mes_msgitem_t *mes_get_msgitem(mes_msgqueue_t *queue);
+
+static inline uint32 mes_msgqueue_count(const mes_msgqueue_t *queue)
+{
+    return queue->count + (cm_ring_inited(&queue->ring) ? cm_ring_count(&queue->ring) : 0);
+}
 
 void mes_task_proc(thread_t *thread);
-void mes_init_msg_queue(void);
+int mes_init_msg_queue(void);
 void mes_free_msg_queue(void);
 int mes_put_inter_msg(mes_message_t *msg);
 int mes_put_inter_msg_in_queue(mes_message_t *msg, mes_msgqueue_t *queue);
@@ -120,6 +145,8 @@ mes_msgitem_t *mes_alloc_msgitem_nolock(mes_msgqueue_t *queue);
 mes_msgitem_t *mes_alloc_msgitem(mes_msgqueue_t *queue);
 mes_msgqueue_t *mes_get_command_task_queue(const mes_message_head_t *head);
 mes_task_group_t *mes_get_task_group(uint32 task_index);
+uint32 mes_get_group_depth(const mes_task_group_t *group);
+void mes_wakeup_task_groups(void);
 int mes_alloc_msgitems(mes_msgitem_pool_t *pool, mes_msgqueue_t *msgitems);
 
 #ifdef __cplusplus
@@ -368,7 +368,7 @@ int mes_start_rdma_rpc_lsnr(void)
 static void mes_rdma_rpc_default_proc_func(OckRpcServerContext handle, OckRpcMessage msg)
 {
     mes_message_head_t* head = (mes_message_head_t*)msg.data;
-    uint32_t channel_id = MES_SESSION_TO_CHANNEL_ID(head->src_sid);
+    uint32_t channel_id = mes_get_send_channel_id(head);
     mes_channel_t *channel = &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->src_inst][channel_id];
     mes_msgqueue_t *my_queue = &channel->msg_queue;
 
@@ -760,7 +760,7 @@ int mes_rdma_rpc_send_data(const void* msg_data)
 {
     int ret;
     mes_message_head_t *head = (mes_message_head_t *)msg_data;
-    uint32_t channel_id = MES_SESSION_TO_CHANNEL_ID(head->src_sid);
+    uint32_t channel_id = mes_get_send_channel_id(head);
     mes_channel_t* channel = &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][channel_id];
 
     cm_rwlock_wlock(&channel->send_lock);
@@ -816,7 +816,7 @@ int mes_rdma_rpc_send_bufflist(mes_bufflist_t *buff_list)
     int ret;
     mes_message_head_t *head = (mes_message_head_t *)((void*)buff_list->buffers[0].buf);
 
-    uint32_t channel_id = MES_SESSION_TO_CHANNEL_ID(head->src_sid);
+    uint32_t channel_id = mes_get_send_channel_id(head);
     mes_channel_t* channel = &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][channel_id];
 
     cm_rwlock_wlock(&channel->send_lock);
@@ -31,11 +31,24 @@
 #include "cm_spinlock.h"
 #include "cm_rwlock.h"
 #include "cs_tcp.h"
+#include "cm_epoll.h"
 #include "mes_cb.h"
 
 #define MES_HOST_NAME(id) ((char *)MES_GLOBAL_INST_MSG.profile.inst_net_addr[id].ip)
 #define MES_CHANNEL_TIMEOUT (50)
 #define MES_CONNECT_TIMEOUT (2000) // mill-seconds
+#define MES_SEND_COALESCE_MSG_SIZE (SIZE_K(2))   // larger messages are never coalesced
+#define MES_SEND_COALESCE_BUF_SIZE (SIZE_K(32))
+#define MES_MIN_RECV_BUF_SIZE (SIZE_K(4))
+#define MES_REACTOR_EVENT_NUM (64)
+#define MES_REACTOR_MAX_ROUNDS (16) // messages handled for one channel before serving the others
+#define MES_REACTOR_MODE (MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt > 0)
+#define MES_COALESCE_MODE (MES_GLOBAL_INST_MSG.profile.send_coalesce_us > 0)
+// the timer ticks twice per interval and a channel idle for one tick gets a heartbeat, so no gap exceeds the interval
+#define MES_HEARTBEAT_PERIOD ((uint32)(MES_HEARTBEAT_INTERVAL * MILLISECS_PER_SECOND / 2)) // ms
+
+static atomic32_t g_mes_coalesce_pending = 0; // channels holding staged messages
+static atomic32_t g_mes_heartbeat_due = 0; // set by the heartbeat timer, cleared by the flusher thread
 
 // channel
 int mes_alloc_channels(void)
@@ -88,13 +101,8 @@ int mes_alloc_channels(void)
     return CM_SUCCESS;
 }
 
-static int mes_read_message_head(cs_pipe_t *pipe, mes_message_head_t *head)
+static int mes_check_message_head(const mes_message_head_t *head)
 {
-    if (cs_read_fixed_size(pipe, (char *)head, sizeof(mes_message_head_t)) != CM_SUCCESS) {
-        LOG_RUN_ERR("mes read message head failed.");
-        return ERR_MES_READ_MSG_FAIL;
-    }
-
     if (SECUREC_UNLIKELY(head->size < sizeof(mes_message_head_t) || head->size > MES_MESSAGE_BUFFER_SIZE)) {
         MES_LOG_ERR_HEAD_EX(head, "message head size invalid or message length excced");
         return ERR_MES_READ_MSG_FAIL;
@@ -107,6 +115,16 @@ static int mes_read_message_head(cs_pipe_t *pipe, mes_message_head_t *head)
     return CM_SUCCESS;
 }
 
+static int mes_read_message_head(cs_pipe_t *pipe, mes_message_head_t *head)
+{
+    if (cs_read_fixed_size(pipe, (char *)head, sizeof(mes_message_head_t)) != CM_SUCCESS) {
+        LOG_RUN_ERR("mes read message head failed.");
+        return ERR_MES_READ_MSG_FAIL;
+    }
+
+    return mes_check_message_head(head);
+}
+
 static int mes_get_message_buf(mes_message_t *msg, const mes_message_head_t *head)
 {
     uint64 stat_time = 0;
@@ -121,6 +139,28 @@ static int mes_get_message_buf(mes_message_t *msg, const mes_message_head_t *hea
     return CM_SUCCESS;
 }
 
+// channels of all instances are laid out in one array, the flat index decides the owner reactor
+static inline mes_reactor_t *mes_get_channel_reactor(const mes_channel_t *channel)
+{
+    uint32 idx = (uint32)(channel - MES_GLOBAL_INST_MSG.mes_ctx.channels[0]);
+    return &MES_GLOBAL_INST_MSG.mes_ctx.reactors[idx % MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt];
+}
+
+static int mes_reactor_ctl(mes_channel_t *channel, int op)
+{
+    struct epoll_event ev;
+    mes_reactor_t *reactor = mes_get_channel_reactor(channel);
+
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = (void *)channel;
+    if (epoll_ctl(reactor->epfd, op, (int)cs_get_socket_fd(&channel->recv_pipe), &ev) != 0) {
+        LOG_RUN_ERR("[mes]: reactor %u epoll ctl %d failed, channel %d, os error %d", reactor->id, op,
+            channel->id, cm_get_os_error());
+        return ERR_MES_EPOLL_INIT_FAIL;
+    }
+    return CM_SUCCESS;
+}
+
 static void mes_close_recv_pipe(mes_channel_t *channel)
 {
     cm_rwlock_wlock(&channel->recv_lock);
@@ -128,8 +168,18 @@ static void mes_close_recv_pipe(mes_channel_t *channel)
         cm_rwlock_unlock(&channel->recv_lock);
         return;
     }
+    if (MES_REACTOR_MODE) {
+        (void)mes_reactor_ctl(channel, EPOLL_CTL_DEL);
+    }
     cs_disconnect(&channel->recv_pipe);
     channel->recv_pipe_active = CM_FALSE;
+    channel->recv_read_pos = 0;
+    channel->recv_write_pos = 0;
+    if (channel->recv_frame != NULL) {
+        mes_free_buf_item(channel->recv_frame);
+        channel->recv_frame = NULL;
+        channel->recv_frame_pos = 0;
+    }
     cm_rwlock_unlock(&channel->recv_lock);
     return;
 }
@@ -179,6 +229,188 @@ static int mes_process_event(mes_channel_t *channel)
     return CM_SUCCESS;
 }
 
+static int mes_alloc_recv_buf(mes_channel_t *channel)
+{
+    uint32 size = MAX(MES_GLOBAL_INST_MSG.profile.recv_buf_size, MES_MIN_RECV_BUF_SIZE);
+
+    channel->recv_buf = (char *)malloc(size);
+    if (channel->recv_buf == NULL) {
+        LOG_RUN_ERR("[mes]: allocate recv buffer failed, channel %d, size %u", channel->id, size);
+        return ERR_MES_MALLOC_FAIL;
+    }
+    channel->recv_buf_size = size;
+    channel->recv_read_pos = 0;
+    channel->recv_write_pos = 0;
+    return CM_SUCCESS;
+}
+
+/*
+ * The frame is not complete in the read buffer. The received part moves into the message buffer and
+ * the rest is read straight into it, so the body is copied once at most whatever the frame size.
+ */
+static int mes_start_recv_frame(mes_channel_t *channel, const mes_message_head_t *head)
+{
+    mes_message_t msg;
+    uint32 avail = channel->recv_write_pos - channel->recv_read_pos;
+
+    int ret = mes_get_message_buf(&msg, head);
+    if (ret != CM_SUCCESS) {
+        return ret;
+    }
+
+    errno_t errcode = memcpy_s(msg.buffer, head->size, channel->recv_buf + channel->recv_read_pos, avail);
+    if (SECUREC_UNLIKELY(errcode != EOK)) {
+        mes_release_message_buf(&msg);
+        return ERR_MES_MEMORY_COPY_FAIL;
+    }
+    channel->recv_read_pos = 0;
+    channel->recv_write_pos = 0;
+    channel->recv_frame = msg.buffer;
+    channel->recv_frame_pos = avail;
+    return CM_SUCCESS;
+}
+
+// returns with recv_frame still set while the frame is incomplete
+static int mes_continue_recv_frame(mes_channel_t *channel, uint64 stat_time)
+{
+    int32 recv_size;
+    mes_message_t msg;
+
+    MES_MESSAGE_ATTACH(&msg, channel->recv_frame);
+    if (cs_read_available(&channel->recv_pipe, msg.buffer + channel->recv_frame_pos,
+        msg.head->size - channel->recv_frame_pos, &recv_size) != CM_SUCCESS) {
+        LOG_RUN_ERR("mes read message body failed.");
+        return ERR_MES_SOCKET_FAIL;
+    }
+    channel->recv_frame_pos += (uint32)recv_size;
+    if (channel->recv_frame_pos < msg.head->size) {
+        return CM_SUCCESS;
+    }
+
+    channel->recv_frame = NULL;
+    channel->recv_frame_pos = 0;
+    mes_consume_with_time(msg.head->cmd, MES_TIME_READ_MES, stat_time);
+    (void)cm_atomic_inc(&(channel->recv_count));
+    mes_process_message(&channel->msg_queue, MES_CHANNEL_ID(channel->id), &msg);
+    return CM_SUCCESS;
+}
+
+static int mes_recv_buffered_message(mes_channel_t *channel, const mes_message_head_t *head, mes_message_t *msg)
+{
+    int ret = mes_get_message_buf(msg, head);
+    // skip the frame anyway, the stream stays in sync without it
+    char *frame = channel->recv_buf + channel->recv_read_pos;
+    channel->recv_read_pos += head->size;
+    if (ret != CM_SUCCESS) {
+        return ret;
+    }
+
+    errno_t errcode = memcpy_s(msg->buffer, head->size, frame, head->size);
+    if (SECUREC_UNLIKELY(errcode != EOK)) {
+        mes_release_message_buf(msg);
+        return ERR_MES_MEMORY_COPY_FAIL;
+    }
+    return CM_SUCCESS;
+}
+
+// dispatch every complete frame in the read buffer
+static int mes_parse_recv_buf(mes_channel_t *channel, uint64 stat_time)
+{
+    int ret;
+    uint32 avail;
+    mes_message_t msg;
+    mes_message_head_t head;
+
+    while ((avail = channel->recv_write_pos - channel->recv_read_pos) >= sizeof(mes_message_head_t)) {
+        // the frame may not be aligned in the read buffer
+        errno_t errcode = memcpy_s(&head, sizeof(mes_message_head_t), channel->recv_buf + channel->recv_read_pos,
+            sizeof(mes_message_head_t));
+        securec_check_ret(errcode);
+        if (mes_check_message_head(&head) != CM_SUCCESS) {
+            return ERR_MES_SOCKET_FAIL;
+        }
+
+        if (avail < head.size) {
+            // a heartbeat has no message buffer, it is small enough to wait in the read buffer
+            if (head.cmd != MES_HEARTBEAT_CMD) {
+                ret = mes_start_recv_frame(channel, &head);
+                if (ret != CM_SUCCESS) {
+                    // the frame stays in the read buffer, try again on the next event
+                    LOG_DEBUG_ERR("[mes]receive message failed, ret %d, cmd %hhu, size %hu.", ret, head.cmd,
+                        head.size);
+                }
+            }
+            break;
+        }
+
+        if (head.cmd == MES_HEARTBEAT_CMD) {
+            channel->recv_read_pos += head.size;
+            continue;
+        }
+
+        ret = mes_recv_buffered_message(channel, &head, &msg);
+        if (ret != CM_SUCCESS) {
+            LOG_DEBUG_ERR("[mes]receive message failed, ret %d, cmd %hhu, size %hu.", ret, head.cmd, head.size);
+            continue;
+        }
+
+        mes_consume_with_time(msg.head->cmd, MES_TIME_READ_MES, stat_time);
+        (void)cm_atomic_inc(&(channel->recv_count));
+        mes_process_message(&channel->msg_queue, MES_CHANNEL_ID(channel->id), &msg);
+    }
+
+    if (channel->recv_read_pos == channel->recv_write_pos) {
+        channel->recv_read_pos = 0;
+        channel->recv_write_pos = 0;
+    }
+    return CM_SUCCESS;
+}
+
+/*
+ * Receive as many messages as one read returns. The read never waits for a message to complete,
+ * a partial frame is kept in the channel until the following events bring the rest.
+ */
+static int mes_process_event_batch(mes_channel_t *channel)
+{
+    int32 recv_size;
+    uint64 stat_time = 0;
+
+    if (channel->recv_buf == NULL && mes_alloc_recv_buf(channel) != CM_SUCCESS) {
+        // a reactor must not block in the message by message read, it tries again on the next event
+        return MES_REACTOR_MODE ? ERR_MES_MALLOC_FAIL : mes_process_event(channel);
+    }
+
+    mes_get_consume_time_start(&stat_time);
+    if (channel->recv_frame != NULL) {
+        int ret = mes_continue_recv_frame(channel, stat_time);
+        if (ret != CM_SUCCESS || channel->recv_frame != NULL) {
+            return ret;
+        }
+        // the read buffer is empty, go on with the frames behind it
+    }
+
+    // move the incomplete frame to the front
+    if (channel->recv_read_pos > 0) {
+        uint32 remain = channel->recv_write_pos - channel->recv_read_pos;
+        if (remain > 0) {
+            errno_t errcode = memmove_s(channel->recv_buf, channel->recv_buf_size,
+                channel->recv_buf + channel->recv_read_pos, remain);
+            securec_check_ret(errcode);
+        }
+        channel->recv_read_pos = 0;
+        channel->recv_write_pos = remain;
+    }
+
+    if (cs_read_available(&channel->recv_pipe, channel->recv_buf + channel->recv_write_pos,
+        channel->recv_buf_size - channel->recv_write_pos, &recv_size) != CM_SUCCESS) {
+        LOG_RUN_ERR("[mes]mes read message failed.");
+        return ERR_MES_SOCKET_FAIL;
+    }
+    channel->recv_write_pos += (uint32)recv_size;
+
+    return mes_parse_recv_buf(channel, stat_time);
+}
+
 // connect
 static void mes_tcp_try_connect(mes_channel_t *channel)
 {
@@ -227,20 +459,23 @@ static void mes_tcp_try_connect(mes_channel_t *channel)
     return;
 }
 
-static void mes_tcp_heartbeat(mes_channel_t *channel)
+static void mes_consume_coalesced(mes_channel_t *channel, uint32 len)
 {
-    if (g_timer()->now - channel->last_send_time < MES_HEARTBEAT_INTERVAL * MICROSECS_PER_SECOND) {
+    if (len == 0) {
         return;
     }
-
-    // dst_inst and src_sid used to get current channel in mes_tcp_send_data
-    mes_message_head_t head = { 0 };
-    head.cmd = MES_HEARTBEAT_CMD;
-    head.dst_inst = MES_INSTANCE_ID(channel->id);
-    head.src_sid = MES_CHANNEL_ID(channel->id);
-    head.size = (uint16)sizeof(mes_message_head_t);
-
-    (void)mes_send_data(&head);
+    channel->coalesce_len -= len;
+    if (channel->coalesce_len == 0) {
+        (void)cm_atomic32_dec(&g_mes_coalesce_pending);
+        return;
+    }
+    if (memmove_s(channel->coalesce_buf, MES_SEND_COALESCE_BUF_SIZE, channel->coalesce_buf + len,
+        channel->coalesce_len) != EOK) {
+        LOG_RUN_ERR("[mes]: move staged messages of channel %d failed, %u bytes dropped", channel->id,
+            channel->coalesce_len);
+        channel->coalesce_len = 0;
+        (void)cm_atomic32_dec(&g_mes_coalesce_pending);
+    }
 }
 
 static void mes_close_send_pipe(mes_channel_t *channel)
@@ -252,6 +487,13 @@ static void mes_close_send_pipe(mes_channel_t *channel)
     }
     cs_disconnect(&channel->send_pipe);
     channel->send_pipe_active = CM_FALSE;
+    // staged messages never reach the peer, a new connection starts with an empty staging buffer
+    if (channel->coalesce_len > 0) {
+        LOG_RUN_WAR("[mes]: channel %d send pipe closed, %u bytes of staged messages dropped", channel->id,
+            channel->coalesce_len);
+        mes_consume_coalesced(channel, channel->coalesce_len);
+    }
+    CM_FREE_PTR(channel->coalesce_buf);
     cm_rwlock_unlock(&channel->send_lock);
     return;
 }
@@ -264,6 +506,7 @@ static void mes_close_channel(mes_channel_t *channel)
 
 static void mes_channel_entry(thread_t *thread)
 {
+    int ret;
     char thread_name[CM_MAX_THREAD_NAME_LEN];
     bool32 ready = CM_FALSE;
     mes_channel_t *channel = (mes_channel_t *)thread->argument;
@@ -278,11 +521,10 @@ static void mes_channel_entry(thread_t *thread)
         LOG_DEBUG_INF("[mes]: status_notify thread init callback: mes channel entry cb_thread_init done");
     }
 
+    mes_attach_buf_cache();
     while (!thread->closed) {
         if (!channel->send_pipe_active) {
             mes_tcp_try_connect(channel);
-        } else {
-            mes_tcp_heartbeat(channel);
         }
 
         cm_rwlock_wlock(&channel->recv_lock);
@@ -301,10 +543,13 @@ static void mes_channel_entry(thread_t *thread)
 
         if (!ready) {
             cm_rwlock_unlock(&channel->recv_lock);
+            mes_return_buf_cache();
             continue;
         }
 
-        if (mes_process_event(channel) == ERR_MES_SOCKET_FAIL) {
+        ret = (MES_GLOBAL_INST_MSG.profile.recv_buf_size > 0) ? mes_process_event_batch(channel) :
+            mes_process_event(channel);
+        if (ret == ERR_MES_SOCKET_FAIL) {
             cm_rwlock_unlock(&channel->recv_lock);
             LOG_RUN_ERR("instance %d, recv pipe closed", channel->id);
             mes_close_recv_pipe(channel);
@@ -315,6 +560,7 @@ static void mes_channel_entry(thread_t *thread)
 
     // thread closing, release pipes
     mes_close_channel(channel);
+    mes_detach_buf_cache();
 }
 
 static int mes_diag_proto_type(cs_pipe_t *pipe)
@@ -377,6 +623,11 @@ void mes_tcp_disconnect(uint32 inst_id, bool32 wait)
 
     for (i = 0; i < channel_cnt; i++) {
         channel = &MES_GLOBAL_INST_MSG.mes_ctx.channels[inst_id][i];
+        if (MES_REACTOR_MODE) {
+            channel->connect_enabled = CM_FALSE;
+            mes_close_channel(channel);
+            continue;
+        }
         if (wait) {
             cm_close_thread(&channel->thread);
         } else {
@@ -403,14 +654,160 @@ void mes_stop_channels(void)
     return;
 }
 
+static void mes_reactor_process(mes_channel_t *channel)
+{
+    int ret;
+    bool32 ready = CM_FALSE;
+
+    cm_rwlock_wlock(&channel->recv_lock);
+    if (!channel->recv_pipe_active) {
+        cm_rwlock_unlock(&channel->recv_lock);
+        return;
+    }
+
+    // one peer must not hold up the others, so the reactor only reads what the socket holds already
+    for (uint32 i = 0; i < MES_REACTOR_MAX_ROUNDS; i++) {
+        ret = mes_process_event_batch(channel);
+        if (ret == ERR_MES_SOCKET_FAIL) {
+            cm_rwlock_unlock(&channel->recv_lock);
+            LOG_RUN_ERR("instance %d, recv pipe closed", channel->id);
+            mes_close_recv_pipe(channel);
+            return;
+        }
+
+        if (cs_wait(&channel->recv_pipe, CS_WAIT_FOR_READ, 0, &ready) != CM_SUCCESS || !ready) {
+            break;
+        }
+    }
+    cm_rwlock_unlock(&channel->recv_lock);
+}
+
+static void mes_reactor_entry(thread_t *thread)
+{
+    int cnt;
+    char thread_name[CM_MAX_THREAD_NAME_LEN];
+    struct epoll_event events[MES_REACTOR_EVENT_NUM];
+    mes_reactor_t *reactor = (mes_reactor_t *)thread->argument;
+
+    PRTS_RETVOID_IFERR(sprintf_s(thread_name, CM_MAX_THREAD_NAME_LEN, "mes_reactor_%u", reactor->id));
+    cm_set_thread_name(thread_name);
+
+    mes_thread_init_t cb_thread_init = get_mes_worker_init_cb();
+    if (cb_thread_init != NULL) {
+        cb_thread_init(CM_FALSE, (char **)&thread->reg_data);
+        LOG_DEBUG_INF("[mes]: status_notify thread init callback: mes reactor cb_thread_init done");
+    }
+
+    mes_attach_buf_cache();
+    while (!thread->closed) {
+        cnt = epoll_wait(reactor->epfd, events, MES_REACTOR_EVENT_NUM, MES_CHANNEL_TIMEOUT);
+        if (cnt <= 0) {
+            mes_return_buf_cache();
+            continue;
+        }
+        for (int i = 0; i < cnt; i++) {
+            mes_reactor_process((mes_channel_t *)events[i].data.ptr);
+        }
+    }
+    mes_detach_buf_cache();
+}
+
+static void mes_connector_entry(thread_t *thread)
+{
+    mes_channel_t *channel = NULL;
+    uint32 total = CM_MAX_INSTANCES * MES_GLOBAL_INST_MSG.profile.channel_cnt;
+
+    cm_set_thread_name("mes_connector");
+    while (!thread->closed) {
+        for (uint32 i = 0; i < total && !thread->closed; i++) {
+            channel = &MES_GLOBAL_INST_MSG.mes_ctx.channels[0][i];
+            if (!channel->connect_enabled || channel->send_pipe_active) {
+                continue;
+            }
+            mes_tcp_try_connect(channel);
+            // disconnected while connecting
+            if (!channel->connect_enabled) {
+                mes_close_send_pipe(channel);
+            }
+        }
+        cm_sleep(MES_CHANNEL_TIMEOUT);
+    }
+}
+
+static int mes_start_reactors(void)
+{
+    mes_reactor_t *reactor = NULL;
+
+    for (uint32 i = 0; i < MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt; i++) {
+        MES_GLOBAL_INST_MSG.mes_ctx.reactors[i].id = i;
+        MES_GLOBAL_INST_MSG.mes_ctx.reactors[i].epfd = -1;
+    }
+    // resources created below are released by mes_stop_reactors on failure
+    MES_GLOBAL_INST_MSG.mes_ctx.startReactorTh = CM_TRUE;
+
+    for (uint32 i = 0; i < MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt; i++) {
+        reactor = &MES_GLOBAL_INST_MSG.mes_ctx.reactors[i];
+        reactor->epfd = epoll_create1(0);
+        if (reactor->epfd < 0) {
+            LOG_RUN_ERR("[mes]: create epoll for reactor %u failed, os error %d", i, cm_get_os_error());
+            return ERR_MES_EPOLL_INIT_FAIL;
+        }
+    }
+
+    for (uint32 i = 0; i < MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt; i++) {
+        reactor = &MES_GLOBAL_INST_MSG.mes_ctx.reactors[i];
+        if (cm_create_thread(mes_reactor_entry, 0, (void *)reactor, &reactor->thread) != CM_SUCCESS) {
+            LOG_RUN_ERR("[mes]: create reactor thread %u failed.", i);
+            return ERR_MES_CHANNEL_THREAD_FAIL;
+        }
+    }
+
+    if (cm_create_thread(mes_connector_entry, 0, NULL, &MES_GLOBAL_INST_MSG.mes_ctx.connector) != CM_SUCCESS) {
+        LOG_RUN_ERR("[mes]: create connector thread failed.");
+        return ERR_MES_CHANNEL_THREAD_FAIL;
+    }
+    return CM_SUCCESS;
+}
+
+void mes_stop_reactors(void)
+{
+    mes_reactor_t *reactor = NULL;
+
+    if (!MES_GLOBAL_INST_MSG.mes_ctx.startReactorTh) {
+        return;
+    }
+
+    cm_close_thread(&MES_GLOBAL_INST_MSG.mes_ctx.connector);
+    for (uint32 i = 0; i < MES_GLOBAL_INST_MSG.profile.reactor_thread_cnt; i++) {
+        reactor = &MES_GLOBAL_INST_MSG.mes_ctx.reactors[i];
+        cm_close_thread(&reactor->thread);
+        if (reactor->epfd >= 0) {
+            (void)epoll_close(reactor->epfd);
+        }
+        reactor->epfd = -1;
+    }
+    MES_GLOBAL_INST_MSG.mes_ctx.startReactorTh = CM_FALSE;
+}
+
 void mes_free_channels(void)
 {
     if (MES_GLOBAL_INST_MSG.mes_ctx.channels == NULL) {
         return;
     }
 
+    cm_timer_cancel(&MES_GLOBAL_INST_MSG.mes_ctx.heartbeat_timer);
+
+    for (uint32 i = 0; i < CM_MAX_INSTANCES; i++) {
+        for (uint32 j = 0; j < MES_GLOBAL_INST_MSG.profile.channel_cnt; j++) {
+            CM_FREE_PTR(MES_GLOBAL_INST_MSG.mes_ctx.channels[i][j].coalesce_buf);
+            MES_GLOBAL_INST_MSG.mes_ctx.channels[i][j].coalesce_len = 0;
+            CM_FREE_PTR(MES_GLOBAL_INST_MSG.mes_ctx.channels[i][j].recv_buf);
+        }
+    }
+
     free(MES_GLOBAL_INST_MSG.mes_ctx.channels);
     MES_GLOBAL_INST_MSG.mes_ctx.channels = NULL;
+    (void)cm_atomic32_add(&g_mes_coalesce_pending, -cm_atomic32_get(&g_mes_coalesce_pending));
     return;
 }
 
@@ -580,6 +977,12 @@ static int mes_accept(cs_pipe_t *pipe)
     channel->recv_pipe_active = CM_TRUE;
     channel->recv_pipe.connect_timeout = CM_CONNECT_TIMEOUT;
     channel->recv_pipe.socket_timeout = (int32)CM_INVALID_INT32;
+    if (MES_REACTOR_MODE && mes_reactor_ctl(channel, EPOLL_CTL_ADD) != CM_SUCCESS) {
+        cs_disconnect(&channel->recv_pipe);
+        channel->recv_pipe_active = CM_FALSE;
+        cm_rwlock_unlock(&channel->recv_lock);
+        return ERR_MES_EPOLL_INIT_FAIL;
+    }
     cm_rwlock_unlock(&channel->recv_lock);
     LOG_RUN_INF("[mes]: mes_accept: channel id %u receive ok.", (uint32)channel->id);
     return CM_SUCCESS;
@@ -590,8 +993,204 @@ static status_t mes_tcp_accept(tcp_lsnr_t *lsnr, cs_pipe_t *pipe)
     return mes_accept(pipe);
 }
 
+// length of the staged messages which lie whole within the first sent bytes
+static uint32 mes_coalesced_whole_len(const mes_channel_t *channel, uint32 sent)
+{
+    mes_message_head_t head;
+    uint32 pos = 0;
+
+    while (pos + sizeof(mes_message_head_t) <= channel->coalesce_len) {
+        if (memcpy_s(&head, sizeof(head), channel->coalesce_buf + pos, sizeof(head)) != EOK ||
+            head.size < sizeof(mes_message_head_t) || pos + head.size > sent) {
+            break;
+        }
+        pos += head.size;
+    }
+    return pos;
+}
+
+// every staged message went out with the one send, each of them is charged its time
+static void mes_coalesced_send_stat(const mes_channel_t *channel, uint64 stat_time)
+{
+    mes_message_head_t head;
+    uint32 pos = 0;
+
+    if (!g_mes_elapsed_stat.mes_elapsed_switch) {
+        return;
+    }
+    uint64 elapsed = cm_get_time_usec() - stat_time;
+    while (pos + sizeof(mes_message_head_t) <= channel->coalesce_len) {
+        if (memcpy_s(&head, sizeof(head), channel->coalesce_buf + pos, sizeof(head)) != EOK ||
+            head.size < sizeof(mes_message_head_t)) {
+            break;
+        }
+        mes_add_elapsed_time(head.cmd, MES_TIME_SEND_IO, elapsed);
+        pos += head.size;
+    }
+}
+
+static int mes_tcp_flush_coalesced(mes_channel_t *channel)
+{
+    cs_iovec_t iov;
+    uint32 sent = 0;
+    uint64 stat_time = 0;
+
+    if (channel->coalesce_len == 0) {
+        return CM_SUCCESS;
+    }
+
+    iov.iov_base = channel->coalesce_buf;
+    iov.iov_len = channel->coalesce_len;
+    mes_get_consume_time_start(&stat_time);
+    if (cs_send_fixed_iov_ex(&channel->send_pipe, &iov, 1, &sent) != CM_SUCCESS) {
+        // messages the socket took whole are gone, the peer drops the one cut off with the connection
+        mes_consume_coalesced(channel, mes_coalesced_whole_len(channel, sent));
+        return CM_ERROR;
+    }
+    mes_coalesced_send_stat(channel, stat_time);
+    mes_consume_coalesced(channel, channel->coalesce_len);
+    return CM_SUCCESS;
+}
+
+static void mes_flush_channels(void)
+{
+    mes_channel_t *channel = NULL;
+    uint32 total = CM_MAX_INSTANCES * MES_GLOBAL_INST_MSG.profile.channel_cnt;
+    int32 pending = cm_atomic32_get(&g_mes_coalesce_pending);
+
+    for (uint32 i = 0; i < total && pending > 0; i++) {
+        channel = &MES_GLOBAL_INST_MSG.mes_ctx.channels[0][i];
+        if (channel->coalesce_len == 0) {
+            continue;
+        }
+        pending--;
+        if (!channel->send_pipe_active) {
+            continue;
+        }
+
+        cm_rwlock_wlock(&channel->send_lock);
+        if (!channel->send_pipe_active) {
+            cm_rwlock_unlock(&channel->send_lock);
+            continue;
+        }
+        if (mes_tcp_flush_coalesced(channel) != CM_SUCCESS) {
+            cm_rwlock_unlock(&channel->send_lock);
+            mes_close_send_pipe(channel);
+            LOG_RUN_ERR("flush coalesced messages failed. channel %d, errno %d, send pipe closed",
+                channel->id, cm_get_os_error());
+            continue;
+        }
+        channel->last_send_time = g_timer()->now;
+        cm_rwlock_unlock(&channel->send_lock);
+    }
+}
+
+static void mes_tcp_heartbeat(mes_channel_t *channel)
+{
+    cs_iovec_t iov;
+    mes_message_head_t head = { 0 };
+
+    if (g_timer()->now - channel->last_send_time < (date_t)MES_HEARTBEAT_PERIOD * MICROSECS_PER_MILLISEC) {
+        return;
+    }
+
+    head.cmd = MES_HEARTBEAT_CMD;
+    head.dst_inst = MES_INSTANCE_ID(channel->id);
+    head.src_sid = MES_CHANNEL_ID(channel->id);
+    head.size = (uint16)sizeof(mes_message_head_t);
+    iov.iov_base = (void *)&head;
+    iov.iov_len = head.size;
+
+    // a channel somebody is sending on needs no heartbeat
+    if (!cm_rwlock_try_wlock(&channel->send_lock)) {
+        return;
+    }
+    if (!channel->send_pipe_active) {
+        cm_rwlock_unlock(&channel->send_lock);
+        return;
+    }
+    if (mes_tcp_flush_coalesced(channel) != CM_SUCCESS ||
+        cs_send_fixed_iov(&channel->send_pipe, &iov, 1) != CM_SUCCESS) {
+        cm_rwlock_unlock(&channel->send_lock);
+        mes_close_send_pipe(channel);
+        LOG_RUN_ERR("send heartbeat failed. channel %d, errno %d, send pipe closed", channel->id, cm_get_os_error());
+        return;
+    }
+    channel->last_send_time = g_timer()->now;
+    cm_rwlock_unlock(&channel->send_lock);
+}
+
+static void mes_send_heartbeats(void)
+{
+    mes_channel_t *channel = MES_GLOBAL_INST_MSG.mes_ctx.channels[0];
+    uint32 total = CM_MAX_INSTANCES * MES_GLOBAL_INST_MSG.profile.channel_cnt;
+
+    for (uint32 i = 0; i < total; i++) {
+        if (channel[i].send_pipe_active) {
+            mes_tcp_heartbeat(&channel[i]);
+        }
+    }
+}
+
+/*
+ * Sends what the channels staged during the last coalescing window and the heartbeats the timer asked for.
+ * Sending may block, so neither the senders nor the timer thread wait for it.
+ */
+static void mes_flusher_entry(thread_t *thread)
+{
+    cm_set_thread_name("mes_flusher");
+    while (!thread->closed) {
+        if (MES_COALESCE_MODE) {
+            cm_usleep(MES_GLOBAL_INST_MSG.profile.send_coalesce_us);
+            mes_flush_channels();
+        } else {
+            (void)cm_event_timedwait(&MES_GLOBAL_INST_MSG.mes_ctx.flusher_event, MES_FLUSHER_IDLE_WAIT);
+        }
+        if (cm_atomic32_cas(&g_mes_heartbeat_due, CM_TRUE, CM_FALSE)) {
+            mes_send_heartbeats();
+        }
+    }
+}
+
+static int mes_start_flusher(void)
+{
+    if (cm_event_init(&MES_GLOBAL_INST_MSG.mes_ctx.flusher_event) != CM_SUCCESS) {
+        LOG_RUN_ERR("[mes]: init flusher event failed.");
+        return ERR_MES_CHANNEL_THREAD_FAIL;
+    }
+    if (cm_create_thread(mes_flusher_entry, 0, NULL, &MES_GLOBAL_INST_MSG.mes_ctx.flusher) != CM_SUCCESS) {
+        cm_event_destory(&MES_GLOBAL_INST_MSG.mes_ctx.flusher_event);
+        LOG_RUN_ERR("[mes]: create flusher thread failed.");
+        return ERR_MES_CHANNEL_THREAD_FAIL;
+    }
+    MES_GLOBAL_INST_MSG.mes_ctx.startFlushTh = CM_TRUE;
+    return CM_SUCCESS;
+}
+
+void mes_stop_flusher(void)
+{
+    if (!MES_GLOBAL_INST_MSG.mes_ctx.startFlushTh) {
+        return;
+    }
+    // no heartbeat callback may notify the event once it is gone
+    cm_timer_cancel(&MES_GLOBAL_INST_MSG.mes_ctx.heartbeat_timer);
+    MES_GLOBAL_INST_MSG.mes_ctx.flusher.closed = CM_TRUE;
+    cm_event_notify(&MES_GLOBAL_INST_MSG.mes_ctx.flusher_event);
+    cm_close_thread(&MES_GLOBAL_INST_MSG.mes_ctx.flusher);
+    cm_event_destory(&MES_GLOBAL_INST_MSG.mes_ctx.flusher_event);
+    MES_GLOBAL_INST_MSG.mes_ctx.startFlushTh = CM_FALSE;
+}
+
+// periodic timer callback, only hands the heartbeats to the flusher thread since sending may block
+static void mes_heartbeat_proc(void *arg)
+{
+    (void)cm_atomic32_cas(&g_mes_heartbeat_due, CM_FALSE, CM_TRUE);
+    cm_event_notify(&MES_GLOBAL_INST_MSG.mes_ctx.flusher_event);
+}
+
 int mes_start_lsnr(void)
 {
+    int ret;
     char *lsnr_host = MES_HOST_NAME(MES_GLOBAL_INST_MSG.profile.inst_id);
 
     MEMS_RETURN_IFERR(strncpy_s(MES_GLOBAL_INST_MSG.mes_ctx.lsnr.tcp.host[0], CM_MAX_IP_LEN, lsnr_host,
@@ -607,6 +1206,18 @@ int mes_start_lsnr(void)
     }
 #endif
 
+    if (MES_REACTOR_MODE) {
+        ret = mes_start_reactors();
+        if (ret != CM_SUCCESS) {
+            return ret;
+        }
+    }
+
+    ret = mes_start_flusher();
+    if (ret != CM_SUCCESS) {
+        return ret;
+    }
+
     if (cs_start_tcp_lsnr(&(MES_GLOBAL_INST_MSG.mes_ctx.lsnr.tcp), mes_tcp_accept) != CM_SUCCESS) {
         LOG_RUN_ERR("[mes]:Start tcp lsnr failed. Host_name: %s, inst_id:%u, port:%hu.",
             lsnr_host, MES_GLOBAL_INST_MSG.profile.inst_id, MES_GLOBAL_INST_MSG.mes_ctx.lsnr.tcp.port);
@@ -614,6 +1225,9 @@ int mes_start_lsnr(void)
     }
     LOG_RUN_INF("[mes]: MES LSNR %s:%hu", lsnr_host, MES_GLOBAL_INST_MSG.mes_ctx.lsnr.tcp.port);
 
+    cm_timer_node_init(&MES_GLOBAL_INST_MSG.mes_ctx.heartbeat_timer, mes_heartbeat_proc, NULL);
+    cm_timer_schedule(&MES_GLOBAL_INST_MSG.mes_ctx.heartbeat_timer, MES_HEARTBEAT_PERIOD, MES_HEARTBEAT_PERIOD);
+
     return CM_SUCCESS;
 }
 
@@ -665,6 +1279,11 @@ int mes_tcp_connect(uint32 inst_id)
         channel->id = (inst_id << INST_ID_MOVE_LEFT_BIT_CNT) | i;
         channel->last_send_time = g_timer()->now;
 
+        if (MES_REACTOR_MODE) {
+            channel->connect_enabled = CM_TRUE;
+            continue;
+        }
+
         // wait last thread close finish
         cm_close_thread(&channel->thread);
 
@@ -679,27 +1298,77 @@ int mes_tcp_connect(uint32 inst_id)
 }
 
 // send
-int mes_tcp_send_data(const void *msg_data)
+static bool32 mes_tcp_stage_message(mes_channel_t *channel, const cs_iovec_t *iov, uint32 iov_cnt, uint32 size)
+{
+    uint32 pos = channel->coalesce_len;
+
+    if (channel->coalesce_buf == NULL) {
+        channel->coalesce_buf = (char *)malloc(MES_SEND_COALESCE_BUF_SIZE);
+        if (channel->coalesce_buf == NULL) {
+            return CM_FALSE;
+        }
+    }
+
+    if (pos + size > MES_SEND_COALESCE_BUF_SIZE) {
+        return CM_FALSE;
+    }
+
+    for (uint32 i = 0; i < iov_cnt; i++) {
+        if (memcpy_s(channel->coalesce_buf + pos, MES_SEND_COALESCE_BUF_SIZE - pos, iov[i].iov_base,
+            iov[i].iov_len) != EOK) {
+            return CM_FALSE;
+        }
+        pos += (uint32)iov[i].iov_len;
+    }
+
+    if (channel->coalesce_len == 0) {
+        (void)cm_atomic32_inc(&g_mes_coalesce_pending);
+    }
+    channel->coalesce_len = pos;
+    return CM_TRUE;
+}
+
+static int mes_tcp_send_iov(mes_channel_t *channel, const mes_message_head_t *head, cs_iovec_t *iov,
+    uint32 iov_cnt)
 {
     uint64 stat_time = 0;
-    int ret;
-    mes_message_head_t *head = (mes_message_head_t *)msg_data;
-    mes_channel_t *channel =
-        &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][MES_SESSION_TO_CHANNEL_ID(head->src_sid)];
+    uint32 size = 0;
+    // a large message in progress gives way to the small ones between its fragments
+    bool32 wait_large = (head->flags & MES_FLAG_LARGE_MSG) == 0 && cm_atomic32_get(&channel->large_senders) > 0;
 
+    for (uint32 i = 0; i < iov_cnt; i++) {
+        size += (uint32)iov[i].iov_len;
+    }
+
+    if (wait_large) {
+        (void)cm_atomic32_inc(&channel->send_waiters);
+    }
     cm_rwlock_wlock(&channel->send_lock);
+    if (wait_large) {
+        (void)cm_atomic32_dec(&channel->send_waiters);
+    }
     if (!channel->send_pipe_active) {
         cm_rwlock_unlock(&channel->send_lock);
         LOG_RUN_ERR_INHIBIT(LOG_INHIBIT_LEVEL4, "send pipe to instance %d is not ready", head->dst_inst);
         return ERR_MES_SENDPIPE_NO_REDAY;
     }
 
+    // small messages are copied into the staging buffer, the flusher thread sends them within one window
+    if (MES_COALESCE_MODE && size <= MES_SEND_COALESCE_MSG_SIZE &&
+        mes_tcp_stage_message(channel, iov, iov_cnt, size)) {
+        cm_rwlock_unlock(&channel->send_lock);
+        (void)cm_atomic_inc(&(channel->send_count));
+        return CM_SUCCESS;
+    }
+
     mes_get_consume_time_start(&stat_time);
-    ret = cs_send_fixed_size(&channel->send_pipe, (char *)msg_data, head->size);
-    if (ret != CM_SUCCESS) {
+    // staged messages go out first to keep the channel order
+    if (mes_tcp_flush_coalesced(channel) != CM_SUCCESS ||
+        cs_send_fixed_iov(&channel->send_pipe, iov, iov_cnt) != CM_SUCCESS) {
         cm_rwlock_unlock(&channel->send_lock);
         mes_close_send_pipe(channel);
-        LOG_RUN_ERR("cs_send_fixed_size failed. instance %d, send pipe closed", channel->id);
+        LOG_RUN_ERR("cs_send_fixed_iov failed. channel %d, errno %d, send pipe closed",
+            channel->id, cm_get_os_error());
         return ERR_MES_SEND_MSG_FAIL;
     }
 
@@ -708,41 +1377,34 @@ int mes_tcp_send_data(const void *msg_data)
     cm_rwlock_unlock(&channel->send_lock);
 
     (void)cm_atomic_inc(&(channel->send_count));
-
     return CM_SUCCESS;
 }
 
+int mes_tcp_send_data(const void *msg_data)
+{
+    cs_iovec_t iov;
+    mes_message_head_t *head = (mes_message_head_t *)msg_data;
+    mes_channel_t *channel =
+        &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][mes_get_send_channel_id(head)];
+
+    iov.iov_base = (void *)msg_data;
+    iov.iov_len = head->size;
+    return mes_tcp_send_iov(channel, head, &iov, 1);
+}
+
 int mes_tcp_send_bufflist(mes_bufflist_t *buff_list)
 {
-    uint64 stat_time = 0;
+    cs_iovec_t iov[MES_MAX_BUFFERLIST];
     mes_message_head_t *head = (mes_message_head_t *)(buff_list->buffers[0].buf);
     mes_channel_t *channel =
-        &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][MES_SESSION_TO_CHANNEL_ID(head->src_sid)];
+        &MES_GLOBAL_INST_MSG.mes_ctx.channels[head->dst_inst][mes_get_send_channel_id(head)];
 
-    cm_rwlock_wlock(&channel->send_lock);
-    if (!channel->send_pipe_active) {
-        cm_rwlock_unlock(&channel->send_lock);
-        LOG_RUN_ERR_INHIBIT(LOG_INHIBIT_LEVEL4, "send pipe to instance %d is not ready", head->dst_inst);
-        return ERR_MES_SENDPIPE_NO_REDAY;
-    }
-    mes_get_consume_time_start(&stat_time);
     LOG_DEBUG_INF("Begin tcp send buffer, buffer list cnt is %u. cmd=%hhu, rsn=%llu, src_inst=%hhu, dst_inst=%hhu, "
                 "src_sid=%hu, dst_sid=%hu.",
         buff_list->cnt, (head)->cmd, (head)->rsn, (head)->src_inst, (head)->dst_inst, (head)->src_sid, (head)->dst_sid);
     for (int i = 0; i < buff_list->cnt; i++) {
-        if (cs_send_fixed_size(&channel->send_pipe, buff_list->buffers[i].buf, buff_list->buffers[i].len) !=
-            CM_SUCCESS) {
-            cm_rwlock_unlock(&channel->send_lock);
-            mes_close_send_pipe(channel);
-            LOG_RUN_ERR("cs_send_fixed_size failed. channel %d, errno %d, send pipe closed",
-                channel->id, cm_get_os_error());
-            return ERR_MES_SEND_MSG_FAIL;
-        }
+        iov[i].iov_base = buff_list->buffers[i].buf;
+        iov[i].iov_len = buff_list->buffers[i].len;
     }
-    channel->last_send_time = g_timer()->now;
-    mes_consume_with_time(head->cmd, MES_TIME_SEND_IO, stat_time);
-    cm_rwlock_unlock(&channel->send_lock);
-
-    (void)cm_atomic_inc(&(channel->send_count));
-    return CM_SUCCESS;
+    return mes_tcp_send_iov(channel, head, iov, buff_list->cnt);
 }
@@ -41,11 +41,14 @@ extern "C" {
 #define MES_CONNECT_CMD             (uint8)(CM_MAX_MES_MSG_CMD + 1)
 #define MES_HEARTBEAT_CMD           (uint8)(254)
 #define MES_HEARTBEAT_INTERVAL      (1)
+#define MES_FLUSHER_IDLE_WAIT       (1000) // ms, without coalescing the flusher only wakes up for heartbeats
 
 
 int mes_init_tcp_resource(void);
 void mes_free_channels(void);
 void mes_stop_channels(void);
+void mes_stop_reactors(void);
+void mes_stop_flusher(void);
 void mes_tcp_disconnect(uint32 inst_id, bool32 wait);
 int mes_tcp_connect(uint32 inst_id);
 int mes_tcp_send_data(const void *msg_data);
@@ -52,6 +52,13 @@ typedef enum en_mes_task_group_id_t {
     MES_TASK_GROUP_ALL
 } mes_task_group_id_t;
 
+typedef enum en_mes_priority {
+    MES_PRIORITY_NORMAL = 0, /* default of every command */
+    MES_PRIORITY_HIGH,       /* control traffic such as lock grants and acks, bypasses the other lanes */
+    MES_PRIORITY_LOW,        /* bulk data, served after the other lanes */
+    MES_PRIORITY_CEIL
+} mes_priority_t;
+
 typedef enum en_mes_time_stat {
     MES_TIME_TEST_SEND = 0,
     MES_TIME_SEND_IO,
@@ -66,9 +73,20 @@ typedef enum en_mes_time_stat {
     MES_TIME_GET_QUEUE,
     MES_TIME_QUEUE_PROC,
     MES_TIME_PUT_BUF,
+    MES_TIME_QUEUE_WAIT, /* enqueue to dispatch by a work thread */
     MES_TIME_CEIL
 } mes_time_stat_t;
 
+typedef struct st_mes_latency_stat {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long p50;
+    unsigned long long p90;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+} mes_latency_stat_t;
+
 typedef enum en_mes_pipe_type {
     MES_TYPE_TCP = 1,
     MES_TYPE_IPC = 2,
@@ -80,6 +98,11 @@ typedef enum en_mes_pipe_type {
     MES_TYPE_CEIL
 } mes_pipe_type_t;
 
+typedef enum en_mes_task_wait_mode {
+    MES_TASK_WAIT_SLEEP = 0, /* idle work threads poll their queues every 1ms */
+    MES_TASK_WAIT_PARK = 1,  /* idle work threads spin, then park until a message is enqueued */
+} mes_task_wait_mode_t;
+
 typedef struct st_mes_addr {
     char ip[MES_MAX_IP_LEN];
     unsigned short port;
@@ -115,8 +138,46 @@ typedef struct st_mes_profile {
     // Indicates whether to connected to other instances during MES initialization
     unsigned int conn_created_during_init : 1;
     unsigned int reserved : 31;
+    // Depth of the buffer cache of each MES thread in front of each buffer pool, 0 means disabled
+    unsigned int buf_cache_count;
+    mes_task_wait_mode_t task_wait_mode;
+    // Rounds an idle work thread spins over its queues before parking, used by MES_TASK_WAIT_PARK
+    unsigned int task_spin_count;
+    // Window in microseconds for batching small tcp messages of one channel into a single send, 0 means disabled.
+    // A batched message is reported sent once it is staged, it is dropped if the connection breaks before the send.
+    unsigned int send_coalesce_us;
+    // Size in bytes of the per-channel tcp read buffer which receives many messages per read, 0 means disabled
+    unsigned int recv_buf_size;
+    // Number of epoll threads receiving on all tcp channels, 0 keeps one receive thread per channel.
+    // Reactors always receive through a read buffer of at least 4K, also when recv_buf_size is 0
+    unsigned int reactor_thread_cnt;
+    // Capacity of the lock-free ring in front of each task queue, 0 keeps the spinlock protected lists only
+    unsigned int task_queue_size;
+    // Messages an idle work thread may take at once from another task group, 0 disables stealing.
+    // Only commands set with mes_set_command_task_group_ex(..., can_steal = 1) are stolen
+    unsigned int task_steal_batch;
+    // Largest body of a message sent by mes_send_large_data and accepted on receive, 0 disables large messages
+    unsigned int large_msg_max_size;
+    // Channels per peer kept for MES_PRIORITY_HIGH commands, taken from channel_cnt, 0 shares all channels
+    unsigned int priority_channel_cnt;
+    // Messages a work thread takes from a priority lane before the lane below gets one, 0 is strict priority
+    unsigned int priority_weight;
 } mes_profile_t;
 
+typedef struct st_mes_buf_cache_stat {
+    unsigned long long alloc_hit;    // allocations served by the thread cache
+    unsigned long long alloc_refill; // batch refills taken from the buffer queues
+    unsigned long long free_hit;     // frees kept in the thread cache
+    unsigned long long free_drain;   // batch drains given back to the buffer queues
+} mes_buf_cache_stat_t;
+
+typedef struct st_mes_task_group_stat {
+    unsigned long long steal_in;  // messages its work threads took from other groups
+    unsigned long long steal_out; // messages other groups took from its queues
+    unsigned int queue_depth;     // messages waiting in its queues now
+    unsigned int max_queue_depth; // deepest single queue seen by its work threads
+} mes_task_group_stat_t;
+
 typedef struct st_mes_message_head {
     unsigned char cmd; // command
     unsigned char flags;
@@ -148,6 +209,18 @@ typedef struct st_mes_bufflist {
     mes_buffer_t buffers[MES_MAX_BUFFERLIST];
 } mes_bufflist_t;
 
+#define MES_FLAG_LARGE_MSG (0x80) /* reserved, set on every fragment of a large message */
+
+typedef struct st_mes_large_message {
+    mes_message_head_t head;  /* head given to mes_send_large_data, size is meaningless */
+    unsigned long long size;  /* body size */
+    char *user_buf;           /* body when received into a buffer from mes_large_buf_alloc_t, or into a heap
+                                 buffer mes_release_large_message frees when too many pool buffers are held,
+                                 otherwise NULL */
+    unsigned int chunk_cnt;   /* pieces of the body left in pool buffers, in order, 0 with user_buf */
+    mes_buffer_t *chunks;
+} mes_large_message_t;
+
 #define MES_INIT_MESSAGE_HEAD(head, v_cmd, v_flags, v_src_inst, v_dst_inst, v_src_sid, v_dst_sid) \
     do {                                                                                          \
         (head)->cmd = (uint8)(v_cmd);                                                               \
@@ -161,6 +234,11 @@ typedef struct st_mes_bufflist {
 #define MES_MESSAGE_BODY(msg) ((msg)->buffer + sizeof(mes_message_head_t))
 
 typedef void (*mes_message_proc_t)(unsigned int work_thread, mes_message_t *message);
+typedef void (*mes_large_message_proc_t)(unsigned int work_thread, mes_large_message_t *message);
+/* return a buffer of at least size bytes to receive the body into, NULL keeps it in pool buffers */
+typedef char *(*mes_large_buf_alloc_t)(const mes_message_head_t *head, unsigned long long size);
+/* take back a buffer from mes_large_buf_alloc_t, its message was dropped before the last fragment */
+typedef void (*mes_large_buf_free_t)(const mes_message_head_t *head, char *buf, unsigned long long size);
 typedef int(*usr_cb_decrypt_pwd_t)(const char *cipher, unsigned int len, char *plain, unsigned int size);
 
 #ifdef __cplusplus
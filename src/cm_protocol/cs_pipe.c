@@ -25,6 +25,8 @@
 #include "cs_pipe.h"
 #include "cm_num.h"
 #include "cm_profile_stat.h"
+#include "cm_timer.h"
+#include "cm_memory.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -346,19 +348,106 @@ status_t cs_send_fixed_size(cs_pipe_t *pipe, char *buf, int32 size)
     return CM_SUCCESS;
 }
 
+static inline void cs_consume_iov(cs_iovec_t **iov, uint32 *iov_cnt, uint32 size)
+{
+    cs_iovec_t *cur = *iov;
+    uint32 cnt = *iov_cnt;
+
+    while (cnt > 0 && size >= cur->iov_len) {
+        size -= (uint32)cur->iov_len;
+        cur++;
+        cnt--;
+    }
+    if (cnt > 0 && size > 0) {
+        cur->iov_base = (char *)cur->iov_base + size;
+        cur->iov_len -= size;
+    }
+    *iov = cur;
+    *iov_cnt = cnt;
+}
+
+/*
+  Send all buffers of iov in order, one syscall for the whole list in most cases.
+  @note
+    The iov array is consumed in place, only tcp pipe supports gather send,
+    other pipes fall back to send the buffers one by one.
+*/
+status_t cs_send_fixed_iov(cs_pipe_t *pipe, cs_iovec_t *iov, uint32 iov_cnt)
+{
+    uint32 sent;
+    return cs_send_fixed_iov_ex(pipe, iov, iov_cnt, &sent);
+}
+
+/*
+  Same as cs_send_fixed_iov, sent is the number of bytes handed to the socket, also when it fails.
+*/
+status_t cs_send_fixed_iov_ex(cs_pipe_t *pipe, cs_iovec_t *iov, uint32 iov_cnt, uint32 *sent)
+{
+    bool32 ready;
+    int32 send_size;
+    int32 wait_interval = 0;
+    cs_iovec_t *send_iov = iov;
+    uint32 remain_cnt = iov_cnt;
+
+    *sent = 0;
+    if (pipe->type != CS_TYPE_TCP) {
+        for (uint32 i = 0; i < iov_cnt; i++) {
+            if (cs_send_fixed_size(pipe, (char *)iov[i].iov_base, (int32)iov[i].iov_len) != CM_SUCCESS) {
+                return CM_ERROR;
+            }
+            *sent += (uint32)iov[i].iov_len;
+        }
+        return CM_SUCCESS;
+    }
+
+    if (cs_tcp_sendv(&pipe->link.tcp, send_iov, remain_cnt, &send_size) != CM_SUCCESS) {
+        return CM_ERROR;
+    }
+    cs_consume_iov(&send_iov, &remain_cnt, (uint32)send_size);
+    *sent += (uint32)send_size;
+
+    while (remain_cnt > 0) {
+        if (cs_wait(pipe, CS_WAIT_FOR_WRITE, CM_POLL_WAIT, &ready) != CM_SUCCESS) {
+            return CM_ERROR;
+        }
+
+        if (!ready) {
+            wait_interval += CM_POLL_WAIT;
+            if (wait_interval >= pipe->socket_timeout) {
+                CM_THROW_ERROR(ERR_TCP_TIMEOUT, "send data");
+                return CM_ERROR;
+            }
+            continue;
+        }
+        if (cs_tcp_sendv(&pipe->link.tcp, send_iov, remain_cnt, &send_size) != CM_SUCCESS) {
+            return CM_ERROR;
+        }
+        cs_consume_iov(&send_iov, &remain_cnt, (uint32)send_size);
+        *sent += (uint32)send_size;
+    }
+
+    return CM_SUCCESS;
+}
+
 status_t cs_send_bytes(cs_pipe_t *pipe, const char *buf, uint32 size)
 {
     return VIO_SEND_TIMED(pipe, buf, size, CM_NETWORK_IO_TIMEOUT);
 }
 
-status_t cs_read_bytes(cs_pipe_t *pipe, char *buf, uint32 max_size, int32 *size)
+/* read what the pipe holds now, must follow cs_wait reporting the pipe readable */
+status_t cs_read_available(cs_pipe_t *pipe, char *buf, uint32 max_size, int32 *size)
 {
     uint32 wait_event;
+    return VIO_RECV(pipe, buf, max_size, size, &wait_event);
+}
+
+status_t cs_read_bytes(cs_pipe_t *pipe, char *buf, uint32 max_size, int32 *size)
+{
     if (cs_wait(pipe, CS_WAIT_FOR_READ, CM_NETWORK_IO_TIMEOUT, NULL) != CM_SUCCESS) {
         return CM_ERROR;
     }
 
-    return VIO_RECV(pipe, buf, max_size, size, &wait_event);
+    return cs_read_available(pipe, buf, max_size, size);
 }
 
 status_t cs_read_fixed_size(cs_pipe_t *pipe, char *buf, uint32 size)
@@ -599,6 +688,284 @@ status_t cs_call_timed(cs_pipe_t *pipe, cs_packet_t *req, cs_packet_t *ack)
     return cs_read(pipe, ack, CM_TRUE);
 }
 
+void cs_mux_init(cs_mux_t *mux, cs_pipe_t *pipe)
+{
+    (void)memset_s(mux, sizeof(cs_mux_t), 0, sizeof(cs_mux_t));
+    mux->pipe = pipe;
+    cm_init_thread_lock(&mux->send_lock);
+    GS_INIT_SPIN_LOCK(mux->lock);
+    cm_park_init(&mux->park);
+}
+
+static inline void cs_mux_wake(cs_mux_t *mux)
+{
+    CM_MFENCE;
+    if (cm_atomic32_get(&mux->park.waiters) > 0) {
+        cm_park_wake(&mux->park, INT32_MAX);
+    }
+}
+
+// caller holds mux->lock
+static cs_mux_call_t *cs_mux_unlink(cs_mux_t *mux, uint32 serial)
+{
+    cs_mux_call_t **prev = &mux->buckets[serial % CS_MUX_BUCKETS];
+    while (*prev != NULL) {
+        cs_mux_call_t *call = *prev;
+        if (call->serial == serial) {
+            *prev = call->next;
+            call->next = NULL;
+            mux->pending--;
+            return call;
+        }
+        prev = &call->next;
+    }
+    return NULL;
+}
+
+static void cs_mux_fail_all(cs_mux_t *mux)
+{
+    cm_spin_lock(&mux->lock, NULL);
+    mux->broken = CM_TRUE;
+    for (uint32 i = 0; i < CS_MUX_BUCKETS; i++) {
+        cs_mux_call_t *call = mux->buckets[i];
+        while (call != NULL) {
+            cs_mux_call_t *next = call->next;
+            call->next = NULL;
+            call->state = CS_MUX_FAILED;
+            call = next;
+        }
+        mux->buckets[i] = NULL;
+    }
+    mux->pending = 0;
+    cm_spin_unlock(&mux->lock);
+    cs_mux_wake(mux);
+}
+
+void cs_mux_destroy(cs_mux_t *mux)
+{
+    cs_mux_fail_all(mux);
+}
+
+status_t cs_mux_send_batch(cs_mux_t *mux, cs_packet_t **reqs, cs_packet_t **acks, cs_mux_call_t *calls, uint32 count)
+{
+    cs_iovec_t iov[CS_MUX_MAX_BATCH];
+    cs_pipe_t *pipe = mux->pipe;
+    uint32 done = 0;
+
+    cm_thread_lock(&mux->send_lock);
+    while (done < count) {
+        uint32 batch = MIN(count - done, CS_MUX_MAX_BATCH);
+
+        // register before sending, the response may come back before the send returns
+        cm_spin_lock(&mux->lock, NULL);
+        if (mux->broken) {
+            cm_spin_unlock(&mux->lock);
+            cm_thread_unlock(&mux->send_lock);
+            CM_THROW_ERROR(ERR_PEER_CLOSED, "multiplexed pipe");
+            return CM_ERROR;
+        }
+        for (uint32 i = 0; i < batch; i++) {
+            cs_mux_call_t *call = &calls[done + i];
+            call->ack = acks[done + i];
+            call->serial = ++mux->serial;
+            call->state = CS_MUX_PENDING;
+            call->next = mux->buckets[call->serial % CS_MUX_BUCKETS];
+            mux->buckets[call->serial % CS_MUX_BUCKETS] = call;
+            mux->pending++;
+        }
+        cm_spin_unlock(&mux->lock);
+
+        for (uint32 i = 0; i < batch; i++) {
+            cs_packet_t *req = reqs[done + i];
+            req->options = pipe->options;
+            req->head->serial_number = calls[done + i].serial;
+            iov[i].iov_base = req->buf;
+            iov[i].iov_len = req->head->size;
+            if (CS_DIFFERENT_ENDIAN(req->options)) {
+                req->head->size = cs_reverse_int32(req->head->size);
+                req->head->flags = cs_reverse_int16(req->head->flags);
+                req->head->version = cs_reverse_int32(req->head->version);
+                req->head->serial_number = cs_reverse_int32(req->head->serial_number);
+            }
+        }
+        if (cs_send_fixed_iov(pipe, iov, batch) != CM_SUCCESS) {
+            // the stream may hold a partial packet now, nothing on this pipe can be trusted
+            cm_thread_unlock(&mux->send_lock);
+            cs_mux_fail_all(mux);
+            return CM_ERROR;
+        }
+        done += batch;
+    }
+    cm_thread_unlock(&mux->send_lock);
+    return CM_SUCCESS;
+}
+
+static status_t cs_mux_drain(cs_pipe_t *pipe, uint32 size)
+{
+    char buf[CM_INIT_PACKET_SIZE];
+    while (size > 0) {
+        uint32 len = MIN(size, (uint32)sizeof(buf));
+        if (VIO_RECV_TIMED(pipe, buf, len, CM_NETWORK_IO_TIMEOUT) != CM_SUCCESS) {
+            return CM_ERROR;
+        }
+        size -= len;
+    }
+    return CM_SUCCESS;
+}
+
+/* reads one response and completes the call it belongs to, called by the reader only */
+static status_t cs_mux_read_response(cs_mux_t *mux)
+{
+    cs_packet_head_t head;
+    cs_pipe_t *pipe = mux->pipe;
+    uint32 head_size = (uint32)sizeof(cs_packet_head_t);
+
+    if (VIO_RECV_TIMED(pipe, (char *)&head, head_size, CM_NETWORK_IO_TIMEOUT) != CM_SUCCESS) {
+        return CM_ERROR;
+    }
+    if (CS_DIFFERENT_ENDIAN(pipe->options)) {
+        head.size = cs_reverse_int32(head.size);
+        head.flags = cs_reverse_int16(head.flags);
+        head.version = cs_reverse_int32(head.version);
+        head.serial_number = cs_reverse_int32(head.serial_number);
+    }
+    if (head.size < head_size) {
+        CM_THROW_ERROR(ERR_INVALID_PROTOCOL);
+        return CM_ERROR;
+    }
+
+    cm_spin_lock(&mux->lock, NULL);
+    cs_mux_call_t *call = cs_mux_unlink(mux, head.serial_number);
+    if (call != NULL) {
+        call->state = CS_MUX_RECEIVING;
+    }
+    cm_spin_unlock(&mux->lock);
+
+    if (call == NULL) {
+        // the caller gave up waiting, drop the response
+        return cs_mux_drain(pipe, head.size - head_size);
+    }
+
+    cs_packet_t *ack = call->ack;
+    ack->options = pipe->options;
+    *ack->head = head;
+    if (cs_try_realloc_packet_buffer(ack, head_size) != CM_SUCCESS ||
+        VIO_RECV_TIMED(pipe, ack->buf + head_size, head.size - head_size, CM_NETWORK_IO_TIMEOUT) != CM_SUCCESS) {
+        call->state = CS_MUX_FAILED;
+        return CM_ERROR;
+    }
+    CM_MFENCE;
+    call->state = CS_MUX_DONE;
+    return CM_SUCCESS;
+}
+
+static inline int32 cs_mux_remain(uint64 deadline)
+{
+    if (deadline == 0) {
+        return CS_MUX_WAIT_SLICE;
+    }
+    uint64 now = cm_monotonic_usec();
+    if (now >= deadline) {
+        return 0;
+    }
+    return (int32)MIN((deadline - now + MICROSECS_PER_MILLISEC - 1) / MICROSECS_PER_MILLISEC, CS_MUX_WAIT_SLICE);
+}
+
+/* reads responses of everyone until the own one arrives */
+static status_t cs_mux_read_until(cs_mux_t *mux, cs_mux_call_t *call, uint64 deadline)
+{
+    bool32 ready = CM_FALSE;
+
+    while (call->state < CS_MUX_DONE) {
+        int32 wait_ms = cs_mux_remain(deadline);
+        if (wait_ms == 0) {
+            return CM_TIMEDOUT;
+        }
+        if (cs_wait(mux->pipe, CS_WAIT_FOR_READ, wait_ms, &ready) != CM_SUCCESS) {
+            return CM_ERROR;
+        }
+        if (!ready) {
+            continue;
+        }
+        if (cs_mux_read_response(mux) != CM_SUCCESS) {
+            return CM_ERROR;
+        }
+        cs_mux_wake(mux);
+    }
+    return CM_SUCCESS;
+}
+
+status_t cs_mux_wait(cs_mux_t *mux, cs_mux_call_t *call, int32 timeout)
+{
+    uint64 deadline = timeout < 0 ? 0 : cm_monotonic_usec() + (uint64)timeout * MICROSECS_PER_MILLISEC;
+
+    for (;;) {
+        uint32 state = call->state;
+        if (state == CS_MUX_DONE) {
+            CM_MFENCE;
+            return CM_SUCCESS;
+        }
+        if (state == CS_MUX_FAILED) {
+            CM_THROW_ERROR(ERR_PEER_CLOSED, "multiplexed pipe");
+            return CM_ERROR;
+        }
+
+        cm_spin_lock(&mux->lock, NULL);
+        bool32 lead = (state == CS_MUX_PENDING && !mux->reading);
+        if (lead) {
+            mux->reading = CM_TRUE;
+        }
+        cm_spin_unlock(&mux->lock);
+
+        if (lead) {
+            status_t ret = cs_mux_read_until(mux, call, deadline);
+            cm_spin_lock(&mux->lock, NULL);
+            mux->reading = CM_FALSE;
+            cm_spin_unlock(&mux->lock);
+            if (ret == CM_ERROR) {
+                cs_mux_fail_all(mux);
+                return CM_ERROR;
+            }
+            // hand the reader role over to the others still waiting
+            cs_mux_wake(mux);
+            if (ret == CM_SUCCESS) {
+                continue;
+            }
+        } else {
+            uint32 seq = cm_park_prepare(&mux->park);
+            int32 wait_ms = cs_mux_remain(deadline);
+            if (call->state != state || !mux->reading || wait_ms == 0) {
+                cm_park_cancel(&mux->park);
+            } else {
+                cm_park_wait(&mux->park, seq, (uint32)wait_ms);
+                continue;
+            }
+        }
+
+        if (cs_mux_remain(deadline) > 0 || call->state != CS_MUX_PENDING) {
+            continue;
+        }
+        cm_spin_lock(&mux->lock, NULL);
+        bool32 gone = (call->state == CS_MUX_PENDING && cs_mux_unlink(mux, call->serial) == call);
+        cm_spin_unlock(&mux->lock);
+        if (gone) {
+            CM_THROW_ERROR(ERR_SOCKET_TIMEOUT, timeout / (int32)CM_TIME_THOUSAND_UN);
+            return CM_ERROR;
+        }
+        // being received right now, wait for it to settle
+    }
+}
+
+status_t cs_mux_call(cs_mux_t *mux, cs_packet_t *req, cs_packet_t *ack)
+{
+    cs_mux_call_t call;
+
+    if (cs_mux_send_batch(mux, &req, &ack, &call, 1) != CM_SUCCESS) {
+        return CM_ERROR;
+    }
+    return cs_mux_wait(mux, &call, mux->pipe->socket_timeout);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,9 @@
 #include "cs_packet.h"
 #include "cs_ssl.h"
 #include "cs_uds.h"
+#include "cm_spinlock.h"
+#include "cm_sync.h"
+#include "cm_thread.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -82,7 +85,10 @@ void cs_shutdown(const cs_pipe_t *pipe);
 status_t cs_wait(cs_pipe_t *pipe, uint32 wait_for, int32 timeout, bool32 *ready);
 status_t cs_read_bytes(cs_pipe_t *pipe, char *buf, uint32 max_size, int32 *size);
 status_t cs_read_fixed_size(cs_pipe_t *pipe, char *buf, uint32 size);
+status_t cs_read_available(cs_pipe_t *pipe, char *buf, uint32 max_size, int32 *size);
 status_t cs_send_fixed_size(cs_pipe_t *pipe, char *buf, int32 size);
+status_t cs_send_fixed_iov(cs_pipe_t *pipe, cs_iovec_t *iov, uint32 iov_cnt);
+status_t cs_send_fixed_iov_ex(cs_pipe_t *pipe, cs_iovec_t *iov, uint32 iov_cnt, uint32 *sent);
 status_t cs_send_bytes(cs_pipe_t *pipe, const char *buf, uint32 size);
 socket_t cs_get_socket_fd(const cs_pipe_t *pipe);
 
@@ -95,6 +101,53 @@ status_t cs_write(cs_pipe_t *pipe, cs_packet_t *pack);
 status_t cs_call(cs_pipe_t *pipe, cs_packet_t *req, cs_packet_t *ack);
 status_t cs_call_timed(cs_pipe_t *pipe, cs_packet_t *req, cs_packet_t *ack);
 
+/*
+  Multiplexed client mode: many threads share one pipe, every request gets a serial number
+  and the response carrying the same serial_number completes it, in any order.
+  @note
+    The server must echo serial_number in the response head.
+    No background thread, the first waiter becomes the reader and dispatches responses
+    of other callers into their ack packets, then hands the role over when its own one arrives.
+*/
+#define CS_MUX_BUCKETS    64
+#define CS_MUX_MAX_BATCH  64
+#define CS_MUX_WAIT_SLICE 100 // ms, the reader re-checks its own deadline at least this often
+
+typedef enum en_cs_mux_state {
+    CS_MUX_PENDING = 0,
+    CS_MUX_RECEIVING = 1,
+    CS_MUX_DONE = 2,
+    CS_MUX_FAILED = 3,
+} cs_mux_state_t;
+
+typedef struct st_cs_mux_call {
+    cs_packet_t *ack;
+    uint32 serial;
+    volatile uint32 state;
+    struct st_cs_mux_call *next;
+} cs_mux_call_t;
+
+typedef struct st_cs_mux {
+    cs_pipe_t *pipe;
+    thread_lock_t send_lock; // keeps packets of concurrent senders apart
+    spinlock_t lock;         // protects the pending table and the reader role
+    bool32 reading;
+    volatile bool32 broken;
+    uint32 serial;
+    uint32 pending;
+    cs_mux_call_t *buckets[CS_MUX_BUCKETS];
+    cm_park_t park;          // callers waiting for the reader
+} cs_mux_t;
+
+void cs_mux_init(cs_mux_t *mux, cs_pipe_t *pipe);
+/* fails all pending calls, the pipe is left to the owner */
+void cs_mux_destroy(cs_mux_t *mux);
+/* writes the requests in one go, waiting for the responses is left to cs_mux_wait */
+status_t cs_mux_send_batch(cs_mux_t *mux, cs_packet_t **reqs, cs_packet_t **acks, cs_mux_call_t *calls, uint32 count);
+/* timeout's unit is milliseconds, negative means no timeout */
+status_t cs_mux_wait(cs_mux_t *mux, cs_mux_call_t *call, int32 timeout);
+status_t cs_mux_call(cs_mux_t *mux, cs_packet_t *req, cs_packet_t *ack);
+
 
 #ifdef __cplusplus
 }
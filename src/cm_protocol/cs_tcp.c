@@ -503,6 +503,39 @@ status_t cs_tcp_send(const tcp_link_t *link, const char *buf, uint32 size, int32
     return CM_SUCCESS;
 }
 
+/* gather send, the return size may stop in the middle of any iov */
+status_t cs_tcp_sendv(const tcp_link_t *link, cs_iovec_t *iov, uint32 iov_cnt, int32 *send_size)
+{
+    if (iov_cnt == 0) {
+        *send_size = 0;
+        return CM_SUCCESS;
+    }
+
+#ifdef WIN32
+    return cs_tcp_send(link, (const char *)iov[0].iov_base, (uint32)iov[0].iov_len, send_size);
+#else
+    int code;
+    struct msghdr msg = { 0 };
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_cnt;
+    do {
+        *send_size = (int32)sendmsg(link->sock, &msg, 0);
+    } while (*send_size < 0 && errno == EINTR);
+    if (*send_size <= 0) {
+        code = errno;
+        if (code == EWOULDBLOCK || code == EAGAIN) {
+            *send_size = 0;
+            return CM_SUCCESS;
+        }
+
+        CM_THROW_ERROR(ERR_PEER_CLOSED_REASON, "tcp", code);
+        return CM_ERROR;
+    }
+
+    return CM_SUCCESS;
+#endif
+}
+
 status_t cs_tcp_send_timed(tcp_link_t *link, const char *buf, uint32 size, uint32 timeout)
 {
     uint32 remain_size, offset;
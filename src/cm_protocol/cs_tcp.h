@@ -57,6 +57,7 @@ typedef int32 socklen_t;
 #include <fcntl.h>
 #include <stddef.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 
 #define cs_close_socket close
 #define cs_ioctl_socket ioctl
@@ -72,6 +73,15 @@ extern "C" {
 #endif
 
 
+#ifdef WIN32
+typedef struct st_cs_iovec {
+    void *iov_base;
+    size_t iov_len;
+} cs_iovec_t;
+#else
+typedef struct iovec cs_iovec_t;
+#endif
+
 typedef struct st_tcp_link {
     socket_t sock; // need to be first!
     bool32 closed; // need to be second!
@@ -97,6 +107,7 @@ bool32 cs_tcp_try_connect(const char *host, uint16 port);
 void cs_tcp_disconnect(tcp_link_t *link);
 void cs_shutdown_socket(socket_t sock);
 status_t cs_tcp_send(const tcp_link_t *link, const char *buf, uint32 size, int32 *send_size);
+status_t cs_tcp_sendv(const tcp_link_t *link, cs_iovec_t *iov, uint32 iov_cnt, int32 *send_size);
 status_t cs_tcp_send_timed(tcp_link_t *link, const char *buf, uint32 size, uint32 timeout);
 status_t cs_tcp_recv(const tcp_link_t *link, char *buf, uint32 size, int32 *recv_size, uint32 *wait_event);
 status_t cs_tcp_recv_timed(tcp_link_t *link, char *buf, uint32 size, uint32 timeout);
@@ -23,17 +23,27 @@
  */
 #include "cm_chan.h"
 #include "cm_error.h"
+#include "cm_memory.h"
+#include "cm_timer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define CHAN_IS_LOCK_FREE(chan) (((chan)->flags & (CHAN_FLAG_LOCK_FREE | CHAN_FLAG_SPSC)) != 0)
+#define CHAN_IS_SPSC(chan)      (((chan)->flags & CHAN_FLAG_SPSC) != 0)
+
 // create an new chan
 chan_t *cm_chan_new(uint32 capacity, uint32 size)
+{
+    return cm_chan_new_ex(capacity, size, 0);
+}
+
+chan_t *cm_chan_new_ex(uint32 capacity, uint32 size, uint32 flags)
 {
     errno_t rc_memzero;
-    uint32 real_size;
-    if (capacity == 0 || size == 0) {
+    uint64 real_size;
+    if (capacity == 0 || size == 0 || capacity > CHAN_MAX_CAPACITY) {
         return NULL;
     }
 
@@ -46,15 +56,28 @@ chan_t *cm_chan_new(uint32 capacity, uint32 size)
         CM_FREE_PTR(chan);
         return NULL;
     }
-    chan->capacity = capacity;
-    chan->count = 0;
-    chan->size = size;
-    real_size = size * capacity;
-    if (real_size / capacity != size) {
+    chan->flags = flags;
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        uint32 cells = 1;
+        while (cells < capacity) {
+            cells <<= 1;
+        }
+        capacity = cells;
+        chan->mask = cells - 1;
+        chan->stride = CM_ALIGN8((uint32)sizeof(atomic_t) + size);
+        real_size = (uint64)chan->stride * capacity;
+    } else {
+        chan->stride = size;
+        real_size = (uint64)size * capacity;
+    }
+    if (real_size > UINT32_MAX) {
         CM_FREE_PTR(chan);
         return NULL;
     }
-    chan->buf = (uint8 *)malloc(real_size);
+    chan->capacity = capacity;
+    chan->count = 0;
+    chan->size = size;
+    chan->buf = (uint8 *)malloc((size_t)real_size);
     if (chan->buf == NULL) {
         CM_FREE_PTR(chan);
         return NULL;
@@ -65,10 +88,21 @@ chan_t *cm_chan_new(uint32 capacity, uint32 size)
         CM_FREE_PTR(chan);
         return NULL;
     }
-    chan->buf_end = chan->buf + size * capacity;
+    chan->buf_end = chan->buf + real_size;
     chan->begin = chan->buf;
     chan->end = chan->buf;
 
+    // a cell is free for the sender at position pos when its sequence equals pos
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        for (uint32 i = 0; i < capacity; i++) {
+            *(atomic_t *)(chan->buf + (uint64)i * chan->stride) = (int64)i;
+        }
+    }
+    cm_park_init(&chan->park_send);
+    cm_park_init(&chan->park_recv);
+    chan->enq_pos = 0;
+    chan->deq_pos = 0;
+
     chan->lock = 0;
     (void)cm_event_init(&chan->event_send);
     (void)cm_event_init(&chan->event_recv);
@@ -80,12 +114,242 @@ chan_t *cm_chan_new(uint32 capacity, uint32 size)
     return chan;
 }
 
+static inline atomic_t *cm_chan_cell(chan_t *chan, int64 pos)
+{
+    return (atomic_t *)(chan->buf + ((uint64)pos & chan->mask) * chan->stride);
+}
+
+#define CHAN_CELL_DATA(cell) ((uint8 *)(cell) + sizeof(atomic_t))
+
+static inline uint32 cm_chan_lf_count(chan_t *chan)
+{
+    int64 count = cm_atomic_get(&chan->enq_pos) - cm_atomic_get(&chan->deq_pos);
+    return count > 0 ? (uint32)count : 0;
+}
+
+// claim up to count cells for the sender, return the first position and the number claimed
+static uint32 cm_chan_lf_claim_send(chan_t *chan, uint32 count, int64 *first)
+{
+    int64 pos;
+    uint32 n;
+
+    if (CHAN_IS_SPSC(chan)) {
+        pos = cm_atomic_get(&chan->enq_pos);
+        n = MIN(count, chan->capacity - (uint32)(pos - cm_atomic_get(&chan->deq_pos)));
+        *first = pos;
+        return n;
+    }
+
+    for (;;) {
+        pos = cm_atomic_get(&chan->enq_pos);
+        int64 diff = cm_atomic_get(cm_chan_cell(chan, pos)) - pos;
+        if (diff < 0) {
+            return 0; // full
+        }
+        if (diff > 0) {
+            continue; // another sender took pos
+        }
+        n = 1;
+        while (n < count && cm_atomic_get(cm_chan_cell(chan, pos + n)) == pos + n) {
+            n++;
+        }
+        if (cm_atomic_cas(&chan->enq_pos, pos, pos + n)) {
+            *first = pos;
+            return n;
+        }
+    }
+}
+
+static uint32 cm_chan_lf_claim_recv(chan_t *chan, uint32 count, int64 *first)
+{
+    int64 pos;
+    uint32 n;
+
+    if (CHAN_IS_SPSC(chan)) {
+        pos = cm_atomic_get(&chan->deq_pos);
+        n = MIN(count, (uint32)(cm_atomic_get(&chan->enq_pos) - pos));
+        *first = pos;
+        return n;
+    }
+
+    for (;;) {
+        pos = cm_atomic_get(&chan->deq_pos);
+        int64 diff = cm_atomic_get(cm_chan_cell(chan, pos)) - (pos + 1);
+        if (diff < 0) {
+            return 0; // empty
+        }
+        if (diff > 0) {
+            continue;
+        }
+        n = 1;
+        while (n < count && cm_atomic_get(cm_chan_cell(chan, pos + n)) == pos + n + 1) {
+            n++;
+        }
+        if (cm_atomic_cas(&chan->deq_pos, pos, pos + n)) {
+            *first = pos;
+            return n;
+        }
+    }
+}
+
+static uint32 cm_chan_lf_push(chan_t *chan, const uint8 *elems, uint32 count)
+{
+    int64 pos;
+    uint32 n = cm_chan_lf_claim_send(chan, count, &pos);
+    if (n == 0) {
+        return 0;
+    }
+
+    for (uint32 i = 0; i < n; i++) {
+        (void)memcpy_sp(CHAN_CELL_DATA(cm_chan_cell(chan, pos + i)), chan->size, elems + (uint64)i * chan->size,
+            chan->size);
+    }
+    // elements must be visible before they are published
+    CM_WMB;
+    if (CHAN_IS_SPSC(chan)) {
+        // the locked add also orders the publish before the loads below
+        (void)cm_atomic_add(&chan->enq_pos, (int64)n);
+    } else {
+        for (uint32 i = 0; i + 1 < n; i++) {
+            (void)cm_atomic_set(cm_chan_cell(chan, pos + i), pos + i + 1);
+        }
+        // the cell is ours, the cas always succeeds and is cheaper than a separate fence
+        (void)cm_atomic_cas(cm_chan_cell(chan, pos + n - 1), pos + n - 1, pos + n);
+    }
+    /*
+     * receivers park only on an empty chan, so nobody can be parked unless all before pos is taken.
+     * Only this transition wakes, so it wakes every receiver parked on it.
+     */
+    if (cm_atomic_get(&chan->deq_pos) >= pos && cm_atomic32_get(&chan->park_send.waiters) > 0) {
+        cm_park_wake(&chan->park_send, INT32_MAX);
+    }
+    return n;
+}
+
+static uint32 cm_chan_lf_pop(chan_t *chan, uint8 *elems, uint32 count)
+{
+    int64 pos;
+    uint32 n = cm_chan_lf_claim_recv(chan, count, &pos);
+    if (n == 0) {
+        return 0;
+    }
+
+    CM_RMB;
+    for (uint32 i = 0; i < n; i++) {
+        (void)memcpy_sp(elems + (uint64)i * chan->size, chan->size, CHAN_CELL_DATA(cm_chan_cell(chan, pos + i)),
+            chan->size);
+    }
+    // copies must be done before the cells are handed back to senders, a load barrier orders later stores too
+    CM_RMB;
+    if (CHAN_IS_SPSC(chan)) {
+        (void)cm_atomic_add(&chan->deq_pos, (int64)n);
+    } else {
+        for (uint32 i = 0; i + 1 < n; i++) {
+            (void)cm_atomic_set(cm_chan_cell(chan, pos + i), pos + i + chan->capacity);
+        }
+        (void)cm_atomic_cas(cm_chan_cell(chan, pos + n - 1), pos + n, pos + n - 1 + chan->capacity);
+    }
+    // likewise senders park only on a full chan
+    if (cm_atomic_get(&chan->enq_pos) >= pos + chan->capacity && cm_atomic32_get(&chan->park_recv.waiters) > 0) {
+        cm_park_wake(&chan->park_recv, INT32_MAX);
+    }
+    return n;
+}
+
+/*
+ * park until the chan may have changed, returns CM_TIMEDOUT once the deadline is passed.
+ * *deadline is 0 before the first wait of a call.
+ */
+static status_t cm_chan_lf_park(chan_t *chan, bool32 is_sender, uint32 timeout_ms, uint64 *deadline)
+{
+    cm_park_t *park = is_sender ? &chan->park_recv : &chan->park_send;
+    uint32 seq = cm_park_prepare(park);
+    uint32 count = cm_chan_lf_count(chan);
+    if (chan->is_closed || (is_sender ? count < chan->capacity : count > 0)) {
+        cm_park_cancel(park);
+        return CM_SUCCESS;
+    }
+
+    uint32 wait_ms = timeout_ms;
+    if (timeout_ms != CM_INFINITE_TIMEOUT) {
+        uint64 now = cm_monotonic_usec();
+        if (*deadline == 0) {
+            *deadline = now + (uint64)timeout_ms * MICROSECS_PER_MILLISEC;
+        }
+        if (now >= *deadline) {
+            cm_park_cancel(park);
+            return CM_TIMEDOUT;
+        }
+        wait_ms = (uint32)((*deadline - now + MICROSECS_PER_MILLISEC - 1) / MICROSECS_PER_MILLISEC);
+    }
+    cm_park_wait(park, seq, wait_ms);
+    return CM_SUCCESS;
+}
+
+static status_t cm_chan_lf_send_batch(chan_t *chan, const uint8 *elems, uint32 count, uint32 *sent,
+    uint32 timeout_ms)
+{
+    uint64 deadline = 0;
+    uint32 done = 0;
+    status_t ret = CM_SUCCESS;
+
+    while (done < count) {
+        if (chan->is_closed) {
+            ret = CM_ERROR;
+            break;
+        }
+        uint32 n = cm_chan_lf_push(chan, elems + (uint64)done * chan->size, count - done);
+        if (n > 0) {
+            done += n;
+            continue;
+        }
+        ret = cm_chan_lf_park(chan, CM_TRUE, timeout_ms, &deadline);
+        if (ret != CM_SUCCESS) {
+            break;
+        }
+    }
+    if (sent != NULL) {
+        *sent = done;
+    }
+    return ret;
+}
+
+static status_t cm_chan_lf_recv_batch(chan_t *chan, uint8 *elems, uint32 count, uint32 *recvd, uint32 timeout_ms)
+{
+    uint64 deadline = 0;
+    uint32 n = 0;
+    status_t ret = CM_SUCCESS;
+
+    for (;;) {
+        n = cm_chan_lf_pop(chan, elems, count);
+        if (n > 0) {
+            break;
+        }
+        if (chan->is_closed && cm_chan_lf_count(chan) == 0) {
+            ret = CM_ERROR;
+            break;
+        }
+        ret = cm_chan_lf_park(chan, CM_FALSE, timeout_ms, &deadline);
+        if (ret != CM_SUCCESS) {
+            break;
+        }
+    }
+    if (recvd != NULL) {
+        *recvd = n;
+    }
+    return ret;
+}
+
 status_t cm_chan_send_timeout(chan_t *chan, const void *elem, uint32 timeout_ms)
 {
     errno_t errcode;
+    bool32 pass_on = CM_FALSE;
     if (chan == NULL || elem == NULL) {
         return CM_ERROR;
     }
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        return cm_chan_lf_send_batch(chan, (const uint8 *)elem, 1, NULL, timeout_ms);
+    }
 
     cm_spin_lock(&chan->lock, NULL);
     {
@@ -104,6 +368,7 @@ status_t cm_chan_send_timeout(chan_t *chan, const void *elem, uint32 timeout_ms)
             }
 
             cm_spin_lock(&chan->lock, NULL);
+            pass_on = CM_TRUE;
 
             if (chan->count < chan->capacity) {
                 break;
@@ -126,10 +391,15 @@ status_t cm_chan_send_timeout(chan_t *chan, const void *elem, uint32 timeout_ms)
         }
         chan->end += chan->size;
         chan->count++;
+        pass_on = pass_on && chan->count < chan->capacity;
     }
     cm_spin_unlock(&chan->lock);
 
     cm_event_notify(&chan->event_send);
+    if (pass_on) {
+        // the event keeps one signal only, hand the space left over to the next waiting sender
+        cm_event_notify(&chan->event_recv);
+    }
 
     return CM_SUCCESS;
 }
@@ -140,6 +410,12 @@ status_t cm_chan_try_send(chan_t *chan, const void *elem)
     if (chan == NULL || elem == NULL) {
         return CM_ERROR;
     }
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        if (chan->is_closed || cm_chan_lf_push(chan, (const uint8 *)elem, 1) == 0) {
+            return CM_ERROR;
+        }
+        return CM_SUCCESS;
+    }
 
     cm_spin_lock(&chan->lock, NULL);
     {
@@ -189,9 +465,13 @@ status_t cm_chan_send(chan_t *chan, const void *elem)
 status_t cm_chan_recv_timeout(chan_t *chan, void *elem, uint32 timeout_ms)
 {
     errno_t errcode;
+    bool32 pass_on = CM_FALSE;
     if (chan == NULL || elem == NULL) {
         return CM_ERROR;
     }
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        return cm_chan_lf_recv_batch(chan, (uint8 *)elem, 1, NULL, timeout_ms);
+    }
 
     cm_spin_lock(&chan->lock, NULL);
     {
@@ -215,6 +495,7 @@ status_t cm_chan_recv_timeout(chan_t *chan, void *elem, uint32 timeout_ms)
             }
 
             cm_spin_lock(&chan->lock, NULL);
+            pass_on = CM_TRUE;
 
             if (chan->count > 0) {
                 break;
@@ -237,10 +518,15 @@ status_t cm_chan_recv_timeout(chan_t *chan, void *elem, uint32 timeout_ms)
         }
         chan->begin += chan->size;
         chan->count--;
+        pass_on = pass_on && chan->count > 0;
     }
     cm_spin_unlock(&chan->lock);
 
     cm_event_notify(&chan->event_recv);
+    if (pass_on) {
+        // likewise hand the elements left over to the next waiting receiver
+        cm_event_notify(&chan->event_send);
+    }
 
     return CM_SUCCESS;
 }
@@ -251,9 +537,145 @@ status_t cm_chan_recv(chan_t *chan, void *elem)
     return cm_chan_recv_timeout(chan, elem, 0xFFFFFFFF);
 }
 
+// copy as many elements as there is space for under one lock hold
+static status_t cm_chan_put_locked(chan_t *chan, const uint8 *elems, uint32 count, uint32 *done)
+{
+    errno_t errcode;
+    while (*done < count && chan->count < chan->capacity) {
+        if (chan->end >= chan->buf_end) {
+            chan->end = chan->buf;
+        }
+        errcode = memcpy_sp(chan->end, (size_t)(chan->buf_end - chan->end), elems + (uint64)(*done) * chan->size,
+            (size_t)chan->size);
+        if (errcode != EOK) {
+            CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+            return CM_ERROR;
+        }
+        chan->end += chan->size;
+        chan->count++;
+        (*done)++;
+    }
+    return CM_SUCCESS;
+}
+
+static status_t cm_chan_get_locked(chan_t *chan, uint8 *elems, uint32 count, uint32 *done)
+{
+    errno_t errcode;
+    while (*done < count && chan->count > 0) {
+        if (chan->begin >= chan->buf_end) {
+            chan->begin = chan->buf;
+        }
+        errcode = memcpy_sp(elems + (uint64)(*done) * chan->size, (size_t)chan->size, chan->begin,
+            (size_t)chan->size);
+        if (errcode != EOK) {
+            CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+            return CM_ERROR;
+        }
+        chan->begin += chan->size;
+        chan->count--;
+        (*done)++;
+    }
+    return CM_SUCCESS;
+}
+
+status_t cm_chan_send_batch(chan_t *chan, const void *elems, uint32 count, uint32 *sent, uint32 timeout_ms)
+{
+    status_t ret = CM_SUCCESS;
+    uint32 done = 0;
+    bool32 waited = CM_FALSE;
+    if (chan == NULL || elems == NULL) {
+        return CM_ERROR;
+    }
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        return cm_chan_lf_send_batch(chan, (const uint8 *)elems, count, sent, timeout_ms);
+    }
+
+    while (done < count) {
+        uint32 last = done;
+        cm_spin_lock(&chan->lock, NULL);
+        if (chan->buf == NULL || chan->is_closed) {
+            cm_spin_unlock(&chan->lock);
+            ret = CM_ERROR;
+            break;
+        }
+        ret = cm_chan_put_locked(chan, (const uint8 *)elems, count, &done);
+        bool32 pass_on = waited && chan->count < chan->capacity;
+        cm_spin_unlock(&chan->lock);
+
+        if (done > last) {
+            cm_event_notify(&chan->event_send);
+        }
+        if (pass_on) {
+            cm_event_notify(&chan->event_recv);
+        }
+        if (ret != CM_SUCCESS || done == count) {
+            break;
+        }
+        // chan is full, wait for the recv signal
+        if (CM_TIMEDOUT == cm_event_timedwait(&chan->event_recv, timeout_ms)) {
+            ret = CM_TIMEDOUT;
+            break;
+        }
+        waited = CM_TRUE;
+    }
+    if (sent != NULL) {
+        *sent = done;
+    }
+    return ret;
+}
+
+status_t cm_chan_recv_batch(chan_t *chan, void *elems, uint32 count, uint32 *recvd, uint32 timeout_ms)
+{
+    status_t ret = CM_SUCCESS;
+    uint32 done = 0;
+    bool32 waited = CM_FALSE;
+    if (chan == NULL || elems == NULL || count == 0) {
+        return CM_ERROR;
+    }
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        return cm_chan_lf_recv_batch(chan, (uint8 *)elems, count, recvd, timeout_ms);
+    }
+
+    for (;;) {
+        cm_spin_lock(&chan->lock, NULL);
+        if (chan->buf == NULL || (chan->count == 0 && chan->is_closed)) {
+            cm_spin_unlock(&chan->lock);
+            ret = CM_ERROR;
+            break;
+        }
+        ret = cm_chan_get_locked(chan, (uint8 *)elems, count, &done);
+        bool32 pass_on = waited && chan->count > 0;
+        cm_spin_unlock(&chan->lock);
+
+        if (done > 0) {
+            cm_event_notify(&chan->event_recv);
+        }
+        if (pass_on) {
+            cm_event_notify(&chan->event_send);
+        }
+        if (ret != CM_SUCCESS || done > 0) {
+            break;
+        }
+        // chan is empty, wait for the send signal
+        if (CM_TIMEDOUT == cm_event_timedwait(&chan->event_send, timeout_ms)) {
+            ret = CM_TIMEDOUT;
+            break;
+        }
+        waited = CM_TRUE;
+    }
+    if (recvd != NULL) {
+        *recvd = done;
+    }
+    return ret;
+}
+
 // is the chan empty
 bool32 cm_chan_empty(chan_t *chan)
 {
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        return cm_chan_lf_count(chan) == 0;
+    }
+
     cm_spin_lock(&chan->lock, NULL);
     if (chan->count == 0) {
         cm_spin_unlock(&chan->lock);
@@ -286,6 +708,11 @@ void cm_chan_close(chan_t *chan)
     }
 
     cm_spin_unlock(&chan->lock);
+
+    if (CHAN_IS_LOCK_FREE(chan)) {
+        cm_park_wake(&chan->park_send, INT32_MAX);
+        cm_park_wake(&chan->park_recv, INT32_MAX);
+    }
 }
 
 // free memory
@@ -39,6 +39,11 @@ extern "C" {
          sender        >==================>        receiver
 
 ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#define CHAN_FLAG_LOCK_FREE 0x01 // lock free ring, multi producer multi consumer
+#define CHAN_FLAG_SPSC      0x02 // lock free ring used by exactly one sender and one receiver thread
+#define CHAN_PAD_SIZE       64
+#define CHAN_MAX_CAPACITY   0x40000000
+
 typedef struct st_chan_t {
     uint32 capacity;
 
@@ -57,14 +62,34 @@ typedef struct st_chan_t {
     cm_event_t event_send;
     cm_event_t event_recv;
     uint32 waittime_ms;
+
+    /*
+     * lock free variant: buf holds capacity cells of a sequence number and an element,
+     * capacity is rounded up to a power of 2. Parked threads are woken only if there are any.
+     */
+    uint32 flags;
+    uint32 mask;
+    uint32 stride;
+    cm_park_t park_send; // receivers waiting for elements
+    cm_park_t park_recv; // senders waiting for space
+    char pad0[CHAN_PAD_SIZE];
+    atomic_t enq_pos;
+    char pad1[CHAN_PAD_SIZE - sizeof(atomic_t)];
+    atomic_t deq_pos;
+    char pad2[CHAN_PAD_SIZE - sizeof(atomic_t)];
 } chan_t;
 
 chan_t *cm_chan_new(uint32 capacity, uint32 size);
+chan_t *cm_chan_new_ex(uint32 capacity, uint32 size, uint32 flags);
 status_t cm_chan_send(chan_t *chan, const void *elem);
 status_t cm_chan_send_timeout(chan_t *chan, const void *elem, uint32 timeout_ms);
 status_t cm_chan_try_send(chan_t *chan, const void *elem);
 status_t cm_chan_recv(chan_t *chan, void *elem);
 status_t cm_chan_recv_timeout(chan_t *chan, void *elem, uint32 timeout_ms);
+// send all count elements, *sent tells how many went in when it times out or the chan is closed
+status_t cm_chan_send_batch(chan_t *chan, const void *elems, uint32 count, uint32 *sent, uint32 timeout_ms);
+// recv at most count elements, waits only until the first one arrives
+status_t cm_chan_recv_batch(chan_t *chan, void *elems, uint32 count, uint32 *recvd, uint32 timeout_ms);
 
 bool32 cm_chan_empty(chan_t *chan);
 void cm_chan_close(chan_t *chan);
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_oamap.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_struct/cm_oamap.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "cm_oamap.h"
+
+/*
+ * Slots of the old table moved by every insert. With the old table at most 7/8 full and the new
+ * one twice as large, or as large when at most half of the old one was used, the new table can
+ * not fill up before the old one is empty.
+ */
+#define OAMAP_MOVE_SLOTS 64
+
+#define OAMAP_MATCH_KEY(funcs, item, key) ((funcs)->f_equal((funcs)->f_key(item), (key)))
+
+static inline uint32 oamap_max_items(uint32 capacity)
+{
+    return capacity - capacity / 8;
+}
+
+static status_t oamap_table_alloc(oamap_t *map, oamap_table_t *table, uint32 capacity)
+{
+    uint8 *buf = NULL;
+
+    if (capacity > OAMAP_MAX_CAPACITY) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY_REACH_LIMIT, (int64)OAMAP_MAX_CAPACITY);
+        return CM_ERROR;
+    }
+
+    uint32 ctrl_size = CM_ALIGN8(capacity + OAMAP_GROUP_WIDTH);
+    uint32 size = ctrl_size + capacity * (uint32)sizeof(oamap_slot_t);
+    CM_RETURN_IFERR(map->alloc.f_alloc(map->alloc.mem_ctx, size, (void **)&buf));
+    MEMS_RETURN_IFERR(memset_s(buf, ctrl_size, OAMAP_CTRL_EMPTY, ctrl_size));
+    table->ctrl = buf;
+    table->slots = (oamap_slot_t *)(buf + ctrl_size);
+    table->mask = capacity - 1;
+    table->growth_left = oamap_max_items(capacity);
+    return CM_SUCCESS;
+}
+
+static inline void oamap_table_free(oamap_t *map, oamap_table_t *table)
+{
+    if (table->ctrl != NULL) {
+        map->alloc.f_free(map->alloc.mem_ctx, table->ctrl);
+        table->ctrl = NULL;
+        table->slots = NULL;
+    }
+}
+
+// the first group is repeated after the last one, so that a group can be loaded at any slot
+static inline void oamap_set_ctrl(oamap_table_t *table, uint32 pos, uint8 ctrl)
+{
+    table->ctrl[pos] = ctrl;
+    table->ctrl[((pos - OAMAP_GROUP_WIDTH) & table->mask) + OAMAP_GROUP_WIDTH] = ctrl;
+}
+
+// hash must not be in table yet
+static void oamap_table_put(oamap_table_t *table, uint32 hash, void *item)
+{
+    uint32 base = (hash >> OAMAP_H2_BITS) & table->mask;
+    uint32 step = 0;
+    uint32 free_lanes = cm_oamap_group_free(table->ctrl + base);
+
+    while (free_lanes == 0) {
+        step += OAMAP_GROUP_WIDTH;
+        base = (base + step) & table->mask;
+        free_lanes = cm_oamap_group_free(table->ctrl + base);
+    }
+
+    uint32 pos = (base + (uint32)__builtin_ctz(free_lanes)) & table->mask;
+    if (table->ctrl[pos] == OAMAP_CTRL_EMPTY) {
+        table->growth_left--;
+    }
+    oamap_set_ctrl(table, pos, OAMAP_H2(hash));
+    table->slots[pos].hash = hash;
+    table->slots[pos].item = item;
+}
+
+/*
+ * A slot may become EMPTY again when no group holding it has been full, as then no probe has
+ * gone past it. Otherwise it stays DELETED so the probes through it still go on.
+ */
+static void oamap_table_erase(oamap_table_t *table, uint32 pos)
+{
+    uint32 after = cm_oamap_group_match(table->ctrl + pos, OAMAP_CTRL_EMPTY);
+    uint32 before = cm_oamap_group_match(table->ctrl + ((pos - OAMAP_GROUP_WIDTH) & table->mask),
+        OAMAP_CTRL_EMPTY);
+
+    // empty slots right after pos and right before it, within one group width
+    if (after != 0 && before != 0 && (uint32)__builtin_ctz(after) +
+        ((uint32)__builtin_clz(before) - (UINT32_BITS - OAMAP_GROUP_WIDTH)) < OAMAP_GROUP_WIDTH) {
+        oamap_set_ctrl(table, pos, OAMAP_CTRL_EMPTY);
+        table->growth_left++;
+        return;
+    }
+    oamap_set_ctrl(table, pos, OAMAP_CTRL_DELETED);
+}
+
+static void oamap_move(oamap_t *map, uint32 slots)
+{
+    oamap_table_t *old = &map->old;
+    uint32 capacity = old->mask + 1;
+    uint32 end = (capacity - map->moved > slots) ? map->moved + slots : capacity;
+
+    for (; map->moved < end; map->moved++) {
+        if (!OAMAP_CTRL_IS_FULL(old->ctrl[map->moved])) {
+            continue;
+        }
+        oamap_table_put(&map->tab, old->slots[map->moved].hash, old->slots[map->moved].item);
+        // lookups still probe the old table until it is gone
+        oamap_set_ctrl(old, map->moved, OAMAP_CTRL_DELETED);
+    }
+
+    if (map->moved == capacity) {
+        oamap_table_free(map, old);
+    }
+}
+
+static status_t oamap_grow(oamap_t *map)
+{
+    if (map->old.ctrl != NULL) {
+        oamap_move(map, map->old.mask + 1);
+        if (map->tab.growth_left > 0) {
+            return CM_SUCCESS;
+        }
+    }
+
+    // a table full of DELETED slots is rebuilt at the same capacity
+    uint32 capacity = map->tab.mask + 1;
+    if (map->count > oamap_max_items(capacity) / 2) {
+        capacity <<= 1;
+    }
+
+    map->old = map->tab;
+    map->moved = 0;
+    if (oamap_table_alloc(map, &map->tab, capacity) != CM_SUCCESS) {
+        map->tab = map->old;
+        map->old.ctrl = NULL;
+        map->old.slots = NULL;
+        return CM_ERROR;
+    }
+    return CM_SUCCESS;
+}
+
+status_t cm_oamap_init(oamap_t *map, cm_allocator_t *alloc, uint32 capacity)
+{
+    uint32 table_capacity = OAMAP_MIN_CAPACITY;
+
+    while (table_capacity <= OAMAP_MAX_CAPACITY && oamap_max_items(table_capacity) < capacity) {
+        table_capacity <<= 1;
+    }
+
+    map->alloc = *alloc;
+    map->old.ctrl = NULL;
+    map->old.slots = NULL;
+    map->moved = 0;
+    map->count = 0;
+    return oamap_table_alloc(map, &map->tab, table_capacity);
+}
+
+void cm_oamap_destroy(oamap_t *map)
+{
+    oamap_table_free(map, &map->tab);
+    oamap_table_free(map, &map->old);
+    map->count = 0;
+}
+
+void *cm_oamap_find(oamap_t *map, oamap_funcs_t *funcs, void *key)
+{
+    uint32 hash = cm_oamap_mix(funcs->f_hash(key));
+    void *item = NULL;
+
+    CM_OAMAP_FIND(map, hash, item, OAMAP_MATCH_KEY(funcs, item, key));
+    return item;
+}
+
+status_t cm_oamap_insert(oamap_t *map, oamap_funcs_t *funcs, void *item, void **exist)
+{
+    void *key = funcs->f_key(item);
+    uint32 hash = cm_oamap_mix(funcs->f_hash(key));
+    void *curr = NULL;
+
+    CM_OAMAP_FIND(map, hash, curr, OAMAP_MATCH_KEY(funcs, curr, key));
+    *exist = curr;
+    if (curr != NULL) {
+        return CM_SUCCESS;
+    }
+
+    if (map->tab.growth_left == 0) {
+        CM_RETURN_IFERR(oamap_grow(map));
+    }
+    oamap_table_put(&map->tab, hash, item);
+    map->count++;
+
+    if (map->old.ctrl != NULL) {
+        oamap_move(map, OAMAP_MOVE_SLOTS);
+    }
+    return CM_SUCCESS;
+}
+
+static void *oamap_table_delete(oamap_table_t *table, oamap_funcs_t *funcs, uint32 hash, void *key)
+{
+    void *item = NULL;
+    uint32 pos;
+
+    if (table->ctrl == NULL) {
+        return NULL;
+    }
+    OAMAP_TABLE_FIND(table, hash, item, OAMAP_MATCH_KEY(funcs, item, key), pos);
+    if (pos == CM_INVALID_ID32) {
+        return NULL;
+    }
+    oamap_table_erase(table, pos);
+    return item;
+}
+
+void *cm_oamap_delete(oamap_t *map, oamap_funcs_t *funcs, void *key)
+{
+    uint32 hash = cm_oamap_mix(funcs->f_hash(key));
+
+    // nothing is moved here, so that deleting while iterating is safe
+    void *item = oamap_table_delete(&map->tab, funcs, hash, key);
+    if (item == NULL) {
+        item = oamap_table_delete(&map->old, funcs, hash, key);
+    }
+    if (item != NULL) {
+        map->count--;
+    }
+    return item;
+}
+
+void cm_oamap_begin(oamap_t *map, oamap_iter_t *iter)
+{
+    iter->table = 0;
+    iter->pos = 0;
+}
+
+void *cm_oamap_next(oamap_t *map, oamap_iter_t *iter)
+{
+    for (; iter->table < 2; iter->table++, iter->pos = 0) {
+        oamap_table_t *table = (iter->table == 0) ? &map->tab : &map->old;
+        if (table->ctrl == NULL) {
+            continue;
+        }
+
+        uint32 capacity = table->mask + 1;
+        while (iter->pos < capacity) {
+            uint32 full = ~cm_oamap_group_free(table->ctrl + iter->pos) & ((1U << OAMAP_GROUP_WIDTH) - 1);
+            // lanes past the last slot repeat the first group
+            if (capacity - iter->pos < OAMAP_GROUP_WIDTH) {
+                full &= (1U << (capacity - iter->pos)) - 1;
+            }
+            if (full != 0) {
+                uint32 pos = iter->pos + (uint32)__builtin_ctz(full);
+                iter->pos = pos + 1;
+                return table->slots[pos].item;
+            }
+            iter->pos += OAMAP_GROUP_WIDTH;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_oamap.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_struct/cm_oamap.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __CM_OAMAP_H__
+#define __CM_OAMAP_H__
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "cm_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Open addressing hash map of item pointers, an alternative to hash_map_t that resizes itself.
+ *
+ * Every slot has a control byte, EMPTY, DELETED or the low 7 bits of the hash of its item. A probe
+ * compares a group of 16 control bytes at once and looks at the slots only where the bits match,
+ * the full hash is kept with each item so keys are compared only for equal hashes. The capacity is
+ * a power of 2 filled to 7/8 at most. When it is full a new table is allocated and the items move
+ * over a few at a time by later inserts, while both tables are searched.
+ *
+ * Items are not copied, the map keeps the pointers given to cm_oamap_insert.
+ */
+#define OAMAP_GROUP_WIDTH   16
+#define OAMAP_MIN_CAPACITY  OAMAP_GROUP_WIDTH
+#define OAMAP_MAX_CAPACITY  (1U << 26)
+#define OAMAP_H2_BITS       7
+#define OAMAP_H2(hash)      ((uint8)((hash) & 0x7F))
+#define OAMAP_CTRL_EMPTY    ((uint8)0x80)
+#define OAMAP_CTRL_DELETED  ((uint8)0xFE)
+#define OAMAP_CTRL_IS_FULL(c) (((c) & 0x80) == 0)
+
+typedef void *(*oamap_key_t)(void *item);
+
+typedef struct st_oamap_funcs {
+    oamap_key_t f_key;
+    hash_equal_t f_equal;
+    hash_func_t f_hash;
+} oamap_funcs_t;
+
+typedef struct st_oamap_slot {
+    uint32 hash; // mixed by cm_oamap_mix
+    void *item;
+} oamap_slot_t;
+
+typedef struct st_oamap_table {
+    uint8 *ctrl;         // capacity + OAMAP_GROUP_WIDTH bytes, the tail repeats the first group
+    oamap_slot_t *slots; // in the same block as ctrl
+    uint32 mask;         // capacity - 1
+    uint32 growth_left;  // empty slots that may still be filled
+} oamap_table_t;
+
+typedef struct st_oamap {
+    oamap_table_t tab;   // new items go here
+    oamap_table_t old;   // moving into tab, ctrl is NULL when there is none
+    uint32 moved;        // slots of old already moved
+    uint32 count;
+    cm_allocator_t alloc;
+} oamap_t;
+
+typedef struct st_oamap_iter {
+    uint32 table; // 0 for tab, 1 for old
+    uint32 pos;
+} oamap_iter_t;
+
+/* user hashes are mixed first, the slot comes from the low bits */
+static inline uint32 cm_oamap_mix(uint32 hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+#if defined(__aarch64__) && !defined(__SSE2__)
+static inline uint32 cm_oamap_neon_mask(uint8x16_t eq)
+{
+    static const uint8 bits[OAMAP_GROUP_WIDTH] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t lanes = vandq_u8(eq, vld1q_u8(bits));
+    return (uint32)vaddv_u8(vget_low_u8(lanes)) | ((uint32)vaddv_u8(vget_high_u8(lanes)) << 8);
+}
+#endif
+
+/* bit i is set when ctrl[i] is c */
+static inline uint32 cm_oamap_group_match(const uint8 *ctrl, uint8 c)
+{
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)c)));
+#elif defined(__aarch64__)
+    return cm_oamap_neon_mask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(c)));
+#else
+    uint32 mask = 0;
+    for (uint32 i = 0; i < OAMAP_GROUP_WIDTH; i++) {
+        mask |= (uint32)(ctrl[i] == c) << i;
+    }
+    return mask;
+#endif
+}
+
+/* bit i is set when ctrl[i] is EMPTY or DELETED */
+static inline uint32 cm_oamap_group_free(const uint8 *ctrl)
+{
+#if defined(__SSE2__)
+    return (uint32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#elif defined(__aarch64__)
+    return cm_oamap_neon_mask(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl))));
+#else
+    uint32 mask = 0;
+    for (uint32 i = 0; i < OAMAP_GROUP_WIDTH; i++) {
+        mask |= (uint32)(!OAMAP_CTRL_IS_FULL(ctrl[i])) << i;
+    }
+    return mask;
+#endif
+}
+
+/*
+ * Probes table for hval, a mixed hash. item_var is set to each candidate with the same hash and
+ * is_match, an expression of item_var, decides. pos_var is the slot found or CM_INVALID_ID32.
+ * table and hval are evaluated more than once.
+ */
+#define OAMAP_TABLE_FIND(table, hval, item_var, is_match, pos_var)                                    \
+    do {                                                                                              \
+        uint32 _base = ((hval) >> OAMAP_H2_BITS) & (table)->mask;                                     \
+        uint32 _step = 0;                                                                             \
+        (pos_var) = CM_INVALID_ID32;                                                                  \
+        for (;;) {                                                                                    \
+            uint32 _match = cm_oamap_group_match((table)->ctrl + _base, OAMAP_H2(hval));              \
+            while (_match != 0 && (pos_var) == CM_INVALID_ID32) {                                     \
+                uint32 _pos = (_base + (uint32)__builtin_ctz(_match)) & (table)->mask;                \
+                _match &= _match - 1;                                                                 \
+                (item_var) = (table)->slots[_pos].item;                                               \
+                if ((table)->slots[_pos].hash == (hval) && (is_match)) {                              \
+                    (pos_var) = _pos;                                                                 \
+                }                                                                                     \
+            }                                                                                         \
+            if ((pos_var) != CM_INVALID_ID32 ||                                                       \
+                cm_oamap_group_match((table)->ctrl + _base, OAMAP_CTRL_EMPTY) != 0) {                 \
+                break;                                                                                \
+            }                                                                                         \
+            _step += OAMAP_GROUP_WIDTH;                                                               \
+            _base = (_base + _step) & (table)->mask;                                                  \
+        }                                                                                             \
+    } while (0)
+
+/* looks hval, a mixed hash, up in both tables of map, item_var is NULL when nothing matches */
+#define CM_OAMAP_FIND(map, hval, item_var, is_match)                                                  \
+    do {                                                                                              \
+        uint32 _found;                                                                                \
+        OAMAP_TABLE_FIND(&(map)->tab, hval, item_var, is_match, _found);                              \
+        if (_found == CM_INVALID_ID32 && (map)->old.ctrl != NULL) {                                   \
+            OAMAP_TABLE_FIND(&(map)->old, hval, item_var, is_match, _found);                          \
+        }                                                                                             \
+        if (_found == CM_INVALID_ID32) {                                                              \
+            (item_var) = NULL;                                                                        \
+        }                                                                                             \
+    } while (0)
+
+/*
+ * Defines static inline void *name(oamap_t *map, key_type key), a find with the functions inlined.
+ * f_hash(key), f_key(item) and f_equal(lkey, rkey) must agree with the oamap_funcs_t of the map.
+ */
+#define CM_OAMAP_DEFINE_FIND(name, key_type, f_hash, f_key, f_equal)                                  \
+    static inline void *name(oamap_t *map, key_type key)                                              \
+    {                                                                                                 \
+        uint32 _hash = cm_oamap_mix(f_hash(key));                                                     \
+        void *_item = NULL;                                                                           \
+        CM_OAMAP_FIND(map, _hash, _item, f_equal(f_key(_item), key));                                 \
+        return _item;                                                                                 \
+    }
+
+/* capacity is the number of items expected, the map grows beyond it when needed */
+status_t cm_oamap_init(oamap_t *map, cm_allocator_t *alloc, uint32 capacity);
+void cm_oamap_destroy(oamap_t *map);
+void *cm_oamap_find(oamap_t *map, oamap_funcs_t *funcs, void *key);
+/* exist is set to the item that already has the key, item is not inserted then */
+status_t cm_oamap_insert(oamap_t *map, oamap_funcs_t *funcs, void *item, void **exist);
+/* returns the removed item, NULL when there was none */
+void *cm_oamap_delete(oamap_t *map, oamap_funcs_t *funcs, void *key);
+
+/*
+ * Visits every item once in O(capacity). The item returned last may be deleted while iterating,
+ * an insert may move items and must not happen until the iteration ends.
+ */
+void cm_oamap_begin(oamap_t *map, oamap_iter_t *iter);
+void *cm_oamap_next(oamap_t *map, oamap_iter_t *iter);
+
+static inline uint32 cm_oamap_count(const oamap_t *map)
+{
+    return map->count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
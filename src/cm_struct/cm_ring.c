@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_ring.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_struct/cm_ring.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "cm_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+status_t cm_ring_init(cm_ring_t *ring, uint32 capacity)
+{
+    uint32 size = 1;
+
+    if (capacity == 0 || capacity > CM_RING_MAX_CAPACITY) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "ring capacity");
+        return CM_ERROR;
+    }
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    ring->cells = (cm_ring_cell_t *)malloc(sizeof(cm_ring_cell_t) * size);
+    if (ring->cells == NULL) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, (uint64)sizeof(cm_ring_cell_t) * size, "ring cells");
+        return CM_ERROR;
+    }
+    for (uint32 i = 0; i < size; i++) {
+        ring->cells[i].seq = (int64)i;
+        ring->cells[i].data = NULL;
+    }
+    ring->capacity = size;
+    ring->mask = size - 1;
+    ring->enq_pos = 0;
+    ring->deq_pos = 0;
+    return CM_SUCCESS;
+}
+
+void cm_ring_destroy(cm_ring_t *ring)
+{
+    CM_FREE_PTR(ring->cells);
+    ring->capacity = 0;
+    ring->mask = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
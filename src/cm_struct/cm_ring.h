@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_ring.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_struct/cm_ring.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __CM_RING_H__
+#define __CM_RING_H__
+
+#include "cm_defs.h"
+#include "cm_atomic.h"
+#include "cm_error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CM_RING_PAD_SIZE (64)
+#define CM_RING_MAX_CAPACITY (0x40000000)
+
+/*
+ * Bounded multi-producer multi-consumer ring of pointers.
+ * Every cell carries a sequence number telling whose turn it is, so producers and
+ * consumers only contend on their own cursor and never take a lock.
+ */
+typedef struct st_cm_ring_cell {
+    atomic_t seq;
+    void *volatile data;
+} cm_ring_cell_t;
+
+typedef struct st_cm_ring {
+    cm_ring_cell_t *cells;
+    uint32 capacity; // power of 2
+    uint32 mask;
+    char pad0[CM_RING_PAD_SIZE];
+    atomic_t enq_pos;
+    char pad1[CM_RING_PAD_SIZE - sizeof(atomic_t)];
+    atomic_t deq_pos;
+    char pad2[CM_RING_PAD_SIZE - sizeof(atomic_t)];
+} cm_ring_t;
+
+status_t cm_ring_init(cm_ring_t *ring, uint32 capacity);
+void cm_ring_destroy(cm_ring_t *ring);
+
+static inline bool32 cm_ring_inited(const cm_ring_t *ring)
+{
+    return ring->cells != NULL;
+}
+
+// return CM_FALSE when the ring is full
+static inline bool32 cm_ring_push(cm_ring_t *ring, void *data)
+{
+    cm_ring_cell_t *cell = NULL;
+    int64 pos = cm_atomic_get(&ring->enq_pos);
+
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        int64 diff = cm_atomic_get(&cell->seq) - pos;
+        if (diff == 0) {
+            if (cm_atomic_cas(&ring->enq_pos, pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return CM_FALSE;
+        }
+        pos = cm_atomic_get(&ring->enq_pos);
+    }
+
+    cell->data = data;
+    (void)cm_atomic_set(&cell->seq, pos + 1);
+    return CM_TRUE;
+}
+
+// return NULL when the ring is empty
+static inline void *cm_ring_pop(cm_ring_t *ring)
+{
+    void *data = NULL;
+    cm_ring_cell_t *cell = NULL;
+    int64 pos = cm_atomic_get(&ring->deq_pos);
+
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        int64 diff = cm_atomic_get(&cell->seq) - (pos + 1);
+        if (diff == 0) {
+            if (cm_atomic_cas(&ring->deq_pos, pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        }
+        pos = cm_atomic_get(&ring->deq_pos);
+    }
+
+    data = cell->data;
+    (void)cm_atomic_set(&cell->seq, pos + (int64)ring->mask + 1);
+    return data;
+}
+
+// approximate number of elements, exact only when the ring is quiet
+static inline uint32 cm_ring_count(const cm_ring_t *ring)
+{
+    int64 count = cm_atomic_get((atomic_t *)&ring->enq_pos) - cm_atomic_get((atomic_t *)&ring->deq_pos);
+    return count > 0 ? (uint32)count : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __CM_TEST_H__
+#define __CM_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cm_defs.h"
+#include "cm_error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Helpers shared by the test_<name> programs ctest runs. Each of them is one cm_test_<name>.c
+ * linked against cbb_static, runs its cases in order and exits with 0 when all of them pass.
+ */
+#define TEST_EXIT_SKIPPED 77 // SKIP_RETURN_CODE of every test, for tests that need a device
+
+#define TEST_CHECK(cond)                                                                      \
+    do {                                                                                      \
+        if (!(cond)) {                                                                        \
+            (void)printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);             \
+            return CM_ERROR;                                                                  \
+        }                                                                                     \
+    } while (0)
+
+typedef status_t (*test_func_t)(void);
+
+typedef struct st_test_case {
+    const char *name;
+    test_func_t func;
+} test_case_t;
+
+#define TEST_CASE(func) { #func, func }
+
+static inline status_t test_malloc(void *ctx, uint32 size, void **buf)
+{
+    *buf = malloc(size);
+    return (*buf == NULL) ? CM_ERROR : CM_SUCCESS;
+}
+
+static inline void test_free(void *ctx, void *buf)
+{
+    free(buf);
+}
+
+#define TEST_ALLOCATOR { test_malloc, test_free, NULL }
+
+static inline int test_run(const test_case_t *cases, uint32 count)
+{
+    uint32 failed = 0;
+
+    for (uint32 i = 0; i < count; i++) {
+        status_t ret = cases[i].func();
+        (void)printf("%-48s %s\n", cases[i].name, ret == CM_SUCCESS ? "ok" : "FAILED");
+        failed += (ret == CM_SUCCESS) ? 0 : 1;
+    }
+    (void)printf("%u of %u cases failed\n", failed, count);
+    return (failed == 0) ? 0 : 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
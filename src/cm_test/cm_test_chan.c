@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_chan.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_chan.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "cm_chan.h"
+#include "cm_thread.h"
+#include "cm_atomic.h"
+#include "cm_test.h"
+
+#define TEST_CAPACITY    8 // a power of two, so the lock free chans hold exactly as many
+#define TEST_WAIT_MS     10
+#define TEST_BATCH       20
+#define TEST_THREADS     4
+#define TEST_PER_THREAD  20000
+
+static const uint32 g_test_flags[] = { 0, CHAN_FLAG_LOCK_FREE, CHAN_FLAG_SPSC };
+
+typedef struct st_test_chan_ctx {
+    chan_t *chan;
+    uint32 flags;
+    atomic_t sum;
+    bool32 failed;
+} test_chan_ctx_t;
+
+typedef struct st_test_worker {
+    thread_t thread;
+    test_chan_ctx_t *ctx;
+    uint32 id;
+} test_worker_t;
+
+static status_t test_fifo_one(uint32 flags)
+{
+    uint32 val;
+    chan_t *chan = cm_chan_new_ex(TEST_CAPACITY, (uint32)sizeof(uint32), flags);
+
+    TEST_CHECK(chan != NULL && cm_chan_empty(chan));
+    // wrap around the ring twice
+    for (uint32 round = 0; round < 2; round++) {
+        for (uint32 i = 0; i < TEST_CAPACITY; i++) {
+            val = round * TEST_CAPACITY + i;
+            TEST_CHECK(cm_chan_try_send(chan, &val) == CM_SUCCESS);
+        }
+        TEST_CHECK(cm_chan_try_send(chan, &val) != CM_SUCCESS);
+        TEST_CHECK(cm_chan_send_timeout(chan, &val, TEST_WAIT_MS) == CM_TIMEDOUT);
+        for (uint32 i = 0; i < TEST_CAPACITY; i++) {
+            TEST_CHECK(cm_chan_recv_timeout(chan, &val, TEST_WAIT_MS) == CM_SUCCESS);
+            TEST_CHECK(val == round * TEST_CAPACITY + i);
+        }
+        TEST_CHECK(cm_chan_empty(chan));
+        TEST_CHECK(cm_chan_recv_timeout(chan, &val, TEST_WAIT_MS) == CM_TIMEDOUT);
+    }
+    cm_chan_free(chan);
+    return CM_SUCCESS;
+}
+
+static status_t test_fifo_full_empty(void)
+{
+    for (uint32 i = 0; i < ELEMENT_COUNT(g_test_flags); i++) {
+        CM_RETURN_IFERR(test_fifo_one(g_test_flags[i]));
+    }
+    return CM_SUCCESS;
+}
+
+// a batch stops where the chan is full or empty
+static status_t test_batch_one(uint32 flags)
+{
+    uint32 vals[TEST_BATCH];
+    uint32 done = 0;
+    chan_t *chan = cm_chan_new_ex(TEST_CAPACITY, (uint32)sizeof(uint32), flags);
+
+    TEST_CHECK(chan != NULL);
+    for (uint32 i = 0; i < TEST_BATCH; i++) {
+        vals[i] = i + 1;
+    }
+    TEST_CHECK(cm_chan_send_batch(chan, vals, TEST_BATCH, &done, TEST_WAIT_MS) == CM_TIMEDOUT);
+    TEST_CHECK(done == TEST_CAPACITY);
+    TEST_CHECK(cm_chan_send_batch(chan, vals, 0, &done, TEST_WAIT_MS) == CM_SUCCESS && done == 0);
+
+    for (uint32 i = 0; i < TEST_BATCH; i++) {
+        vals[i] = 0;
+    }
+    TEST_CHECK(cm_chan_recv_batch(chan, vals, TEST_BATCH, &done, TEST_WAIT_MS) == CM_SUCCESS);
+    TEST_CHECK(done == TEST_CAPACITY);
+    for (uint32 i = 0; i < TEST_CAPACITY; i++) {
+        TEST_CHECK(vals[i] == i + 1);
+    }
+    TEST_CHECK(cm_chan_recv_batch(chan, vals, TEST_BATCH, &done, TEST_WAIT_MS) == CM_TIMEDOUT && done == 0);
+    TEST_CHECK(cm_chan_recv_batch(chan, vals, 0, &done, TEST_WAIT_MS) != CM_SUCCESS);
+    cm_chan_free(chan);
+    return CM_SUCCESS;
+}
+
+static status_t test_batch_counts(void)
+{
+    for (uint32 i = 0; i < ELEMENT_COUNT(g_test_flags); i++) {
+        CM_RETURN_IFERR(test_batch_one(g_test_flags[i]));
+    }
+    return CM_SUCCESS;
+}
+
+// what was sent before the close is still received, then both ends fail
+static status_t test_close_one(uint32 flags)
+{
+    uint32 val = 1;
+    chan_t *chan = cm_chan_new_ex(TEST_CAPACITY, (uint32)sizeof(uint32), flags);
+
+    TEST_CHECK(chan != NULL);
+    TEST_CHECK(cm_chan_send(chan, &val) == CM_SUCCESS);
+    cm_chan_close(chan);
+    cm_chan_close(chan);
+    TEST_CHECK(cm_chan_try_send(chan, &val) != CM_SUCCESS);
+    TEST_CHECK(cm_chan_send_timeout(chan, &val, TEST_WAIT_MS) == CM_ERROR);
+    val = 0;
+    TEST_CHECK(cm_chan_recv_timeout(chan, &val, TEST_WAIT_MS) == CM_SUCCESS && val == 1);
+    TEST_CHECK(cm_chan_recv_timeout(chan, &val, TEST_WAIT_MS) == CM_ERROR);
+    cm_chan_free(chan);
+    return CM_SUCCESS;
+}
+
+static void test_blocked_receiver(thread_t *thread)
+{
+    test_chan_ctx_t *ctx = (test_chan_ctx_t *)thread->argument;
+    uint32 val;
+
+    if (cm_chan_recv(ctx->chan, &val) != CM_ERROR) {
+        ctx->failed = CM_TRUE;
+    }
+}
+
+static status_t test_close(void)
+{
+    test_chan_ctx_t ctx = { 0 };
+    thread_t thread;
+
+    for (uint32 i = 0; i < ELEMENT_COUNT(g_test_flags); i++) {
+        CM_RETURN_IFERR(test_close_one(g_test_flags[i]));
+    }
+
+    // a receiver parked on the lock free chan without a timeout is woken by the close
+    ctx.chan = cm_chan_new_ex(TEST_CAPACITY, (uint32)sizeof(uint32), CHAN_FLAG_LOCK_FREE);
+    TEST_CHECK(ctx.chan != NULL);
+    TEST_CHECK(cm_create_thread(test_blocked_receiver, 0, &ctx, &thread) == CM_SUCCESS);
+    cm_sleep(TEST_WAIT_MS);
+    cm_chan_close(ctx.chan);
+    cm_close_thread(&thread);
+    cm_chan_free(ctx.chan);
+    TEST_CHECK(!ctx.failed);
+    return CM_SUCCESS;
+}
+
+static void test_sender(thread_t *thread)
+{
+    test_worker_t *worker = (test_worker_t *)thread->argument;
+    test_chan_ctx_t *ctx = worker->ctx;
+    uint64 vals[TEST_CAPACITY];
+    uint64 base = (uint64)worker->id * TEST_PER_THREAD;
+    uint32 sent;
+
+    // single sends and batches larger than the room left take turns
+    for (uint32 i = 0; i < TEST_PER_THREAD;) {
+        uint32 count = ((i / TEST_CAPACITY) % 2 == 0) ? 1 : MIN(TEST_CAPACITY, TEST_PER_THREAD - i);
+        for (uint32 j = 0; j < count; j++) {
+            vals[j] = base + i + j + 1;
+        }
+        status_t ret = (count == 1) ? cm_chan_send(ctx->chan, &vals[0]) :
+            cm_chan_send_batch(ctx->chan, vals, count, &sent, CM_INFINITE_TIMEOUT);
+        if (ret != CM_SUCCESS) {
+            ctx->failed = CM_TRUE;
+            return;
+        }
+        i += count;
+    }
+}
+
+static void test_receiver(thread_t *thread)
+{
+    test_worker_t *worker = (test_worker_t *)thread->argument;
+    test_chan_ctx_t *ctx = worker->ctx;
+    uint64 vals[TEST_CAPACITY];
+    uint64 sum = 0;
+    uint32 recvd = 0;
+
+    for (uint32 i = 0; i < TEST_PER_THREAD; i += recvd) {
+        uint32 count = MIN(TEST_CAPACITY, TEST_PER_THREAD - i);
+        if (cm_chan_recv_batch(ctx->chan, vals, count, &recvd, CM_INFINITE_TIMEOUT) != CM_SUCCESS) {
+            ctx->failed = CM_TRUE;
+            return;
+        }
+        for (uint32 j = 0; j < recvd; j++) {
+            sum += vals[j];
+        }
+    }
+    (void)cm_atomic_add(&ctx->sum, (int64)sum);
+}
+
+// every element sent by the senders is received exactly once
+static status_t test_threads_one(uint32 flags, uint32 threads)
+{
+    test_chan_ctx_t ctx = { 0 };
+    test_worker_t workers[2 * TEST_THREADS];
+    uint32 started = 0;
+
+    ctx.chan = cm_chan_new_ex(TEST_CAPACITY, (uint32)sizeof(uint64), flags);
+    TEST_CHECK(ctx.chan != NULL);
+    for (uint32 i = 0; i < 2 * threads; i++) {
+        workers[i].ctx = &ctx;
+        workers[i].id = i / 2;
+        if (cm_create_thread((i % 2 == 0) ? test_sender : test_receiver, 0, &workers[i], &workers[i].thread) !=
+            CM_SUCCESS) {
+            ctx.failed = CM_TRUE;
+            cm_chan_close(ctx.chan);
+            break;
+        }
+        started++;
+    }
+    for (uint32 i = 0; i < started; i++) {
+        cm_close_thread(&workers[i].thread);
+    }
+    cm_chan_free(ctx.chan);
+
+    uint64 total = (uint64)threads * TEST_PER_THREAD;
+    TEST_CHECK(!ctx.failed);
+    TEST_CHECK((uint64)cm_atomic_get(&ctx.sum) == total * (total + 1) / 2);
+    return CM_SUCCESS;
+}
+
+static status_t test_threads(void)
+{
+    CM_RETURN_IFERR(test_threads_one(0, TEST_THREADS));
+    CM_RETURN_IFERR(test_threads_one(CHAN_FLAG_LOCK_FREE, TEST_THREADS));
+    return test_threads_one(CHAN_FLAG_SPSC, 1);
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_fifo_full_empty),
+        TEST_CASE(test_batch_counts),
+        TEST_CASE(test_close),
+        TEST_CASE(test_threads),
+    };
+    return test_run(cases, ELEMENT_COUNT(cases));
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_checksum.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_checksum.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "cm_checksum.h"
+#include "cm_test.h"
+
+#define TEST_POLY_REFLECT 0x82F63B78
+#define TEST_CHECK_VALUE  0xE3069283 // crc32c of "123456789"
+#define TEST_BUF_SIZE     (3 * 3 * 1024 + 512) // past three rounds of the long and the short interleaved blocks
+#define TEST_MAX_OFFSET   8
+
+static uint8 g_test_buf[TEST_BUF_SIZE + TEST_MAX_OFFSET];
+
+// one bit at a time, shares nothing with the kernels under test
+static uint32 test_crc32c_bitwise(const uint8 *data, uint32 len)
+{
+    uint32 crc = 0xFFFFFFFF;
+
+    for (uint32 i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint32 bit = 0; bit < 8; bit++) {
+            crc = ((crc & 1) != 0) ? ((crc >> 1) ^ TEST_POLY_REFLECT) : (crc >> 1);
+        }
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void test_fill_buf(void)
+{
+    uint32 seed = 1;
+    for (uint32 i = 0; i < sizeof(g_test_buf); i++) {
+        seed = seed * 1103515245 + 12345;
+        g_test_buf[i] = (uint8)(seed >> 16);
+    }
+}
+
+static status_t test_check_value(void)
+{
+    const char *str = "123456789";
+
+    TEST_CHECK(test_crc32c_bitwise((const uint8 *)str, 9) == TEST_CHECK_VALUE);
+    TEST_CHECK(cm_get_checksum(str, 9) == TEST_CHECK_VALUE);
+    TEST_CHECK(cm_verify_checksum(str, 9, TEST_CHECK_VALUE));
+    TEST_CHECK(cm_get_checksum(str, 0) == 0);
+    return CM_SUCCESS;
+}
+
+// the kernel picked for this cpu, and the others it can run, agree at every length and alignment
+static status_t test_kernels_agree(void)
+{
+    bool32 sse42 = cm_crc32c_sse42_available();
+
+    test_fill_buf();
+    for (uint32 offset = 0; offset < TEST_MAX_OFFSET; offset++) {
+        for (uint32 len = 0; len <= TEST_BUF_SIZE; len += (len < 1024) ? 1 : 61) {
+            const uint8 *data = g_test_buf + offset;
+            uint32 expect = test_crc32c_bitwise(data, len);
+            if (cm_get_checksum(data, len) != expect || (!IS_BIG_ENDIAN && cm_get_crc32_sb8(data, len) != expect) ||
+                (sse42 && cm_get_crc32_sse42(data, len) != expect)) {
+                (void)printf("checksums of %u bytes at offset %u differ\n", len, offset);
+                return CM_ERROR;
+            }
+        }
+    }
+    return CM_SUCCESS;
+}
+
+static status_t test_combine(void)
+{
+    static const uint32 lens[] = { 0, 1, 7, 128, 1000, 3072, TEST_BUF_SIZE };
+
+    test_fill_buf();
+    for (uint32 i = 0; i < ELEMENT_COUNT(lens); i++) {
+        for (uint32 j = 0; j < ELEMENT_COUNT(lens); j++) {
+            uint32 len1 = lens[i] / 2;
+            uint32 len2 = lens[j] / 2;
+            uint32 crc1 = cm_get_checksum(g_test_buf, len1);
+            uint32 crc2 = cm_get_checksum(g_test_buf + len1, len2);
+            TEST_CHECK(cm_crc32c_combine(crc1, crc2, len2) == cm_get_checksum(g_test_buf, len1 + len2));
+        }
+    }
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_check_value),
+        TEST_CASE(test_kernels_agree),
+        TEST_CASE(test_combine),
+    };
+    return test_run(cases, ELEMENT_COUNT(cases));
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_dlock_mgr.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_dlock_mgr.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include <stdlib.h>
+#include "cm_dlock_mgr.h"
+#include "cm_test.h"
+
+/*
+ * Needs a scsi device that supports compare and write, perctrl in PATH and a block of the device
+ * that nobody else uses: CBB_TEST_SCSI_DEV=<device> CBB_TEST_DLOCK_ADDR=<byte offset of the block>.
+ * The test is skipped without them, it overwrites that block.
+ */
+#define TEST_INST_A       0
+#define TEST_INST_B       1
+#define TEST_TIMEOUT_MS   5000
+#define TEST_CONTENDED_MS 200
+
+static dlock_mgr_t g_test_mgr;
+static uint64 g_test_addr;
+
+static status_t test_check_held_by(dlock_entry_t *entry, int64 inst_id)
+{
+    TEST_CHECK(entry->state == DLOCK_ENTRY_HELD);
+    TEST_CHECK(cm_dlock_mgr_read(&g_test_mgr, &entry, 1) == CM_SUCCESS);
+    dlock_area *area = (dlock_area *)entry->lock.tmp;
+    TEST_CHECK(area->lock_info.header.magic_num == (int64)DISK_LOCK_HEADER_MAGIC);
+    TEST_CHECK(area->lock_info.header.inst_id == inst_id + 1);
+    return CM_SUCCESS;
+}
+
+static status_t test_acquire_release_reacquire(void)
+{
+    dlock_entry_t a;
+    dlock_entry_t b;
+    dlock_entry_t *pa = &a;
+    dlock_entry_t *pb = &b;
+
+    TEST_CHECK(cm_dlock_mgr_add(&g_test_mgr, &a, g_test_addr, TEST_INST_A) == CM_SUCCESS);
+    TEST_CHECK(cm_dlock_mgr_add(&g_test_mgr, &b, g_test_addr, TEST_INST_B) == CM_SUCCESS);
+
+    TEST_CHECK(cm_dlock_mgr_acquire(&g_test_mgr, &pa, 1, TEST_TIMEOUT_MS) == CM_SUCCESS);
+    CM_RETURN_IFERR(test_check_held_by(&a, TEST_INST_A));
+    TEST_CHECK(cm_dlock_mgr_release(&g_test_mgr, &a) == CM_SUCCESS);
+
+    // the release zeroed the block, the reacquire has to put a full header on disk again
+    TEST_CHECK(cm_dlock_mgr_acquire(&g_test_mgr, &pa, 1, TEST_TIMEOUT_MS) == CM_SUCCESS);
+    CM_RETURN_IFERR(test_check_held_by(&a, TEST_INST_A));
+    TEST_CHECK(cm_dlock_mgr_acquire(&g_test_mgr, &pb, 1, TEST_CONTENDED_MS) == CM_TIMEDOUT);
+    TEST_CHECK(b.state == DLOCK_ENTRY_IDLE);
+
+    TEST_CHECK(cm_dlock_mgr_release(&g_test_mgr, &a) == CM_SUCCESS);
+    TEST_CHECK(cm_dlock_mgr_acquire(&g_test_mgr, &pb, 1, TEST_TIMEOUT_MS) == CM_SUCCESS);
+    CM_RETURN_IFERR(test_check_held_by(&b, TEST_INST_B));
+    TEST_CHECK(cm_dlock_mgr_acquire(&g_test_mgr, &pa, 1, TEST_CONTENDED_MS) == CM_TIMEDOUT);
+    TEST_CHECK(cm_dlock_mgr_release(&g_test_mgr, &b) == CM_SUCCESS);
+
+    cm_dlock_mgr_remove(&g_test_mgr, &a);
+    cm_dlock_mgr_remove(&g_test_mgr, &b);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_acquire_release_reacquire),
+    };
+    const char *dev = getenv("CBB_TEST_SCSI_DEV");
+    const char *addr = getenv("CBB_TEST_DLOCK_ADDR");
+
+    if (dev == NULL || addr == NULL) {
+        (void)printf("CBB_TEST_SCSI_DEV and CBB_TEST_DLOCK_ADDR are not set, skipped\n");
+        return TEST_EXIT_SKIPPED;
+    }
+    g_test_addr = strtoull(addr, NULL, 10);
+    if (cm_dlock_mgr_init(&g_test_mgr, dev, NULL) != CM_SUCCESS) {
+        (void)printf("cannot open %s\n", dev);
+        return 1;
+    }
+    int ret = test_run(cases, ELEMENT_COUNT(cases));
+    cm_dlock_mgr_destroy(&g_test_mgr);
+    return ret;
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_json.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_json.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include <float.h>
+#include <math.h>
+#include "cm_text.h"
+#include "ddes_json.h"
+#include "cm_test.h"
+
+#define TEST_KEY_BUF_SIZE 16
+#define TEST_MANY_MEMBERS 40 // enough for the key index of json_build_index
+#define TEST_DOC_SIZE     1024
+#define TEST_NUM_SIZE     512 // %.9f of DBL_MAX
+#define TEST_RAND_DOUBLES 100000
+
+static cm_allocator_t g_test_alloc = TEST_ALLOCATOR;
+
+static status_t test_parse(const char *str, json_t **json)
+{
+    text_t txt = { (char *)str, (uint32)strlen(str) };
+    return json_create(json, &txt, &g_test_alloc);
+}
+
+static bool32 test_rejects(const char *str)
+{
+    json_t *json = NULL;
+    if (test_parse(str, &json) == CM_SUCCESS) {
+        json_destory(json);
+        return CM_FALSE;
+    }
+    return CM_TRUE;
+}
+
+static status_t test_parse_values(void)
+{
+    json_t *json = NULL;
+    text_t key_name = { "name", 4 };
+    text_t key_count = { "count", 5 };
+    text_t key_on = { "on", 2 };
+    text_t key_list = { "list", 4 };
+    text_t key_inner = { "inner", 5 };
+    text_t key_id = { "id", 2 };
+    text_t key_none = { "none", 4 };
+    text_t str;
+    uint64 num;
+    bool32 on;
+
+    TEST_CHECK(test_parse(" {\"name\": \"dss\", \"count\": 42, \"on\": true,\n\t"
+        "\"list\": [{\"id\": 1}, {\"id\": 2}, {}], \"inner\": {\"id\": 7}} ", &json) == CM_SUCCESS);
+    TEST_CHECK(json_get_str(json, &key_name, &str) == CM_SUCCESS && cm_text_str_equal(&str, "dss"));
+    TEST_CHECK(json_get_uint64(json, &key_count, &num) == CM_SUCCESS && num == 42);
+    TEST_CHECK(json_get_bool(json, &key_on, &on) == CM_SUCCESS && on);
+    TEST_CHECK(!json_has_item(json, &key_none));
+    // a key of another type is not found
+    TEST_CHECK(json_get_str(json, &key_count, &str) != CM_SUCCESS);
+
+    json_arr_t *arr = json_get_arr(json, &key_list);
+    TEST_CHECK(arr != NULL && jarr_get_size(arr) == 3);
+    for (uint32 i = 0; i < 2; i++) {
+        json_t *item = jarr_get_obj(arr, i);
+        TEST_CHECK(item != NULL && json_get_uint64(item, &key_id, &num) == CM_SUCCESS && num == i + 1);
+    }
+    TEST_CHECK(jarr_get_obj(arr, 3) == NULL);
+    json_t *inner = json_get_obj(json, &key_inner);
+    TEST_CHECK(inner != NULL && json_get_uint64(inner, &key_id, &num) == CM_SUCCESS && num == 7);
+    json_destory(json);
+    return CM_SUCCESS;
+}
+
+static status_t test_parse_many_members(void)
+{
+    char doc[TEST_DOC_SIZE];
+    char key[TEST_KEY_BUF_SIZE];
+    json_t *json = NULL;
+    uint64 num;
+    int32 len = snprintf_s(doc, sizeof(doc), sizeof(doc) - 1, "{");
+
+    for (uint32 i = 0; i < TEST_MANY_MEMBERS && len > 0; i++) {
+        int32 n = snprintf_s(doc + len, sizeof(doc) - (uint32)len, sizeof(doc) - (uint32)len - 1, "%s\"k%u\": %u",
+            i == 0 ? "" : ", ", i, i * 3);
+        len = (n < 0) ? n : len + n;
+    }
+    TEST_CHECK(len > 0 && snprintf_s(doc + len, sizeof(doc) - (uint32)len, sizeof(doc) - (uint32)len - 1, "}") > 0);
+    TEST_CHECK(test_parse(doc, &json) == CM_SUCCESS);
+    for (uint32 i = 0; i < TEST_MANY_MEMBERS; i++) {
+        text_t txt = { key, (uint32)snprintf_s(key, sizeof(key), sizeof(key) - 1, "k%u", i) };
+        TEST_CHECK(json_get_uint64(json, &txt, &num) == CM_SUCCESS && num == i * 3);
+    }
+    text_t missing = { "k40", 3 };
+    TEST_CHECK(!json_has_item(json, &missing));
+    json_destory(json);
+    return CM_SUCCESS;
+}
+
+// escapes stay in the text as they were written
+static status_t test_parse_escapes(void)
+{
+    json_t *json = NULL;
+    text_t key = { "a", 1 };
+    text_t str;
+
+    TEST_CHECK(test_parse("{\"a\": \"q\\\"\\\\\\/\\b\\f\\n\\r\\t\\u001F\"}", &json) == CM_SUCCESS);
+    TEST_CHECK(json_get_str(json, &key, &str) == CM_SUCCESS);
+    TEST_CHECK(cm_text_str_equal(&str, "q\\\"\\\\\\/\\b\\f\\n\\r\\t\\u001F"));
+    json_destory(json);
+
+    TEST_CHECK(test_rejects("{\"a\": \"\\q\"}"));
+    TEST_CHECK(test_rejects("{\"a\": \"\\u12\"}"));
+    TEST_CHECK(test_rejects("{\"a\": \"\\u12g4\"}"));
+    TEST_CHECK(test_rejects("{\"a\": \"abc\\"));
+    return CM_SUCCESS;
+}
+
+static status_t test_reject_broken(void)
+{
+    TEST_CHECK(test_rejects(""));
+    TEST_CHECK(test_rejects("[1, 2]"));
+    TEST_CHECK(test_rejects("{\"a\": 1"));
+    TEST_CHECK(test_rejects("{\"a\": [1, 2}"));
+    TEST_CHECK(test_rejects("{\"a\" 1}"));
+    TEST_CHECK(test_rejects("{\"a\": 1 \"b\": 2}"));
+    TEST_CHECK(test_rejects("{\"a\": }"));
+    TEST_CHECK(test_rejects("{\"a\": 1x}"));
+    TEST_CHECK(test_rejects("{\"a\": \"unterminated}"));
+    return CM_SUCCESS;
+}
+
+static status_t test_reject_trailing_text(void)
+{
+    json_t *json = NULL;
+
+    TEST_CHECK(test_rejects("{\"a\": 1} garbage"));
+    TEST_CHECK(test_rejects("{\"a\": 1}}"));
+    TEST_CHECK(test_rejects("{\"a\": 1}{\"b\": 2}"));
+    TEST_CHECK(test_rejects("{} ,"));
+    TEST_CHECK(test_parse("{\"a\": 1} \r\n\t ", &json) == CM_SUCCESS);
+    json_destory(json);
+    return CM_SUCCESS;
+}
+
+static status_t test_write_one_double(double val, uint32 prec)
+{
+    char out[TEST_NUM_SIZE];
+    char expect[TEST_NUM_SIZE];
+    text_buf_t buf;
+    json_writer_t writer;
+
+    CM_INIT_TEXTBUF(&buf, sizeof(out), out);
+    json_writer_init(&writer, &buf);
+    TEST_CHECK(json_write_double(&writer, NULL, val, prec) == CM_SUCCESS);
+    TEST_CHECK(json_writer_finish(&writer) == CM_SUCCESS);
+    TEST_CHECK(snprintf_s(expect, sizeof(expect), sizeof(expect) - 1, "%.*f", (int32)prec, val) > 0);
+    if (strcmp(out, expect) != 0) {
+        (void)printf("%.17g with %u digits written as %s, not %s\n", val, prec, out, expect);
+        return CM_ERROR;
+    }
+    return CM_SUCCESS;
+}
+
+// the digits are the ones %.*f prints, also for ties and values past the fast path
+static status_t test_write_double(void)
+{
+    static const double vals[] = { 0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375, 1.005, 2.675, 1e-10, 123456.789,
+        -98765.4321, 4503599627370495.5, 9007199254740993.0, 1e300, -1e300, DBL_MAX, DBL_MIN };
+    uint64 seed = 1;
+
+    for (uint32 i = 0; i < ELEMENT_COUNT(vals); i++) {
+        for (uint32 prec = 0; prec <= JSON_MAX_DOUBLE_PREC; prec++) {
+            CM_RETURN_IFERR(test_write_one_double(vals[i], prec));
+        }
+    }
+    for (uint32 i = 0; i < TEST_RAND_DOUBLES; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        // mantissas of up to 12 digits with a few decimals, which is where ties show up
+        double val = (double)(int64)(seed >> 24) / (double)(1ULL << (seed % 24));
+        CM_RETURN_IFERR(test_write_one_double(val, (uint32)(seed >> 60) % (JSON_MAX_DOUBLE_PREC + 1)));
+    }
+    return CM_SUCCESS;
+}
+
+static status_t test_write_special_doubles(void)
+{
+    char out[TEST_NUM_SIZE];
+    text_buf_t buf;
+    json_writer_t writer;
+
+    CM_INIT_TEXTBUF(&buf, sizeof(out), out);
+    json_writer_init(&writer, &buf);
+    (void)json_write_begin_arr(&writer, NULL);
+    (void)json_write_double(&writer, NULL, NAN, 2);
+    (void)json_write_double(&writer, NULL, -INFINITY, 2);
+    // more digits than JSON_MAX_DOUBLE_PREC are cut to it
+    (void)json_write_double(&writer, NULL, 0.25, JSON_MAX_DOUBLE_PREC + 3);
+    (void)json_write_end_arr(&writer);
+    TEST_CHECK(json_writer_finish(&writer) == CM_SUCCESS);
+    TEST_CHECK(strcmp(out, "[null,null,0.250000000]") == 0);
+    return CM_SUCCESS;
+}
+
+// a written document parses back, and writing the parsed document again gives the same text
+static status_t test_write_read_back(void)
+{
+    char out[TEST_DOC_SIZE];
+    char again[TEST_DOC_SIZE];
+    const char *expect = "{\"name\":\"a\\\"b\\\\c\\nd\\t\\u0001\",\"neg\":-9223372036854775808,"
+        "\"big\":9223372036854775808,\"on\":false,\"list\":[{\"id\":1},{\"id\":2}],\"ratio\":0.33}";
+    text_t key_name = { "name", 4 };
+    text_t key_big = { "big", 3 };
+    text_t key_on = { "on", 2 };
+    text_t key_list = { "list", 4 };
+    text_buf_t buf;
+    json_writer_t writer;
+    json_t *json = NULL;
+    text_t str;
+    uint64 num;
+    bool32 on = CM_TRUE;
+
+    CM_INIT_TEXTBUF(&buf, sizeof(out), out);
+    json_writer_init(&writer, &buf);
+    (void)json_write_begin_obj(&writer, NULL);
+    (void)json_write_str(&writer, "name", "a\"b\\c\nd\t\001");
+    (void)json_write_int64(&writer, "neg", CM_MIN_INT64);
+    (void)json_write_uint64(&writer, "big", (uint64)CM_MAX_INT64 + 1);
+    (void)json_write_bool(&writer, "on", CM_FALSE);
+    (void)json_write_begin_arr(&writer, "list");
+    for (uint32 i = 1; i <= 2; i++) {
+        (void)json_write_begin_obj(&writer, NULL);
+        (void)json_write_uint64(&writer, "id", i);
+        (void)json_write_end_obj(&writer);
+    }
+    (void)json_write_end_arr(&writer);
+    (void)json_write_double(&writer, "ratio", 1.0 / 3, 2);
+    (void)json_write_end_obj(&writer);
+    TEST_CHECK(json_writer_finish(&writer) == CM_SUCCESS);
+    TEST_CHECK(strcmp(out, expect) == 0);
+
+    TEST_CHECK(test_parse(out, &json) == CM_SUCCESS);
+    TEST_CHECK(json_get_str(json, &key_name, &str) == CM_SUCCESS);
+    TEST_CHECK(cm_text_str_equal(&str, "a\\\"b\\\\c\\nd\\t\\u0001"));
+    TEST_CHECK(json_get_uint64(json, &key_big, &num) == CM_SUCCESS && num == (uint64)CM_MAX_INT64 + 1);
+    TEST_CHECK(json_get_bool(json, &key_on, &on) == CM_SUCCESS && !on);
+    json_arr_t *arr = json_get_arr(json, &key_list);
+    TEST_CHECK(arr != NULL && jarr_get_size(arr) == 2);
+
+    CM_INIT_TEXTBUF(&buf, sizeof(again), again);
+    json_writer_init(&writer, &buf);
+    (void)json_write_json(&writer, NULL, json);
+    json_destory(json);
+    TEST_CHECK(json_writer_finish(&writer) == CM_SUCCESS);
+    TEST_CHECK(strcmp(again, expect) == 0);
+    return CM_SUCCESS;
+}
+
+// the first failure sticks and the output is still terminated
+static status_t test_write_overflow(void)
+{
+    char out[TEST_KEY_BUF_SIZE];
+    text_buf_t buf;
+    json_writer_t writer;
+
+    CM_INIT_TEXTBUF(&buf, sizeof(out), out);
+    json_writer_init(&writer, &buf);
+    TEST_CHECK(json_write_begin_obj(&writer, NULL) == CM_SUCCESS);
+    TEST_CHECK(json_write_str(&writer, "key", "a value longer than the buffer") != CM_SUCCESS);
+    TEST_CHECK(json_write_end_obj(&writer) != CM_SUCCESS);
+    TEST_CHECK(json_writer_finish(&writer) != CM_SUCCESS);
+    TEST_CHECK(strlen(out) == sizeof(out) - 1);
+
+    // closing more than was opened fails too
+    CM_INIT_TEXTBUF(&buf, sizeof(out), out);
+    json_writer_init(&writer, &buf);
+    TEST_CHECK(json_write_end_arr(&writer) != CM_SUCCESS);
+    TEST_CHECK(json_writer_finish(&writer) != CM_SUCCESS);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_parse_values),
+        TEST_CASE(test_parse_many_members),
+        TEST_CASE(test_parse_escapes),
+        TEST_CASE(test_reject_broken),
+        TEST_CASE(test_reject_trailing_text),
+        TEST_CASE(test_write_double),
+        TEST_CASE(test_write_special_doubles),
+        TEST_CASE(test_write_read_back),
+        TEST_CASE(test_write_overflow),
+    };
+    return test_run(cases, ELEMENT_COUNT(cases));
+}
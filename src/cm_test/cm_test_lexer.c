@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_lexer.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_lexer.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "ddes_lexer.h"
+#include "ddes_oper.h"
+#include "cm_test.h"
+
+#define TEST_ANY_ID CM_INVALID_ID32 // the id of a variant is not checked
+
+typedef struct st_test_word {
+    const char *text;
+    word_type_t type;
+    uint32 id;
+} test_word_t;
+
+static void test_lex_init(lex_t *lex, lang_text_t *sql, const char *str)
+{
+    sql->str = (char *)str;
+    sql->len = (uint32)strlen(str);
+    sql->loc.line = 1;
+    sql->loc.column = 1;
+    lex_init(lex, sql);
+}
+
+// lex the text alone, so that no word after it changes what it is fetched as
+static status_t test_fetch_one(const test_word_t *expect, bool32 in_hint)
+{
+    lang_text_t sql;
+    lex_t lex;
+    word_t word;
+
+    test_lex_init(&lex, &sql, expect->text);
+    TEST_CHECK((in_hint ? lex_fetch_in_hint(&lex, &word) : lex_fetch(&lex, &word)) == CM_SUCCESS);
+    if (word.type != expect->type || (expect->id != TEST_ANY_ID && word.id != expect->id) ||
+        word.text.len != sql.len) {
+        (void)printf("'%s' fetched as type 0x%x id %u\n", expect->text, (uint32)word.type, word.id);
+        return CM_ERROR;
+    }
+    TEST_CHECK(lex_fetch(&lex, &word) == CM_SUCCESS && word.type == WORD_TYPE_EOF);
+    return CM_SUCCESS;
+}
+
+static status_t test_fetch_words(const test_word_t *words, uint32 count, bool32 in_hint)
+{
+    for (uint32 i = 0; i < count; i++) {
+        CM_RETURN_IFERR(test_fetch_one(&words[i], in_hint));
+    }
+    return CM_SUCCESS;
+}
+
+// every reserved word, in any case, and a few words close to them
+static status_t test_reserved_words(void)
+{
+    static const test_word_t words[] = {
+        { "column_value", WORD_TYPE_RESERVED, RES_WORD_COLUMN_VALUE },
+        { "connect_by_iscycle", WORD_TYPE_RESERVED, RES_WORD_CONNECT_BY_ISCYCLE },
+        { "connect_by_isleaf", WORD_TYPE_RESERVED, RES_WORD_CONNECT_BY_ISLEAF },
+        { "curdate", WORD_TYPE_RESERVED, RES_WORD_CURDATE },
+        { "Current_Date", WORD_TYPE_RESERVED, RES_WORD_CURDATE },
+        { "current_timestamp", WORD_TYPE_RESERVED, RES_WORD_CURTIMESTAMP },
+        { "dbtimezone", WORD_TYPE_RESERVED, RES_WORD_DATABASETZ },
+        { "default", WORD_TYPE_RESERVED, RES_WORD_DEFAULT },
+        { "deleting", WORD_TYPE_RESERVED, RES_WORD_DELETING },
+        { "FALSE", WORD_TYPE_RESERVED, RES_WORD_FALSE },
+        { "inserting", WORD_TYPE_RESERVED, RES_WORD_INSERTING },
+        { "level", WORD_TYPE_RESERVED, RES_WORD_LEVEL },
+        { "localtimestamp", WORD_TYPE_RESERVED, RES_WORD_LOCALTIMESTAMP },
+        { "now", WORD_TYPE_RESERVED, RES_WORD_SYSTIMESTAMP },
+        { "NULL", WORD_TYPE_RESERVED, RES_WORD_NULL },
+        { "rowid", WORD_TYPE_RESERVED, RES_WORD_ROWID },
+        { "RowNum", WORD_TYPE_RESERVED, RES_WORD_ROWNUM },
+        { "rowscn", WORD_TYPE_RESERVED, RES_WORD_ROWSCN },
+        { "sessiontimezone", WORD_TYPE_RESERVED, RES_WORD_SESSIONTZ },
+        { "sysdate", WORD_TYPE_RESERVED, RES_WORD_SYSDATE },
+        { "systimestamp", WORD_TYPE_RESERVED, RES_WORD_SYSTIMESTAMP },
+        { "true", WORD_TYPE_RESERVED, RES_WORD_TRUE },
+        { "updating", WORD_TYPE_RESERVED, RES_WORD_UPDATING },
+        { "user", WORD_TYPE_RESERVED, RES_WORD_USER },
+        { "utc_timestamp", WORD_TYPE_RESERVED, RES_WORD_UTCTIMESTAMP },
+        { "rownu", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "rownum_", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "userx", WORD_TYPE_VARIANT, TEST_ANY_ID },
+    };
+    return test_fetch_words(words, ELEMENT_COUNT(words), CM_FALSE);
+}
+
+static status_t test_key_words(void)
+{
+    static const test_word_t words[] = {
+        { "select", WORD_TYPE_KEYWORD, KEY_WORD_SELECT },
+        { "SeLeCt", WORD_TYPE_KEYWORD, KEY_WORD_SELECT },
+        { "FROM", WORD_TYPE_KEYWORD, KEY_WORD_FROM },
+        { "where", WORD_TYPE_KEYWORD, KEY_WORD_WHERE },
+        // the binary search missed one of these two, they were out of order in g_key_words
+        { "skip_triggers", WORD_TYPE_KEYWORD, KEY_WORD_SKIP_TRIGGERS },
+        { "skip_quote_names", WORD_TYPE_KEYWORD, KEY_WORD_SKIP_QUOTE_NAMES },
+        { "prior", WORD_TYPE_OPERATOR, OPER_TYPE_PRIOR },
+        { "bigint", WORD_TYPE_DATATYPE, DTYP_BIGINT },
+        { "VarChar", WORD_TYPE_DATATYPE, DTYP_VARCHAR },
+        { "binary_double", WORD_TYPE_DATATYPE, DTYP_BINARY_DOUBLE },
+        { "selec", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "selects", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "skip_trigger", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "a$b#c_1", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "x", WORD_TYPE_VARIANT, TEST_ANY_ID },
+    };
+    return test_fetch_words(words, ELEMENT_COUNT(words), CM_FALSE);
+}
+
+static status_t test_hint_words(void)
+{
+    static const test_word_t words[] = {
+        { "full", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_FULL },
+        { "hash_bucket_size", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_HASH_BUCKET_SIZE },
+        { "INDEX", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_INDEX },
+        { "index_asc", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_INDEX_ASC },
+        { "index_desc", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_INDEX_DESC },
+        { "index_ffs", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_INDEX_FFS },
+        { "leading", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_LEADING },
+        { "no_index", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_NO_INDEX },
+        { "no_index_ffs", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_NO_INDEX_FFS },
+        { "ordered", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_ORDERED },
+        { "parallel", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_PARALLEL },
+        { "rule", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_RULE },
+        { "throw_duplicate", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_THROW_DUPLICATE },
+        { "use_hash", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_USE_HASH },
+        { "use_merge", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_USE_MERGE },
+        { "Use_NL", WORD_TYPE_HINT_KEYWORD, HINT_KEY_WORD_USE_NL },
+        { "use_nlx", WORD_TYPE_VARIANT, TEST_ANY_ID },
+        { "select", WORD_TYPE_VARIANT, TEST_ANY_ID },
+    };
+    return test_fetch_words(words, ELEMENT_COUNT(words), CM_TRUE);
+}
+
+static status_t test_datetime_units(void)
+{
+    static const char *units[] = { "day", "HOUR", "microsecond", "minute", "month", "quarter", "second",
+        "sql_tsi_day", "SQL_TSI_FRAC_SECOND", "sql_tsi_hour", "sql_tsi_minute", "sql_tsi_month", "sql_tsi_quarter",
+        "sql_tsi_second", "sql_tsi_week", "sql_tsi_year", "week", "Year" };
+    static const char *others[] = { "days", "sql_tsi", "hou", "select" };
+    word_t word;
+
+    for (uint32 i = 0; i < ELEMENT_COUNT(units) + ELEMENT_COUNT(others); i++) {
+        bool32 is_unit = i < ELEMENT_COUNT(units);
+        word.text.str = (char *)(is_unit ? units[i] : others[i - ELEMENT_COUNT(units)]);
+        word.text.len = (uint32)strlen(word.text.str);
+        word.id = 0;
+        if (lex_match_datetime_unit(&word) != is_unit || (is_unit && word.id == 0)) {
+            (void)printf("'%s' %s a datetime unit\n", word.text.str, is_unit ? "is not found as" : "is found as");
+            return CM_ERROR;
+        }
+    }
+    return CM_SUCCESS;
+}
+
+// the name scan stops at the first splitter and keeps the location of the next word right
+static status_t test_fetch_names(void)
+{
+    lang_text_t sql;
+    lex_t lex;
+    word_t word;
+
+    test_lex_init(&lex, &sql, "abc_1$#,Select\n  rownum");
+    TEST_CHECK(lex_fetch(&lex, &word) == CM_SUCCESS && word.type == WORD_TYPE_VARIANT);
+    TEST_CHECK(cm_text_str_equal(&word.text.txt, "abc_1$#"));
+    TEST_CHECK(lex_fetch(&lex, &word) == CM_SUCCESS && word.type == WORD_TYPE_SPEC_CHAR);
+    TEST_CHECK(lex_fetch(&lex, &word) == CM_SUCCESS && word.type == WORD_TYPE_KEYWORD && word.id == KEY_WORD_SELECT);
+    TEST_CHECK(word.loc.line == 1 && word.loc.column == 9);
+    TEST_CHECK(lex_fetch(&lex, &word) == CM_SUCCESS && word.type == WORD_TYPE_RESERVED && word.id == RES_WORD_ROWNUM);
+    TEST_CHECK(word.loc.line == 2 && word.loc.column == 3);
+    TEST_CHECK(lex_fetch(&lex, &word) == CM_SUCCESS && word.type == WORD_TYPE_EOF);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_reserved_words),
+        TEST_CASE(test_key_words),
+        TEST_CASE(test_hint_words),
+        TEST_CASE(test_datetime_units),
+        TEST_CASE(test_fetch_names),
+    };
+    return test_run(cases, ELEMENT_COUNT(cases));
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_mes_queue.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_mes_queue.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "cm_ring.h"
+#include "mes_queue.h"
+#include "cm_test.h"
+
+#define TEST_RING_SIZE   4
+#define TEST_ITEMS       16
+#define TEST_THREADS     4
+#define TEST_PER_THREAD  50000
+
+typedef struct st_test_ring_ctx {
+    cm_ring_t ring;
+    uint32 *seen;
+    atomic32_t popped;
+    bool32 failed;
+} test_ring_ctx_t;
+
+typedef struct st_test_worker {
+    thread_t thread;
+    test_ring_ctx_t *ctx;
+    uint32 id;
+} test_worker_t;
+
+static uint32 g_test_vals[TEST_ITEMS];
+static mes_msgitem_t g_test_msgitems[TEST_ITEMS];
+
+static status_t test_ring_full_empty(void)
+{
+    cm_ring_t ring;
+
+    TEST_CHECK(cm_ring_init(&ring, 0) != CM_SUCCESS);
+    TEST_CHECK(cm_ring_init(&ring, CM_RING_MAX_CAPACITY + 1) != CM_SUCCESS);
+    // the capacity is rounded up to a power of two
+    TEST_CHECK(cm_ring_init(&ring, TEST_RING_SIZE - 1) == CM_SUCCESS && ring.capacity == TEST_RING_SIZE);
+    TEST_CHECK(cm_ring_inited(&ring) && cm_ring_pop(&ring) == NULL);
+
+    // wrap around the cells several times
+    for (uint32 round = 0; round < TEST_ITEMS / TEST_RING_SIZE; round++) {
+        uint32 *vals = g_test_vals + round * TEST_RING_SIZE;
+        for (uint32 i = 0; i < TEST_RING_SIZE; i++) {
+            TEST_CHECK(cm_ring_push(&ring, &vals[i]));
+        }
+        TEST_CHECK(!cm_ring_push(&ring, &vals[0]));
+        TEST_CHECK(cm_ring_count(&ring) == TEST_RING_SIZE);
+        for (uint32 i = 0; i < TEST_RING_SIZE; i++) {
+            TEST_CHECK(cm_ring_pop(&ring) == &vals[i]);
+        }
+        TEST_CHECK(cm_ring_pop(&ring) == NULL && cm_ring_count(&ring) == 0);
+    }
+    cm_ring_destroy(&ring);
+    TEST_CHECK(!cm_ring_inited(&ring));
+    return CM_SUCCESS;
+}
+
+// values are index + 1 in seen, so that no pushed pointer is NULL
+static void test_ring_producer(thread_t *thread)
+{
+    test_worker_t *worker = (test_worker_t *)thread->argument;
+    test_ring_ctx_t *ctx = worker->ctx;
+    uintptr_t base = (uintptr_t)worker->id * TEST_PER_THREAD;
+
+    for (uint32 i = 0; i < TEST_PER_THREAD && !ctx->failed;) {
+        if (cm_ring_push(&ctx->ring, (void *)(base + i + 1))) {
+            i++;
+        } else {
+            cm_spin_sleep();
+        }
+    }
+}
+
+static void test_ring_consumer(thread_t *thread)
+{
+    test_worker_t *worker = (test_worker_t *)thread->argument;
+    test_ring_ctx_t *ctx = worker->ctx;
+    uint32 total = TEST_THREADS * TEST_PER_THREAD;
+
+    while ((uint32)cm_atomic32_get(&ctx->popped) < total && !ctx->failed) {
+        uintptr_t val = (uintptr_t)cm_ring_pop(&ctx->ring);
+        if (val == 0) {
+            cm_spin_sleep();
+            continue;
+        }
+        if (val > total) {
+            ctx->failed = CM_TRUE;
+            return;
+        }
+        ctx->seen[val - 1]++;
+        (void)cm_atomic32_inc(&ctx->popped);
+    }
+}
+
+// every pushed value is popped exactly once
+static status_t test_ring_threads(void)
+{
+    test_ring_ctx_t ctx = { 0 };
+    test_worker_t workers[2 * TEST_THREADS];
+    uint32 total = TEST_THREADS * TEST_PER_THREAD;
+    uint32 started = 0;
+
+    ctx.seen = (uint32 *)calloc(total, sizeof(uint32));
+    TEST_CHECK(ctx.seen != NULL);
+    if (cm_ring_init(&ctx.ring, TEST_ITEMS) != CM_SUCCESS) {
+        free(ctx.seen);
+        return CM_ERROR;
+    }
+    for (uint32 i = 0; i < 2 * TEST_THREADS; i++) {
+        workers[i].ctx = &ctx;
+        workers[i].id = i / 2;
+        if (cm_create_thread((i % 2 == 0) ? test_ring_producer : test_ring_consumer, 0, &workers[i],
+            &workers[i].thread) != CM_SUCCESS) {
+            // the running producers and consumers stop on the flag
+            ctx.failed = CM_TRUE;
+            break;
+        }
+        started++;
+    }
+    for (uint32 i = 0; i < started; i++) {
+        cm_close_thread(&workers[i].thread);
+    }
+    cm_ring_destroy(&ctx.ring);
+
+    status_t ret = ctx.failed ? CM_ERROR : CM_SUCCESS;
+    for (uint32 i = 0; i < total && ret == CM_SUCCESS; i++) {
+        ret = (ctx.seen[i] == 1) ? CM_SUCCESS : CM_ERROR;
+    }
+    free(ctx.seen);
+    TEST_CHECK(ret == CM_SUCCESS);
+    return CM_SUCCESS;
+}
+
+// items that overflowed the ring to the list keep their order, also when more come while the list drains
+static status_t test_queue_fifo_overflow(void)
+{
+    mes_msgqueue_t queue;
+    uint32 next = 0;
+
+    mes_init_msgqueue(&queue);
+    TEST_CHECK(cm_ring_init(&queue.ring, TEST_RING_SIZE) == CM_SUCCESS);
+    for (uint32 i = 0; i < TEST_RING_SIZE + 2; i++) {
+        mes_put_msgitem(&queue, &g_test_msgitems[i]);
+    }
+    TEST_CHECK(queue.count == 2 && mes_msgqueue_count(&queue) == TEST_RING_SIZE + 2);
+
+    // the ring has room again, the new item still goes behind the ones in the list
+    TEST_CHECK(mes_get_msgitem(&queue) == &g_test_msgitems[next++]);
+    for (uint32 i = TEST_RING_SIZE + 2; i < TEST_ITEMS; i++) {
+        mes_put_msgitem(&queue, &g_test_msgitems[i]);
+    }
+    while (next < TEST_ITEMS) {
+        TEST_CHECK(mes_get_msgitem(&queue) == &g_test_msgitems[next++]);
+    }
+    TEST_CHECK(mes_get_msgitem(&queue) == NULL && mes_msgqueue_count(&queue) == 0);
+
+    // once drained, items take the ring again
+    mes_put_msgitem(&queue, &g_test_msgitems[0]);
+    TEST_CHECK(queue.count == 0 && cm_ring_count(&queue.ring) == 1);
+    TEST_CHECK(mes_get_msgitem(&queue) == &g_test_msgitems[0]);
+    cm_ring_destroy(&queue.ring);
+    return CM_SUCCESS;
+}
+
+static status_t test_queue_without_ring(void)
+{
+    mes_msgqueue_t queue;
+
+    mes_init_msgqueue(&queue);
+    queue.ring.cells = NULL;
+    for (uint32 i = 0; i < TEST_ITEMS; i++) {
+        mes_put_msgitem(&queue, &g_test_msgitems[i]);
+    }
+    TEST_CHECK(mes_msgqueue_count(&queue) == TEST_ITEMS);
+    for (uint32 i = 0; i < TEST_ITEMS; i++) {
+        TEST_CHECK(mes_get_msgitem(&queue) == &g_test_msgitems[i]);
+    }
+    TEST_CHECK(mes_get_msgitem(&queue) == NULL);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_ring_full_empty),
+        TEST_CASE(test_ring_threads),
+        TEST_CASE(test_queue_fifo_overflow),
+        TEST_CASE(test_queue_without_ring),
+    };
+    return test_run(cases, ELEMENT_COUNT(cases));
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_test_oamap.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_test/cm_test_oamap.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "cm_oamap.h"
+#include "cm_test.h"
+
+#define TEST_ITEMS       5000
+#define TEST_COLLISIONS  200
+#define TEST_MISS_BIT    0x80000000U
+
+typedef struct st_test_item {
+    uint32 key;
+    uint32 seen;
+} test_item_t;
+
+static cm_allocator_t g_test_alloc = TEST_ALLOCATOR;
+static test_item_t g_test_items[TEST_ITEMS];
+
+static void *test_item_key(void *item)
+{
+    return &((test_item_t *)item)->key;
+}
+
+static bool32 test_key_equal(void *lkey, void *rkey)
+{
+    return *(uint32 *)lkey == *(uint32 *)rkey;
+}
+
+static uint32 test_key_hash(void *key)
+{
+    return *(uint32 *)key;
+}
+
+// every key in one of four hashes, so the probes run through long chains of equal control bytes
+static uint32 test_key_collide(void *key)
+{
+    return *(uint32 *)key % 4;
+}
+
+static oamap_funcs_t g_test_funcs = { test_item_key, test_key_equal, test_key_hash };
+static oamap_funcs_t g_test_collide_funcs = { test_item_key, test_key_equal, test_key_collide };
+
+#define TEST_ITEM_KEY(item)        (&((test_item_t *)(item))->key)
+#define TEST_KEY_HASH(key)         (*(key))
+#define TEST_KEY_EQUAL(lkey, rkey) (*(uint32 *)(lkey) == *(rkey))
+CM_OAMAP_DEFINE_FIND(test_oamap_find, const uint32 *, TEST_KEY_HASH, TEST_ITEM_KEY, TEST_KEY_EQUAL)
+
+static void test_init_items(uint32 count)
+{
+    for (uint32 i = 0; i < count; i++) {
+        g_test_items[i].key = i * 7 + 1;
+        g_test_items[i].seen = 0;
+    }
+}
+
+static status_t test_insert_items(oamap_t *map, oamap_funcs_t *funcs, uint32 count)
+{
+    void *exist = NULL;
+
+    for (uint32 i = 0; i < count; i++) {
+        TEST_CHECK(cm_oamap_insert(map, funcs, &g_test_items[i], &exist) == CM_SUCCESS);
+        TEST_CHECK(exist == NULL);
+    }
+    TEST_CHECK(map->count == count);
+    return CM_SUCCESS;
+}
+
+static status_t test_insert_find_grow(void)
+{
+    oamap_t map;
+    void *exist = NULL;
+    test_item_t dup = { 1, 0 };
+
+    test_init_items(TEST_ITEMS);
+    TEST_CHECK(cm_oamap_init(&map, &g_test_alloc, 0) == CM_SUCCESS);
+    CM_RETURN_IFERR(test_insert_items(&map, &g_test_funcs, TEST_ITEMS));
+
+    // a key that is there already is not inserted again
+    TEST_CHECK(cm_oamap_insert(&map, &g_test_funcs, &dup, &exist) == CM_SUCCESS);
+    TEST_CHECK(exist == &g_test_items[0] && map.count == TEST_ITEMS);
+
+    for (uint32 i = 0; i < TEST_ITEMS; i++) {
+        uint32 miss = g_test_items[i].key | TEST_MISS_BIT;
+        TEST_CHECK(cm_oamap_find(&map, &g_test_funcs, &g_test_items[i].key) == &g_test_items[i]);
+        TEST_CHECK(test_oamap_find(&map, &g_test_items[i].key) == &g_test_items[i]);
+        TEST_CHECK(cm_oamap_find(&map, &g_test_funcs, &miss) == NULL);
+    }
+    cm_oamap_destroy(&map);
+    return CM_SUCCESS;
+}
+
+static status_t test_delete_reinsert(void)
+{
+    oamap_t map;
+
+    test_init_items(TEST_ITEMS);
+    TEST_CHECK(cm_oamap_init(&map, &g_test_alloc, TEST_ITEMS) == CM_SUCCESS);
+    CM_RETURN_IFERR(test_insert_items(&map, &g_test_funcs, TEST_ITEMS));
+
+    for (uint32 i = 0; i < TEST_ITEMS; i += 2) {
+        TEST_CHECK(cm_oamap_delete(&map, &g_test_funcs, &g_test_items[i].key) == &g_test_items[i]);
+        TEST_CHECK(cm_oamap_delete(&map, &g_test_funcs, &g_test_items[i].key) == NULL);
+    }
+    TEST_CHECK(map.count == TEST_ITEMS / 2);
+    for (uint32 i = 0; i < TEST_ITEMS; i++) {
+        void *expect = (i % 2 == 0) ? NULL : &g_test_items[i];
+        TEST_CHECK(cm_oamap_find(&map, &g_test_funcs, &g_test_items[i].key) == expect);
+    }
+
+    // the deleted slots are used again
+    void *exist = NULL;
+    for (uint32 i = 0; i < TEST_ITEMS; i += 2) {
+        TEST_CHECK(cm_oamap_insert(&map, &g_test_funcs, &g_test_items[i], &exist) == CM_SUCCESS && exist == NULL);
+    }
+    TEST_CHECK(map.count == TEST_ITEMS);
+    for (uint32 i = 0; i < TEST_ITEMS; i++) {
+        TEST_CHECK(cm_oamap_find(&map, &g_test_funcs, &g_test_items[i].key) == &g_test_items[i]);
+    }
+    cm_oamap_destroy(&map);
+    return CM_SUCCESS;
+}
+
+static status_t test_colliding_hashes(void)
+{
+    oamap_t map;
+
+    test_init_items(TEST_COLLISIONS);
+    TEST_CHECK(cm_oamap_init(&map, &g_test_alloc, 0) == CM_SUCCESS);
+    CM_RETURN_IFERR(test_insert_items(&map, &g_test_collide_funcs, TEST_COLLISIONS));
+    for (uint32 i = 0; i < TEST_COLLISIONS; i += 3) {
+        TEST_CHECK(cm_oamap_delete(&map, &g_test_collide_funcs, &g_test_items[i].key) == &g_test_items[i]);
+    }
+    for (uint32 i = 0; i < TEST_COLLISIONS; i++) {
+        void *expect = (i % 3 == 0) ? NULL : &g_test_items[i];
+        TEST_CHECK(cm_oamap_find(&map, &g_test_collide_funcs, &g_test_items[i].key) == expect);
+    }
+    cm_oamap_destroy(&map);
+    return CM_SUCCESS;
+}
+
+// iterate while a grow is half done, so both tables hold items, and delete what the iterator returned
+static status_t test_iterate_while_moving(void)
+{
+    oamap_t map;
+    oamap_iter_t iter;
+    void *exist = NULL;
+    uint32 count = 0;
+    uint32 inserted = 0;
+
+    test_init_items(TEST_ITEMS);
+    TEST_CHECK(cm_oamap_init(&map, &g_test_alloc, 0) == CM_SUCCESS);
+    while (inserted < TEST_ITEMS && (inserted < OAMAP_MIN_CAPACITY || map.old.ctrl == NULL)) {
+        TEST_CHECK(cm_oamap_insert(&map, &g_test_funcs, &g_test_items[inserted], &exist) == CM_SUCCESS);
+        inserted++;
+    }
+    TEST_CHECK(map.old.ctrl != NULL);
+
+    cm_oamap_begin(&map, &iter);
+    for (test_item_t *item = cm_oamap_next(&map, &iter); item != NULL; item = cm_oamap_next(&map, &iter)) {
+        item->seen++;
+        count++;
+        if (item->key % 2 == 0) {
+            TEST_CHECK(cm_oamap_delete(&map, &g_test_funcs, &item->key) == item);
+        }
+    }
+    TEST_CHECK(count == inserted);
+    for (uint32 i = 0; i < inserted; i++) {
+        TEST_CHECK(g_test_items[i].seen == 1);
+        void *expect = (g_test_items[i].key % 2 == 0) ? NULL : &g_test_items[i];
+        TEST_CHECK(cm_oamap_find(&map, &g_test_funcs, &g_test_items[i].key) == expect);
+    }
+    cm_oamap_destroy(&map);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const test_case_t cases[] = {
+        TEST_CASE(test_insert_find_grow),
+        TEST_CASE(test_delete_reinsert),
+        TEST_CASE(test_colliding_hashes),
+        TEST_CASE(test_iterate_while_moving),
+    };
+    return test_run(cases, ELEMENT_COUNT(cases));
+}
@@ -34,6 +34,24 @@ gs_timer_t *g_timer(void)
     return &g_timer_t;
 }
 
+static thread_local_var bool32 g_in_timer_thread = CM_FALSE;
+
+uint64 cm_monotonic_usec(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    (void)QueryPerformanceFrequency(&freq);
+    (void)QueryPerformanceCounter(&count);
+    return (uint64)(count.QuadPart / freq.QuadPart) * MICROSECS_PER_SECOND +
+        (uint64)(count.QuadPart % freq.QuadPart) * MICROSECS_PER_SECOND / (uint64)freq.QuadPart;
+#else
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64)ts.tv_sec * MICROSECS_PER_SECOND + (uint64)ts.tv_nsec / NANOSECS_PER_MICROSECS;
+#endif
+}
+
 static inline int32 cm_get_time_zone(void)
 {
 #ifdef WIN32
@@ -49,37 +67,191 @@ static inline int32 cm_get_time_zone(void)
 #endif
 }
 
+static void cm_timer_link(cm_timer_wheel_t *wheel, cm_timer_node_t *node)
+{
+    uint32 level = 0;
+    uint64 expire = MAX(node->expire, wheel->tick);
+    uint64 delta = expire - wheel->tick;
+
+    while (level < CM_TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64)1 << (CM_TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    // too far away for the wheel, it comes back to the last level until it fits
+    if (delta >= ((uint64)1 << (CM_TIMER_WHEEL_BITS * CM_TIMER_WHEEL_LEVELS))) {
+        expire = wheel->tick + ((uint64)1 << (CM_TIMER_WHEEL_BITS * CM_TIMER_WHEEL_LEVELS)) - 1;
+    }
+
+    cm_timer_node_t **head = &wheel->slots[level][(expire >> (CM_TIMER_WHEEL_BITS * level)) & CM_TIMER_WHEEL_MASK];
+    node->prev = NULL;
+    node->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = node;
+    }
+    *head = node;
+    node->head = head;
+}
+
+static void cm_timer_unlink(cm_timer_node_t *node)
+{
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        *node->head = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    node->prev = NULL;
+    node->next = NULL;
+    node->head = NULL;
+}
+
+void cm_timer_node_init(cm_timer_node_t *node, cm_timer_func_t func, void *arg)
+{
+    node->prev = NULL;
+    node->next = NULL;
+    node->head = NULL;
+    node->expire = 0;
+    node->interval = 0;
+    node->func = func;
+    node->arg = arg;
+}
+
+static inline uint64 cm_timer_ms_to_ticks(uint32 ms)
+{
+    return MAX((uint64)ms * MICROSECS_PER_MILLISEC / CM_TIMER_TICK_US, 1);
+}
+
+void cm_timer_schedule(cm_timer_node_t *node, uint32 delay_ms, uint32 interval_ms)
+{
+    cm_timer_wheel_t *wheel = &g_timer()->wheel;
+
+    cm_spin_lock(&wheel->lock, NULL);
+    if (node->head != NULL) {
+        cm_timer_unlink(node);
+    }
+    node->expire = wheel->tick + cm_timer_ms_to_ticks(delay_ms);
+    node->interval = (interval_ms == 0) ? 0 : cm_timer_ms_to_ticks(interval_ms);
+    cm_timer_link(wheel, node);
+    cm_spin_unlock(&wheel->lock);
+}
+
+void cm_timer_cancel(cm_timer_node_t *node)
+{
+    cm_timer_wheel_t *wheel = &g_timer()->wheel;
+
+    cm_spin_lock(&wheel->lock, NULL);
+    node->interval = 0;
+    if (node->head != NULL) {
+        cm_timer_unlink(node);
+    }
+    cm_spin_unlock(&wheel->lock);
+
+    while (!g_in_timer_thread && wheel->running == node) {
+        cm_spin_sleep();
+    }
+}
+
+bool32 cm_timer_pending(const cm_timer_node_t *node)
+{
+    return node->head != NULL;
+}
+
+// move the nodes of one slot of a level down, returns the slot index
+static uint32 cm_timer_cascade(cm_timer_wheel_t *wheel, uint32 level)
+{
+    uint32 idx = (uint32)(wheel->tick >> (CM_TIMER_WHEEL_BITS * level)) & CM_TIMER_WHEEL_MASK;
+    cm_timer_node_t *node = wheel->slots[level][idx];
+
+    wheel->slots[level][idx] = NULL;
+    while (node != NULL) {
+        cm_timer_node_t *next = node->next;
+        cm_timer_link(wheel, node);
+        node = next;
+    }
+    return idx;
+}
+
+static void cm_timer_run_tick(cm_timer_wheel_t *wheel)
+{
+    uint32 idx = (uint32)wheel->tick & CM_TIMER_WHEEL_MASK;
+    cm_timer_node_t **head = &wheel->slots[0][idx];
+
+    cm_spin_lock(&wheel->lock, NULL);
+    if (idx == 0) {
+        for (uint32 level = 1; level < CM_TIMER_WHEEL_LEVELS && cm_timer_cascade(wheel, level) == 0; level++) {
+        }
+    }
+
+    // the lock is released around each callback, which may schedule or cancel any node
+    while (*head != NULL) {
+        cm_timer_node_t *node = *head;
+        cm_timer_unlink(node);
+        wheel->running = node;
+        cm_spin_unlock(&wheel->lock);
+
+        node->func(node->arg);
+
+        cm_spin_lock(&wheel->lock, NULL);
+        wheel->running = NULL;
+        if (node->interval > 0 && node->head == NULL) {
+            node->expire = wheel->tick + node->interval;
+            cm_timer_link(wheel, node);
+        }
+    }
+    wheel->tick++;
+    cm_spin_unlock(&wheel->lock);
+}
+
+static void cm_timer_refresh(gs_timer_t *timer, date_t start_time, bool32 flush_tz)
+{
+    if (flush_tz) {
+        int16 tz_min = (int16)cm_get_time_zone();
+        timer->tz = tz_min / MINUTES_PER_HOUR;
+        timer->host_tz_offset = tz_min * SECONDS_PER_MIN * MICROSECS_PER_SECOND_LL;
+    }
+    // cm_now reads the clock from the vDSO, the broken-down time is computed from it
+    timer->now = cm_now();
+    cm_decode_date(timer->now, (date_detail_t *)&timer->detail);
+    timer->today = (timer->now / (int64)DAY_USECS) * (int64)DAY_USECS;
+    timer->systime = (uint32)((timer->now - start_time) / (int64)MICROSECS_PER_SECOND);
+}
+
 static void timer_proc(thread_t *thread)
 {
     date_t start_time;
     gs_timer_t *timer_temp = (gs_timer_t *)thread->argument;
-    int16 tz_min;
+    cm_timer_wheel_t *wheel = &timer_temp->wheel;
+    uint32 last_systime = 0;
 
     start_time = cm_now();
+    g_in_timer_thread = CM_TRUE;
 
     cm_set_thread_name("timer");
 
-#ifndef _WIN32
-    struct timespec tq, tr;
-    tq.tv_sec = 0;
-    tq.tv_nsec = 100000; // 0.1ms
-#endif
-
     while (!thread->closed) {
-        cm_now_detail((date_detail_t *)&timer_temp->detail);
-        timer_temp->now = cm_encode_date((const date_detail_t *)&timer_temp->detail);
-        timer_temp->today = (timer_temp->now / (int64)DAY_USECS) * (int64)DAY_USECS;
-        timer_temp->systime = (uint32)((timer_temp->now - start_time) / (int64)MICROSECS_PER_SECOND);
-
-        // flush timezone
-        tz_min = (int16)cm_get_time_zone();
-        timer_temp->tz = tz_min / MINUTES_PER_HOUR;
-        timer_temp->host_tz_offset = tz_min * SECONDS_PER_MIN * MICROSECS_PER_SECOND_LL;
+        // the time zone only needs a look once a second
+        cm_timer_refresh(timer_temp, start_time, timer_temp->systime != last_systime);
+        last_systime = timer_temp->systime;
+
+        uint64 target = (cm_monotonic_usec() - wheel->start_usec) / CM_TIMER_TICK_US;
+        while (wheel->tick <= target) {
+            cm_timer_run_tick(wheel);
+        }
+
+        // now keeps its 0.1 ms resolution, the wheel only runs once per tick
+        uint64 now_usec = cm_monotonic_usec();
+        uint64 next_usec = MIN(wheel->start_usec + wheel->tick * CM_TIMER_TICK_US, now_usec + CM_TIMER_NOW_US);
+        if (next_usec > now_usec) {
 #ifdef _WIN32
-        cm_sleep(1);
+            cm_sleep(1);
 #else
-        (void)nanosleep(&tq, &tr);
+            struct timespec tq;
+            tq.tv_sec = 0;
+            tq.tv_nsec = (long)((next_usec - now_usec) * NANOSECS_PER_MICROSECS);
+            (void)nanosleep(&tq, NULL);
 #endif
+        }
     }
 }
 
@@ -95,6 +267,10 @@ status_t cm_start_timer(gs_timer_t *timer)
     int16 tz_min = (int16)cm_get_time_zone();
     timer->tz = tz_min / (int32)SECONDS_PER_MIN;
     timer->host_tz_offset = tz_min * SECONDS_PER_MIN * MICROSECS_PER_SECOND_LL;
+    GS_INIT_SPIN_LOCK(timer->wheel.lock);
+    timer->wheel.tick = 0;
+    timer->wheel.start_usec = cm_monotonic_usec();
+    timer->wheel.running = NULL;
     timer->init = CM_TRUE;
     return cm_create_thread(timer_proc, 0, timer, &timer->thread);
 }
@@ -27,6 +27,7 @@
 #include "cm_defs.h"
 #include "cm_thread.h"
 #include "cm_date.h"
+#include "cm_spinlock.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,34 @@ extern "C" {
 #define CM_HOST_TIMEZONE (g_timer()->host_tz_offset)
 
 
+#define CM_TIMER_NOW_US (100)    // resolution of now
+#define CM_TIMER_TICK_US (1000)  // resolution of the timer wheel
+#define CM_TIMER_WHEEL_BITS (6)
+#define CM_TIMER_WHEEL_SLOTS (1 << CM_TIMER_WHEEL_BITS)
+#define CM_TIMER_WHEEL_MASK (CM_TIMER_WHEEL_SLOTS - 1)
+#define CM_TIMER_WHEEL_LEVELS (4) // 64 ticks per slot of the next level, about 4.6 hours in all
+
+typedef void (*cm_timer_func_t)(void *arg);
+
+/* owned by the caller, scheduling and cancelling never allocate */
+typedef struct st_cm_timer_node {
+    struct st_cm_timer_node *prev;
+    struct st_cm_timer_node *next;
+    struct st_cm_timer_node **head; // slot the node is linked in, NULL when not scheduled
+    uint64 expire;                  // tick the callback is due
+    uint64 interval;                // ticks between two runs, 0 runs once
+    cm_timer_func_t func;
+    void *arg;
+} cm_timer_node_t;
+
+typedef struct st_cm_timer_wheel {
+    spinlock_t lock;
+    uint64 tick;       // next tick to run, all earlier ones are done
+    uint64 start_usec; // monotonic time of tick 0
+    cm_timer_node_t *slots[CM_TIMER_WHEEL_LEVELS][CM_TIMER_WHEEL_SLOTS];
+    cm_timer_node_t *volatile running;
+} cm_timer_wheel_t;
+
 typedef struct st_gs_timer {
     volatile date_detail_t detail;  // detail of date, yyyy-mm-dd hh24:mi:ss
     volatile date_t now;
@@ -44,6 +73,7 @@ typedef struct st_gs_timer {
     volatile int64 host_tz_offset;  // host timezone offset (us)
     thread_t thread;
     bool32 init;
+    cm_timer_wheel_t wheel;
 } gs_timer_t;
 
 
@@ -51,6 +81,19 @@ status_t cm_start_timer(gs_timer_t *timer);
 void cm_close_timer(gs_timer_t *timer);
 gs_timer_t *g_timer(void);
 
+/* monotonic clock in microseconds, read from the vDSO without entering the kernel */
+uint64 cm_monotonic_usec(void);
+
+/*
+ * Timer callbacks run on the timer thread of g_timer(), they must be short and must not block.
+ * cm_timer_schedule reschedules a node which is already pending, cm_timer_cancel returns after
+ * a running callback of the node finished unless it is called from that callback.
+ */
+void cm_timer_node_init(cm_timer_node_t *node, cm_timer_func_t func, void *arg);
+void cm_timer_schedule(cm_timer_node_t *node, uint32 delay_ms, uint32 interval_ms);
+void cm_timer_cancel(cm_timer_node_t *node);
+bool32 cm_timer_pending(const cm_timer_node_t *node);
+
 #ifdef __cplusplus
 }
 #endif
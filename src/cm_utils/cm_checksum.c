@@ -28,6 +28,39 @@
 #define __x86_64__
 #endif
 
+#if defined(CM_HAVE_SSE4_2) && defined(__x86_64__)
+#include <wmmintrin.h>
+#define CM_HAVE_CRC32C_PCLMUL
+#if defined(__GNUC__)
+#define CM_CRC32C_PCLMUL_TARGET __attribute__((target("sse4.2,pclmul")))
+#else
+#define CM_CRC32C_PCLMUL_TARGET
+#endif
+#endif
+
+#if defined(HAVE_ARM_ACLE) && defined(__aarch64__) && defined(__linux__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#define CM_HAVE_CRC32C_PMULL
+#ifndef HWCAP_PMULL
+#define HWCAP_PMULL (1 << 4)
+#endif
+#define CM_CRC32C_PMULL_TARGET __attribute__((target("arch=armv8-a+crc+crypto")))
+#endif
+
+/*
+ * the crc32 instruction has a latency of 3 cycles but a throughput of 1, so three independent streams
+ * keep it busy. The streams are merged by a carry-less multiply with x^(8 * n - 33) mod P, where n is
+ * the number of bytes behind the stream; the extra x^33 is paid back by the final crc32 of the product.
+ */
+#define CRC32C_LONG_BLOCK   1024
+#define CRC32C_SHORT_BLOCK  128
+#define CRC32C_LONG_K1      0x170076faULL  // x^(8 * 1024 - 33) mod P
+#define CRC32C_LONG_K2      0xa51b6135ULL  // x^(8 * 2048 - 33) mod P
+#define CRC32C_SHORT_K1     0x0d3b6092ULL  // x^(8 * 128 - 33) mod P
+#define CRC32C_SHORT_K2     0xb9e02b86ULL  // x^(8 * 256 - 33) mod P
+#define CRC32C_POLY_REFLECT 0x82F63B78
+
 static const uint32 g_crc32c_table_littleendian[8][256];
 static const uint32 g_crc32c_table_bigendian[8][256];
 
@@ -241,6 +274,191 @@ uint32 cm_crc32c_sb8(const void *data, uint32 len, uint32 crc)
     return cm_crc32c_sb8_remain_bendian(ptr, len, crc);
 }
 
+#if defined(CM_HAVE_CRC32C_PCLMUL)
+CM_CRC32C_PCLMUL_TARGET
+static inline uint32 cm_crc32c_sse42_3way_block(const uint8 **p, uint32 crc, uint32 block, uint64 k1, uint64 k2)
+{
+    const uint8 *ptr = *p;
+    const uint8 *ptr_end = ptr + block - sizeof(uint64);
+    uint64 crc0 = crc;
+    uint64 crc1 = 0;
+    uint64 crc2 = 0;
+
+    for (; ptr < ptr_end; ptr += sizeof(uint64)) {
+        crc0 = SSE42_CRC32C_U64(crc0, *((const uint64 *)ptr));
+        crc1 = SSE42_CRC32C_U64(crc1, *((const uint64 *)(ptr + block)));
+        crc2 = SSE42_CRC32C_U64(crc2, *((const uint64 *)(ptr + 2 * block)));
+    }
+    crc0 = SSE42_CRC32C_U64(crc0, *((const uint64 *)ptr));
+    crc1 = SSE42_CRC32C_U64(crc1, *((const uint64 *)(ptr + block)));
+
+    // the last word of the third stream carries the shifted crc of the first two
+    __m128i crcs = _mm_set_epi64x((long long)crc1, (long long)crc0);
+    __m128i consts = _mm_set_epi64x((long long)k1, (long long)k2);
+    uint64 fold = (uint64)_mm_cvtsi128_si64(_mm_clmulepi64_si128(crcs, consts, 0x00)) ^
+                  (uint64)_mm_cvtsi128_si64(_mm_clmulepi64_si128(crcs, consts, 0x11));
+    crc2 = SSE42_CRC32C_U64(crc2, *((const uint64 *)(ptr + 2 * block)) ^ fold);
+
+    *p = ptr + 2 * block + sizeof(uint64);
+    return (uint32)crc2;
+}
+
+CM_CRC32C_PCLMUL_TARGET
+static uint32 cm_crc32c_sse42_pclmul(const void *data, uint32 len, uint32 crc)
+{
+    const uint8 *ptr = (const uint8 *)data;
+
+    for (; len >= 3 * CRC32C_LONG_BLOCK; len -= 3 * CRC32C_LONG_BLOCK) {
+        crc = cm_crc32c_sse42_3way_block(&ptr, crc, CRC32C_LONG_BLOCK, CRC32C_LONG_K1, CRC32C_LONG_K2);
+    }
+    for (; len >= 3 * CRC32C_SHORT_BLOCK; len -= 3 * CRC32C_SHORT_BLOCK) {
+        crc = cm_crc32c_sse42_3way_block(&ptr, crc, CRC32C_SHORT_BLOCK, CRC32C_SHORT_K1, CRC32C_SHORT_K2);
+    }
+
+    return cm_crc32c_sse42(ptr, len, crc);
+}
+
+static bool32 cm_crc32c_pclmul_available(void)
+{
+    uint32 arr[4] = { 0, 0, 0, 0 };
+
+#if defined(CM_HAVE__GET_CPUID)
+    (void)__get_cpuid(1, &arr[0], &arr[1], &arr[2], &arr[3]);
+#elif defined(CM_HAVE__CPUID)
+    (void)__cpuid(arr, 1);
+#endif
+
+    return (arr[2] & (1 << 1)) != 0;
+}
+#endif
+
+#if defined(CM_HAVE_CRC32C_PMULL)
+CM_CRC32C_PMULL_TARGET
+static inline uint32 cm_crc32c_aarch_3way_block(const uint8 **p, uint32 crc, uint32 block, uint64 k1, uint64 k2)
+{
+    const uint8 *ptr = *p;
+    const uint8 *ptr_end = ptr + block - sizeof(uint64);
+    uint32 crc0 = crc;
+    uint32 crc1 = 0;
+    uint32 crc2 = 0;
+
+    for (; ptr < ptr_end; ptr += sizeof(uint64)) {
+        crc0 = AARCH_CRC32C_U64(crc0, *((const uint64 *)ptr));
+        crc1 = AARCH_CRC32C_U64(crc1, *((const uint64 *)(ptr + block)));
+        crc2 = AARCH_CRC32C_U64(crc2, *((const uint64 *)(ptr + 2 * block)));
+    }
+    crc0 = AARCH_CRC32C_U64(crc0, *((const uint64 *)ptr));
+    crc1 = AARCH_CRC32C_U64(crc1, *((const uint64 *)(ptr + block)));
+
+    poly128_t prod0 = vmull_p64((poly64_t)crc0, (poly64_t)k2);
+    poly128_t prod1 = vmull_p64((poly64_t)crc1, (poly64_t)k1);
+    uint64 fold = vgetq_lane_u64(vreinterpretq_u64_p128(prod0), 0) ^
+                  vgetq_lane_u64(vreinterpretq_u64_p128(prod1), 0);
+    crc2 = AARCH_CRC32C_U64(crc2, *((const uint64 *)(ptr + 2 * block)) ^ fold);
+
+    *p = ptr + 2 * block + sizeof(uint64);
+    return crc2;
+}
+
+CM_CRC32C_PMULL_TARGET
+static uint32 cm_crc32c_aarch_pmull(const void *data, uint32 len, uint32 crc)
+{
+    const uint8 *ptr = (const uint8 *)data;
+
+    for (; len >= 3 * CRC32C_LONG_BLOCK; len -= 3 * CRC32C_LONG_BLOCK) {
+        crc = cm_crc32c_aarch_3way_block(&ptr, crc, CRC32C_LONG_BLOCK, CRC32C_LONG_K1, CRC32C_LONG_K2);
+    }
+    for (; len >= 3 * CRC32C_SHORT_BLOCK; len -= 3 * CRC32C_SHORT_BLOCK) {
+        crc = cm_crc32c_aarch_3way_block(&ptr, crc, CRC32C_SHORT_BLOCK, CRC32C_SHORT_K1, CRC32C_SHORT_K2);
+    }
+
+    return cm_crc32c_aarch(ptr, len, crc);
+}
+#endif
+
+// the table kernel keeps its state byte swapped on big endian hosts
+static uint32 cm_crc32c_sb8_bendian(const void *data, uint32 len, uint32 crc)
+{
+    return swap32(cm_crc32c_sb8(data, len, swap32(crc)));
+}
+
+static cm_crc32c_func_t cm_crc32c_select(void)
+{
+#if defined(HAVE_ARM_ACLE)
+    if (cm_crc32c_aarch_available()) {
+#if defined(CM_HAVE_CRC32C_PMULL)
+        if ((getauxval(AT_HWCAP) & HWCAP_PMULL) != 0) {
+            return cm_crc32c_aarch_pmull;
+        }
+#endif
+        return cm_crc32c_aarch;
+    }
+#else
+    if (cm_crc32c_sse42_available()) {
+#if defined(CM_HAVE_CRC32C_PCLMUL)
+        if (cm_crc32c_pclmul_available()) {
+            return cm_crc32c_sse42_pclmul;
+        }
+#endif
+        return cm_crc32c_sse42;
+    }
+#endif
+
+    return IS_BIG_ENDIAN ? cm_crc32c_sb8_bendian : cm_crc32c_sb8;
+}
+
+// first call probes the cpu once, every later call goes straight to the chosen kernel
+static uint32 cm_crc32c_resolve(const void *data, uint32 len, uint32 crc)
+{
+    g_crc32c_func = cm_crc32c_select();
+    return g_crc32c_func(data, len, crc);
+}
+
+cm_crc32c_func_t g_crc32c_func = cm_crc32c_resolve;
+
+// x^(2^k) mod P, entry 31 wraps to x^1 as the multiplicative order of x divides 2^31 - 1
+static const uint32 g_crc32c_x2n_table[32] = {
+    0x40000000, 0x20000000, 0x08000000, 0x00800000, 0x00008000, 0x82f63b78, 0x6ea2d55c, 0x18b8ea18,
+    0x510ac59a, 0xb82be955, 0xb8fdb1e7, 0x88e56f72, 0x74c360a4, 0xe4172b16, 0x0d65762a, 0x35d73a62,
+    0x28461564, 0xbf455269, 0xe2ea32dc, 0xfe7740e6, 0xf946610b, 0x3c204f8f, 0x538586e3, 0x59726915,
+    0x734d5309, 0xbc1ac763, 0x7d0722cc, 0xd289cabe, 0xe94ca9bc, 0x05b74f3f, 0xa51e1f42, 0x40000000
+};
+
+// a * b mod P, both reflected
+static uint32 cm_crc32c_multmodp(uint32 a, uint32 b)
+{
+    uint32 m = (uint32)1 << 31;
+    uint32 p = 0;
+
+    for (;;) {
+        if ((a & m) != 0) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = ((b & 1) != 0) ? ((b >> 1) ^ CRC32C_POLY_REFLECT) : (b >> 1);
+    }
+    return p;
+}
+
+uint32 cm_crc32c_combine(uint32 crc1, uint32 crc2, uint64 len2)
+{
+    uint32 xp = (uint32)1 << 31;  // x^0
+    uint32 k = 3;                 // len2 counts bytes, x^(8 * len2) starts at x^(2^3)
+
+    while (len2 != 0) {
+        if ((len2 & 1) != 0) {
+            xp = cm_crc32c_multmodp(g_crc32c_x2n_table[k & 31], xp);
+        }
+        len2 >>= 1;
+        k++;
+    }
+
+    return cm_crc32c_multmodp(xp, crc1) ^ crc2;
+}
+
 static const uint32 g_crc32c_table_littleendian[8][256] = {
     { 000000000000, 036232701403, 034116670367, 002324171764,
       030746513437, 006574212034, 004650363750, 032462462353,
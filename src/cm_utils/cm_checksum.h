@@ -92,6 +92,17 @@ static inline void cm_final_crc32c_bendian(uint32 *crc)
 uint32 cm_crc32c_sse42(const void *data, uint32 len, uint32 crc);
 uint32 cm_crc32c_sb8(const void *data, uint32 len, uint32 crc);
 
+/* fastest kernel of the running cpu, picked on the first call; works on the raw (not inverted) crc */
+typedef uint32 (*cm_crc32c_func_t)(const void *data, uint32 len, uint32 crc);
+extern cm_crc32c_func_t g_crc32c_func;
+
+/*
+ * @brief checksum of the concatenation of two buffers
+ * @param crc1 cm_get_checksum of the first buffer, crc2 of the second, len2 length of the second
+ * @return the value cm_get_checksum would return for both buffers
+ */
+uint32 cm_crc32c_combine(uint32 crc1, uint32 crc2, uint64 len2);
+
 #if defined(HAVE_ARM_ACLE)
 uint32 cm_crc32c_aarch(const void *data, uint32 len, uint32 crc);
 bool32 cm_crc32c_aarch_available(void);
@@ -134,17 +145,12 @@ static inline uint32 cm_get_crc32_sb8(const void *data, uint32 len)
 
 static inline uint32 cm_get_checksum(const void *data, uint32 len)
 {
-#if defined(HAVE_ARM_ACLE)
-    if (cm_crc32c_aarch_available()) {
-        return cm_get_crc32c_aarch(data, len);
-    }
-#else
-    if (cm_crc32c_sse42_available()) {
-        return cm_get_crc32_sse42(data, len);
-    }
-#endif
+    uint32 crc;
 
-    return cm_get_crc32_sb8(data, len);
+    cm_init_crc32c(&crc);
+    crc = g_crc32c_func(data, len, crc);
+    cm_final_crc32c(&crc);
+    return crc;
 }
 
 static inline bool32 cm_verify_checksum(const void *data, uint32 len, uint32 ref_val)
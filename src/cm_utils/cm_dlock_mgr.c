@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_dlock_mgr.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_utils/cm_dlock_mgr.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+#include "cm_log.h"
+#include "cm_utils.h"
+#include "ddes_perctrl_api.h"
+#include "cm_dlock_mgr.h"
+
+#define DLOCK_MGR_WAIT_SLICE 100 // ms
+
+static void dlock_mgr_enqueue(dlock_mgr_t *mgr, dlock_entry_t *entry)
+{
+    cm_spin_lock(&mgr->lock, NULL);
+    if (entry->queued || (entry->state != DLOCK_ENTRY_ACQUIRING && entry->state != DLOCK_ENTRY_HELD)) {
+        cm_spin_unlock(&mgr->lock);
+        return;
+    }
+    entry->queued = CM_TRUE;
+    cm_bilist_add_tail(&entry->due_node, &mgr->due);
+    cm_spin_unlock(&mgr->lock);
+    cm_park_wake(&mgr->park, 1);
+}
+
+// runs on the timer thread, the caws are left to the manager thread
+static void dlock_mgr_timer_proc(void *arg)
+{
+    dlock_entry_t *entry = (dlock_entry_t *)arg;
+    dlock_mgr_enqueue(entry->mgr, entry);
+}
+
+static int32 dlock_entry_cmp(const void *a, const void *b)
+{
+    uint64 addr_a = (*(dlock_entry_t *const *)a)->lock.lock_addr;
+    uint64 addr_b = (*(dlock_entry_t *const *)b)->lock.lock_addr;
+    return (addr_a > addr_b) - (addr_a < addr_b);
+}
+
+// entries are sorted by address, each run of adjacent blocks is read with one call
+static status_t dlock_mgr_read_blocks(dlock_mgr_t *mgr, dlock_entry_t **entries, uint32 count, bool32 to_lockr)
+{
+#ifndef WIN32
+    struct iovec iov[DLOCK_MGR_BATCH_MAX];
+
+    qsort(entries, count, sizeof(dlock_entry_t *), dlock_entry_cmp);
+    for (uint32 i = 0; i < count;) {
+        uint64 addr = entries[i]->lock.lock_addr;
+        uint32 n = 0;
+        while (i + n < count && n < DLOCK_MGR_BATCH_MAX &&
+            entries[i + n]->lock.lock_addr == addr + (uint64)n * CM_DEF_BLOCK_SIZE) {
+            dlock_t *lock = &entries[i + n]->lock;
+            iov[n].iov_base = to_lockr ? lock->lockr : lock->tmp;
+            iov[n].iov_len = CM_DEF_BLOCK_SIZE;
+            n++;
+        }
+        ssize_t size = preadv(mgr->fd, iov, (int32)n, (off_t)addr);
+        if (size != (ssize_t)n * CM_DEF_BLOCK_SIZE) {
+            LOG_DEBUG_ERR("Read lock blocks failed, addr %llu, count %u, ret %lld, errno %d.", addr, n,
+                (int64)size, errno);
+            return CM_ERROR;
+        }
+        i += n;
+    }
+#endif
+    return CM_SUCCESS;
+}
+
+static inline void dlock_mgr_fill_caw(perctrl_caw_t *caw, dlock_entry_t *entry)
+{
+    caw->block_addr = entry->lock.lock_addr / CM_DEF_BLOCK_SIZE;
+    caw->buff = entry->lock.lockr;
+    caw->buff_len = 2 * CM_DEF_BLOCK_SIZE;
+    caw->ret = CM_ERROR;
+}
+
+static void dlock_mgr_caw_batch(dlock_mgr_t *mgr, dlock_entry_t **entries, perctrl_caw_t *caws, uint32 count)
+{
+    for (uint32 i = 0; i < count; i++) {
+        dlock_mgr_fill_caw(&caws[i], entries[i]);
+    }
+    // caws[i].ret stays CM_ERROR unless its own caw came back
+    if (perctrl_scsi3_caw_batch(mgr->scsi_dev, caws, count) != CM_SUCCESS) {
+        LOG_DEBUG_ERR("Scsi3 caw batch failed, dev %s, count %u.", mgr->scsi_dev, count);
+    }
+}
+
+// lockr may hold the block of another instance, comparing against it would steal the lock
+static inline void dlock_mgr_expect_free(dlock_entry_t *entry)
+{
+    (void)memset_s(entry->lock.lockr, DISK_LOCK_HEADER_LEN, 0, DISK_LOCK_HEADER_LEN);
+}
+
+static void dlock_mgr_on_acquire(dlock_mgr_t *mgr, dlock_entry_t *entry, int32 ret, uint32 *delay)
+{
+    uint64 now = cm_monotonic_usec();
+
+    if (ret == CM_SUCCESS) {
+        uint64 usecs = now - entry->acquire_begin;
+        entry->stat.acquires++;
+        entry->stat.last_acquire_usecs = usecs;
+        entry->stat.max_acquire_usecs = MAX(entry->stat.max_acquire_usecs, usecs);
+        entry->stat.total_acquire_usecs += usecs;
+        entry->state = DLOCK_ENTRY_HELD;
+        entry->result = CM_SUCCESS;
+        *delay = mgr->attr.renew_interval;
+        return;
+    }
+
+    if (ret != CM_DLOCK_ERR_LOCK_OCCUPIED) {
+        entry->stat.errors++;
+        entry->state = DLOCK_ENTRY_IDLE;
+        entry->result = CM_ERROR;
+        return;
+    }
+
+    entry->stat.contended++;
+    dlock_mgr_expect_free(entry);
+    if (now + (uint64)entry->backoff * MICROSECS_PER_MILLISEC >= entry->deadline) {
+        entry->state = DLOCK_ENTRY_IDLE;
+        entry->result = CM_TIMEDOUT;
+        return;
+    }
+    // half of the backoff is random so that instances waiting for the same lock spread out
+    *delay = entry->backoff / 2 + cm_rand_int32(&mgr->seed, entry->backoff / 2 + 1);
+    entry->backoff = MIN(entry->backoff * 2, mgr->attr.backoff_max);
+}
+
+static void dlock_mgr_on_renew(dlock_mgr_t *mgr, dlock_entry_t *entry, int32 ret, uint32 *delay)
+{
+    if (ret == CM_SUCCESS) {
+        entry->stat.renews++;
+        *delay = mgr->attr.renew_interval;
+    } else if (ret == CM_DLOCK_ERR_LOCK_OCCUPIED) {
+        LOG_RUN_WAR("Disk lock lost, addr %llu, held by inst %lld.", entry->lock.lock_addr,
+            LOCKR_ORG_INST_ID(entry->lock));
+        entry->stat.lost++;
+        entry->state = DLOCK_ENTRY_LOST;
+    } else {
+        // the lease is still running, try again soon
+        entry->stat.errors++;
+        *delay = mgr->attr.backoff_min;
+    }
+}
+
+static void dlock_mgr_finish(dlock_mgr_t *mgr, dlock_entry_t *entry, int32 ret)
+{
+    uint32 delay = 0;
+
+    if (ret == CM_SUCCESS) {
+        // the disk holds lockw now, the next renewal needs a single caw against it
+        errno_t errcode = memcpy_s(entry->lock.lockr, CM_DEF_BLOCK_SIZE, entry->lock.lockw, CM_DEF_BLOCK_SIZE);
+        if (errcode != EOK) {
+            ret = CM_ERROR;
+        }
+    }
+
+    cm_spin_lock(&mgr->lock, NULL);
+    entry->queued = CM_FALSE;
+    if (entry->state == DLOCK_ENTRY_ACQUIRING) {
+        dlock_mgr_on_acquire(mgr, entry, ret, &delay);
+    } else if (entry->state == DLOCK_ENTRY_HELD) {
+        dlock_mgr_on_renew(mgr, entry, ret, &delay);
+    } else if (ret == CM_SUCCESS) {
+        // stopped while its caw was in flight, the disk lock is ours and dlock_mgr_stop has to know
+        entry->result = CM_SUCCESS;
+    }
+    if (delay > 0) {
+        cm_timer_schedule(&entry->timer, delay, 0);
+    }
+    cm_spin_unlock(&mgr->lock);
+    cm_park_wake(&mgr->done_park, INT32_MAX);
+}
+
+// drop the entries stopped since they were queued, a caw for them would take a lock nobody releases
+static uint32 dlock_mgr_keep_live(dlock_mgr_t *mgr, dlock_entry_t **batch, uint32 count)
+{
+    uint32 live = 0;
+
+    cm_spin_lock(&mgr->lock, NULL);
+    for (uint32 i = 0; i < count; i++) {
+        if (batch[i]->state == DLOCK_ENTRY_ACQUIRING || batch[i]->state == DLOCK_ENTRY_HELD) {
+            batch[live++] = batch[i];
+        } else {
+            batch[i]->queued = CM_FALSE;
+        }
+    }
+    cm_spin_unlock(&mgr->lock);
+    if (live < count) {
+        cm_park_wake(&mgr->done_park, INT32_MAX);
+    }
+    return live;
+}
+
+static void dlock_mgr_run_batch(dlock_mgr_t *mgr, dlock_entry_t **batch, uint32 count)
+{
+    perctrl_caw_t caws[DLOCK_MGR_BATCH_MAX];
+    dlock_entry_t *retry[DLOCK_MGR_BATCH_MAX];
+    uint32 retry_count = 0;
+    time_t now = time(NULL);
+
+    count = dlock_mgr_keep_live(mgr, batch, count);
+    if (count == 0) {
+        return;
+    }
+    for (uint32 i = 0; i < count; i++) {
+        dlock_entry_t *entry = batch[i];
+        LOCKW_LOCK_TIME(entry->lock) = now;
+        if (entry->state == DLOCK_ENTRY_ACQUIRING) {
+            LOCKW_LOCK_CREATE_TIME(entry->lock) = now;
+        }
+    }
+    dlock_mgr_caw_batch(mgr, batch, caws, count);
+    for (uint32 i = 0; i < count; i++) {
+        if (caws[i].ret == CM_SCSI_ERR_MISCOMPARE) {
+            retry[retry_count++] = batch[i];
+        } else {
+            dlock_mgr_finish(mgr, batch[i], caws[i].ret);
+        }
+    }
+    if (retry_count == 0) {
+        return;
+    }
+
+    // our copy of the disk is stale, read the lock blocks back and retry the free or own ones
+    if (dlock_mgr_read_blocks(mgr, retry, retry_count, CM_TRUE) != CM_SUCCESS) {
+        for (uint32 i = 0; i < retry_count; i++) {
+            dlock_mgr_finish(mgr, retry[i], CM_ERROR);
+        }
+        return;
+    }
+    count = 0;
+    for (uint32 i = 0; i < retry_count; i++) {
+        dlock_entry_t *entry = retry[i];
+        int64 inst_id = LOCKR_INST_ID(entry->lock);
+        // a held lock found free was unlocked behind our back, it is lost as well
+        if (inst_id != LOCKW_INST_ID(entry->lock) && (inst_id != 0 || entry->state == DLOCK_ENTRY_HELD)) {
+            dlock_mgr_finish(mgr, entry, CM_DLOCK_ERR_LOCK_OCCUPIED);
+            continue;
+        }
+        if (inst_id != 0) {
+            LOCKW_LOCK_CREATE_TIME(entry->lock) = LOCKR_LOCK_CREATE_TIME(entry->lock);
+        }
+        batch[count++] = entry;
+    }
+    count = dlock_mgr_keep_live(mgr, batch, count);
+    if (count == 0) {
+        return;
+    }
+    dlock_mgr_caw_batch(mgr, batch, caws, count);
+    for (uint32 i = 0; i < count; i++) {
+        int32 ret = caws[i].ret == CM_SCSI_ERR_MISCOMPARE ? CM_DLOCK_ERR_LOCK_OCCUPIED : caws[i].ret;
+        dlock_mgr_finish(mgr, batch[i], ret);
+    }
+}
+
+static uint32 dlock_mgr_take_due(dlock_mgr_t *mgr, dlock_entry_t **batch)
+{
+    uint32 count = 0;
+
+    cm_spin_lock(&mgr->lock, NULL);
+    while (count < DLOCK_MGR_BATCH_MAX && !cm_bilist_empty(&mgr->due)) {
+        bilist_node_t *node = cm_bilist_head(&mgr->due);
+        cm_bilist_del_head(&mgr->due);
+        batch[count++] = BILIST_NODE_OF(dlock_entry_t, node, due_node);
+    }
+    cm_spin_unlock(&mgr->lock);
+    return count;
+}
+
+static void dlock_mgr_proc(thread_t *thread)
+{
+    dlock_mgr_t *mgr = (dlock_mgr_t *)thread->argument;
+    dlock_entry_t *batch[DLOCK_MGR_BATCH_MAX];
+
+    cm_set_thread_name("dlock_mgr");
+    while (!thread->closed) {
+        uint32 count = dlock_mgr_take_due(mgr, batch);
+        if (count > 0) {
+            dlock_mgr_run_batch(mgr, batch, count);
+            continue;
+        }
+
+        uint32 seq = cm_park_prepare(&mgr->park);
+        if (!cm_bilist_empty(&mgr->due) || thread->closed) {
+            cm_park_cancel(&mgr->park);
+            continue;
+        }
+        cm_park_wait(&mgr->park, seq, DLOCK_MGR_WAIT_SLICE);
+    }
+}
+
+status_t cm_dlock_mgr_init(dlock_mgr_t *mgr, const char *scsi_dev, const dlock_mgr_attr_t *attr)
+{
+#ifdef WIN32
+    return CM_SUCCESS;
+#else
+    errno_t errcode = memset_s(mgr, sizeof(dlock_mgr_t), 0, sizeof(dlock_mgr_t));
+    securec_check_ret(errcode);
+    errcode = strcpy_s(mgr->scsi_dev, sizeof(mgr->scsi_dev), scsi_dev);
+    if (errcode != EOK) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "scsi_dev");
+        return CM_ERROR;
+    }
+
+    if (attr != NULL) {
+        mgr->attr = *attr;
+    }
+    mgr->attr.renew_interval = mgr->attr.renew_interval > 0 ? mgr->attr.renew_interval : DLOCK_MGR_RENEW_INTERVAL;
+    mgr->attr.backoff_min = mgr->attr.backoff_min > 0 ? mgr->attr.backoff_min : DLOCK_MGR_BACKOFF_MIN;
+    mgr->attr.backoff_max = MAX(mgr->attr.backoff_max > 0 ? mgr->attr.backoff_max : DLOCK_MGR_BACKOFF_MAX,
+        mgr->attr.backoff_min);
+
+    GS_INIT_SPIN_LOCK(mgr->lock);
+    cm_bilist_init(&mgr->due);
+    cm_park_init(&mgr->park);
+    cm_park_init(&mgr->done_park);
+    mgr->seed = (int64)cm_monotonic_usec();
+    CM_RETURN_IFERR(cm_start_timer(g_timer()));
+
+    mgr->fd = open(scsi_dev, O_RDONLY | O_DIRECT);
+    if (mgr->fd < 0) {
+        LOG_DEBUG_ERR("Open dev %s failed, errno %d.", scsi_dev, errno);
+        return CM_ERROR;
+    }
+    if (cm_create_thread(dlock_mgr_proc, 0, mgr, &mgr->thread) != CM_SUCCESS) {
+        (void)close(mgr->fd);
+        mgr->fd = -1;
+        return CM_ERROR;
+    }
+    return CM_SUCCESS;
+#endif
+}
+
+void cm_dlock_mgr_destroy(dlock_mgr_t *mgr)
+{
+#ifndef WIN32
+    mgr->thread.closed = CM_TRUE;
+    cm_park_wake(&mgr->park, 1);
+    cm_close_thread(&mgr->thread);
+    if (mgr->fd >= 0) {
+        (void)close(mgr->fd);
+        mgr->fd = -1;
+    }
+#endif
+}
+
+status_t cm_dlock_mgr_add(dlock_mgr_t *mgr, dlock_entry_t *entry, uint64 lock_addr, int64 inst_id)
+{
+    errno_t errcode = memset_s(entry, sizeof(dlock_entry_t), 0, sizeof(dlock_entry_t));
+    securec_check_ret(errcode);
+    CM_RETURN_IFERR(cm_alloc_dlock(&entry->lock, lock_addr, inst_id));
+    entry->mgr = mgr;
+    entry->inst_id = inst_id;
+    entry->state = DLOCK_ENTRY_IDLE;
+    entry->result = CM_SUCCESS;
+    cm_timer_node_init(&entry->timer, dlock_mgr_timer_proc, entry);
+    return CM_SUCCESS;
+}
+
+// the entry is out of the manager's hands once this returns
+static uint32 dlock_mgr_stop(dlock_mgr_t *mgr, dlock_entry_t *entry)
+{
+    cm_spin_lock(&mgr->lock, NULL);
+    uint32 state = entry->state;
+    entry->state = DLOCK_ENTRY_IDLE;
+    cm_spin_unlock(&mgr->lock);
+
+    cm_timer_cancel(&entry->timer);
+    while (entry->queued) {
+        uint32 seq = cm_park_prepare(&mgr->done_park);
+        if (!entry->queued) {
+            cm_park_cancel(&mgr->done_park);
+            break;
+        }
+        cm_park_wait(&mgr->done_park, seq, DLOCK_MGR_WAIT_SLICE);
+    }
+    // an acquire stopped with its caw in flight may still have won the lock
+    if (state == DLOCK_ENTRY_ACQUIRING && entry->result == CM_SUCCESS) {
+        state = DLOCK_ENTRY_HELD;
+    }
+    return state;
+}
+
+void cm_dlock_mgr_remove(dlock_mgr_t *mgr, dlock_entry_t *entry)
+{
+    (void)dlock_mgr_stop(mgr, entry);
+    cm_destory_dlock(&entry->lock);
+}
+
+static bool32 dlock_mgr_acquired(dlock_entry_t **entries, uint32 count)
+{
+    for (uint32 i = 0; i < count; i++) {
+        if (entries[i]->state == DLOCK_ENTRY_ACQUIRING) {
+            return CM_FALSE;
+        }
+    }
+    return CM_TRUE;
+}
+
+status_t cm_dlock_mgr_acquire(dlock_mgr_t *mgr, dlock_entry_t **entries, uint32 count, uint32 timeout_ms)
+{
+    uint64 begin = cm_monotonic_usec();
+    bool32 queued = CM_FALSE;
+
+    cm_spin_lock(&mgr->lock, NULL);
+    // all or nothing, an invalid entry must not leave the ones before it acquiring
+    for (uint32 i = 0; i < count; i++) {
+        dlock_entry_t *entry = entries[i];
+        if (entry->state != DLOCK_ENTRY_HELD && (entry->state == DLOCK_ENTRY_ACQUIRING || entry->queued)) {
+            cm_spin_unlock(&mgr->lock);
+            CM_THROW_ERROR(ERR_INVALID_PARAM, "dlock entry");
+            return CM_ERROR;
+        }
+    }
+    for (uint32 i = 0; i < count; i++) {
+        dlock_entry_t *entry = entries[i];
+        if (entry->state == DLOCK_ENTRY_HELD) {
+            entry->result = CM_SUCCESS;
+            continue;
+        }
+        if (entry->queued) {
+            continue; // listed twice
+        }
+        // a release zeroed lockw, so write our header again, clearing lockr makes the caw expect a free block
+        cm_init_dlock_header(&entry->lock, entry->lock.lock_addr, entry->inst_id);
+        entry->state = DLOCK_ENTRY_ACQUIRING;
+        entry->result = CM_ERROR;
+        entry->backoff = mgr->attr.backoff_min;
+        entry->acquire_begin = begin;
+        entry->deadline = begin + (uint64)timeout_ms * MICROSECS_PER_MILLISEC;
+        entry->queued = CM_TRUE;
+        cm_bilist_add_tail(&entry->due_node, &mgr->due);
+        queued = CM_TRUE;
+    }
+    cm_spin_unlock(&mgr->lock);
+
+    if (queued) {
+        cm_park_wake(&mgr->park, 1);
+    }
+    while (!dlock_mgr_acquired(entries, count)) {
+        uint32 seq = cm_park_prepare(&mgr->done_park);
+        if (dlock_mgr_acquired(entries, count)) {
+            cm_park_cancel(&mgr->done_park);
+            break;
+        }
+        cm_park_wait(&mgr->done_park, seq, DLOCK_MGR_WAIT_SLICE);
+    }
+
+    status_t status = CM_SUCCESS;
+    for (uint32 i = 0; i < count; i++) {
+        if (status == CM_SUCCESS && entries[i]->result != CM_SUCCESS) {
+            status = entries[i]->result;
+        }
+    }
+    return status;
+}
+
+status_t cm_dlock_mgr_release(dlock_mgr_t *mgr, dlock_entry_t *entry)
+{
+    if (dlock_mgr_stop(mgr, entry) != DLOCK_ENTRY_HELD) {
+        return CM_SUCCESS;
+    }
+    return cm_disk_unlock_s(&entry->lock, mgr->scsi_dev);
+}
+
+status_t cm_dlock_mgr_read(dlock_mgr_t *mgr, dlock_entry_t **entries, uint32 count)
+{
+    dlock_entry_t *sorted[DLOCK_MGR_BATCH_MAX];
+
+    for (uint32 i = 0; i < count; i += DLOCK_MGR_BATCH_MAX) {
+        uint32 n = MIN(count - i, DLOCK_MGR_BATCH_MAX);
+        errno_t errcode = memcpy_s(sorted, sizeof(sorted), entries + i, n * sizeof(dlock_entry_t *));
+        securec_check_ret(errcode);
+        CM_RETURN_IFERR(dlock_mgr_read_blocks(mgr, sorted, n, CM_FALSE));
+    }
+    return CM_SUCCESS;
+}
+
+void cm_dlock_mgr_get_stat(dlock_mgr_t *mgr, dlock_entry_t *entry, dlock_stat_t *stat)
+{
+    cm_spin_lock(&mgr->lock, NULL);
+    *stat = entry->stat;
+    cm_spin_unlock(&mgr->lock);
+}
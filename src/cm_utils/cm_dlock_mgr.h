@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * cm_dlock_mgr.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/cm_utils/cm_dlock_mgr.h
+ *
+ * -------------------------------------------------------------------------
+ */
+#ifndef __CM_DLOCK_MGR_H__
+#define __CM_DLOCK_MGR_H__
+
+#include "cm_dlock.h"
+#include "cm_bilist.h"
+#include "cm_spinlock.h"
+#include "cm_sync.h"
+#include "cm_thread.h"
+#include "cm_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Disk lock manager: one thread drives the CAWs of many dlocks on one device. Lease renewals and
+ * acquire retries fall due on the timer wheel and are sent as one batch of CAWs through perctrl,
+ * the lock blocks of the miscompared ones are read back with as few reads as their addresses allow.
+ */
+#define DLOCK_MGR_BATCH_MAX         64
+#define DLOCK_MGR_RENEW_INTERVAL    1000 // ms
+#define DLOCK_MGR_BACKOFF_MIN       10   // ms
+#define DLOCK_MGR_BACKOFF_MAX       1000 // ms
+
+typedef enum {
+    DLOCK_ENTRY_IDLE,
+    DLOCK_ENTRY_ACQUIRING,
+    DLOCK_ENTRY_HELD,
+    DLOCK_ENTRY_LOST, // the lease was found taken over by another instance
+} dlock_entry_state_e;
+
+typedef struct st_dlock_stat {
+    uint64 acquires;  // successful acquires
+    uint64 renews;    // successful lease renewals
+    uint64 contended; // caws that found the lock held by another instance
+    uint64 errors;    // caws or reads that failed
+    uint64 lost;
+    uint64 last_acquire_usecs;
+    uint64 max_acquire_usecs;
+    uint64 total_acquire_usecs;
+} dlock_stat_t;
+
+typedef struct st_dlock_entry {
+    dlock_t lock;
+    struct st_dlock_mgr *mgr;
+    int64 inst_id;
+    volatile uint32 state; // dlock_entry_state_e, changed under mgr->lock
+    int32 result;          // result of the last acquire
+    uint32 backoff;        // ms before the next acquire retry
+    uint64 acquire_begin;  // usecs, monotonic
+    uint64 deadline;       // usecs, monotonic, an acquire gives up after it
+    volatile bool32 queued; // due or in the batch being processed
+    bilist_node_t due_node;
+    cm_timer_node_t timer;
+    dlock_stat_t stat;
+} dlock_entry_t;
+
+typedef struct st_dlock_mgr_attr {
+    uint32 renew_interval; // ms
+    uint32 backoff_min;    // ms
+    uint32 backoff_max;    // ms
+} dlock_mgr_attr_t;
+
+typedef struct st_dlock_mgr {
+    char scsi_dev[CM_FILE_NAME_BUFFER_SIZE];
+    int32 fd; // O_DIRECT, for reading lock blocks
+    dlock_mgr_attr_t attr;
+    spinlock_t lock;
+    bilist_t due;
+    cm_park_t park;      // the manager thread sleeps here
+    cm_park_t done_park; // acquirers sleep here
+    int64 seed;
+    thread_t thread;
+} dlock_mgr_t;
+
+// attr may be NULL for the defaults, the global timer is started if needed
+status_t cm_dlock_mgr_init(dlock_mgr_t *mgr, const char *scsi_dev, const dlock_mgr_attr_t *attr);
+// all entries must be removed before
+void cm_dlock_mgr_destroy(dlock_mgr_t *mgr);
+status_t cm_dlock_mgr_add(dlock_mgr_t *mgr, dlock_entry_t *entry, uint64 lock_addr, int64 inst_id);
+// stops renewing the lease without unlocking it on disk
+void cm_dlock_mgr_remove(dlock_mgr_t *mgr, dlock_entry_t *entry);
+/*
+ * acquires all entries in one batch, retrying the contended ones with backoff until timeout_ms.
+ * Returns CM_SUCCESS when all are held, otherwise entries[i]->result tells which ones failed,
+ * CM_TIMEDOUT for the contended ones. Held entries are renewed until released.
+ */
+status_t cm_dlock_mgr_acquire(dlock_mgr_t *mgr, dlock_entry_t **entries, uint32 count, uint32 timeout_ms);
+status_t cm_dlock_mgr_release(dlock_mgr_t *mgr, dlock_entry_t *entry);
+// reads the lock blocks into entries[i]->lock.tmp, adjacent blocks are read together
+status_t cm_dlock_mgr_read(dlock_mgr_t *mgr, dlock_entry_t **entries, uint32 count);
+void cm_dlock_mgr_get_stat(dlock_mgr_t *mgr, dlock_entry_t *entry, dlock_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -27,11 +27,18 @@
 #include "cm_thread.h"
 #include "cm_timer.h"
 #include "cm_hash.h"
+#include "cm_sync.h"
+#include "cm_memory.h"
+#include "cm_atomic.h"
 #include "zlib.h"
 
 #ifndef _WIN32
 #include <dirent.h>
 #include <execinfo.h>
+#include <sys/uio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #endif
 
@@ -65,6 +72,9 @@ static log_file_handle_t g_logger[LOG_COUNT] = {
         .file_handle = CM_INVALID_FD,
         .file_inode = 0 },
     [LOG_PROFILE] = {
+        .file_handle = CM_INVALID_FD,
+        .file_inode = 0 },
+    [LOG_BTRACE] = {
         .file_handle = CM_INVALID_FD,
         .file_inode = 0 }
 };
@@ -820,29 +830,24 @@ static void cm_compress_log_file(log_file_handle_t *log_file_handle, char *bak_f
     return;
 }
 
-static void cm_stat_and_write_log(log_file_handle_t *log_file_handle, char *buf, uint32 size,
-                                  bool32 need_rec_filelog, cm_log_write_func_t func)
-{
-    uint64 file_size = 0;
-    uint32 file_inode = 0;
-    // TEST RESULT: 10000 timeout_ticks is approximately 1 second
-    // in SUSE 11 (8  Intel(R) Xeon(R) CPU E5-2690 v2 @ 3.00GHz)
-    uint32 timeout_ticks = 10000;
+typedef struct st_log_rotate {
     char new_bak_file_name[CM_FILE_NAME_BUFFER_SIZE];
     char *bak_file_name[CM_MAX_LOG_FILE_COUNT_LARGER];
-    uint32 remove_file_count = 0;
+    uint32 remove_file_count;
     int handle_before_log;
+} log_rotate_t;
+
+// stat the file and rotate it when full, the caller holds log_file_handle->lock
+static status_t cm_log_prepare_write(log_file_handle_t *log_file_handle, bool32 need_rec_filelog,
+                                     log_rotate_t *rotate)
+{
+    uint64 file_size = 0;
+    uint32 file_inode = 0;
     uint64 max_file_size;
-    new_bak_file_name[0] = '\0';
     status_t ret = CM_SUCCESS;
 
-    if (LOG_DEBUG_INF_ON) {
-        timeout_ticks = 100000;
-    }
-
-    if (!cm_spin_timed_lock(&log_file_handle->lock, timeout_ticks)) {
-        return;
-    }
+    rotate->new_bak_file_name[0] = '\0';
+    rotate->remove_file_count = 0;
 
     if (!cm_log_stat_file(log_file_handle, &file_size, &file_inode)) {
         cm_log_close_file(log_file_handle);
@@ -862,24 +867,52 @@ static void cm_stat_and_write_log(log_file_handle_t *log_file_handle, char *buf,
         || (file_size < max_file_size + SIZE_K(3) && file_size > max_file_size + SIZE_K(2)
             && need_rec_filelog == CM_FALSE)) {
         cm_log_close_file(log_file_handle);
-        ret = cm_rmv_and_bak_log_file(log_file_handle, bak_file_name, new_bak_file_name, &remove_file_count);
+        ret = cm_rmv_and_bak_log_file(log_file_handle, rotate->bak_file_name, rotate->new_bak_file_name,
+            &rotate->remove_file_count);
     }
 
+    rotate->handle_before_log = log_file_handle->file_handle;
+    return ret;
+}
+
+// compress the backup and record the rotation, called after log_file_handle->lock is released
+static void cm_log_finish_write(log_file_handle_t *log_file_handle, log_rotate_t *rotate, status_t ret)
+{
     if (ret == CM_SUCCESS) {
-        handle_before_log = log_file_handle->file_handle;
-        func(log_file_handle, buf, size);
-        cm_spin_unlock(&log_file_handle->lock);
-        cm_compress_log_file(log_file_handle, new_bak_file_name, CM_FILE_NAME_BUFFER_SIZE);
-        cm_write_rmv_and_bak_file_log(bak_file_name, remove_file_count, new_bak_file_name);
-        if (handle_before_log == CM_INVALID_FD && log_file_handle->file_handle != CM_INVALID_FD) {
+        cm_compress_log_file(log_file_handle, rotate->new_bak_file_name, CM_FILE_NAME_BUFFER_SIZE);
+        cm_write_rmv_and_bak_file_log(rotate->bak_file_name, rotate->remove_file_count, rotate->new_bak_file_name);
+        if (rotate->handle_before_log == CM_INVALID_FD && log_file_handle->file_handle != CM_INVALID_FD) {
             LOG_RUN_FILE_INF(CM_FALSE, "[LOG] file '%s' is added", log_file_handle->file_name);
         }
-    } else {
-        cm_spin_unlock(&log_file_handle->lock);
     }
-    for (uint32 i = 0; i < remove_file_count; ++i) {
-        CM_FREE_PTR(bak_file_name[i]);
+    for (uint32 i = 0; i < rotate->remove_file_count; ++i) {
+        CM_FREE_PTR(rotate->bak_file_name[i]);
+    }
+}
+
+static void cm_stat_and_write_log(log_file_handle_t *log_file_handle, char *buf, uint32 size,
+                                  bool32 need_rec_filelog, cm_log_write_func_t func)
+{
+    // TEST RESULT: 10000 timeout_ticks is approximately 1 second
+    // in SUSE 11 (8  Intel(R) Xeon(R) CPU E5-2690 v2 @ 3.00GHz)
+    uint32 timeout_ticks = 10000;
+    log_rotate_t rotate;
+    status_t ret;
+
+    if (LOG_DEBUG_INF_ON) {
+        timeout_ticks = 100000;
+    }
+
+    if (!cm_spin_timed_lock(&log_file_handle->lock, timeout_ticks)) {
+        return;
+    }
+
+    ret = cm_log_prepare_write(log_file_handle, need_rec_filelog, &rotate);
+    if (ret == CM_SUCCESS) {
+        func(log_file_handle, buf, size);
     }
+    cm_spin_unlock(&log_file_handle->lock);
+    cm_log_finish_write(log_file_handle, &rotate, ret);
 }
 
 static void cm_log_write_large_buf(const char *buf, bool32 need_rec_filelog, const char *format,
@@ -1077,6 +1110,689 @@ static log_suppress_status check_log_suppress(log_type_t log_type, const char *c
     return g_log_suppress[index]->suppress_status;
 }
 
+#ifndef _WIN32
+#define CM_LOG_ASYNC_MAX_RINGS      MAX_THREAD_NUM_COUNT
+#define CM_LOG_ASYNC_MIN_RING_SIZE  SIZE_K(64)
+#define CM_LOG_ASYNC_MAX_RING_SIZE  SIZE_M(64)
+#define CM_LOG_ASYNC_MAX_RECORD     (CM_MAX_LOG_CONTENT_LENGTH + CM_MAX_LOG_HEAD_LENGTH + 2)
+#define CM_LOG_ASYNC_IOV_COUNT      64
+#define CM_LOG_ASYNC_FLUSH_INTERVAL 10       // ms
+#define CM_LOG_ASYNC_PAD            LOG_COUNT // fills the ring tail so that no record wraps
+
+typedef struct st_log_async_rec {
+    uint32 size; // text bytes following the header, '\n' included
+    uint16 log_type;
+    uint16 need_rec_filelog;
+} log_async_rec_t;
+
+/* single producer (the owner thread) single consumer (the flusher) byte ring of 8 bytes aligned records */
+typedef struct st_log_async_ring {
+    volatile uint64 head;
+    volatile uint64 tail;
+    atomic_t dropped;
+    volatile bool32 exited; // owner thread is gone, the ring is freed once drained
+    volatile bool32 busy;   // owner is between its started check and its last touch of the ring and the event
+    uint32 size;
+    char *buf;
+} log_async_ring_t;
+
+typedef struct st_log_async {
+    volatile bool32 started;
+    bool32 key_created;
+    pthread_key_t key;
+    uint32 ring_size;
+    thread_t flusher;
+    cm_event_t event;
+    spinlock_t lock;       // protects rings[] registration
+    spinlock_t flush_lock; // one drainer at a time
+    log_async_ring_t *rings[CM_LOG_ASYNC_MAX_RINGS];
+} log_async_t;
+
+static log_async_t g_log_async;
+static thread_local_var log_async_ring_t *g_log_ring = NULL;
+static thread_local_var bool32 g_log_sync_only = CM_FALSE;
+static thread_local_var bool32 g_log_ring_exited = CM_FALSE;
+
+// runs on the exiting thread, whatever it logs from later destructors is written synchronously
+static void cm_log_async_ring_exit(void *arg)
+{
+    g_log_ring = NULL;
+    g_log_ring_exited = CM_TRUE;
+    CM_MFENCE;
+    ((log_async_ring_t *)arg)->exited = CM_TRUE;
+}
+
+static log_async_ring_t *cm_log_async_get_ring(void)
+{
+    if (SECUREC_LIKELY(g_log_ring != NULL)) {
+        return g_log_ring;
+    }
+    if (g_log_ring_exited) {
+        return NULL;
+    }
+
+    log_async_ring_t *ring = (log_async_ring_t *)malloc(sizeof(log_async_ring_t) + g_log_async.ring_size);
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->exited = CM_FALSE;
+    ring->busy = CM_FALSE;
+    ring->size = g_log_async.ring_size;
+    ring->buf = (char *)(ring + 1);
+
+    cm_spin_lock(&g_log_async.lock, NULL);
+    for (uint32 i = 0; i < CM_LOG_ASYNC_MAX_RINGS; i++) {
+        if (g_log_async.rings[i] == NULL) {
+            g_log_async.rings[i] = ring;
+            g_log_ring = ring;
+            break;
+        }
+    }
+    cm_spin_unlock(&g_log_async.lock);
+
+    if (g_log_ring == NULL) {
+        // too many threads, this one keeps writing synchronously
+        free(ring);
+        g_log_sync_only = CM_TRUE;
+        return NULL;
+    }
+    (void)pthread_setspecific(g_log_async.key, ring);
+    return ring;
+}
+
+/*
+ * Returns the ring of the thread marked busy, NULL when async logging stopped. cm_log_stop_async clears
+ * started and then waits for busy rings, so one of the two always sees the other.
+ */
+static log_async_ring_t *cm_log_async_enter(void)
+{
+    log_async_ring_t *ring = cm_log_async_get_ring();
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->busy = CM_TRUE;
+    CM_MFENCE;
+    if (SECUREC_UNLIKELY(!g_log_async.started)) {
+        ring->busy = CM_FALSE;
+        return NULL;
+    }
+    return ring;
+}
+
+static inline void cm_log_async_leave(log_async_ring_t *ring)
+{
+    ring->busy = CM_FALSE;
+}
+
+// room for max_size bytes after the record header, contiguous; NULL when the ring is full and the record dropped
+static log_async_rec_t *cm_log_async_reserve(log_async_ring_t *ring, uint32 max_size, uint64 *head)
+{
+    uint64 used = ring->head - ring->tail;
+    uint32 pos = (uint32)(ring->head & (ring->size - 1));
+    uint32 need = (uint32)CM_ALIGN8(sizeof(log_async_rec_t) + max_size);
+    uint32 pad = (ring->size - pos < need) ? (ring->size - pos) : 0;
+
+    if (ring->size - used < (uint64)pad + need) {
+        if (cm_atomic_inc(&ring->dropped) == 1) {
+            cm_event_notify(&g_log_async.event);
+        }
+        return NULL;
+    }
+
+    *head = ring->head;
+    log_async_rec_t *rec = (log_async_rec_t *)(ring->buf + pos);
+    if (pad != 0) {
+        rec->size = pad - (uint32)sizeof(log_async_rec_t);
+        rec->log_type = CM_LOG_ASYNC_PAD;
+        *head += pad;
+        rec = (log_async_rec_t *)ring->buf;
+    }
+    return rec;
+}
+
+static void cm_log_async_commit(log_async_ring_t *ring, log_async_rec_t *rec, uint64 head, uint32 size,
+    log_type_t log_type, bool32 need_rec_filelog)
+{
+    uint64 tail = ring->tail;
+    uint64 old_head = ring->head;
+
+    rec->size = size;
+    rec->log_type = (uint16)log_type;
+    rec->need_rec_filelog = (uint16)need_rec_filelog;
+    CM_MFENCE;
+    ring->head = head + CM_ALIGN8(sizeof(log_async_rec_t) + size);
+
+    // wake the flusher once when the ring crosses half full, it polls anyway
+    if (old_head - tail <= ring->size / 2 && ring->head - tail > ring->size / 2) {
+        cm_event_notify(&g_log_async.event);
+    }
+}
+
+static bool32 cm_log_async_write(log_type_t log_type, log_level_t log_level, const char *code_file_name,
+    uint32 code_line_num, const char *module_name, bool32 need_rec_filelog, log_suppress_status suppress_status,
+    const char *format, va_list args)
+{
+    uint64 head;
+    log_async_ring_t *ring = cm_log_async_enter();
+    if (ring == NULL) {
+        return CM_FALSE;
+    }
+
+    log_async_rec_t *rec = cm_log_async_reserve(ring, CM_LOG_ASYNC_MAX_RECORD, &head);
+    if (rec == NULL) {
+        cm_log_async_leave(ring);
+        return CM_TRUE;
+    }
+
+    // format straight into the ring, a truncated message keeps its prefix
+    char *text = (char *)(rec + 1);
+    uint32 len;
+    cm_log_build_normal_head(text, CM_LOG_ASYNC_MAX_RECORD, log_level, module_name, suppress_status);
+    len = (uint32)strlen(text);
+    (void)vsnprintf_s(text + len, CM_LOG_ASYNC_MAX_RECORD - len, CM_LOG_ASYNC_MAX_RECORD - len - 1, format, args);
+    len += (uint32)strlen(text + len);
+    (void)snprintf_s(text + len, CM_LOG_ASYNC_MAX_RECORD - len, CM_LOG_ASYNC_MAX_RECORD - len - 1, " [%s:%u]",
+        code_file_name, code_line_num);
+    len += (uint32)strlen(text + len);
+    text[len++] = '\n';
+
+    cm_log_async_commit(ring, rec, head, len, log_type, need_rec_filelog);
+    cm_log_async_leave(ring);
+    return CM_TRUE;
+}
+
+#define CM_TRACE_MAX_POINTS    65536
+#define CM_TRACE_INVALID_ID    0xFFFFFFFF
+#define CM_TRACE_CALIBRATE_MS  20
+#define CM_TRACE_RING_SIZE     SIZE_M(1)
+
+typedef struct st_trace_site {
+    cm_trace_define_t define;
+    char *file;
+    char *format;
+} trace_site_t;
+
+typedef struct st_log_trace {
+    spinlock_t lock;     // protects registration
+    volatile uint32 count;
+    uint32 emitted;      // definitions already in the current file, touched by the drainer only
+    cm_trace_file_t file;
+    trace_site_t *sites[CM_TRACE_MAX_POINTS];
+} log_trace_t;
+
+static log_trace_t g_log_trace;
+
+static inline uint64 cm_trace_tick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64 tick;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(tick));
+    return tick;
+#else
+    return cm_monotonic_usec();
+#endif
+}
+
+static void cm_trace_write_defines(int handle, bool32 fresh)
+{
+    cm_trace_head_t head = { 0 };
+    struct iovec iov[3];
+    uint32 count = g_log_trace.count;
+
+    if (fresh) {
+        head.size = (uint32)(sizeof(cm_trace_head_t) + sizeof(cm_trace_file_t));
+        head.kind = CM_TRACE_FILE;
+        head.tick = g_log_trace.file.base_tick;
+        iov[0].iov_base = (void *)&head;
+        iov[0].iov_len = sizeof(cm_trace_head_t);
+        iov[1].iov_base = (void *)&g_log_trace.file;
+        iov[1].iov_len = sizeof(cm_trace_file_t);
+        (void)writev(handle, iov, 2);
+        g_log_trace.emitted = 0;
+    }
+
+    CM_MFENCE;
+    for (uint32 i = g_log_trace.emitted; i < count; i++) {
+        trace_site_t *site = g_log_trace.sites[i];
+        head.size = (uint32)(sizeof(cm_trace_head_t) + sizeof(cm_trace_define_t)) + site->define.file_len +
+            site->define.format_len;
+        head.kind = CM_TRACE_DEFINE;
+        head.id = i + 1;
+        head.tick = 0;
+        iov[0].iov_base = (void *)&head;
+        iov[0].iov_len = sizeof(cm_trace_head_t);
+        iov[1].iov_base = (void *)&site->define;
+        iov[1].iov_len = sizeof(cm_trace_define_t);
+        iov[2].iov_base = (void *)site->file;
+        iov[2].iov_len = (size_t)site->define.file_len + site->define.format_len;
+        (void)writev(handle, iov, 3);
+    }
+    g_log_trace.emitted = count;
+}
+
+static void cm_log_async_write_batch(log_type_t log_type, bool32 need_rec_filelog, struct iovec *iov, int iov_cnt)
+{
+    log_file_handle_t *log_file_handle = &g_logger[log_type];
+    log_rotate_t rotate;
+    status_t ret;
+
+    cm_spin_lock(&log_file_handle->lock, NULL);
+    ret = cm_log_prepare_write(log_file_handle, need_rec_filelog, &rotate);
+    if (ret == CM_SUCCESS) {
+        bool32 fresh = CM_FALSE;
+        if (log_file_handle->file_handle == CM_INVALID_FD) {
+            cm_log_open_file(log_file_handle);
+            fresh = CM_TRUE;
+        }
+        if (log_file_handle->file_handle != CM_INVALID_FD) {
+            if (log_type == LOG_BTRACE) {
+                // every trace file is decodable alone
+                cm_trace_write_defines(log_file_handle->file_handle, fresh);
+            }
+            (void)writev(log_file_handle->file_handle, iov, iov_cnt);
+        }
+    }
+    cm_spin_unlock(&log_file_handle->lock);
+    cm_log_finish_write(log_file_handle, &rotate, ret);
+}
+
+static void cm_log_async_drain_ring(log_async_ring_t *ring)
+{
+    struct iovec iov[CM_LOG_ASYNC_IOV_COUNT];
+    int iov_cnt = 0;
+    uint16 log_type = 0;
+    uint16 need_rec_filelog = 0;
+    uint64 tail = ring->tail;
+    uint64 head = ring->head;
+
+    CM_MFENCE;
+    while (tail < head) {
+        log_async_rec_t *rec = (log_async_rec_t *)(ring->buf + (tail & (ring->size - 1)));
+        uint64 next = tail + CM_ALIGN8(sizeof(log_async_rec_t) + rec->size);
+
+        if (rec->log_type != CM_LOG_ASYNC_PAD) {
+            if (iov_cnt == CM_LOG_ASYNC_IOV_COUNT ||
+                (iov_cnt > 0 && (rec->log_type != log_type || rec->need_rec_filelog != need_rec_filelog))) {
+                cm_log_async_write_batch((log_type_t)log_type, (bool32)need_rec_filelog, iov, iov_cnt);
+                iov_cnt = 0;
+                CM_MFENCE;
+                ring->tail = tail;
+            }
+            iov[iov_cnt].iov_base = (void *)(rec + 1);
+            iov[iov_cnt].iov_len = rec->size;
+            iov_cnt++;
+            log_type = rec->log_type;
+            need_rec_filelog = rec->need_rec_filelog;
+        }
+        tail = next;
+    }
+
+    if (iov_cnt > 0) {
+        cm_log_async_write_batch((log_type_t)log_type, (bool32)need_rec_filelog, iov, iov_cnt);
+    }
+    CM_MFENCE;
+    ring->tail = tail;
+}
+
+static void cm_log_async_drain(void)
+{
+    int64 dropped = 0;
+    bool32 sync_only = g_log_sync_only;
+
+    // whatever the drain logs itself (rotation, drop counts) must not go back into a ring
+    g_log_sync_only = CM_TRUE;
+    cm_spin_lock(&g_log_async.flush_lock, NULL);
+    for (uint32 i = 0; i < CM_LOG_ASYNC_MAX_RINGS; i++) {
+        log_async_ring_t *ring = g_log_async.rings[i];
+        if (ring == NULL) {
+            continue;
+        }
+
+        bool32 exited = ring->exited;
+        cm_log_async_drain_ring(ring);
+        int64 count = cm_atomic_get(&ring->dropped);
+        if (count != 0) {
+            (void)cm_atomic_add(&ring->dropped, -count);
+            dropped += count;
+        }
+
+        if (exited) {
+            cm_spin_lock(&g_log_async.lock, NULL);
+            g_log_async.rings[i] = NULL;
+            cm_spin_unlock(&g_log_async.lock);
+            free(ring);
+        }
+    }
+    cm_spin_unlock(&g_log_async.flush_lock);
+
+    if (dropped != 0) {
+        LOG_RUN_WAR("[LOG] async log buffer is full, %lld records dropped", dropped);
+    }
+    g_log_sync_only = sync_only;
+}
+
+static void cm_log_async_proc(thread_t *thread)
+{
+    cm_set_thread_name("log_flusher");
+    g_log_sync_only = CM_TRUE;
+
+    while (!thread->closed) {
+        (void)cm_event_timedwait(&g_log_async.event, CM_LOG_ASYNC_FLUSH_INTERVAL);
+        cm_log_async_drain();
+    }
+}
+#endif
+
+status_t cm_log_start_async(uint32 ring_size)
+{
+#ifdef _WIN32
+    CM_THROW_ERROR(ERR_INVALID_PARAM, "async log is not supported on windows");
+    return CM_ERROR;
+#else
+    uint32 size = CM_LOG_ASYNC_MIN_RING_SIZE;
+
+    if (g_log_async.started) {
+        return CM_SUCCESS;
+    }
+
+    while (size < ring_size && size < CM_LOG_ASYNC_MAX_RING_SIZE) {
+        size <<= 1;
+    }
+    // rings of an earlier start are reused, their owners still point at them
+    if (g_log_async.ring_size == 0) {
+        g_log_async.ring_size = size;
+    }
+
+    if (!g_log_async.key_created) {
+        if (pthread_key_create(&g_log_async.key, cm_log_async_ring_exit) != 0) {
+            CM_THROW_ERROR(ERR_SYSTEM_CALL, errno);
+            return CM_ERROR;
+        }
+        g_log_async.key_created = CM_TRUE;
+    }
+
+    if (cm_event_init(&g_log_async.event) != CM_SUCCESS) {
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, errno);
+        return CM_ERROR;
+    }
+    if (cm_create_thread(cm_log_async_proc, 0, NULL, &g_log_async.flusher) != CM_SUCCESS) {
+        cm_event_destory(&g_log_async.event);
+        return CM_ERROR;
+    }
+
+    g_log_async.started = CM_TRUE;
+    return CM_SUCCESS;
+#endif
+}
+
+void cm_log_stop_async(void)
+{
+#ifndef _WIN32
+    if (!g_log_async.started) {
+        return;
+    }
+
+    g_log_async.started = CM_FALSE;
+    CM_MFENCE;
+    // producers which passed the started check finish their record before the event goes
+    cm_spin_lock(&g_log_async.flush_lock, NULL);
+    for (uint32 i = 0; i < CM_LOG_ASYNC_MAX_RINGS; i++) {
+        while (g_log_async.rings[i] != NULL && g_log_async.rings[i]->busy) {
+            cm_spin_sleep();
+        }
+    }
+    cm_spin_unlock(&g_log_async.flush_lock);
+
+    cm_close_thread(&g_log_async.flusher);
+    cm_log_async_drain();
+    cm_event_destory(&g_log_async.event);
+#endif
+}
+
+#ifndef _WIN32
+// records the argument type of every conversion, the format is not understood past the first unknown one
+static void cm_trace_parse_format(cm_trace_define_t *define, const char *format)
+{
+    const char *ptr = format;
+    define->argc = 0;
+
+    while (*ptr != '\0' && define->argc < CM_TRACE_MAX_ARGS) {
+        if (*ptr++ != '%') {
+            continue;
+        }
+        if (*ptr == '%') {
+            ptr++;
+            continue;
+        }
+        ptr += strspn(ptr, "-+ #0'");
+        for (; (*ptr >= '0' && *ptr <= '9') || *ptr == '.' || *ptr == '*'; ptr++) {
+            if (*ptr == '*' && define->argc < CM_TRACE_MAX_ARGS) {
+                define->arg_type[define->argc++] = CM_TRACE_ARG_INT32;
+            }
+        }
+
+        bool32 wide = CM_FALSE;
+        uint32 longs = 0;
+        for (; *ptr != '\0' && strchr("hlqjzt", *ptr) != NULL; ptr++) {
+            if (*ptr == 'l') {
+                longs++;
+                wide = (longs > 1 || sizeof(long) == sizeof(int64));
+            } else if (*ptr == 'q' || *ptr == 'j') {
+                wide = CM_TRUE;
+            } else if (*ptr == 'z' || *ptr == 't') {
+                wide = (sizeof(size_t) == sizeof(int64));
+            }
+        }
+
+        uint8 type;
+        switch (*ptr) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                type = wide ? CM_TRACE_ARG_INT64 : CM_TRACE_ARG_INT32;
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+                type = CM_TRACE_ARG_DOUBLE;
+                break;
+            case 's':
+                type = CM_TRACE_ARG_STR;
+                break;
+            case 'p':
+                type = CM_TRACE_ARG_PTR;
+                break;
+            default:
+                return;
+        }
+        if (define->argc < CM_TRACE_MAX_ARGS) {
+            define->arg_type[define->argc++] = type;
+        }
+        ptr++;
+    }
+}
+
+// the file name and format are copied, a call site with a changing format keeps its first one
+static void cm_trace_register(cm_trace_point_t *point, log_level_t level, const char *code_file_name,
+    uint32 code_line_num, const char *format)
+{
+    size_t file_len = strlen(code_file_name);
+    size_t format_len = strlen(format);
+
+    cm_spin_lock(&g_log_trace.lock, NULL);
+    if (point->id != 0) {
+        cm_spin_unlock(&g_log_trace.lock);
+        return;
+    }
+    if (g_log_trace.count >= CM_TRACE_MAX_POINTS || file_len > UINT16_MAX || format_len > UINT16_MAX) {
+        point->id = CM_TRACE_INVALID_ID;
+        cm_spin_unlock(&g_log_trace.lock);
+        return;
+    }
+
+    trace_site_t *site = (trace_site_t *)malloc(sizeof(trace_site_t) + file_len + format_len);
+    if (site == NULL) {
+        cm_spin_unlock(&g_log_trace.lock);
+        return;
+    }
+    (void)memset_s(site, sizeof(trace_site_t), 0, sizeof(trace_site_t));
+    site->file = (char *)(site + 1);
+    site->format = site->file + file_len;
+    if (file_len > 0) {
+        (void)memcpy_s(site->file, file_len, code_file_name, file_len);
+    }
+    if (format_len > 0) {
+        (void)memcpy_s(site->format, format_len, format, format_len);
+    }
+    site->define.line = code_line_num;
+    site->define.level = (uint8)level;
+    site->define.file_len = (uint16)file_len;
+    site->define.format_len = (uint16)format_len;
+    cm_trace_parse_format(&site->define, format);
+
+    g_log_trace.sites[g_log_trace.count] = site;
+    CM_MFENCE;
+    g_log_trace.count++;
+    point->id = g_log_trace.count;
+    cm_spin_unlock(&g_log_trace.lock);
+}
+#endif
+
+void cm_trace_write(cm_trace_point_t *point, log_level_t level, const char *code_file_name, uint32 code_line_num,
+    const char *format, ...)
+{
+#ifndef _WIN32
+    uint64 head;
+    va_list args;
+
+    if (SECUREC_UNLIKELY(point->id == 0)) {
+        cm_trace_register(point, level, code_file_name, code_line_num, format);
+    }
+    if (point->id == 0 || point->id == CM_TRACE_INVALID_ID || !g_log_async.started || g_log_sync_only) {
+        return;
+    }
+
+    log_async_ring_t *ring = cm_log_async_enter();
+    if (ring == NULL) {
+        return;
+    }
+    log_async_rec_t *rec = cm_log_async_reserve(ring, CM_TRACE_MAX_RECORD, &head);
+    if (rec == NULL) {
+        cm_log_async_leave(ring);
+        return;
+    }
+
+    const cm_trace_define_t *define = &g_log_trace.sites[point->id - 1]->define;
+    cm_trace_head_t *trace = (cm_trace_head_t *)(rec + 1);
+    char *pos = (char *)(trace + 1);
+    char *end = (char *)trace + CM_TRACE_MAX_RECORD;
+
+    va_start(args, format);
+    for (uint32 i = 0; i < define->argc; i++) {
+        switch (define->arg_type[i]) {
+            case CM_TRACE_ARG_INT32:
+                *(int32 *)pos = va_arg(args, int32);
+                pos += sizeof(int32);
+                break;
+            case CM_TRACE_ARG_INT64:
+                *(int64 *)pos = va_arg(args, int64);
+                pos += sizeof(int64);
+                break;
+            case CM_TRACE_ARG_DOUBLE:
+                *(double *)pos = va_arg(args, double);
+                pos += sizeof(double);
+                break;
+            case CM_TRACE_ARG_PTR:
+                *(uint64 *)pos = (uint64)(uintptr_t)va_arg(args, void *);
+                pos += sizeof(uint64);
+                break;
+            default: {
+                // strings share what the fixed size arguments behind them leave over
+                const char *str = va_arg(args, const char *);
+                int64 room = (int64)(end - pos) - (int64)sizeof(uint16) -
+                    (int64)(define->argc - i - 1) * (int64)sizeof(uint64);
+                uint16 len = 0;
+                if (str != NULL && room > 0) {
+                    len = (uint16)strnlen(str, (size_t)MIN(room, CM_TRACE_MAX_STR));
+                }
+                *(uint16 *)pos = len;
+                pos += sizeof(uint16);
+                if (len > 0) {
+                    (void)memcpy_s(pos, (size_t)(end - pos), str, len);
+                    pos += len;
+                }
+                break;
+            }
+        }
+    }
+    va_end(args);
+
+    trace->size = (uint32)(pos - (char *)trace);
+    trace->kind = CM_TRACE_EVENT;
+    trace->reserved = 0;
+    trace->id = point->id;
+    trace->tid = cm_get_current_thread_id();
+    trace->tick = cm_trace_tick();
+    cm_log_async_commit(ring, rec, head, trace->size, LOG_BTRACE, CM_TRUE);
+    cm_log_async_leave(ring);
+#endif
+}
+
+status_t cm_trace_start(const char *file_name)
+{
+#ifdef _WIN32
+    CM_THROW_ERROR(ERR_INVALID_PARAM, "binary trace is not supported on windows");
+    return CM_ERROR;
+#else
+    struct timespec now;
+
+    if (g_log_param.log_btrace_on) {
+        return CM_SUCCESS;
+    }
+    CM_RETURN_IFERR(cm_log_init(LOG_BTRACE, file_name));
+
+    if (g_log_trace.file.tick_hz == 0) {
+        uint64 usec = cm_monotonic_usec();
+        uint64 tick = cm_trace_tick();
+        cm_sleep(CM_TRACE_CALIBRATE_MS);
+        g_log_trace.file.base_tick = cm_trace_tick();
+        g_log_trace.file.tick_hz = (g_log_trace.file.base_tick - tick) * MICROSECS_PER_SECOND /
+            MAX(cm_monotonic_usec() - usec, 1);
+        (void)clock_gettime(CLOCK_REALTIME, &now);
+        g_log_trace.file.base_usec = (uint64)now.tv_sec * MICROSECS_PER_SECOND +
+            (uint64)now.tv_nsec / NANOSECS_PER_MICROSECS;
+        g_log_trace.file.magic = CM_TRACE_MAGIC;
+        g_log_trace.file.version = CM_TRACE_VERSION;
+        g_log_trace.file.pid = (uint32)getpid();
+        (void)memcpy_s(g_log_trace.file.module, CM_MAX_LOG_MODULE_NAME, g_log_param.log_module_name,
+            CM_MAX_LOG_MODULE_NAME);
+    }
+
+    if (!g_log_async.started) {
+        CM_RETURN_IFERR(cm_log_start_async(CM_TRACE_RING_SIZE));
+    }
+    g_log_param.log_btrace_on = CM_TRUE;
+    return CM_SUCCESS;
+#endif
+}
+
+void cm_trace_stop(void)
+{
+    g_log_param.log_btrace_on = CM_FALSE;
+}
+
 void cm_write_normal_log_common(log_type_t log_type, log_level_t log_level, const char *code_file_name,
     uint32 code_line_num, const char *module_name, bool32 need_rec_filelog, const char *format, va_list args)
 {
@@ -1085,20 +1801,29 @@ void cm_write_normal_log_common(log_type_t log_type, log_level_t log_level, cons
     log_file_handle_t *log_file_handle = &g_logger[log_type];
     text_t buf_text;
     log_param_t *log_param = cm_log_param_instance();
+
+    log_suppress_status suppress_status = LOG_NORMAL;
     errno_t errcode;
 
-    errcode = snprintf_s(new_format, CM_MAX_LOG_CONTENT_LENGTH, CM_MAX_LOG_CONTENT_LENGTH - 1, "%s [%s:%u]",
-                         format, code_file_name, code_line_num);
     if (log_param->log_suppress_enable && (log_type == LOG_RUN || log_type == LOG_DEBUG)) {
-        log_suppress_status suppress_status = check_log_suppress(log_type, code_file_name, code_line_num);
+        suppress_status = check_log_suppress(log_type, code_file_name, code_line_num);
         if (suppress_status == LOG_SUPPRESS) {
             return;
         }
-        cm_log_build_normal_head((char *)buf, sizeof(buf), log_level, module_name, suppress_status);
-    } else {
-        cm_log_build_normal_head((char *)buf, sizeof(buf), log_level, module_name, LOG_NORMAL);
     }
 
+#ifndef _WIN32
+    if (g_log_async.started && !g_log_sync_only &&
+        cm_log_async_write(log_type, log_level, code_file_name, code_line_num, module_name, need_rec_filelog,
+            suppress_status, format, args)) {
+        return;
+    }
+#endif
+
+    errcode = snprintf_s(new_format, CM_MAX_LOG_CONTENT_LENGTH, CM_MAX_LOG_CONTENT_LENGTH - 1, "%s [%s:%u]",
+                         format, code_file_name, code_line_num);
+    cm_log_build_normal_head((char *)buf, sizeof(buf), log_level, module_name, suppress_status);
+
     buf_text.str = buf;
     buf_text.len = (uint32)strlen(buf);
     if (errcode >= 0) {
@@ -1214,6 +1939,7 @@ void cm_log_open_compress(log_type_t log_type, bool8 log_compressed)
 
 void cm_log_uninit(void)
 {
+    cm_log_stop_async();
     for (uint32 i = 0; i < MAX_THREAD_NUM_COUNT; i++) {
         CM_FREE_PTR(g_log_suppress_array[i]);
     }
@@ -1329,6 +2055,9 @@ void cm_log_set_path_permissions(uint16 val)
 void cm_fync_logfile(void)
 {
 #ifndef _WIN32
+    if (g_log_async.started) {
+        cm_log_async_drain();
+    }
     for (int i = 0; i < LOG_COUNT; i++) {
         if (g_logger[i].file_handle != CM_INVALID_FD) {
             (void)fsync(g_logger[i].file_handle);
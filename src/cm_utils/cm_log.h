@@ -49,6 +49,7 @@ typedef enum en_log_type {
     LOG_MEC,
     LOG_TRACE,
     LOG_PROFILE,
+    LOG_BTRACE, // binary trace, see cm_trace_start
     LOG_COUNT // LOG COUNT
 } log_type_t;
 
@@ -75,6 +76,7 @@ typedef struct st_log_param {
     volatile uint32 audit_level;
     char *log_compress_buf;
     bool8 log_compressed;
+    volatile bool32 log_btrace_on;
 } log_param_t;
 
 /* _log_level */
@@ -113,6 +115,7 @@ log_param_t *cm_log_param_instance(void);
 #define LOG_ON (cm_log_param_instance()->log_level > 0)
 #define LOG_REG_CB (cm_log_param_instance()->log_write != NULL)
 #define LOG_INITED (cm_log_param_instance()->log_instance_startup)
+#define LOG_BTRACE_ON (cm_log_param_instance()->log_btrace_on)
 
 #define LOG_MODULE_NAME (cm_log_param_instance()->log_module_name)
 
@@ -148,6 +151,91 @@ void cm_log_set_path_permissions(uint16 val);
 void cm_log_set_file_permissions(uint16 val);
 void cm_log_open_file(log_file_handle_t *log_file_handle);
 
+/*
+ * @brief hand normal logs to a flusher thread: callers format into a per-thread ring, the flusher batches them
+ *        with writev and does stat, rotation and compression off the calling thread. Full rings drop records,
+ *        the flusher reports how many. Alarm, audit and oper logs stay synchronous.
+ * @param ring_size bytes of each thread's ring, rounded up to a power of 2 in [64K, 64M]
+ * @return CM_SUCCESS, CM_ERROR on windows or when the flusher can not start
+ */
+status_t cm_log_start_async(uint32 ring_size);
+/* @brief flush everything buffered and go back to synchronous writes */
+void cm_log_stop_async(void);
+
+/*
+ * binary trace: the hot path keeps a registered call site id, a cpu tick, the thread id and the raw
+ * arguments; text is rendered offline by trace_decode. Every record starts with cm_trace_head_t.
+ */
+#define CM_TRACE_MAGIC      0x4543415254424D43ULL // "CMBTRACE"
+#define CM_TRACE_VERSION    1
+#define CM_TRACE_MAX_ARGS   16
+#define CM_TRACE_MAX_STR    256
+#define CM_TRACE_MAX_RECORD 1024
+
+typedef enum en_trace_kind {
+    CM_TRACE_FILE = 1, // starts a run, drops all definitions seen before
+    CM_TRACE_DEFINE,
+    CM_TRACE_EVENT,
+} cm_trace_kind_t;
+
+typedef enum en_trace_arg {
+    CM_TRACE_ARG_INT32 = 1,
+    CM_TRACE_ARG_INT64,
+    CM_TRACE_ARG_DOUBLE,
+    CM_TRACE_ARG_STR, // uint16 length and the bytes, no terminator
+    CM_TRACE_ARG_PTR, // 8 bytes
+} cm_trace_arg_t;
+
+typedef struct st_trace_head {
+    uint32 size; // whole record, head included
+    uint16 kind;
+    uint16 reserved;
+    uint32 id;
+    uint32 tid;
+    uint64 tick;
+} cm_trace_head_t;
+
+typedef struct st_trace_file {
+    uint64 magic;
+    uint64 tick_hz;
+    uint64 base_tick;
+    uint64 base_usec; // unix time of base_tick
+    uint32 version;
+    uint32 pid;
+    char module[CM_MAX_LOG_MODULE_NAME];
+    uint8 reserved[6];
+} cm_trace_file_t;
+
+/* followed by file_len bytes of file name and format_len bytes of format */
+typedef struct st_trace_define {
+    uint32 line;
+    uint8 level;
+    uint8 argc;
+    uint8 arg_type[CM_TRACE_MAX_ARGS];
+    uint16 file_len;
+    uint16 format_len;
+    uint8 reserved[2];
+} cm_trace_define_t;
+
+typedef struct st_trace_point {
+    volatile uint32 id; // 0 until the call site registers
+} cm_trace_point_t;
+
+/*
+ * @brief start writing LOG_DEBUG_* records in binary form to file_name, the asynchronous pipeline is started
+ *        when it is not running yet
+ */
+status_t cm_trace_start(const char *file_name);
+void cm_trace_stop(void);
+void cm_trace_write(cm_trace_point_t *point, log_level_t level, const char *code_file_name, uint32 code_line_num,
+    const char *format, ...);
+
+#define LOG_BTRACE(level, format, ...)                                                                           \
+    do {                                                                                                         \
+        static cm_trace_point_t __trace_point = { 0 };                                                           \
+        cm_trace_write(&__trace_point, level, (char *)__FILE_NAME__, (uint32)__LINE__, format, ##__VA_ARGS__);   \
+    } while (0)
+
 void cm_write_audit_log(const char *format, ...) CM_CHECK_FMT(1, 2);
 void cm_write_alarm_log(uint32 warn_id, const char *format, ...) CM_CHECK_FMT(2, 3);
 
@@ -164,7 +252,9 @@ void cm_write_normal_log_common(log_type_t log_type, log_level_t log_level, cons
 #define LOG_DEBUG_INF(format, ...)                                                                               \
     do {                                                                                                         \
         if (LOG_DEBUG_INF_ON) {                                                                                  \
-            if (LOG_REG_CB) {                                                                                    \
+            if (LOG_BTRACE_ON) {                                                                                 \
+                LOG_BTRACE(LEVEL_INFO, format, ##__VA_ARGS__);                                                   \
+            } else if (LOG_REG_CB) {                                                                             \
                 cm_log_param_instance()->log_write(LOG_DEBUG, LEVEL_INFO, (char *)__FILE_NAME__, (uint32)__LINE__,    \
                     LOG_MODULE_NAME, format, ##__VA_ARGS__);                                                     \
             } else if (LOG_INITED) {                                                                             \
@@ -177,7 +267,9 @@ void cm_write_normal_log_common(log_type_t log_type, log_level_t log_level, cons
 #define LOG_DEBUG_WAR(format, ...)                                                                               \
     do {                                                                                                         \
         if (LOG_DEBUG_WAR_ON) {                                                                                  \
-            if (LOG_REG_CB) {                                                                                    \
+            if (LOG_BTRACE_ON) {                                                                                 \
+                LOG_BTRACE(LEVEL_WARN, format, ##__VA_ARGS__);                                                   \
+            } else if (LOG_REG_CB) {                                                                             \
                 cm_log_param_instance()->log_write(LOG_DEBUG, LEVEL_WARN, (char *)__FILE_NAME__, (uint32)__LINE__,    \
                     LOG_MODULE_NAME, format, ##__VA_ARGS__);                                                     \
             } else if (LOG_INITED) {                                                                             \
@@ -189,7 +281,9 @@ void cm_write_normal_log_common(log_type_t log_type, log_level_t log_level, cons
 #define LOG_DEBUG_ERR(format, ...)                                                                               \
     do {                                                                                                         \
         if (LOG_DEBUG_ERR_ON) {                                                                                  \
-            if (LOG_REG_CB) {                                                                                    \
+            if (LOG_BTRACE_ON) {                                                                                 \
+                LOG_BTRACE(LEVEL_ERROR, format, ##__VA_ARGS__);                                                  \
+            } else if (LOG_REG_CB) {                                                                             \
                 cm_log_param_instance()->log_write(LOG_DEBUG, LEVEL_ERROR, (char *)__FILE_NAME__, (uint32)__LINE__,   \
                     LOG_MODULE_NAME, format, ##__VA_ARGS__);                                                     \
             } else if (LOG_INITED) {                                                                             \
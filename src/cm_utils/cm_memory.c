@@ -23,6 +23,8 @@
  */
 #include "cm_memory.h"
 #include "cm_log.h"
+#include "cm_atomic.h"
+#include "cm_thread.h"
 
 #ifndef WIN32
 #include <execinfo.h>
@@ -130,6 +132,57 @@ static mem_zone_t *mem_zone_init(mem_pool_t *mem, uint64 size)
     return mem_zone;
 }
 
+/*
+ * size classes step by 16 bytes up to 128, then by a quarter of the power of 2 below them,
+ * so a request wastes at most 25% instead of up to half of a buddy block.
+ */
+static inline uint32 mem_slab_class(uint64 size)
+{
+    uint64 val = size - 1;
+    if (val < 128) {
+        return (uint32)(val >> 4);
+    }
+#ifdef WIN32
+    uint32 exp = cm_get_power_exp(val + 1) - 1;
+#else
+    uint32 exp = 63 - (uint32)__builtin_clzll(val);
+#endif
+    return 8 + (exp - 7) * 4 + (uint32)(val >> (exp - 2)) - 4;
+}
+
+static inline uint32 mem_slab_class_size(uint32 class_id)
+{
+    if (class_id < 8) {
+        return (class_id + 1) * 16;
+    }
+    uint32 exp = 7 + (class_id - 8) / 4;
+    return (5 + (class_id - 8) % 4) << (exp - 2);
+}
+
+static status_t mem_slab_init(mem_pool_t *mem)
+{
+    mem_slab_ctx_t *ctx = (mem_slab_ctx_t *)malloc(sizeof(mem_slab_ctx_t));
+    if (ctx == NULL) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, (uint64)sizeof(mem_slab_ctx_t), "memory slab context");
+        return CM_ERROR;
+    }
+    errno_t ret = memset_sp(ctx, sizeof(mem_slab_ctx_t), 0, sizeof(mem_slab_ctx_t));
+    if (ret != EOK) {
+        CM_FREE_PTR(ctx);
+        return CM_ERROR;
+    }
+
+    for (uint32 i = 0; i < MEM_SLAB_CLASS_NUM; i++) {
+        mem_slab_class_t *cls = &ctx->classes[i];
+        GS_INIT_SPIN_LOCK(cls->lock);
+        cls->obj_size = mem_slab_class_size(i);
+        cls->batch = MAX(MIN(SIZE_K(8) / cls->obj_size, 32), 2);
+        cm_bilist_init(&cls->partial);
+    }
+    mem->slab = ctx;
+    return CM_SUCCESS;
+}
+
 status_t buddy_pool_init(char *pool_name, uint64 init_size, uint64 max_size, mem_pool_t *mem)
 {
     mem_zone_t *mem_zone;
@@ -171,6 +224,11 @@ status_t buddy_pool_init(char *pool_name, uint64 init_size, uint64 max_size, mem
 
     cm_bilist_add_tail(&mem_zone->link, &mem->mem_zone_lst);
 
+    if (max_size >= MEM_SLAB_MIN_POOL && mem_slab_init(mem) != CM_SUCCESS) {
+        buddy_pool_deinit(mem);
+        cm_event_destory(&mem->event);
+        return CM_ERROR;
+    }
     return CM_SUCCESS;
 }
 
@@ -262,19 +320,19 @@ static status_t mem_check_if_extend(mem_pool_t *mem, uint64 align_size)
     return CM_SUCCESS;
 }
 
-void *galloc(uint64 size, mem_pool_t *mem)
+// slabs are not counted as requested, only the objects carved from them are
+static void *mem_buddy_alloc(uint64 size, mem_pool_t *mem, bool32 is_slab)
 {
     mem_zone_t *mem_zone;
     mem_block_t *mem_block = NULL;
     uint64 align_size;
     status_t status;
-    CM_MAGIC_CHECK(mem, mem_pool_t);
     align_size = cm_get_next_2power(size + MEM_BLOCK_SIZE);
     if (SECUREC_UNLIKELY(align_size > BUDDY_MAX_BLOCK_SIZE)) {
         return NULL;
     }
 
-    cm_spin_lock(&mem->lock, NULL);
+    cm_spin_lock(&mem->lock, &mem->lock_stat);
 
     status = mem_check_if_extend(mem, align_size);
     if (status != CM_SUCCESS) {
@@ -304,11 +362,12 @@ void *galloc(uint64 size, mem_pool_t *mem)
     }
     CM_ASSERT(mem_block != NULL);
 
-    mem_block->actual_size = size;
+    mem_block->actual_size = is_slab ? 0 : size;
     CM_ASSERT(mem_block->actual_size < mem_block->size);
     mem_block->use_flag = CM_TRUE;
     mem_block->mem_zone->used_size += mem_block->size;
     mem_block->mem_zone->mem->used_size += mem_block->size;
+    mem->requested_size += mem_block->actual_size;
     cm_spin_unlock(&mem->lock);
 
     return mem_block->data;
@@ -399,31 +458,6 @@ static void mem_recycle_low(mem_pool_t *mem, mem_block_t *mem_block)
     mem_recycle_low(mem, mem_block_merge);
 }
 
-void *grealloc(void *p, uint64 size, mem_pool_t *mem)
-{
-    CM_ASSERT(p != NULL);
-    mem_block_t *mem_block = (mem_block_t *)((char *)p - MEM_BLOCK_SIZE);
-    if (mem_block->size - MEM_BLOCK_SIZE >= size) {
-        mem_block->actual_size = size;
-        return p;
-    }
-
-    void *new_p = galloc(size, mem);
-    if (new_p == NULL) {
-        return NULL;
-    }
-
-    mem_block_t *new_block = (mem_block_t *)((char *)new_p - MEM_BLOCK_SIZE);
-    if (memcpy_sp(new_p, (size_t)(new_block->size - MEM_BLOCK_SIZE), p, (size_t)mem_block->actual_size) != EOK) {
-        gfree(new_p);
-        return NULL;
-    }
-
-    gfree(p);
-
-    return new_p;
-}
-
 void *galloc_timeout(uint64 size, mem_pool_t *mem, uint32 timeout_ms)
 {
     while (timeout_ms > 0) {
@@ -433,7 +467,10 @@ void *galloc_timeout(uint64 size, mem_pool_t *mem, uint32 timeout_ms)
         }
 
         uint32 wait = MIN(timeout_ms, 100);
-        if (cm_event_timedwait(&mem->event, wait) == CM_SUCCESS) {
+        (void)cm_atomic32_inc(&mem->waiters);
+        int32 ret = cm_event_timedwait(&mem->event, wait);
+        (void)cm_atomic32_dec(&mem->waiters);
+        if (ret == CM_SUCCESS) {
             continue;
         }
         timeout_ms -= wait;
@@ -441,11 +478,10 @@ void *galloc_timeout(uint64 size, mem_pool_t *mem, uint32 timeout_ms)
     return NULL;
 }
 
-void gfree(void *p)
+static void mem_buddy_free(void *p)
 {
     mem_block_t *mem_block;
     mem_pool_t *mem;
-    CM_ASSERT(p != NULL);
 
     mem_block = (mem_block_t *)((char *)p - MEM_BLOCK_SIZE);
     mem = mem_block->mem_zone->mem;
@@ -455,11 +491,12 @@ void gfree(void *p)
     CM_ASSERT(mem_block->link.next == NULL);
     CM_ASSERT(mem_block->link.prev == NULL);
 
-    cm_spin_lock(&mem->lock, NULL);
+    cm_spin_lock(&mem->lock, &mem->lock_stat);
     mem_block = (mem_block_t *)((char *)p - MEM_BLOCK_SIZE);
 #ifdef DB_DEBUG_VERSION
     check_mem_double_free(mem_block, mem_block->mem_zone);
 #endif
+    mem->requested_size -= mem_block->actual_size;
     mem_block->use_flag = CM_FALSE;
     mem_block->actual_size = 0;
     mem_block->mem_zone->used_size -= mem_block->size;
@@ -469,11 +506,398 @@ void gfree(void *p)
     cm_event_notify(&mem->event);
 }
 
+static thread_local_var uint32 g_mem_cache_slot = CM_INVALID_ID32;
+static atomic32_t g_mem_cache_next = 0;
+
+static inline mem_thread_cache_t *mem_get_thread_cache(mem_slab_ctx_t *ctx)
+{
+    if (SECUREC_UNLIKELY(g_mem_cache_slot == CM_INVALID_ID32)) {
+        g_mem_cache_slot = (uint32)cm_atomic32_inc(&g_mem_cache_next) % MEM_THREAD_CACHE_NUM;
+    }
+    return &ctx->caches[g_mem_cache_slot];
+}
+
+static inline mem_slab_t *mem_slab_of(mem_slab_obj_t *obj)
+{
+    return (mem_slab_t *)((char *)obj - obj->offset);
+}
+
+static inline mem_pool_t *mem_slab_pool(mem_slab_t *slab)
+{
+    mem_block_t *mem_block = (mem_block_t *)((char *)slab - MEM_BLOCK_SIZE);
+    CM_MAGIC_CHECK(mem_block, mem_block_t);
+    return mem_block->mem_zone->mem;
+}
+
+#define MEM_SLAB_NEXT(obj) (*(char **)((mem_slab_obj_t *)(obj))->data)
+
+// a slab is one buddy block, objects are carved from it on demand
+static mem_slab_t *mem_slab_create(mem_pool_t *mem, mem_slab_class_t *cls, uint32 class_id)
+{
+    mem_slab_t *slab = (mem_slab_t *)mem_buddy_alloc(MEM_SLAB_SIZE - MEM_BLOCK_SIZE, mem, CM_TRUE);
+    if (slab == NULL) {
+        return NULL;
+    }
+    mem_block_t *mem_block = (mem_block_t *)((char *)slab - MEM_BLOCK_SIZE);
+
+    // keep object data 16 bytes aligned, class sizes are multiples of 16
+    uint64 first = (uint64)(uintptr_t)(slab + 1) + MEM_SLAB_OBJ_SIZE;
+    first = CM_ALIGN16(first) - MEM_SLAB_OBJ_SIZE;
+    slab->link.prev = NULL;
+    slab->link.next = NULL;
+    slab->free_objs = NULL;
+    slab->unused = (char *)(uintptr_t)first;
+    slab->end = (char *)mem_block + mem_block->size;
+    slab->used = 0;
+    slab->class_id = class_id;
+    slab->listed = CM_TRUE;
+    cm_bilist_add_head(&slab->link, &cls->partial);
+    cls->slabs++;
+    return slab;
+}
+
+static inline char *mem_slab_take(mem_slab_t *slab, uint32 obj_size)
+{
+    char *obj = slab->free_objs;
+    if (obj != NULL) {
+        slab->free_objs = MEM_SLAB_NEXT(obj);
+    } else if (slab->unused + obj_size <= slab->end) {
+        obj = slab->unused;
+        slab->unused += obj_size;
+        ((mem_slab_obj_t *)obj)->offset = (uint32)(obj - (char *)slab);
+        ((mem_slab_obj_t *)obj)->class_id = (uint8)slab->class_id;
+    } else {
+        return NULL;
+    }
+    slab->used++;
+    return obj;
+}
+
+static inline bool32 mem_slab_is_full(const mem_slab_t *slab, uint32 obj_size)
+{
+    return slab->free_objs == NULL && slab->unused + obj_size > slab->end;
+}
+
+static uint32 mem_slab_refill(mem_pool_t *mem, uint32 class_id, mem_cache_bin_t *bin)
+{
+    mem_slab_class_t *cls = &mem->slab->classes[class_id];
+    uint32 count = 0;
+
+    cm_spin_lock(&cls->lock, &cls->lock_stat);
+    while (count < cls->batch) {
+        mem_slab_t *slab;
+        if (cm_bilist_empty(&cls->partial)) {
+            slab = mem_slab_create(mem, cls, class_id);
+            if (slab == NULL) {
+                break;
+            }
+        } else {
+            slab = BILIST_NODE_OF(mem_slab_t, cm_bilist_head(&cls->partial), link);
+        }
+
+        char *obj;
+        while (count < cls->batch && (obj = mem_slab_take(slab, cls->obj_size)) != NULL) {
+            MEM_SLAB_NEXT(obj) = bin->objs;
+            bin->objs = obj;
+            count++;
+        }
+        if (mem_slab_is_full(slab, cls->obj_size)) {
+            cm_bilist_del(&slab->link, &cls->partial);
+            slab->listed = CM_FALSE;
+        }
+    }
+    cm_spin_unlock(&cls->lock);
+    bin->count += count;
+    return count;
+}
+
+static inline bool32 mem_under_pressure(const mem_pool_t *mem)
+{
+    return cm_atomic32_get((atomic32_t *)&mem->waiters) > 0 ||
+        mem->max_size - mem->used_size < mem->max_size / MEM_SLAB_PRESSURE;
+}
+
+static void mem_slab_release(bilist_t *released)
+{
+    while (!cm_bilist_empty(released)) {
+        mem_slab_t *slab = BILIST_NODE_OF(mem_slab_t, cm_bilist_head(released), link);
+        cm_bilist_del_head(released);
+        mem_buddy_free(slab);
+    }
+}
+
+/*
+ * Give a list of cached objects back to their slabs. Empty slabs go back to buddy, except that each class
+ * keeps its last one while the pool has room.
+ */
+static void mem_slab_flush(mem_pool_t *mem, uint32 class_id, char *objs)
+{
+    mem_slab_class_t *cls = &mem->slab->classes[class_id];
+    bool32 keep_last = !mem_under_pressure(mem);
+    bilist_t released;
+
+    cm_bilist_init(&released);
+    cm_spin_lock(&cls->lock, &cls->lock_stat);
+    while (objs != NULL) {
+        char *obj = objs;
+        objs = MEM_SLAB_NEXT(obj);
+
+        mem_slab_t *slab = mem_slab_of((mem_slab_obj_t *)obj);
+        MEM_SLAB_NEXT(obj) = slab->free_objs;
+        slab->free_objs = obj;
+        slab->used--;
+        if (!slab->listed) {
+            cm_bilist_add_tail(&slab->link, &cls->partial);
+            slab->listed = CM_TRUE;
+        }
+        if (slab->used == 0 && (cls->partial.count > 1 || !keep_last)) {
+            cm_bilist_del(&slab->link, &cls->partial);
+            slab->listed = CM_FALSE;
+            cls->slabs--;
+            cm_bilist_add_tail(&slab->link, &released);
+        }
+    }
+    cm_spin_unlock(&cls->lock);
+    mem_slab_release(&released);
+}
+
+// buddy ran out, the objects cached by all threads and every empty slab go back; returns the slabs released
+static uint32 mem_slab_reclaim(mem_pool_t *mem)
+{
+    mem_slab_ctx_t *ctx = mem->slab;
+    uint32 count = 0;
+    bilist_t released;
+
+    for (uint32 i = 0; i < MEM_THREAD_CACHE_NUM; i++) {
+        mem_thread_cache_t *cache = &ctx->caches[i];
+        for (uint32 class_id = 0; class_id < MEM_SLAB_CLASS_NUM; class_id++) {
+            cm_spin_lock(&cache->lock, &cache->lock_stat);
+            char *objs = cache->bins[class_id].objs;
+            cache->bins[class_id].objs = NULL;
+            cache->bins[class_id].count = 0;
+            cm_spin_unlock(&cache->lock);
+            if (objs != NULL) {
+                mem_slab_flush(mem, class_id, objs);
+            }
+        }
+    }
+
+    for (uint32 class_id = 0; class_id < MEM_SLAB_CLASS_NUM; class_id++) {
+        mem_slab_class_t *cls = &ctx->classes[class_id];
+        cm_bilist_init(&released);
+        cm_spin_lock(&cls->lock, &cls->lock_stat);
+        bilist_node_t *node = cm_bilist_head(&cls->partial);
+        while (node != NULL) {
+            mem_slab_t *slab = BILIST_NODE_OF(mem_slab_t, node, link);
+            node = BINODE_NEXT(node);
+            if (slab->used == 0) {
+                cm_bilist_del(&slab->link, &cls->partial);
+                slab->listed = CM_FALSE;
+                cls->slabs--;
+                cm_bilist_add_tail(&slab->link, &released);
+            }
+        }
+        cm_spin_unlock(&cls->lock);
+        count += released.count;
+        mem_slab_release(&released);
+    }
+    return count;
+}
+
+static void *mem_slab_alloc(uint64 size, mem_pool_t *mem)
+{
+    uint32 class_id = mem_slab_class(size + MEM_SLAB_OBJ_SIZE);
+    mem_thread_cache_t *cache = mem_get_thread_cache(mem->slab);
+    mem_cache_bin_t *bin = &cache->bins[class_id];
+
+    cm_spin_lock(&cache->lock, &cache->lock_stat);
+    if (SECUREC_LIKELY(bin->objs != NULL)) {
+        bin->hits++;
+    } else {
+        bin->misses++;
+        if (mem_slab_refill(mem, class_id, bin) == 0) {
+            cm_spin_unlock(&cache->lock);
+            return NULL;
+        }
+    }
+    mem_slab_obj_t *obj = (mem_slab_obj_t *)bin->objs;
+    bin->objs = MEM_SLAB_NEXT(obj);
+    bin->count--;
+    cache->requested += (int64)size;
+    cm_spin_unlock(&cache->lock);
+
+    obj->slack = (uint16)(mem_slab_class_size(class_id) - MEM_SLAB_OBJ_SIZE - size);
+    obj->kind = MEM_KIND_SLAB;
+    return obj->data;
+}
+
+static void mem_slab_free(void *p)
+{
+    mem_slab_obj_t *obj = (mem_slab_obj_t *)((char *)p - MEM_SLAB_OBJ_SIZE);
+    mem_pool_t *mem = mem_slab_pool(mem_slab_of(obj));
+    uint32 class_id = obj->class_id;
+    mem_slab_class_t *cls = &mem->slab->classes[class_id];
+    mem_thread_cache_t *cache = mem_get_thread_cache(mem->slab);
+    mem_cache_bin_t *bin = &cache->bins[class_id];
+    char *flush = NULL;
+
+    CM_MAGIC_CHECK(mem, mem_pool_t);
+    obj->kind = MEM_KIND_SLAB_FREE;
+
+    cm_spin_lock(&cache->lock, &cache->lock_stat);
+    cache->requested -= (int64)(cls->obj_size - MEM_SLAB_OBJ_SIZE - obj->slack);
+    MEM_SLAB_NEXT(obj) = bin->objs;
+    bin->objs = (char *)obj;
+    bin->count++;
+    if (SECUREC_UNLIKELY(cm_atomic32_get(&mem->waiters) > 0)) {
+        // somebody waits in galloc_timeout, the object must be reachable by other threads
+        flush = bin->objs;
+        bin->objs = NULL;
+        bin->count = 0;
+    } else if (bin->count > cls->batch * 2) {
+        // keep at most two batches cached, the older half goes back to the slabs
+        char *tail = bin->objs;
+        for (uint32 i = 1; i < cls->batch; i++) {
+            tail = MEM_SLAB_NEXT(tail);
+        }
+        flush = MEM_SLAB_NEXT(tail);
+        MEM_SLAB_NEXT(tail) = NULL;
+        bin->count = cls->batch;
+    }
+    cm_spin_unlock(&cache->lock);
+
+    if (flush != NULL) {
+        mem_slab_flush(mem, class_id, flush);
+        if (cm_atomic32_get(&mem->waiters) > 0) {
+            cm_event_notify(&mem->event);
+        }
+    }
+}
+
+static inline uint64 mem_usable_size(void *p)
+{
+    if (MEM_PTR_KIND(p) == MEM_KIND_SLAB) {
+        mem_slab_obj_t *obj = (mem_slab_obj_t *)((char *)p - MEM_SLAB_OBJ_SIZE);
+        return mem_slab_class_size(obj->class_id) - MEM_SLAB_OBJ_SIZE;
+    }
+    mem_block_t *mem_block = (mem_block_t *)((char *)p - MEM_BLOCK_SIZE);
+    return mem_block->size - MEM_BLOCK_SIZE;
+}
+
+void *galloc(uint64 size, mem_pool_t *mem)
+{
+    CM_MAGIC_CHECK(mem, mem_pool_t);
+    if (mem->slab != NULL && size <= MEM_SLAB_MAX_SIZE) {
+        void *p = mem_slab_alloc(size, mem);
+        if (p != NULL) {
+            return p;
+        }
+    }
+    void *p = mem_buddy_alloc(size, mem, CM_FALSE);
+    if (p == NULL && mem->slab != NULL && mem_slab_reclaim(mem) > 0) {
+        p = mem_buddy_alloc(size, mem, CM_FALSE);
+    }
+    return p;
+}
+
+void gfree(void *p)
+{
+    CM_ASSERT(p != NULL);
+    if (MEM_PTR_KIND(p) == MEM_KIND_SLAB) {
+        mem_slab_free(p);
+        return;
+    }
+    CM_ASSERT(MEM_PTR_KIND(p) == MEM_KIND_BUDDY);
+    mem_buddy_free(p);
+}
+
+void *grealloc(void *p, uint64 size, mem_pool_t *mem)
+{
+    CM_ASSERT(p != NULL);
+    uint64 old_size;
+    if (MEM_PTR_KIND(p) == MEM_KIND_SLAB) {
+        old_size = mem_usable_size(p);
+        if (old_size >= size) {
+            mem_slab_obj_t *obj = (mem_slab_obj_t *)((char *)p - MEM_SLAB_OBJ_SIZE);
+            mem_thread_cache_t *cache = mem_get_thread_cache(mem->slab);
+            cm_spin_lock(&cache->lock, &cache->lock_stat);
+            cache->requested += (int64)size - (int64)(old_size - obj->slack);
+            cm_spin_unlock(&cache->lock);
+            obj->slack = (uint16)(old_size - size);
+            return p;
+        }
+    } else {
+        mem_block_t *mem_block = (mem_block_t *)((char *)p - MEM_BLOCK_SIZE);
+        if (mem_block->size - MEM_BLOCK_SIZE >= size) {
+            cm_spin_lock(&mem->lock, &mem->lock_stat);
+            mem->requested_size += size - mem_block->actual_size;
+            cm_spin_unlock(&mem->lock);
+            mem_block->actual_size = size;
+            return p;
+        }
+        old_size = mem_block->actual_size;
+    }
+
+    void *new_p = galloc(size, mem);
+    if (new_p == NULL) {
+        return NULL;
+    }
+
+    if (memcpy_sp(new_p, (size_t)mem_usable_size(new_p), p, (size_t)old_size) != EOK) {
+        gfree(new_p);
+        return NULL;
+    }
+
+    gfree(p);
+
+    return new_p;
+}
+
+void buddy_pool_get_stat(mem_pool_t *mem, mem_pool_stat_t *stat)
+{
+    int64 requested = 0;
+
+    (void)memset_sp(stat, sizeof(mem_pool_stat_t), 0, sizeof(mem_pool_stat_t));
+    cm_spin_lock(&mem->lock, NULL);
+    stat->total_size = mem->total_size;
+    stat->used_size = mem->used_size;
+    requested = (int64)mem->requested_size;
+    stat->lock_stat = mem->lock_stat;
+    cm_spin_unlock(&mem->lock);
+
+    if (mem->slab != NULL) {
+        for (uint32 i = 0; i < MEM_THREAD_CACHE_NUM; i++) {
+            mem_thread_cache_t *cache = &mem->slab->caches[i];
+            requested += cache->requested;
+            stat->cache_lock_stat.spins += cache->lock_stat.spins;
+            stat->cache_lock_stat.wait_usecs += cache->lock_stat.wait_usecs;
+            stat->cache_lock_stat.fails += cache->lock_stat.fails;
+            for (uint32 j = 0; j < MEM_SLAB_CLASS_NUM; j++) {
+                stat->classes[j].hits += cache->bins[j].hits;
+                stat->classes[j].misses += cache->bins[j].misses;
+            }
+        }
+        for (uint32 j = 0; j < MEM_SLAB_CLASS_NUM; j++) {
+            mem_slab_class_t *cls = &mem->slab->classes[j];
+            stat->classes[j].obj_size = cls->obj_size;
+            stat->classes[j].slabs = cls->slabs;
+            stat->classes[j].lock_stat = cls->lock_stat;
+        }
+    }
+
+    stat->requested_size = (uint64)MAX(requested, 0);
+    if (stat->used_size > 0) {
+        stat->fragmentation = 1.0 - (double)stat->requested_size / (double)stat->used_size;
+    }
+}
+
 void buddy_pool_deinit(mem_pool_t *mem)
 {
     mem_zone_t *mem_zone;
     bilist_node_t *head;
 
+    CM_FREE_PTR(mem->slab);
+
     while (!cm_bilist_empty(&mem->mem_zone_lst)) {
         head = cm_bilist_head(&mem->mem_zone_lst);
         cm_bilist_del(head, &mem->mem_zone_lst);
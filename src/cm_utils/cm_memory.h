@@ -65,6 +65,33 @@ extern "C" {
     }
 #endif
 
+/* store-store and load-load barriers, x86 keeps these orders itself so only the compiler is stopped */
+#ifdef WIN32
+#define CM_WMB              \
+    {                       \
+        _ReadWriteBarrier(); \
+    }
+#define CM_RMB CM_WMB
+#elif defined(__arm__) || defined(__aarch64__)
+#define CM_WMB                            \
+    {                                     \
+        __asm__ volatile("dmb ishst" ::   \
+                             : "memory"); \
+    }
+#define CM_RMB                            \
+    {                                     \
+        __asm__ volatile("dmb ishld" ::   \
+                             : "memory"); \
+    }
+#else
+#define CM_WMB                            \
+    {                                     \
+        __asm__ volatile("" ::            \
+                             : "memory"); \
+    }
+#define CM_RMB CM_WMB
+#endif
+
 
 typedef struct st_mem_block {
     struct st_mem_zone *mem_zone;
@@ -72,9 +99,10 @@ typedef struct st_mem_block {
     uint64 actual_size;  //
     uint64 bitmap;       // block bitmap at the left and right positions of buddy at all levels
     bilist_node_t link;  // block lst node
+    CM_MAGIC_DECLARE
     bool8 use_flag;      // block is used
-    bool8 reserved[3];
-    CM_MAGIC_DECLARE   // first above data field
+    bool8 reserved[2];
+    uint8 kind;          // MEM_KIND_BUDDY, first above data field
     char data[4];  // data pointer
 } mem_block_t;
 
@@ -82,6 +110,71 @@ typedef struct st_mem_block {
 #define MEM_BLOCK_RIGHT 1
 #define MEM_BLOCK_SIZE (OFFSET_OF(mem_block_t, data))
 
+/* the byte right above the user pointer tells which allocator owns it */
+#define MEM_KIND_BUDDY     0x00
+#define MEM_KIND_SLAB      0x5A
+#define MEM_KIND_SLAB_FREE 0xA5
+#define MEM_PTR_KIND(p)    (*((uint8 *)(p) - 1))
+
+/* small requests are served from slabs of fixed size classes, cached per thread */
+typedef struct st_mem_slab_obj {
+    uint32 offset;       // distance from the owning slab
+    uint16 slack;        // usable size minus the requested size
+    uint8 class_id;
+    uint8 kind;          // MEM_KIND_SLAB, first above data field
+    char data[8];        // data pointer, holds the free list link while cached
+} mem_slab_obj_t;
+
+#define MEM_SLAB_OBJ_SIZE    (OFFSET_OF(mem_slab_obj_t, data))
+#define MEM_SLAB_CLASS_NUM   28
+#define MEM_SLAB_MAX_OBJ     4096 // largest class, header included
+#define MEM_SLAB_MAX_SIZE    (MEM_SLAB_MAX_OBJ - MEM_SLAB_OBJ_SIZE)
+#define MEM_SLAB_SIZE        SIZE_K(64)
+#define MEM_SLAB_MIN_POOL    SIZE_M(16) // every class may keep one empty slab, 1.75 MB in all
+#define MEM_SLAB_PRESSURE    8          // below 1/8 of max_size left, empty slabs go back to buddy at once
+#define MEM_THREAD_CACHE_NUM 64
+
+typedef struct st_mem_slab {
+    bilist_node_t link;  // in the partial list of its class
+    char *free_objs;     // objects given back to this slab
+    char *unused;        // never carved part
+    char *end;
+    uint32 used;         // objects out of the slab, cached or in use
+    uint32 class_id;
+    bool32 listed;
+} mem_slab_t;
+
+typedef struct st_mem_slab_class {
+    spinlock_t lock;
+    uint32 obj_size;     // header included
+    uint32 batch;        // objects moved between thread caches and the class at once
+    uint32 reserved;
+    bilist_t partial;    // slabs which still have free objects
+    uint64 slabs;
+    spin_statis_t lock_stat;
+} mem_slab_class_t;
+
+typedef struct st_mem_cache_bin {
+    char *objs;
+    uint32 count;
+    uint32 reserved;
+    uint64 hits;         // served by the thread cache
+    uint64 misses;       // refilled from the class
+} mem_cache_bin_t;
+
+typedef struct st_mem_thread_cache {
+    spinlock_t lock;
+    uint32 reserved;
+    int64 requested;     // requested bytes alloced minus freed through this cache
+    spin_statis_t lock_stat;
+    mem_cache_bin_t bins[MEM_SLAB_CLASS_NUM];
+} mem_thread_cache_t;
+
+typedef struct st_mem_slab_ctx {
+    mem_slab_class_t classes[MEM_SLAB_CLASS_NUM];
+    mem_thread_cache_t caches[MEM_THREAD_CACHE_NUM];
+} mem_slab_ctx_t;
+
 #define mem_block_t_MAGIC 8116518
 #define mem_zone_t_MAGIC 8116517
 #define mem_pool_t_MAGIC 8116519
@@ -132,18 +225,42 @@ typedef struct st_mem_pool {
     uint64 total_size;              // total size
     uint64 max_size;                // max size
     uint64 used_size;               // current used size
+    uint64 requested_size;          // requested bytes of the blocks alloced by buddy
     spinlock_t lock;
+    spin_statis_t lock_stat;
     cm_event_t event;
+    atomic32_t waiters;    // threads in galloc_timeout, slab frees notify the event only for them
     bilist_t mem_zone_lst; // mem zone list
+    mem_slab_ctx_t *slab;  // NULL if the pool is too small for slabs
     CM_MAGIC_DECLARE
 } mem_pool_t;
 
+typedef struct st_mem_class_stat {
+    uint32 obj_size;
+    uint32 reserved;
+    uint64 slabs;
+    uint64 hits;
+    uint64 misses;
+    spin_statis_t lock_stat;
+} mem_class_stat_t;
+
+typedef struct st_mem_pool_stat {
+    uint64 total_size;
+    uint64 used_size;
+    uint64 requested_size;
+    double fragmentation;   // share of used size not requested by callers
+    spin_statis_t lock_stat;       // pool lock
+    spin_statis_t cache_lock_stat; // thread cache locks
+    mem_class_stat_t classes[MEM_SLAB_CLASS_NUM];
+} mem_pool_stat_t;
+
 status_t buddy_pool_init(char *pool_name, uint64 init_size, uint64 max_size, mem_pool_t *mem);
 void *galloc(uint64 size, mem_pool_t *mem);
 void *galloc_timeout(uint64 size, mem_pool_t *mem, uint32 timeout_ms);
 void *grealloc(void *p, uint64 size, mem_pool_t *mem);
 void gfree(void *p);
 void buddy_pool_deinit(mem_pool_t *mem);
+void buddy_pool_get_stat(mem_pool_t *mem, mem_pool_stat_t *stat);
 static inline uint64 mem_used_size(const mem_pool_t *mem)
 {
     return mem->used_size;
@@ -22,14 +22,17 @@
  * -------------------------------------------------------------------------
  */
 
+#include <float.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "cm_file.h"
 #include "ddes_json.h"
 
 #define LEXER(json) (&(json)->lexer)
-// using for bool, num, string
-#define JSON_OFFSET_KEY(jval) (((json_val_t *)(jval))->data)
-#define JSON_OFFSET_VAL(jval) (JSON_OFFSET_KEY(jval) + sizeof(key_len_t) + *(key_len_t *)JSON_OFFSET_KEY(jval))
-// using for array item
-#define JSON_OFFSET_DATA(jval) (((json_val_t *)(jval))->data)
 
 status_t jtxt_iter_init(jtxt_iter_t *jtxt, const text_t *txt)
 {
@@ -160,324 +163,554 @@ status_t jtxt_iter_arr(bool32 *eof, jtxt_iter_t *jtxt, jtxt_val_t *jval)
     return skip_comma(jtxt);
 }
 
-static inline void key2text(void *key, text_t *txt)
-{
-    txt->str = (char *)key + sizeof(key_len_t);
-    txt->len = (uint32)(*(key_len_t *)key - 1);
-}
+/*
+ * json_create parses in two steps over the text and allocates once:
+ * 1. json_prescan walks the structure and counts what the document needs, quotes and escapes in
+ *    strings are found 16 bytes at a time.
+ * 2. json_parse_* fill a tape of json_val_t in one pass. The values of a container are pushed at
+ *    the back of the tape while it is open and moved to the front in order when it closes, so the
+ *    members of every object and array end up contiguous, indexed by position.
+ * Everything lives in one block: doc header|tape|numbers|key index slots|copy of the text.
+ * Strings and keys point into the copy, terminated in place.
+ */
+#define JSON_SCAN_MEMBERS 8 // objects with more members get a key index
+#define JSON_UNICODE_ESCAPE_LEN 6 // \uXXXX
+#define JSON_IS_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+#define JSON_IS_DELIM(c) (JSON_IS_SPACE(c) || (c) == ',' || (c) == ':' || (c) == '}' || (c) == ']')
 
-static bool32 json_equal(void *lkey, void *rkey)
-{
-    text_t ltxt, rtxt;
-    key2text(lkey, &ltxt);
-    key2text(rkey, &rtxt);
-    return (cm_compare_text_ins(&ltxt, &rtxt) == 0);
-}
+typedef struct st_json_doc {
+    cm_allocator_t alloc;
+    json_t root;
+} json_doc_t;
 
-static uint32 json_hash(void *key)
-{
-    text_t txt;
-    key2text(key, &txt);
-    return cm_hash_bytes((uint8 *)txt.str, txt.len, 0);
-}
+typedef struct st_json_scan {
+    uint32 vals;  // values below the root
+    uint32 nums;
+    uint32 slots; // key index slots of all objects
+    uint32 depth;
+    uint32 members[JSON_MAX_DEPTH];
+    bool32 is_obj[JSON_MAX_DEPTH];
+} json_scan_t;
 
-static bool32 json_equal2(void *lkey, void *rkey)
+typedef struct st_json_parser {
+    const char *str;
+    const char *curr;
+    const char *end;
+    char *copy;
+    json_val_t *vals;
+    uint32 placed;  // values moved to the front
+    uint32 pending; // lowest index of the values of the open containers
+    digitext_t *nums;
+    uint32 num_count;
+    uint32 *slots;
+    uint32 slot_count;
+    uint32 slot_max;
+    uint32 depth;
+} json_parser_t;
+
+// offset of the first double quotation or escape character, len when there is none
+static inline uint32 json_find_quote(const char *str, uint32 len)
 {
-    text_t ltxt, *rtxt;
-    key2text(lkey, &ltxt);
-    rtxt = (text_t *)rkey;
-    return (cm_compare_text_ins(&ltxt, rtxt) == 0);
+    uint32 i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i escape = _mm_set1_epi8('\\');
+    for (; i + sizeof(__m128i) <= len; i += sizeof(__m128i)) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(str + i));
+        uint32 mask = (uint32)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+            _mm_cmpeq_epi8(chunk, escape)));
+        if (mask != 0) {
+            return i + (uint32)__builtin_ctz(mask);
+        }
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t escape = vdupq_n_u8('\\');
+    for (; i + sizeof(uint8x16_t) <= len; i += sizeof(uint8x16_t)) {
+        uint8x16_t chunk = vld1q_u8((const uint8 *)(str + i));
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, escape))) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (str[i] == '"' || str[i] == '\\') {
+            return i;
+        }
+    }
+    return len;
 }
 
-static uint32 json_hash2(void *key)
+static inline uint32 json_index_size(uint32 members)
 {
-    text_t *txt = (text_t *)key;
-    return cm_hash_bytes((uint8 *)txt->str, txt->len, 0);
+    if (members <= JSON_SCAN_MEMBERS) {
+        return 0;
+    }
+    uint32 size = JSON_SCAN_MEMBERS * 2;
+    while (size < members * 2) {
+        size <<= 1;
+    }
+    return size;
 }
 
-static void *json_key(hash_node_t *node)
+static src_loc_t json_loc(const char *str, const char *pos)
 {
-    return JSON_OFFSET_KEY(node);
+    src_loc_t loc = { 1, 1 };
+    for (const char *p = str; p < pos; p++) {
+        if (*p == '\n') {
+            loc.line++;
+            loc.column = 1;
+        } else {
+            loc.column++;
+        }
+    }
+    return loc;
 }
 
-static hash_funcs_t g_json_hfs = {
-    .f_key = json_key,
-    .f_equal = json_equal,
-    .f_hash = json_hash
-};
+#define JSON_THROW_ERROR(str, pos, msg) \
+    LEX_THROW_ERROR_EX(json_loc((str), (pos)), ERR_LEX_SYNTAX_ERROR, "%s", (msg))
 
-static hash_funcs_t g_json_hfs2 = {
-    .f_key = json_key,
-    .f_equal = json_equal2,
-    .f_hash = json_hash2
-};
-
-static inline uint32 add_val_size(uint32 size, const jtxt_val_t *jtxt_val)
+// skips a string starting after its opening quotation, returns the closing one or NULL
+static const char *json_skip_str(const char *curr, const char *end)
 {
-    switch (jtxt_val->type) {
-        case JSON_BOOL:
-            return size + sizeof(bool32);
-        case JSON_NUM:
-            return size + sizeof(digitext_t);
-        case JSON_STR:
-            return size + sizeof(jstr_len_t) + jtxt_val->val.len + 1; // include terminator
-        case JSON_OBJ:
-            return size + sizeof(json_t);
-        case JSON_ARRAY:
-            return size + sizeof(json_arr_t);
-        default:
-            return size;
+    for (;;) {
+        curr += json_find_quote(curr, (uint32)(end - curr));
+        if (curr >= end) {
+            return NULL;
+        }
+        if (*curr == '"') {
+            return curr;
+        }
+        if (curr + 1 >= end) {
+            return NULL; // a trailing backslash escapes nothing
+        }
+        curr += 2; // escape character and the escaped one
     }
 }
 
-static inline uint32 calc_prop_size(jtxt_prop_t *jtxt_prop)
+static status_t json_prescan(const text_t *txt, json_scan_t *scan)
 {
-    jtxt_val_t *jtxt_val = &jtxt_prop->val;
+    const char *curr = txt->str;
+    const char *end = txt->str + txt->len;
 
-    /* json value struct|key size|key|val(include terminator)|data */
-    uint32 size = sizeof(json_val_t) + sizeof(uint16) + jtxt_prop->key.len + 1;
-    return add_val_size(size, jtxt_val);
-}
-
-#define TRUE_OR_FALSE(str) (((str)[0] == 't' || (str)[0] == 'T') ? 1 : 0)
-
-static inline void assign_val_data(jtxt_val_t *jtxt_val, char *data)
-{
-    text_t *txt = &jtxt_val->val;
-    switch (jtxt_val->type) {
-        case JSON_BOOL:
-            *(bool32 *)data = TRUE_OR_FALSE(txt->str);
-            break;
-        case JSON_NUM:
-            cm_text2digitext(txt, (digitext_t *)data);
-            break;
-        case JSON_STR:
-            *(uint32 *)data = txt->len;
-            errno_t errcode = memcpy_s(data + sizeof(jstr_len_t), txt->len, txt->str, txt->len);
-            securec_check_panic(errcode);
-            data[txt->len + sizeof(jstr_len_t)] = '\0';
-            break;
-        case JSON_OBJ:
-        case JSON_ARRAY:
-        default:
-            // currently do nothing
-            break;
+    scan->vals = 0;
+    scan->nums = 0;
+    scan->slots = 0;
+    scan->depth = 0;
+    while (curr < end) {
+        char c = *curr;
+        switch (c) {
+            case '{':
+            case '[':
+                if (scan->depth == JSON_MAX_DEPTH) {
+                    JSON_THROW_ERROR(txt->str, curr, "json nested too deep.");
+                    return CM_ERROR;
+                }
+                scan->vals++;
+                scan->members[scan->depth] = 0;
+                scan->is_obj[scan->depth] = (c == '{');
+                scan->depth++;
+                curr++;
+                break;
+            case '}':
+            case ']':
+                if (scan->depth == 0 || scan->is_obj[scan->depth - 1] != (c == '}')) {
+                    JSON_THROW_ERROR(txt->str, curr, "unmatched bracket.");
+                    return CM_ERROR;
+                }
+                scan->depth--;
+                scan->slots += scan->is_obj[scan->depth] ? json_index_size(scan->members[scan->depth]) : 0;
+                curr++;
+                if (scan->depth == 0) {
+                    scan->vals--; // the root is not on the tape
+                    return CM_SUCCESS;
+                }
+                break;
+            case ':':
+                // the string before was a key
+                scan->vals--;
+                if (scan->depth > 0) {
+                    scan->members[scan->depth - 1]++;
+                }
+                curr++;
+                break;
+            case '"':
+                scan->vals++;
+                curr = json_skip_str(curr + 1, end);
+                if (curr == NULL) {
+                    JSON_THROW_ERROR(txt->str, end, "text not completed.");
+                    return CM_ERROR;
+                }
+                curr++;
+                break;
+            default:
+                if (JSON_IS_SPACE(c) || c == ',') {
+                    curr++;
+                    break;
+                }
+                scan->vals++;
+                scan->nums += (c == '-' || (c >= '0' && c <= '9')) ? 1 : 0;
+                while (curr < end && !JSON_IS_DELIM(*curr) && *curr != '{' && *curr != '[') {
+                    curr++;
+                }
+                break;
+        }
     }
+    JSON_THROW_ERROR(txt->str, end, "curly bracket expected.");
+    return CM_ERROR;
 }
 
-static void assign_prop_data(jtxt_prop_t *jtxt_prop, json_val_t *jval)
+static inline void json_skip_space(json_parser_t *parser)
 {
-    jtxt_val_t *jtxt_val = &jtxt_prop->val;
-    char *data = jval->data;
-
-    /* assign key */
-    *(uint16 *)data = (uint16)jtxt_prop->key.len + 1;
-    data += sizeof(uint16);
-    errno_t err = memcpy_s(data, jtxt_prop->key.len, jtxt_prop->key.str, jtxt_prop->key.len);
-    securec_check_panic(err);
-    data[jtxt_prop->key.len] = '\0';
-    data += jtxt_prop->key.len + 1;
-
-    /* assign val */
-    jval->type = jtxt_val->type;
-    assign_val_data(jtxt_val, data);
+    while (parser->curr < parser->end && JSON_IS_SPACE(*parser->curr)) {
+        parser->curr++;
+    }
 }
 
-static status_t construct_obj(json_t *json, const text_t *txt);
-static status_t construct_arr(json_t *json, json_arr_t *arr, const text_t *txt);
-static status_t new_obj_prop(json_t *json, jtxt_prop_t *jtxt_prop, json_val_t **jval)
+static inline bool32 json_try_char(json_parser_t *parser, char c)
 {
-    uint32 size = calc_prop_size(jtxt_prop);
-    CM_RETURN_IFERR(json->alloc.f_alloc(json->alloc.mem_ctx, size, (void**)jval));
-    assign_prop_data(jtxt_prop, *jval);
-
-    jtxt_val_t *jtxt_val = &jtxt_prop->val;
-    switch (jtxt_val->type) {
-        case JSON_OBJ:
-            ((json_t *)JSON_OFFSET_VAL(*jval))->alloc = json->alloc;
-            return construct_obj((json_t *)JSON_OFFSET_VAL(*jval), &jtxt_val->val);
-        case JSON_ARRAY:
-            return construct_arr(json, (json_arr_t *)JSON_OFFSET_VAL(*jval), &jtxt_val->val);
-        default:
-            return CM_SUCCESS;
+    json_skip_space(parser);
+    if (parser->curr < parser->end && *parser->curr == c) {
+        parser->curr++;
+        return CM_TRUE;
     }
+    return CM_FALSE;
 }
 
-static status_t construct_obj(json_t *json, const text_t *txt)
+static status_t json_parse_str(json_parser_t *parser, text_t *txt)
 {
-    jtxt_iter_t jtxt;
-    CM_RETURN_IFERR(jtxt_iter_init(&jtxt, txt));
+    const char *begin = parser->curr + 1;
+    const char *curr = begin;
 
-    json_val_t *first = NULL;
-    json_val_t *last = NULL;
-    uint32 count = 0;
     for (;;) {
-        bool32 eof;
-        jtxt_prop_t jtxt_prop;
-        json_val_t *jval;
-        CM_RETURN_IFERR(jtxt_iter_obj(&eof, &jtxt, &jtxt_prop));
-        if (SECUREC_UNLIKELY(eof)) {
+        curr += json_find_quote(curr, (uint32)(parser->end - curr));
+        if (curr >= parser->end) {
+            JSON_THROW_ERROR(parser->str, curr, "text not completed.");
+            return CM_ERROR;
+        }
+        if (*curr == '"') {
             break;
         }
-        CM_RETURN_IFERR(new_obj_prop(json, &jtxt_prop, &jval));
-        ++count;
-        jval->next = NULL;
-        if (last == NULL) {
-            first = jval;
-            last = jval;
-        } else {
-            last->next = jval;
-            last = jval;
+        char next = (curr + 1 < parser->end) ? curr[1] : '\0';
+        if (next == 'u') {
+            // four hex digits of a code point, json_writer_put_escaped writes control characters this way
+            for (uint32 i = 2; i < JSON_UNICODE_ESCAPE_LEN; i++) {
+                if (curr + i >= parser->end || !CM_IS_HEX((uchar)curr[i])) {
+                    JSON_THROW_ERROR(parser->str, curr, "invalid unicode escape.");
+                    return CM_ERROR;
+                }
+            }
+            curr += JSON_UNICODE_ESCAPE_LEN;
+            continue;
         }
+        if (next != '\\' && next != '/' && next != '"' && next != 'b' && next != 'f' && next != 'r' && next != 'n' &&
+            next != 't') {
+            JSON_THROW_ERROR(parser->str, curr, "invalid escape character.");
+            return CM_ERROR;
+        }
+        curr += 2;
     }
 
-    hash_map_t *hmap = &json->props;
-    CM_RETURN_IFERR(cm_hmap_init(hmap, &json->alloc, count));
-
-    // the new created value node will be added to hash map directly
-    // so deal the next pointer carefully
-    json_val_t *prev, *next = first;
-    while (next != NULL) {
-        prev = next;
-        next = next->next;
-        (void)cm_hmap_insert(hmap, &g_json_hfs, (hash_node_t *)prev);
-    }
+    // escapes are kept as they are, the same as the lexer does
+    txt->str = parser->copy + (begin - parser->str);
+    txt->len = (uint32)(curr - begin);
+    txt->str[txt->len] = '\0';
+    parser->curr = curr + 1;
     return CM_SUCCESS;
 }
 
-static inline uint32 calc_item_size(jtxt_val_t *jtxt_val)
+static status_t json_parse_word(json_parser_t *parser, json_val_t *val)
 {
-    // json value struct|data
-    uint32 size = sizeof(json_val_t);
-    return add_val_size(size, jtxt_val);
+    const char *begin = parser->curr;
+    while (parser->curr < parser->end && !JSON_IS_DELIM(*parser->curr)) {
+        parser->curr++;
+    }
+    text_t word = { (char *)begin, (uint32)(parser->curr - begin) };
+
+    if (cm_text_str_equal_ins(&word, "true") || cm_text_str_equal_ins(&word, "false")) {
+        val->type = JSON_BOOL;
+        val->boolean = (word.str[0] == 't' || word.str[0] == 'T');
+        return CM_SUCCESS;
+    }
+    if (word.len == 0 || word.len >= CM_MAX_NUM_PART_BUFF || !CM_IS_DIGIT(word.str[word.len - 1]) ||
+        parser->num_count == 0) {
+        JSON_THROW_ERROR(parser->str, begin, "invalid value.");
+        return CM_ERROR;
+    }
+    for (uint32 i = 0; i < word.len; i++) {
+        char c = word.str[i];
+        if (!CM_IS_DIGIT(c) && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') {
+            JSON_THROW_ERROR(parser->str, begin + i, "invalid value.");
+            return CM_ERROR;
+        }
+    }
+    val->type = JSON_NUM;
+    val->num = parser->nums++;
+    parser->num_count--;
+    cm_text2digitext(&word, val->num);
+    return CM_SUCCESS;
 }
 
-static status_t append_item(json_t *json, json_arr_t *arr, jtxt_val_t *jtxt_val, json_val_t **jval)
+static void json_build_index(json_parser_t *parser, json_t *json)
 {
-    uint32 size = calc_item_size(jtxt_val);
-    CM_RETURN_IFERR(json->alloc.f_alloc(json->alloc.mem_ctx, size, (void**)jval));
-    assign_val_data(jtxt_val, (*jval)->data);
-
-    (*jval)->next = NULL;
-    (*jval)->type = jtxt_val->type;
-
-    switch (jtxt_val->type) {
-        case JSON_OBJ:
-            ((json_t *)JSON_OFFSET_DATA(*jval))->alloc = json->alloc;
-            return construct_obj((json_t *)JSON_OFFSET_DATA(*jval), &jtxt_val->val);
+    uint32 size = json_index_size(json->num);
+    json->index = NULL;
+    json->mask = 0;
+    if (size == 0 || parser->slot_count + size > parser->slot_max) {
+        return;
+    }
+    json->index = parser->slots + parser->slot_count;
+    json->mask = size - 1;
+    parser->slot_count += size;
+    for (uint32 i = 0; i < size; i++) {
+        json->index[i] = 0;
+    }
+    for (uint32 i = 0; i < json->num; i++) {
+        uint32 pos = json->members[i].hash & json->mask;
+        while (json->index[pos] != 0) {
+            pos = (pos + 1) & json->mask;
+        }
+        json->index[pos] = i + 1;
+    }
+}
 
-        case JSON_ARRAY:
-            return construct_arr(json, (json_arr_t *)JSON_OFFSET_DATA(*jval), &jtxt_val->val);
+static status_t json_parse_container(json_parser_t *parser, bool32 is_obj, json_val_t **vals, uint32 *num);
 
-        case JSON_BOOL:
-        case JSON_NUM:
-        case JSON_STR:
-        default:
+static status_t json_parse_value(json_parser_t *parser, json_val_t *val)
+{
+    json_skip_space(parser);
+    if (parser->curr >= parser->end) {
+        JSON_THROW_ERROR(parser->str, parser->curr, "value expected.");
+        return CM_ERROR;
+    }
+    switch (*parser->curr) {
+        case '{':
+            val->type = JSON_OBJ;
+            CM_RETURN_IFERR(json_parse_container(parser, CM_TRUE, &val->obj.members, &val->obj.num));
+            json_build_index(parser, &val->obj);
             return CM_SUCCESS;
+        case '[':
+            val->type = JSON_ARRAY;
+            return json_parse_container(parser, CM_FALSE, &val->arr.vals, &val->arr.num);
+        case '"':
+            val->type = JSON_STR;
+            return json_parse_str(parser, &val->str);
+        default:
+            return json_parse_word(parser, val);
     }
 }
 
-static status_t construct_arr(json_t *json, json_arr_t *arr, const text_t *txt)
+static status_t json_parse_member(json_parser_t *parser, bool32 is_obj)
 {
-    jtxt_iter_t jtxt;
-    CM_RETURN_IFERR(jtxt_iter_init(&jtxt, txt));
-    arr->vals = NULL;
-    arr->num = 0;
-    json_val_t *last = arr->vals;
-
-    for (;;) {
-        bool32 eof;
-        jtxt_val_t jtxt_val;
-        json_val_t *jval;
-        CM_RETURN_IFERR(jtxt_iter_arr(&eof, &jtxt, &jtxt_val));
-        if (SECUREC_UNLIKELY(eof)) {
-            break;
+    // the prescan counted the values, more of them means the text is broken
+    if (parser->pending == parser->placed) {
+        JSON_THROW_ERROR(parser->str, parser->curr, "invalid json.");
+        return CM_ERROR;
+    }
+    json_val_t *val = &parser->vals[--parser->pending];
+    val->key.str = NULL;
+    val->key.len = 0;
+    val->hash = 0;
+    if (is_obj) {
+        json_skip_space(parser);
+        if (parser->curr >= parser->end || *parser->curr != '"') {
+            JSON_THROW_ERROR(parser->str, parser->curr, "double qutation expected.");
+            return CM_ERROR;
         }
-        CM_RETURN_IFERR(append_item(json, arr, &jtxt_val, &jval));
-        if (last == NULL) {
-            arr->vals = jval;
-        } else {
-            last->next = jval;
+        CM_RETURN_IFERR(json_parse_str(parser, &val->key));
+        val->hash = cm_hash_bytes((uint8 *)val->key.str, val->key.len, 0);
+        if (!json_try_char(parser, ':')) {
+            JSON_THROW_ERROR(parser->str, parser->curr, "colon expected.");
+            return CM_ERROR;
         }
-        arr->num++;
-        last = jval;
     }
+    return json_parse_value(parser, val);
+}
+
+static status_t json_parse_container(json_parser_t *parser, bool32 is_obj, json_val_t **vals, uint32 *num)
+{
+    char close = is_obj ? '}' : ']';
+    uint32 top = parser->pending;
+
+    if (++parser->depth > JSON_MAX_DEPTH) {
+        JSON_THROW_ERROR(parser->str, parser->curr, "json nested too deep.");
+        return CM_ERROR;
+    }
+    parser->curr++;
+    if (!json_try_char(parser, close)) {
+        for (;;) {
+            CM_RETURN_IFERR(json_parse_member(parser, is_obj));
+            if (json_try_char(parser, ',')) {
+                continue;
+            }
+            if (json_try_char(parser, close)) {
+                break;
+            }
+            JSON_THROW_ERROR(parser->str, parser->curr, "comma expected.");
+            return CM_ERROR;
+        }
+    }
+    parser->depth--;
+
+    // pushed downwards, so reverse them into text order while moving them to the front
+    uint32 count = top - parser->pending;
+    json_val_t *first = &parser->vals[parser->pending];
+    for (uint32 i = 0; i < count / 2; i++) {
+        json_val_t tmp = first[i];
+        first[i] = first[count - 1 - i];
+        first[count - 1 - i] = tmp;
+    }
+    *vals = &parser->vals[parser->placed];
+    *num = count;
+    if (count > 0 && *vals != first) {
+        errno_t errcode = memmove_s(*vals, count * sizeof(json_val_t), first, count * sizeof(json_val_t));
+        securec_check_ret(errcode);
+    }
+    parser->placed += count;
+    parser->pending = top;
     return CM_SUCCESS;
 }
 
 status_t json_create(json_t **json, const text_t *txt, cm_allocator_t *alloc)
 {
-    if (alloc == NULL) {
+    json_scan_t scan;
+    json_doc_t *doc = NULL;
+
+    if (alloc == NULL || txt == NULL) {
+        return CM_ERROR;
+    }
+    CM_RETURN_IFERR(json_prescan(txt, &scan));
+
+    uint64 size = sizeof(json_doc_t) + (uint64)scan.vals * sizeof(json_val_t) +
+        (uint64)scan.nums * sizeof(digitext_t) + (uint64)scan.slots * sizeof(uint32) + txt->len + 1;
+    if (size > CM_MAX_UINT32) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, size, "json document");
         return CM_ERROR;
     }
-    
-    status_t ret = alloc->f_alloc((void *)alloc->mem_ctx, sizeof(json_t), (void **)json);
-    if (ret != CM_SUCCESS) {
+    CM_RETURN_IFERR(alloc->f_alloc(alloc->mem_ctx, (uint32)size, (void **)&doc));
+    doc->alloc = *alloc;
+
+    json_parser_t parser;
+    parser.str = txt->str;
+    parser.curr = txt->str;
+    parser.end = txt->str + txt->len;
+    parser.vals = (json_val_t *)(doc + 1);
+    parser.placed = 0;
+    parser.pending = scan.vals;
+    parser.nums = (digitext_t *)(parser.vals + scan.vals);
+    parser.num_count = scan.nums;
+    parser.slots = (uint32 *)(parser.nums + scan.nums);
+    parser.slot_count = 0;
+    parser.slot_max = scan.slots;
+    parser.copy = (char *)(parser.slots + scan.slots);
+    parser.depth = 0;
+    if (txt->len > 0) {
+        errno_t errcode = memcpy_s(parser.copy, txt->len, txt->str, txt->len);
+        if (errcode != EOK) {
+            alloc->f_free(alloc->mem_ctx, doc);
+            CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+            return CM_ERROR;
+        }
+    }
+    parser.copy[txt->len] = '\0';
+
+    if (!json_try_char(&parser, '{')) {
+        alloc->f_free(alloc->mem_ctx, doc);
+        JSON_THROW_ERROR(txt->str, parser.curr, "curly bracket expected.");
         return CM_ERROR;
     }
-    (*json)->alloc = *alloc;
-    return construct_obj(*json, txt);
+    parser.curr--;
+    if (json_parse_container(&parser, CM_TRUE, &doc->root.members, &doc->root.num) != CM_SUCCESS) {
+        alloc->f_free(alloc->mem_ctx, doc);
+        return CM_ERROR;
+    }
+    json_skip_space(&parser);
+    if (parser.curr < parser.end) {
+        alloc->f_free(alloc->mem_ctx, doc);
+        JSON_THROW_ERROR(txt->str, parser.curr, "text after the json document.");
+        return CM_ERROR;
+    }
+    json_build_index(&parser, &doc->root);
+    *json = &doc->root;
+    return CM_SUCCESS;
 }
 
 void json_destory(json_t *json)
 {
-    // do nothing now
+    // only the root owns the block, objects below it go with the document
+    if (json == NULL) {
+        return;
+    }
+    json_doc_t *doc = (json_doc_t *)((char *)json - OFFSET_OF(json_doc_t, root));
+    if (doc->alloc.f_free != NULL) {
+        doc->alloc.f_free(doc->alloc.mem_ctx, doc);
+    }
 }
 
-void json_to_str(json_t *json, char *buf, int32 len)
+static json_val_t *json_find(json_t *json, const text_t *key)
+{
+    uint32 hash = cm_hash_bytes((uint8 *)key->str, key->len, 0);
+
+    if (json->index == NULL) {
+        for (uint32 i = 0; i < json->num; i++) {
+            json_val_t *val = &json->members[i];
+            if (val->hash == hash && cm_compare_text_ins(&val->key, key) == 0) {
+                return val;
+            }
+        }
+        return NULL;
+    }
+
+    for (uint32 pos = hash & json->mask; json->index[pos] != 0; pos = (pos + 1) & json->mask) {
+        json_val_t *val = &json->members[json->index[pos] - 1];
+        if (val->hash == hash && cm_compare_text_ins(&val->key, key) == 0) {
+            return val;
+        }
+    }
+    return NULL;
+}
+
+static inline json_val_t *json_find_type(json_t *json, const text_t *key, json_type_t type)
 {
+    json_val_t *val = json_find(json, key);
+    return (val != NULL && val->type == type) ? val : NULL;
 }
 
 bool32 json_has_item(json_t *json, text_t *key)
 {
-    if (cm_hmap_find(&json->props, &g_json_hfs2, key) != NULL) {
-        return CM_TRUE;
-    }
-    return CM_FALSE;
+    return json_find(json, key) != NULL;
 }
 
 json_t *json_get_obj(json_t *json, text_t *key)
 {
-    json_val_t *jval;
-    jval = (json_val_t *)cm_hmap_find(&json->props, &g_json_hfs2, key);
-    if (jval == NULL) {
-        return NULL;
-    }
-    return (json_t *)JSON_OFFSET_VAL(jval);
+    json_val_t *val = json_find_type(json, key, JSON_OBJ);
+    return (val == NULL) ? NULL : &val->obj;
 }
 
 status_t json_get_str(json_t *json, text_t *key, text_t *txt)
 {
-    json_val_t *jval;
-    jval = (json_val_t *)cm_hmap_find(&json->props, &g_json_hfs2, key);
-    if (jval == NULL) {
+    json_val_t *val = json_find_type(json, key, JSON_STR);
+    if (val == NULL) {
         return CM_ERROR;
     }
-    char *jval_addr = JSON_OFFSET_VAL(jval);
-    txt->str = jval_addr + sizeof(jstr_len_t);
-    txt->len =  *(jstr_len_t *)jval_addr;
+    *txt = val->str;
     return CM_SUCCESS;
 }
 
 status_t json_get_bool(json_t *json, text_t *key, bool32 *val)
 {
-    json_val_t *jval;
-    jval = (json_val_t *)cm_hmap_find(&json->props, &g_json_hfs2, key);
+    json_val_t *jval = json_find_type(json, key, JSON_BOOL);
     if (jval == NULL) {
         return CM_ERROR;
     }
-    *val = *(bool32 *)JSON_OFFSET_VAL(jval);
+    *val = jval->boolean;
     return CM_SUCCESS;
 }
 
 digitext_t *json_get_num(json_t *json, text_t *key)
 {
-    json_val_t *jval;
-    jval = (json_val_t *)cm_hmap_find(&json->props, &g_json_hfs2, key);
-    if (jval == NULL) {
-        return NULL;
-    }
-    return (digitext_t *)JSON_OFFSET_VAL(jval);
+    json_val_t *val = json_find_type(json, key, JSON_NUM);
+    return (val == NULL) ? NULL : val->num;
 }
 
 status_t json_get_uint64(json_t *json, text_t *key, uint64 *val)
@@ -491,12 +724,8 @@ status_t json_get_uint64(json_t *json, text_t *key, uint64 *val)
 
 json_arr_t *json_get_arr(json_t *json, text_t *key)
 {
-    json_val_t *jval;
-    jval = (json_val_t *)cm_hmap_find(&json->props, &g_json_hfs2, key);
-    if (jval == NULL) {
-        return NULL;
-    }
-    return (json_arr_t *)JSON_OFFSET_VAL(jval);
+    json_val_t *val = json_find_type(json, key, JSON_ARRAY);
+    return (val == NULL) ? NULL : &val->arr;
 }
 
 uint32 jarr_get_size(json_arr_t *jarr)
@@ -506,13 +735,408 @@ uint32 jarr_get_size(json_arr_t *jarr)
 
 json_t *jarr_get_obj(json_arr_t *jarr, uint32 idx)
 {
-    json_val_t *jval = jarr->vals;
-    for (uint32 i = 0; i < jarr->num; i++) {
-        if (i == idx) {
-            return (json_t *)JSON_OFFSET_DATA(jval);
+    if (idx >= jarr->num || jarr->vals[idx].type != JSON_OBJ) {
+        return NULL;
+    }
+    return &jarr->vals[idx].obj;
+}
+
+static const char g_json_digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint64 g_json_pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+// the longest of an int64 and of a fixed point double below JSON_DOUBLE_FAST_MAX
+#define JSON_NUM_BUF_SIZE 32
+// the longest %.*f of a double: sign, 309 integer digits, point, JSON_MAX_DOUBLE_PREC digits and the terminator
+#define JSON_DOUBLE_BUF_SIZE (DBL_MAX_10_EXP + JSON_MAX_DOUBLE_PREC + 4)
+// 2^53, doubles below it hold every integer exactly
+#define JSON_DOUBLE_FAST_MAX 9007199254740992.0
+
+void json_writer_init(json_writer_t *writer, text_buf_t *buf)
+{
+    writer->buf = buf;
+    writer->fd = -1;
+    writer->depth = 0;
+    writer->has_val = 0;
+    writer->status = CM_SUCCESS;
+}
+
+void json_writer_init_fd(json_writer_t *writer, text_buf_t *buf, int32 fd)
+{
+    json_writer_init(writer, buf);
+    writer->fd = fd;
+}
+
+static status_t json_writer_flush(json_writer_t *writer)
+{
+    text_buf_t *buf = writer->buf;
+    if (writer->fd < 0) {
+        CM_THROW_ERROR(ERR_BUFFER_OVERFLOW, (int32)buf->len + 1, (int32)buf->max_size);
+        writer->status = CM_ERROR;
+        return CM_ERROR;
+    }
+    if (buf->len > 0 && cm_write_file(writer->fd, buf->str, (int32)buf->len) != CM_SUCCESS) {
+        writer->status = CM_ERROR;
+        return CM_ERROR;
+    }
+    buf->len = 0;
+    return CM_SUCCESS;
+}
+
+// one byte of buf is kept for the terminator
+static void json_writer_put(json_writer_t *writer, const char *str, uint32 len)
+{
+    text_buf_t *buf = writer->buf;
+    while (len > 0 && writer->status == CM_SUCCESS) {
+        uint32 room = buf->max_size - 1 - buf->len;
+        if (room == 0) {
+            (void)json_writer_flush(writer);
+            continue;
+        }
+        uint32 size = MIN(room, len);
+        errno_t errcode = memcpy_s(buf->str + buf->len, room, str, size);
+        if (errcode != EOK) {
+            CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+            writer->status = CM_ERROR;
+            return;
         }
-        jval = jval->next;
+        buf->len += size;
+        str += size;
+        len -= size;
     }
-    return NULL;
 }
 
+static inline void json_writer_putc(json_writer_t *writer, char c)
+{
+    text_buf_t *buf = writer->buf;
+    if (buf->len + 1 < buf->max_size) {
+        buf->str[buf->len++] = c;
+        return;
+    }
+    json_writer_put(writer, &c, 1);
+}
+
+static void json_writer_put_escaped(json_writer_t *writer, const char *str, uint32 len)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint32 begin = 0;
+
+    for (uint32 i = 0; i < len; i++) {
+        uchar c = (uchar)str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        json_writer_put(writer, str + begin, i - begin);
+        begin = i + 1;
+        switch (c) {
+            case '"':
+                json_writer_put(writer, "\\\"", 2);
+                break;
+            case '\\':
+                json_writer_put(writer, "\\\\", 2);
+                break;
+            case '\n':
+                json_writer_put(writer, "\\n", 2);
+                break;
+            case '\r':
+                json_writer_put(writer, "\\r", 2);
+                break;
+            case '\t':
+                json_writer_put(writer, "\\t", 2);
+                break;
+            default: {
+                char esc[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                json_writer_put(writer, esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    json_writer_put(writer, str + begin, len - begin);
+}
+
+// the comma before a value and its key, escaped keys come from callers, raw ones from parsed documents
+static status_t json_writer_key(json_writer_t *writer, const char *key, uint32 key_len, bool32 escape)
+{
+    if (writer->status != CM_SUCCESS) {
+        return writer->status;
+    }
+    uint64 bit = 1ULL << writer->depth;
+    if (writer->has_val & bit) {
+        json_writer_putc(writer, ',');
+    }
+    writer->has_val |= bit;
+    if (key != NULL) {
+        json_writer_putc(writer, '"');
+        if (escape) {
+            json_writer_put_escaped(writer, key, key_len);
+        } else {
+            json_writer_put(writer, key, key_len);
+        }
+        json_writer_put(writer, "\":", 2);
+    }
+    return writer->status;
+}
+
+#define JSON_WRITER_KEY(writer, key) \
+    json_writer_key((writer), (key), ((key) == NULL) ? 0 : (uint32)strlen(key), CM_TRUE)
+
+static status_t json_writer_begin(json_writer_t *writer, char open)
+{
+    if (writer->status != CM_SUCCESS) {
+        return writer->status;
+    }
+    if (writer->depth + 1 >= JSON_MAX_DEPTH) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "json writer depth");
+        writer->status = CM_ERROR;
+        return CM_ERROR;
+    }
+    json_writer_putc(writer, open);
+    writer->depth++;
+    writer->has_val &= ~(1ULL << writer->depth);
+    return writer->status;
+}
+
+static status_t json_writer_end(json_writer_t *writer, char close)
+{
+    if (writer->status != CM_SUCCESS) {
+        return writer->status;
+    }
+    if (writer->depth == 0) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "json writer depth");
+        writer->status = CM_ERROR;
+        return CM_ERROR;
+    }
+    writer->depth--;
+    json_writer_putc(writer, close);
+    return writer->status;
+}
+
+status_t json_writer_finish(json_writer_t *writer)
+{
+    text_buf_t *buf = writer->buf;
+    if (writer->fd >= 0) {
+        if (writer->status == CM_SUCCESS) {
+            (void)json_writer_flush(writer);
+        }
+    } else if (buf->max_size > 0) {
+        // a failed document is still terminated, cut where the buffer ran out
+        buf->str[MIN(buf->len, buf->max_size - 1)] = '\0';
+    }
+    return writer->status;
+}
+
+status_t json_write_begin_obj(json_writer_t *writer, const char *key)
+{
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    return json_writer_begin(writer, '{');
+}
+
+status_t json_write_end_obj(json_writer_t *writer)
+{
+    return json_writer_end(writer, '}');
+}
+
+status_t json_write_begin_arr(json_writer_t *writer, const char *key)
+{
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    return json_writer_begin(writer, '[');
+}
+
+status_t json_write_end_arr(json_writer_t *writer)
+{
+    return json_writer_end(writer, ']');
+}
+
+status_t json_write_text(json_writer_t *writer, const char *key, const text_t *txt)
+{
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    json_writer_putc(writer, '"');
+    json_writer_put_escaped(writer, txt->str, txt->len);
+    json_writer_putc(writer, '"');
+    return writer->status;
+}
+
+status_t json_write_str(json_writer_t *writer, const char *key, const char *str)
+{
+    text_t txt = { (char *)str, (uint32)strlen(str) };
+    return json_write_text(writer, key, &txt);
+}
+
+// writes the digits backwards ending at end, returns where they begin
+static char *json_format_uint64(uint64 val, char *end)
+{
+    char *curr = end;
+    while (val >= 100) {
+        uint32 pair = (uint32)(val % 100) * 2;
+        val /= 100;
+        *--curr = g_json_digits[pair + 1];
+        *--curr = g_json_digits[pair];
+    }
+    if (val >= 10) {
+        uint32 pair = (uint32)val * 2;
+        *--curr = g_json_digits[pair + 1];
+        *--curr = g_json_digits[pair];
+    } else {
+        *--curr = (char)('0' + val);
+    }
+    return curr;
+}
+
+status_t json_write_uint64(json_writer_t *writer, const char *key, uint64 val)
+{
+    char num[JSON_NUM_BUF_SIZE];
+    char *end = num + sizeof(num);
+
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    char *begin = json_format_uint64(val, end);
+    json_writer_put(writer, begin, (uint32)(end - begin));
+    return writer->status;
+}
+
+status_t json_write_int64(json_writer_t *writer, const char *key, int64 val)
+{
+    char num[JSON_NUM_BUF_SIZE];
+    char *end = num + sizeof(num);
+
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    // negate in unsigned so that the minimal int64 does not overflow
+    char *begin = json_format_uint64((val < 0) ? (0 - (uint64)val) : (uint64)val, end);
+    if (val < 0) {
+        *--begin = '-';
+    }
+    json_writer_put(writer, begin, (uint32)(end - begin));
+    return writer->status;
+}
+
+static status_t json_write_double_printf(json_writer_t *writer, double val, uint32 prec)
+{
+    char num[JSON_DOUBLE_BUF_SIZE];
+
+    int32 len = snprintf_s(num, sizeof(num), sizeof(num) - 1, "%.*f", (int32)prec, val);
+    if (len < 0) {
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, len);
+        writer->status = CM_ERROR;
+        return CM_ERROR;
+    }
+    json_writer_put(writer, num, (uint32)len);
+    return writer->status;
+}
+
+status_t json_write_double(json_writer_t *writer, const char *key, double val, uint32 prec)
+{
+    char num[JSON_NUM_BUF_SIZE];
+    char *end = num + sizeof(num);
+
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    if (isnan(val) || isinf(val)) {
+        json_writer_put(writer, "null", 4);
+        return writer->status;
+    }
+
+    /*
+     * %.*f rounds the exact binary value. val * 10^prec is off from it by half an ulp at most, so its
+     * rounding only tells the digits when the fraction is further than that from one half.
+     */
+    prec = MIN(prec, JSON_MAX_DOUBLE_PREC);
+    double scaled = fabs(val) * (double)g_json_pow10[prec];
+    if (scaled >= JSON_DOUBLE_FAST_MAX) {
+        return json_write_double_printf(writer, val, prec);
+    }
+    uint64 fixed = (uint64)scaled;
+    double frac = scaled - (double)fixed;
+    if (fabs(frac - 0.5) <= scaled * DBL_EPSILON) {
+        return json_write_double_printf(writer, val, prec);
+    }
+    fixed += (frac > 0.5) ? 1 : 0;
+
+    char *begin = end;
+    if (prec > 0) {
+        begin = json_format_uint64(fixed % g_json_pow10[prec], end);
+        while ((uint32)(end - begin) < prec) {
+            *--begin = '0';
+        }
+        *--begin = '.';
+    }
+    begin = json_format_uint64(fixed / g_json_pow10[prec], begin);
+    if (signbit(val)) {
+        *--begin = '-';
+    }
+    json_writer_put(writer, begin, (uint32)(end - begin));
+    return writer->status;
+}
+
+status_t json_write_bool(json_writer_t *writer, const char *key, bool32 val)
+{
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    if (val) {
+        json_writer_put(writer, "true", 4);
+    } else {
+        json_writer_put(writer, "false", 5);
+    }
+    return writer->status;
+}
+
+static status_t json_write_val(json_writer_t *writer, json_val_t *val);
+
+static status_t json_write_members(json_writer_t *writer, json_val_t *vals, uint32 num, char open, char close)
+{
+    CM_RETURN_IFERR(json_writer_begin(writer, open));
+    for (uint32 i = 0; i < num; i++) {
+        CM_RETURN_IFERR(json_write_val(writer, &vals[i]));
+    }
+    return json_writer_end(writer, close);
+}
+
+// strings and keys of a parsed document keep their escapes, they are written as they are
+static status_t json_write_val(json_writer_t *writer, json_val_t *val)
+{
+    CM_RETURN_IFERR(json_writer_key(writer, val->key.str, val->key.len, CM_FALSE));
+    switch (val->type) {
+        case JSON_BOOL:
+            if (val->boolean) {
+                json_writer_put(writer, "true", 4);
+            } else {
+                json_writer_put(writer, "false", 5);
+            }
+            return writer->status;
+        case JSON_NUM:
+            json_writer_put(writer, val->num->str, val->num->len);
+            return writer->status;
+        case JSON_STR:
+            json_writer_putc(writer, '"');
+            json_writer_put(writer, val->str.str, val->str.len);
+            json_writer_putc(writer, '"');
+            return writer->status;
+        case JSON_OBJ:
+            return json_write_members(writer, val->obj.members, val->obj.num, '{', '}');
+        case JSON_ARRAY:
+            return json_write_members(writer, val->arr.vals, val->arr.num, '[', ']');
+        default:
+            return CM_SUCCESS;
+    }
+}
+
+status_t json_write_json(json_writer_t *writer, const char *key, json_t *json)
+{
+    CM_RETURN_IFERR(JSON_WRITER_KEY(writer, key));
+    return json_write_members(writer, json->members, json->num, '{', '}');
+}
+
+void json_to_str(json_t *json, char *buf, int32 len)
+{
+    text_buf_t text_buf;
+    json_writer_t writer;
+
+    if (json == NULL || buf == NULL || len <= 0) {
+        return;
+    }
+    CM_INIT_TEXTBUF(&text_buf, (uint32)len, buf);
+    json_writer_init(&writer, &text_buf);
+    (void)json_write_json(&writer, NULL, json);
+    (void)json_writer_finish(&writer);
+}
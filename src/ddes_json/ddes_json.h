@@ -56,24 +56,49 @@ typedef struct st_json_iter {
     lex_t lexer;
 } jtxt_iter_t;
 
+typedef struct st_json_val json_val_t;
+
+// values of a document sit in one block owned by the root, see json_create
 typedef struct st_json_t {
-    cm_allocator_t alloc;
-    hash_map_t props;
+    json_val_t *members; // in text order
+    uint32 num;
+    uint32 mask;   // size of index - 1
+    uint32 *index; // member position + 1 by key hash, NULL for small objects
 } json_t;
 
-typedef struct st_json_val {
-    struct st_json_val *next;
-    json_type_t type;
-    char data[0];
-} json_val_t;
-
 typedef struct st_json_arr {
     json_val_t *vals;
     uint32 num;
 } json_arr_t;
 
-typedef uint32 jstr_len_t;
-typedef uint16 key_len_t;
+struct st_json_val {
+    json_type_t type;
+    uint32 hash; // of the key
+    text_t key;  // empty for array items
+    union {
+        bool32 boolean;
+        digitext_t *num;
+        text_t str;
+        json_t obj;
+        json_arr_t arr;
+    };
+};
+
+#define JSON_MAX_DEPTH 64
+#define JSON_MAX_DOUBLE_PREC 9 // digits after the point json_write_double keeps at most
+
+/*
+ * Streaming writer that never allocates. Output goes into buf, when fd is given a full buf is
+ * written to the fd and reused. The first failure sticks, later calls do nothing and return it.
+ * Keys are NULL inside arrays and for the outermost value.
+ */
+typedef struct st_json_writer {
+    text_buf_t *buf;
+    int32 fd;       // -1 when the output stays in buf
+    uint32 depth;
+    uint64 has_val; // bit n is set once the container at depth n has a value
+    status_t status;
+} json_writer_t;
 
 status_t jtxt_iter_init(jtxt_iter_t *jtxt, const text_t *txt);
 status_t jtxt_iter_obj(bool32 *eof, jtxt_iter_t *json, jtxt_prop_t *prop);
@@ -102,6 +127,24 @@ uint32 jarr_get_size(json_arr_t *jarr);
 // return null means error
 json_t *jarr_get_obj(json_arr_t *jarr, uint32 idx);
 
+void json_writer_init(json_writer_t *writer, text_buf_t *buf);
+void json_writer_init_fd(json_writer_t *writer, text_buf_t *buf, int32 fd);
+// terminates buf or writes the rest to the fd
+status_t json_writer_finish(json_writer_t *writer);
+status_t json_write_begin_obj(json_writer_t *writer, const char *key);
+status_t json_write_end_obj(json_writer_t *writer);
+status_t json_write_begin_arr(json_writer_t *writer, const char *key);
+status_t json_write_end_arr(json_writer_t *writer);
+// str is escaped as needed
+status_t json_write_str(json_writer_t *writer, const char *key, const char *str);
+status_t json_write_text(json_writer_t *writer, const char *key, const text_t *txt);
+status_t json_write_int64(json_writer_t *writer, const char *key, int64 val);
+status_t json_write_uint64(json_writer_t *writer, const char *key, uint64 val);
+// the same digits as %.*f with prec up to JSON_MAX_DOUBLE_PREC, null for nan and inf
+status_t json_write_double(json_writer_t *writer, const char *key, double val, uint32 prec);
+status_t json_write_bool(json_writer_t *writer, const char *key, bool32 val);
+status_t json_write_json(json_writer_t *writer, const char *key, json_t *json);
+
 #ifdef __cplusplus
 }
 #endif
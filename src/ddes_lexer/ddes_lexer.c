@@ -23,6 +23,11 @@
  */
 
 #include "string.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "cm_defs.h"
 #include "cm_num.h"
 #include "cm_binary.h"
@@ -644,20 +649,19 @@ static void lex_fetch_special_char(lex_t *lex, word_t *word)
 
 static status_t lex_fetch_name(lex_t *lex, word_t *word)
 {
-    char c;
-    c = lex_skip(lex, 1);
-
-    while (c != LEX_END && c != '@') {
-        if (IS_SPLITTER(c)) {
-            break;
-        }
+    const char *str = lex->curr_text->str;
+    uint32 len = lex->curr_text->len;
+    uint32 pos = 1;
 
-        if (!IS_NAMABLE(c)) {
-            LEX_THROW_ERROR_EX(LEX_LOC, ERR_LEX_SYNTAX_ERROR, "namable char expected but %c found", c);
-            return CM_ERROR;
-        }
+    // namable chars never break a line, so the whole name is skipped at once
+    while (pos < len && IS_NAMABLE(str[pos])) {
+        pos++;
+    }
 
-        c = lex_skip(lex, 1);
+    char c = lex_skip(lex, pos);
+    if (c != LEX_END && c != '@' && !IS_SPLITTER(c)) {
+        LEX_THROW_ERROR_EX(LEX_LOC, ERR_LEX_SYNTAX_ERROR, "namable char expected but %c found", c);
+        return CM_ERROR;
     }
 
     word->text.len = (uint32)(lex->curr_text->str - word->text.str);
@@ -758,12 +762,81 @@ static status_t lex_fetch_variant(lex_t *lex, word_t *word, bool32 in_hint)
     return CM_SUCCESS;
 }
 
+/*
+ * offset of the first of c1..c4 or of a '\0', which ends the text like LEX_END does, len when
+ * there is none. Pass a char more than once to look for fewer.
+ */
+static inline uint32 lex_scan(const char *str, uint32 len, char c1, char c2, char c3, char c4)
+{
+    uint32 i = 0;
+#if defined(__SSE2__)
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    const __m128i v3 = _mm_set1_epi8(c3);
+    const __m128i v4 = _mm_set1_epi8(c4);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + sizeof(__m128i) <= len; i += sizeof(__m128i)) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1), _mm_cmpeq_epi8(chunk, v2)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, v3), _mm_cmpeq_epi8(chunk, v4)));
+        uint32 mask = (uint32)_mm_movemask_epi8(_mm_or_si128(hit, _mm_cmpeq_epi8(chunk, zero)));
+        if (mask != 0) {
+            return i + (uint32)__builtin_ctz(mask);
+        }
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t v1 = vdupq_n_u8((uint8)c1);
+    const uint8x16_t v2 = vdupq_n_u8((uint8)c2);
+    const uint8x16_t v3 = vdupq_n_u8((uint8)c3);
+    const uint8x16_t v4 = vdupq_n_u8((uint8)c4);
+    for (; i + sizeof(uint8x16_t) <= len; i += sizeof(uint8x16_t)) {
+        uint8x16_t chunk = vld1q_u8((const uint8 *)(str + i));
+        uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(chunk, v1), vceqq_u8(chunk, v2)),
+            vorrq_u8(vceqq_u8(chunk, v3), vceqq_u8(chunk, v4)));
+        if (vmaxvq_u8(vorrq_u8(hit, vceqzq_u8(chunk))) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        char c = str[i];
+        if (c == c1 || c == c2 || c == c3 || c == c4 || c == '\0') {
+            return i;
+        }
+    }
+    return len;
+}
+
+/* the same as step calls of lex_move, the lines of the span are counted at once */
+static inline char lex_move_n(lex_t *lex, uint32 step)
+{
+    lang_text_t *text = lex->curr_text;
+    const char *end = text->str + step;
+    const char *line = (const char *)memchr(text->str, '\n', step);
+
+    if (line == NULL) {
+        text->loc.column += step;
+    } else {
+        const char *last = NULL;
+        while (line != NULL) {
+            text->loc.line++;
+            last = line;
+            line = (const char *)memchr(last + 1, '\n', (size_t)(end - last - 1));
+        }
+        text->loc.column = (uint16)(end - last);
+    }
+    text->str += step;
+    text->len -= step;
+    return LEX_CURR;
+}
+
 static status_t lex_fetch_quota(lex_t *lex, word_t *word, char quota)
 {
     bool32 finished = CM_FALSE;
-    char curr, next;
+    lang_text_t *text = lex->curr_text;
+    char curr;
 
-    curr = lex_move(lex);
+    (void)lex_move(lex);
 
     char charcurr = LEX_CURR;
     char charnext = LEX_NEXT;
@@ -771,21 +844,20 @@ static status_t lex_fetch_quota(lex_t *lex, word_t *word, char quota)
         word->id = CM_TYPE_BINARY;
     }
 
-    while (curr != LEX_END) {
-        if (curr == quota) {
-            next = LEX_NEXT;
-
-            if (next == quota) {  // a''b => a'b
-                curr = lex_skip(lex, 2);
-                continue;
-            }
-
-            (void)lex_skip(lex, 1);
-            finished = CM_TRUE;
+    for (;;) {
+        curr = lex_move_n(lex, lex_scan(text->str, text->len, quota, quota, quota, quota));
+        if (curr != quota) {
             break;
         }
 
-        curr = lex_move(lex);
+        if (LEX_NEXT == quota) {  // a''b => a'b
+            (void)lex_skip(lex, 2);
+            continue;
+        }
+
+        (void)lex_skip(lex, 1);
+        finished = CM_TRUE;
+        break;
     }
 
     if (!finished) {
@@ -821,12 +893,14 @@ static status_t lex_skip_escape(lex_t *lex)
 static status_t lex_fetch_c_str(lex_t *lex, word_t *word)
 {
     bool32 finished = CM_FALSE;
+    lang_text_t *text = lex->curr_text;
     char curr;
 
-    curr = lex_move(lex);
+    (void)lex_move(lex);
 
     char escchar = '\\';
-    while (curr != LEX_END) {
+    for (;;) {
+        curr = lex_move_n(lex, lex_scan(text->str, text->len, escchar, DOUBLE_QUOTATION, escchar, DOUBLE_QUOTATION));
         if (curr == escchar) {
             if (lex_skip_escape(lex) != CM_SUCCESS) {
                 LEX_THROW_ERROR_EX(LEX_LOC, ERR_LEX_SYNTAX_ERROR, "invalid escape character");
@@ -837,9 +911,8 @@ static status_t lex_fetch_c_str(lex_t *lex, word_t *word)
         if (curr == DOUBLE_QUOTATION) {
             (void)lex_skip(lex, 1);
             finished = CM_TRUE;
-            break;
         }
-        curr = lex_move(lex);
+        break;
     }
 
     if (!finished) {
@@ -929,42 +1002,40 @@ static status_t lex_fetch_brackets(lex_t *lex, word_t *word, const char *bracket
     bool32 in_squota = CM_FALSE;
     bool32 in_dquota = CM_FALSE;
     uint32 depth = 1;
+    lang_text_t *text = lex->curr_text;
+    char lbracket = LBRACKET(brackets);
+    char rbracket = RBRACKET(brackets);
 
-    c = lex_move(lex);
+    (void)lex_move(lex);
 
-    while (c != LEX_END) {
-        if (c == SINGLE_QUOTATION) {
-            in_squota = !in_squota;
-            c = lex_move(lex);
-            continue;
-        }
+    for (;;) {
+        // only the chars that can change the state stop the scan, a single quotation wins in every state
         if (in_squota) {
-            c = lex_move(lex);
-            continue;
-        }
-
-        if (c == DOUBLE_QUOTATION) {
-            in_dquota = !in_dquota;
-            c = lex_move(lex);
-            continue;
+            c = lex_move_n(lex, lex_scan(text->str, text->len, SINGLE_QUOTATION, SINGLE_QUOTATION,
+                SINGLE_QUOTATION, SINGLE_QUOTATION));
+        } else if (in_dquota) {
+            c = lex_move_n(lex, lex_scan(text->str, text->len, SINGLE_QUOTATION, DOUBLE_QUOTATION,
+                SINGLE_QUOTATION, DOUBLE_QUOTATION));
+        } else {
+            c = lex_move_n(lex, lex_scan(text->str, text->len, SINGLE_QUOTATION, DOUBLE_QUOTATION,
+                lbracket, rbracket));
         }
-
-        if (in_dquota) {
-            c = lex_move(lex);
-            continue;
+        if (c == LEX_END) {
+            break;
         }
 
-        if (c == LBRACKET(brackets)) {
+        if (c == SINGLE_QUOTATION) {
+            in_squota = !in_squota;
+        } else if (c == DOUBLE_QUOTATION) {
+            in_dquota = !in_dquota;
+        } else if (c == lbracket) {
             depth++;
-        } else if (c == RBRACKET(brackets)) {
-            depth--;
-            if (depth == 0) {
-                (void)lex_skip(lex, 1);
-                break;
-            }
+        } else if (--depth == 0) {
+            (void)lex_skip(lex, 1);
+            break;
         }
 
-        c = lex_move(lex);
+        (void)lex_skip(lex, 1);
     }
 
     if (in_dquota || in_squota || depth != 0) {
@@ -26,6 +26,7 @@
 #include "ddes_word.h"
 #include "ddes_oper.h"
 #include "ddes_lexer.h"
+#include "ddes_word_hash.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -464,8 +465,8 @@ static datatype_word_t g_datatype_words[] = {
 };
 
 /* reserved keywords
- * **Note:** the reserved keywords must be arrange in alphabetically
- * ascending order for speeding the search process. */
+ * **Note:** the word tables here are looked up through ddes_word_hash.h,
+ * run ddes_word_hash.py after changing any of them. */
 static key_word_t g_reserved_words[] = {
     { (uint32)RES_WORD_COLUMN_VALUE,       CM_TRUE,  CONSTRUCT_TEXT("column_value") },
     { (uint32)RES_WORD_CONNECT_BY_ISCYCLE, CM_TRUE,  CONSTRUCT_TEXT("connect_by_iscycle") },
@@ -559,6 +560,73 @@ static key_word_t g_hint_key_words[] = {
 #define DATATYPE_WORDS_COUNT (ELEMENT_COUNT(g_datatype_words))
 #define HINT_KEY_WORDS_COUNT (sizeof(g_hint_key_words) / sizeof(key_word_t))
 
+// checked on every platform, a stale table would silently miss words
+#define LEX_WORD_HASH_FRESH                                                                                      \
+    (KEY_WORDS_COUNT == KEY_WORDS_HASH_COUNT && RESERVED_WORDS_COUNT == RESERVED_WORDS_HASH_COUNT &&            \
+        DATATYPE_WORDS_COUNT == DATATYPE_WORDS_HASH_COUNT && HINT_KEY_WORDS_COUNT == HINT_KEY_WORDS_HASH_COUNT && \
+        ELEMENT_COUNT(g_datetime_unit_words) == DATETIME_UNIT_WORDS_HASH_COUNT)
+#ifdef WIN32
+static_assert(LEX_WORD_HASH_FRESH, "ddes_word_hash.h is stale, run ddes_word_hash.py");
+#else
+_Static_assert(LEX_WORD_HASH_FRESH, "ddes_word_hash.h is stale, run ddes_word_hash.py");
+#endif
+
+#define LEX_WORD_HASH_BASIS 0x811C9DC5
+#define LEX_WORD_HASH_PRIME 0x01000193
+
+/* FNV-1a of the lower case word, must stay the same as word_hash in ddes_word_hash.py */
+static inline uint32 lex_word_hash(const text_t *text)
+{
+    uint32 hash = LEX_WORD_HASH_BASIS;
+    for (uint32 i = 0; i < text->len; i++) {
+        hash = (hash ^ (uint8)LOWER(text->str[i])) * LEX_WORD_HASH_PRIME;
+    }
+    return hash;
+}
+
+/* must stay the same as word_hash_slot in ddes_word_hash.py */
+static inline uint32 lex_word_hash_slot(uint32 hash, uint32 seed, uint32 mask)
+{
+    hash ^= seed;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
+    return hash & mask;
+}
+
+/* the only candidate for the word in a table of count words, CM_INVALID_ID32 when there is none */
+static inline uint32 lex_word_hash_find(const word_hash_t *word_hash, uint32 hash, uint32 count)
+{
+    uint32 seed = word_hash->seeds[hash & word_hash->bucket_mask];
+    uint32 pos = word_hash->slots[lex_word_hash_slot(hash, seed, word_hash->slot_mask)];
+    // the bound keeps a stale table from reading past the words, the caller compares the text
+    return (pos == 0 || pos > count) ? CM_INVALID_ID32 : pos - 1;
+}
+
+static bool32 lex_match_hashed(const word_hash_t *word_hash, const key_word_t *word_set, uint32 count,
+    uint32 hash, word_t *word)
+{
+    uint32 pos = lex_word_hash_find(word_hash, hash, count);
+    if (pos == CM_INVALID_ID32 || !cm_text_equal_ins((text_t *)&word->text, &word_set[pos].text)) {
+        return CM_FALSE;
+    }
+    word->namable = (uint32)word_set[pos].namable;
+    word->id = (uint32)word_set[pos].id;
+    return CM_TRUE;
+}
+
+static const datatype_word_t *lex_match_datatype_hashed(uint32 hash, const word_t *word)
+{
+    uint32 pos = lex_word_hash_find(&g_datatype_words_hash, hash, DATATYPE_WORDS_COUNT);
+    if (pos == CM_INVALID_ID32 || !cm_text_equal_ins((text_t *)&word->text, &g_datatype_words[pos].text)) {
+        return NULL;
+    }
+    return &g_datatype_words[pos];
+}
+
+/* binary search, for word sets given by callers which must be sorted */
 bool32 lex_match_subset(key_word_t *word_set, int32 count, word_t *word)
 {
     int32 begin_pos, end_pos, mid_pos, cmp_result;
@@ -588,7 +656,9 @@ bool32 lex_match_subset(key_word_t *word_set, int32 count, word_t *word)
 
 bool32 lex_match_datetime_unit(word_t *word)
 {
-    return lex_match_subset(g_datetime_unit_words, ELEMENT_COUNT(g_datetime_unit_words), word);
+    uint32 hash = lex_word_hash((text_t *)&word->text);
+    return lex_match_hashed(&g_datetime_unit_words_hash, g_datetime_unit_words, ELEMENT_COUNT(g_datetime_unit_words),
+        hash, word);
 }
 
 const datatype_word_t *lex_match_datatype_words(const datatype_word_t *word_set, int32 count, const word_t *word)
@@ -618,14 +688,14 @@ const datatype_word_t *lex_match_datatype_words(const datatype_word_t *word_set,
 
 bool32 lex_check_datatype(word_t *word)
 {
-    return lex_match_datatype_words(g_datatype_words, DATATYPE_WORDS_COUNT, word) != NULL;
+    return lex_match_datatype_hashed(lex_word_hash((text_t *)&word->text), word) != NULL;
 }
 
 status_t lex_try_match_datatype(struct st_lex *lex, word_t *word, bool32 *matched)
 {
     bool32 result = CM_FALSE;
     uint32 signed_flag;
-    const datatype_word_t *dt_word = lex_match_datatype_words(g_datatype_words, DATATYPE_WORDS_COUNT, word);
+    const datatype_word_t *dt_word = lex_match_datatype_hashed(lex_word_hash((text_t *)&word->text), word);
 
     if (dt_word == NULL) {
         *matched = CM_FALSE;
@@ -715,12 +785,14 @@ status_t lex_match_keyword(struct st_lex *lex, word_t *word)
         }
     }
 
-    if (lex_match_subset((key_word_t *)g_reserved_words, RESERVED_WORDS_COUNT, word)) {
+    // one hash serves all the built in tables
+    uint32 hash = lex_word_hash((text_t *)&word->text);
+    if (lex_match_hashed(&g_reserved_words_hash, g_reserved_words, RESERVED_WORDS_COUNT, hash, word)) {
         word->type = WORD_TYPE_RESERVED;
         return CM_SUCCESS;
     }
 
-    if (lex_match_subset((key_word_t *)g_key_words, KEY_WORDS_COUNT, word)) {
+    if (lex_match_hashed(&g_key_words_hash, g_key_words, KEY_WORDS_COUNT, hash, word)) {
         word->type = WORD_TYPE_KEYWORD;
         if (word->id == KEY_WORD_PRIOR) {
             word->type = WORD_TYPE_OPERATOR;
@@ -729,7 +801,7 @@ status_t lex_match_keyword(struct st_lex *lex, word_t *word)
         return CM_SUCCESS;
     }
 
-    const datatype_word_t *dt_word = lex_match_datatype_words(g_datatype_words, DATATYPE_WORDS_COUNT, word);
+    const datatype_word_t *dt_word = lex_match_datatype_hashed(hash, word);
     if (dt_word != NULL) {
         word->type = WORD_TYPE_DATATYPE;
         word->id = (uint32)dt_word->id;
@@ -742,7 +814,8 @@ status_t lex_match_keyword(struct st_lex *lex, word_t *word)
 
 status_t lex_match_hint_keyword(struct st_lex *lex, word_t *word)
 {
-    if (lex_match_subset((key_word_t *)g_hint_key_words, HINT_KEY_WORDS_COUNT, word)) {
+    uint32 hash = lex_word_hash((text_t *)&word->text);
+    if (lex_match_hashed(&g_hint_key_words_hash, g_hint_key_words, HINT_KEY_WORDS_COUNT, hash, word)) {
         word->type = WORD_TYPE_HINT_KEYWORD;
     }
 
@@ -185,6 +185,14 @@ typedef struct st_datatype_word {
     bool32 can_sign; /* can has signed or unsigned */
 } datatype_word_t;
 
+/* perfect hash of a word table, generated into ddes_word_hash.h by ddes_word_hash.py */
+typedef struct st_word_hash {
+    const uint8 *seeds;  /* by bucket */
+    const uint16 *slots; /* position in the word table + 1, 0 for an empty slot */
+    uint32 bucket_mask;
+    uint32 slot_mask;
+} word_hash_t;
+
 typedef struct st_column_word {
     lang_text_t user;
     lang_text_t table;
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * ddes_word_hash.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/ddes_lexer/ddes_word_hash.h
+ *
+ * -------------------------------------------------------------------------
+ */
+
+/* Generated by ddes_word_hash.py from the word tables of ddes_word.c, do not edit. */
+
+#ifndef __DDES_WORD_HASH_H__
+#define __DDES_WORD_HASH_H__
+
+#if !defined(DB_DEBUG_VERSION)
+/* g_key_words, 361 words */
+#define KEY_WORDS_HASH_COUNT 361
+static const uint8 g_key_words_seeds[] = {
+    0, 0, 0, 0, 0, 0, 0, 3, 3, 0, 0, 0, 0, 0, 0, 4,
+    0, 0, 2, 0, 1, 3, 0, 4, 3, 0, 1, 0, 2, 0, 0, 0,
+    0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1, 3, 0,
+    0, 0, 5, 3, 0, 3, 3, 0, 2, 0, 0, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 2, 0, 0, 2, 0, 6, 7, 1, 0, 1, 1, 0,
+    4, 2, 1, 0, 0, 2, 0, 2, 0, 0, 0, 2, 0, 1, 2, 0,
+    1, 0, 0, 0, 0, 6, 0, 0, 1, 0, 0, 1, 4, 1, 0, 2,
+    0, 0, 0, 1, 0, 0, 4, 2, 0, 4, 2, 0, 0, 1, 0, 0,
+    0, 0, 0, 0, 0, 2, 4, 1, 1, 0, 1, 0, 1, 0, 0, 0,
+    6, 0, 1, 2, 2, 0, 0, 1, 1, 0, 6, 1, 0, 0, 5, 0,
+    1, 0, 2, 2, 1, 1, 1, 0, 1, 1, 2, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 5, 0, 0, 2, 8, 0, 0, 2, 0, 2,
+    2, 0, 1, 4, 2, 8, 0, 11, 0, 0, 0, 1, 2, 0, 0, 0,
+    0, 1, 3, 2, 0, 0, 1, 0, 0, 0, 2, 4, 2, 0, 0, 0,
+    4, 0, 0, 0, 0, 0, 1, 0, 4, 1, 0, 2, 0, 0, 0, 1,
+    0, 2, 0, 1, 9, 0, 5, 1, 6, 0, 1, 4, 9, 0, 0, 1,
+};
+static const uint16 g_key_words_slots[] = {
+    0, 0, 0, 0, 292, 196, 0, 81, 323, 0, 0, 270, 181, 271, 312, 140,
+    14, 165, 111, 358, 335, 360, 199, 248, 329, 0, 184, 275, 268, 0, 143, 361,
+    249, 264, 0, 0, 0, 0, 343, 0, 139, 0, 198, 359, 0, 11, 224, 150,
+    63, 0, 0, 144, 99, 311, 0, 1, 159, 229, 3, 205, 0, 210, 272, 208,
+    332, 279, 179, 0, 97, 113, 0, 46, 307, 274, 0, 86, 245, 227, 0, 52,
+    0, 321, 73, 0, 218, 6, 0, 0, 29, 0, 0, 19, 0, 0, 228, 353,
+    115, 283, 314, 62, 71, 112, 195, 0, 337, 87, 91, 317, 0, 256, 0, 0,
+    200, 0, 226, 350, 0, 177, 70, 341, 25, 0, 0, 69, 166, 0, 58, 251,
+    215, 338, 83, 0, 103, 0, 0, 50, 298, 42, 39, 105, 0, 330, 123, 106,
+    240, 55, 129, 180, 0, 130, 349, 255, 0, 173, 217, 0, 286, 22, 276, 239,
+    0, 0, 186, 281, 44, 0, 148, 40, 0, 0, 0, 0, 241, 0, 122, 36,
+    0, 0, 299, 0, 128, 0, 102, 207, 135, 342, 278, 16, 0, 318, 138, 80,
+    357, 13, 118, 95, 0, 0, 18, 243, 0, 54, 209, 233, 9, 154, 306, 0,
+    119, 34, 348, 146, 125, 127, 142, 47, 265, 41, 134, 169, 340, 253, 301, 0,
+    237, 137, 326, 0, 176, 0, 0, 131, 327, 197, 300, 0, 231, 223, 294, 53,
+    0, 101, 221, 273, 296, 310, 0, 185, 0, 162, 160, 0, 68, 347, 79, 23,
+    247, 263, 183, 82, 116, 216, 0, 297, 287, 67, 0, 258, 212, 0, 65, 72,
+    0, 168, 84, 193, 266, 0, 96, 0, 38, 260, 324, 0, 94, 220, 325, 51,
+    155, 0, 242, 60, 0, 120, 109, 0, 188, 0, 0, 0, 236, 158, 0, 222,
+    98, 211, 282, 351, 213, 316, 93, 164, 322, 309, 304, 171, 0, 107, 257, 0,
+    56, 267, 0, 0, 8, 0, 0, 0, 0, 172, 0, 24, 302, 153, 126, 141,
+    0, 0, 339, 21, 203, 0, 191, 117, 0, 4, 0, 194, 246, 12, 15, 163,
+    219, 0, 0, 0, 92, 235, 187, 214, 5, 43, 0, 313, 262, 331, 0, 0,
+    0, 0, 355, 157, 204, 0, 0, 0, 49, 31, 285, 344, 0, 0, 10, 121,
+    333, 0, 269, 305, 284, 319, 352, 0, 0, 33, 30, 0, 0, 0, 27, 345,
+    250, 0, 32, 77, 35, 0, 0, 0, 88, 346, 334, 174, 182, 0, 0, 0,
+    85, 202, 0, 37, 0, 277, 45, 175, 147, 20, 170, 252, 0, 110, 76, 295,
+    0, 201, 315, 308, 152, 0, 100, 0, 178, 291, 0, 0, 0, 124, 225, 57,
+    0, 238, 156, 192, 64, 74, 75, 0, 303, 114, 78, 61, 0, 230, 254, 167,
+    59, 149, 132, 0, 26, 136, 133, 0, 354, 280, 0, 232, 17, 0, 261, 0,
+    89, 2, 290, 48, 320, 0, 336, 0, 288, 259, 293, 0, 244, 190, 0, 289,
+    356, 234, 0, 189, 161, 66, 90, 108, 328, 0, 151, 7, 206, 145, 104, 28,
+};
+static const word_hash_t g_key_words_hash = {
+    g_key_words_seeds, g_key_words_slots, 255, 511
+};
+#else
+/* g_key_words, 363 words */
+#define KEY_WORDS_HASH_COUNT 363
+static const uint8 g_key_words_seeds[] = {
+    0, 0, 0, 0, 0, 0, 0, 3, 3, 0, 0, 0, 0, 0, 0, 4,
+    0, 0, 2, 0, 1, 3, 0, 4, 3, 0, 1, 0, 2, 0, 0, 0,
+    0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1, 3, 0,
+    0, 0, 5, 3, 0, 3, 3, 0, 2, 0, 0, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 2, 0, 0, 2, 0, 6, 7, 1, 0, 1, 1, 0,
+    4, 2, 1, 0, 0, 2, 0, 2, 0, 0, 0, 2, 0, 1, 2, 0,
+    1, 0, 0, 0, 0, 6, 0, 0, 1, 0, 0, 1, 4, 1, 0, 2,
+    0, 0, 0, 1, 0, 0, 4, 2, 0, 4, 2, 0, 0, 1, 0, 0,
+    0, 0, 0, 0, 0, 2, 4, 1, 1, 0, 1, 0, 1, 0, 0, 0,
+    6, 0, 1, 2, 2, 0, 0, 1, 1, 0, 6, 1, 0, 0, 5, 0,
+    1, 0, 2, 2, 1, 1, 1, 0, 1, 1, 2, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 5, 0, 0, 2, 8, 0, 0, 2, 0, 2,
+    2, 0, 1, 4, 2, 8, 0, 11, 0, 0, 0, 1, 2, 0, 0, 0,
+    0, 1, 3, 2, 0, 0, 1, 0, 0, 0, 2, 4, 2, 0, 0, 0,
+    4, 0, 0, 0, 0, 0, 1, 0, 4, 1, 0, 2, 0, 0, 0, 1,
+    0, 2, 0, 1, 9, 0, 5, 1, 6, 0, 1, 4, 9, 0, 0, 1,
+};
+static const uint16 g_key_words_slots[] = {
+    0, 0, 0, 0, 292, 196, 0, 81, 325, 0, 0, 270, 181, 271, 313, 140,
+    14, 165, 111, 360, 337, 362, 199, 248, 331, 0, 184, 275, 268, 0, 143, 363,
+    249, 264, 0, 0, 0, 0, 345, 0, 139, 0, 198, 361, 0, 11, 224, 150,
+    63, 0, 0, 144, 99, 312, 0, 1, 159, 229, 3, 205, 0, 210, 272, 208,
+    334, 279, 179, 0, 97, 113, 0, 46, 308, 274, 0, 86, 245, 227, 0, 52,
+    0, 323, 73, 0, 218, 6, 0, 0, 29, 0, 0, 19, 0, 0, 228, 355,
+    115, 283, 315, 62, 71, 112, 195, 0, 339, 87, 91, 318, 0, 256, 0, 0,
+    200, 0, 226, 352, 300, 177, 70, 343, 25, 0, 0, 69, 166, 0, 58, 251,
+    215, 340, 83, 0, 103, 0, 0, 50, 298, 42, 39, 105, 0, 332, 123, 106,
+    240, 55, 129, 180, 0, 130, 351, 255, 0, 173, 217, 0, 286, 22, 276, 239,
+    0, 0, 186, 281, 44, 0, 148, 40, 0, 0, 0, 0, 241, 0, 122, 36,
+    0, 0, 299, 0, 128, 0, 102, 207, 135, 344, 278, 16, 0, 319, 138, 80,
+    359, 13, 118, 95, 0, 0, 18, 243, 0, 54, 209, 233, 9, 154, 307, 0,
+    119, 34, 350, 146, 125, 127, 142, 47, 265, 41, 134, 169, 342, 253, 302, 0,
+    237, 137, 328, 0, 176, 0, 0, 131, 329, 197, 301, 0, 231, 223, 294, 53,
+    0, 101, 221, 273, 296, 311, 0, 185, 0, 162, 160, 0, 68, 349, 79, 23,
+    247, 263, 183, 82, 116, 216, 0, 297, 287, 67, 0, 258, 212, 0, 65, 72,
+    0, 168, 84, 193, 266, 0, 96, 0, 38, 260, 326, 0, 94, 220, 327, 51,
+    155, 0, 242, 60, 0, 120, 109, 0, 188, 0, 0, 0, 236, 158, 0, 222,
+    98, 211, 282, 353, 213, 317, 93, 164, 324, 310, 305, 171, 0, 107, 257, 0,
+    56, 267, 0, 0, 8, 0, 0, 0, 0, 172, 0, 24, 303, 153, 126, 141,
+    0, 0, 341, 21, 203, 0, 191, 117, 0, 4, 0, 194, 246, 12, 15, 163,
+    219, 0, 0, 0, 92, 235, 187, 214, 5, 43, 0, 314, 262, 333, 0, 0,
+    0, 0, 357, 157, 204, 0, 0, 0, 49, 31, 285, 346, 0, 0, 10, 121,
+    335, 0, 269, 306, 284, 320, 354, 0, 0, 33, 30, 0, 0, 0, 27, 347,
+    250, 0, 32, 77, 35, 0, 0, 0, 88, 348, 336, 174, 182, 0, 0, 0,
+    85, 202, 0, 37, 0, 277, 45, 175, 147, 20, 170, 252, 0, 110, 76, 295,
+    0, 201, 316, 309, 152, 0, 100, 0, 178, 291, 0, 0, 0, 124, 225, 57,
+    0, 238, 156, 192, 64, 74, 75, 0, 304, 114, 78, 61, 0, 230, 254, 167,
+    59, 149, 132, 0, 26, 136, 133, 0, 356, 280, 0, 232, 17, 0, 261, 0,
+    89, 2, 290, 48, 322, 0, 338, 321, 288, 259, 293, 0, 244, 190, 0, 289,
+    358, 234, 0, 189, 161, 66, 90, 108, 330, 0, 151, 7, 206, 145, 104, 28,
+};
+static const word_hash_t g_key_words_hash = {
+    g_key_words_seeds, g_key_words_slots, 255, 511
+};
+#endif
+
+/* g_reserved_words, 25 words */
+#define RESERVED_WORDS_HASH_COUNT 25
+static const uint8 g_reserved_words_seeds[] = {
+    0, 0, 2, 0, 1, 3, 6, 2, 1, 0, 2, 2, 2, 1, 0, 0,
+};
+static const uint16 g_reserved_words_slots[] = {
+    3, 14, 0, 25, 0, 17, 0, 15, 10, 4, 18, 16, 8, 2, 5, 1,
+    24, 22, 0, 13, 11, 20, 0, 12, 0, 19, 7, 6, 23, 21, 9, 0,
+};
+static const word_hash_t g_reserved_words_hash = {
+    g_reserved_words_seeds, g_reserved_words_slots, 15, 31
+};
+
+/* g_datatype_words, 50 words */
+#define DATATYPE_WORDS_HASH_COUNT 50
+static const uint8 g_datatype_words_seeds[] = {
+    1, 0, 4, 1, 1, 1, 0, 0, 0, 0, 0, 0, 3, 0, 0, 1,
+    0, 5, 2, 9, 0, 1, 2, 2, 9, 1, 2, 0, 0, 0, 1, 6,
+};
+static const uint16 g_datatype_words_slots[] = {
+    17, 3, 29, 37, 48, 33, 21, 2, 0, 0, 23, 13, 44, 41, 0, 0,
+    19, 0, 7, 18, 22, 40, 32, 0, 45, 0, 24, 49, 30, 42, 15, 0,
+    34, 39, 10, 1, 14, 5, 36, 28, 0, 0, 25, 9, 47, 0, 43, 0,
+    11, 20, 38, 16, 26, 6, 50, 0, 35, 0, 27, 4, 46, 12, 8, 31,
+};
+static const word_hash_t g_datatype_words_hash = {
+    g_datatype_words_seeds, g_datatype_words_slots, 31, 63
+};
+
+/* g_datetime_unit_words, 18 words */
+#define DATETIME_UNIT_WORDS_HASH_COUNT 18
+static const uint8 g_datetime_unit_words_seeds[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 2, 2, 0, 2,
+};
+static const uint16 g_datetime_unit_words_slots[] = {
+    0, 0, 8, 17, 10, 15, 0, 0, 0, 0, 14, 6, 16, 0, 3, 18,
+    0, 0, 13, 4, 2, 0, 9, 12, 5, 11, 0, 0, 0, 0, 1, 7,
+};
+static const word_hash_t g_datetime_unit_words_hash = {
+    g_datetime_unit_words_seeds, g_datetime_unit_words_slots, 15, 31
+};
+
+/* g_hint_key_words, 16 words */
+#define HINT_KEY_WORDS_HASH_COUNT 16
+static const uint8 g_hint_key_words_seeds[] = {
+    0, 2, 0, 0, 2, 0, 0, 0,
+};
+static const uint16 g_hint_key_words_slots[] = {
+    16, 0, 0, 15, 0, 14, 0, 1, 12, 11, 0, 0, 6, 0, 0, 8,
+    0, 0, 4, 0, 13, 5, 3, 0, 0, 2, 0, 10, 0, 9, 7, 0,
+};
+static const word_hash_t g_hint_key_words_hash = {
+    g_hint_key_words_seeds, g_hint_key_words_slots, 7, 31
+};
+
+#endif
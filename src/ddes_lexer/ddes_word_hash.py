@@ -0,0 +1,237 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+#
+# CBB is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+# See the Mulan PSL v2 for more details.
+# -------------------------------------------------------------------------
+#
+# ddes_word_hash.py
+#    Generates ddes_word_hash.h, the perfect hash tables of the word tables in ddes_word.c.
+#    Run it again whenever one of those tables changes:
+#        python3 ddes_word_hash.py           rewrite ddes_word_hash.h
+#        python3 ddes_word_hash.py --check   fail when ddes_word_hash.h is stale
+#
+# Every word is hashed once with FNV-1a over its lower case bytes. The low bits of that hash pick
+# a bucket, the seed of the bucket is mixed into the hash and the mixed low bits pick the slot.
+# Seeds are searched bucket by bucket, largest first, until no two words share a slot. The hash
+# functions must stay the same as lex_word_hash and lex_word_hash_slot in ddes_word.c.
+
+import os
+import re
+import sys
+
+WORD_TABLES = (
+    "g_key_words",
+    "g_reserved_words",
+    "g_datatype_words",
+    "g_datetime_unit_words",
+    "g_hint_key_words",
+)
+
+FNV_BASIS = 0x811C9DC5
+FNV_PRIME = 0x01000193
+MASK32 = 0xFFFFFFFF
+MAX_SEED = 0xFF
+WORDS_PER_BUCKET = 2
+SLOTS_PER_LINE = 16
+
+HEADER = """/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * ddes_word_hash.h
+ *
+ *
+ * IDENTIFICATION
+ *    src/ddes_lexer/ddes_word_hash.h
+ *
+ * -------------------------------------------------------------------------
+ */
+
+/* Generated by ddes_word_hash.py from the word tables of ddes_word.c, do not edit. */
+
+#ifndef __DDES_WORD_HASH_H__
+#define __DDES_WORD_HASH_H__
+
+"""
+
+FOOTER = "#endif\n"
+
+
+def word_hash(word):
+    h = FNV_BASIS
+    for c in word.lower().encode():
+        h = ((h ^ c) * FNV_PRIME) & MASK32
+    return h
+
+
+def word_hash_slot(h, seed, mask):
+    h ^= seed
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK32
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK32
+    h ^= h >> 16
+    return h & mask
+
+
+def next_pow2(n):
+    size = 1
+    while size < n:
+        size <<= 1
+    return size
+
+
+def read_table(name, body):
+    # entries under #ifdef/#ifndef are kept with the macros they depend on
+    entries = []
+    conds = []
+    for line in body.splitlines():
+        line = line.strip()
+        directive = re.match(r"#\s*(ifdef|ifndef|else|endif)\b\s*(\w*)", line)
+        if directive is not None:
+            kind, macro = directive.groups()
+            if kind in ("ifdef", "ifndef"):
+                conds.append((macro, kind == "ifdef"))
+            elif kind == "else":
+                conds[-1] = (conds[-1][0], not conds[-1][1])
+            else:
+                conds.pop()
+            continue
+        if line.startswith("#"):
+            sys.exit("%s: unsupported directive '%s'" % (name, line))
+        for word in re.findall(r'CONSTRUCT_TEXT\("([^"]*)"\)', line):
+            entries.append((word, tuple(conds)))
+    return entries
+
+
+def read_tables(path):
+    with open(path, encoding="utf-8") as f:
+        src = f.read()
+    tables = {}
+    for name in WORD_TABLES:
+        found = re.search(r"static \w+ %s\[\] = \{(.*?)\n\};" % name, src, re.S)
+        if found is None:
+            sys.exit("%s: table %s not found" % (path, name))
+        tables[name] = read_table(name, found.group(1))
+    return tables
+
+
+def table_variants(entries):
+    # one word list for every combination of the macros the table depends on
+    macros = sorted({macro for _, conds in entries for macro, _ in conds})
+    for mask in range(1 << len(macros)):
+        defined = {m: bool(mask & (1 << i)) for i, m in enumerate(macros)}
+        words = [w for w, conds in entries if all(defined[m] == want for m, want in conds)]
+        cond = " && ".join(("defined(%s)" if defined[m] else "!defined(%s)") % m for m in macros)
+        yield cond, words
+
+
+def build(name, words):
+    hashes = [word_hash(w) for w in words]
+    seen = {}
+    for i, w in enumerate(words):
+        if w.lower() in seen:
+            sys.exit("%s: word '%s' appears twice" % (name, w))
+        seen[w.lower()] = i
+    if len(set(hashes)) != len(hashes):
+        sys.exit("%s: two words share a hash, change FNV_BASIS" % name)
+
+    slot_count = next_pow2(len(words) + len(words) // 4)
+    bucket_count = next_pow2((len(words) + WORDS_PER_BUCKET - 1) // WORDS_PER_BUCKET)
+    buckets = [[] for _ in range(bucket_count)]
+    for i, h in enumerate(hashes):
+        buckets[h & (bucket_count - 1)].append(i)
+
+    seeds = [0] * bucket_count
+    slots = [0] * slot_count
+    for b in sorted(range(bucket_count), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        for seed in range(MAX_SEED + 1):
+            pos = [word_hash_slot(hashes[i], seed, slot_count - 1) for i in buckets[b]]
+            if len(set(pos)) == len(pos) and all(slots[p] == 0 for p in pos):
+                break
+        else:
+            sys.exit("%s: no seed found for bucket %d" % (name, b))
+        seeds[b] = seed
+        for i, p in zip(buckets[b], pos):
+            slots[p] = i + 1
+    return seeds, slots
+
+
+def format_array(ctype, name, values):
+    lines = ["static const %s %s[] = {" % (ctype, name)]
+    for i in range(0, len(values), SLOTS_PER_LINE):
+        lines.append("    " + ", ".join("%d" % v for v in values[i:i + SLOTS_PER_LINE]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def generate_table(name, words):
+    seeds, slots = build(name, words)
+    upper = name[2:].upper()
+    parts = ["/* %s, %d words */\n" % (name, len(words))]
+    parts.append("#define %s_HASH_COUNT %d\n" % (upper, len(words)))
+    parts.append(format_array("uint8", name + "_seeds", seeds) + "\n")
+    parts.append(format_array("uint16", name + "_slots", slots) + "\n")
+    parts.append("static const word_hash_t %s_hash = {\n    %s_seeds, %s_slots, %d, %d\n};\n" %
+                 (name, name, name, len(seeds) - 1, len(slots) - 1))
+    return "".join(parts)
+
+
+def generate(tables):
+    parts = [HEADER]
+    for name in WORD_TABLES:
+        variants = list(table_variants(tables[name]))
+        if len(variants) == 1:
+            parts.append(generate_table(name, variants[0][1]) + "\n")
+            continue
+        for i, (cond, words) in enumerate(variants):
+            if i == 0:
+                parts.append("#if %s\n" % cond)
+            elif i == len(variants) - 1:
+                parts.append("#else\n")
+            else:
+                parts.append("#elif %s\n" % cond)
+            parts.append(generate_table(name, words))
+        parts.append("#endif\n\n")
+    parts.append(FOOTER)
+    return "".join(parts)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    target = os.path.join(here, "ddes_word_hash.h")
+    text = generate(read_tables(os.path.join(here, "ddes_word.c")))
+    if len(sys.argv) > 1 and sys.argv[1] == "--check":
+        with open(target, encoding="utf-8") as f:
+            if f.read() != text:
+                sys.exit("%s is stale, run %s" % (target, os.path.basename(__file__)))
+        return
+    with open(target, "w", encoding="utf-8") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
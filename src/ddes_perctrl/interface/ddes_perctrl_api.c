@@ -25,6 +25,8 @@
 #ifdef WIN32
 #else
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include "sys/wait.h"
 #endif
 
@@ -36,10 +38,21 @@
 extern "C" {
 #endif
 
-static perctrl_pipes_t g_perctrl = {.req_pipe.fds = {0}, .res_pipe.fds = {0}, .pid = 0};
+static perctrl_pipes_t g_perctrl = {.req_pipe.fds = {0}, .res_pipe.fds = {0}, .pid = 0, .shm_fd = -1, .shm = NULL};
 static bool32 g_is_init = CM_FALSE;
 static spinlock_t g_init_lock = 0;
 
+// slots of the shared memory owned by no client thread
+typedef struct st_perctrl_free_slots {
+    spinlock_t lock;
+    uint32 count;
+    uint32 ids[PERCTRL_SLOT_COUNT];
+    cm_park_t park;
+} perctrl_free_slots_t;
+
+static perctrl_free_slots_t g_free_slots;
+static volatile bool32 g_perctrl_gone = CM_FALSE;
+
 #ifdef WIN32
 status_t perctrl_init(perctrl_pipes_t *perctrl, const char* name)
 {
@@ -56,6 +69,13 @@ status_t exec_perctrl_cmd(perctrl_packet_t *req, perctrl_packet_t *ack)
     return CM_SUCCESS;
 }
 
+static void exec_perctrl_cmd_batch(perctrl_packet_t *reqs, perctrl_packet_t *acks, status_t *rets, uint32 count)
+{
+    for (uint32 i = 0; i < count; i++) {
+        rets[i] = CM_SUCCESS;
+    }
+}
+
 status_t perctrl_receive(int32 fd, perctrl_packet_t *msg)
 {
     return CM_SUCCESS;
@@ -127,6 +147,54 @@ status_t perctrl_send(int32 fd, perctrl_packet_t *msg)
     return CM_SUCCESS;
 }
 
+static void perctrl_free_shm(perctrl_pipes_t *perctrl)
+{
+    if (perctrl->shm != NULL) {
+        (void)munmap(perctrl->shm, sizeof(perctrl_shm_t));
+        perctrl->shm = NULL;
+    }
+    if (perctrl->shm_fd >= 0) {
+        (void)close(perctrl->shm_fd);
+        perctrl->shm_fd = -1;
+    }
+}
+
+/* an unnamed shared memory inherited by perctrl through its fd, falls back to the pipes on failure */
+static void perctrl_create_shm(perctrl_pipes_t *perctrl)
+{
+    char name[MAX_FD_LEN];
+    int32 ret = snprintf_s(name, sizeof(name), sizeof(name) - 1, "/perctrl_%d_%p", (int32)getpid(), perctrl);
+    if (ret < 0) {
+        return;
+    }
+    perctrl->shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (perctrl->shm_fd < 0) {
+        LOG_DEBUG_WAR("create perctrl shared memory failed, errno %d, use pipes only.", errno);
+        return;
+    }
+    (void)shm_unlink(name);
+    if (ftruncate(perctrl->shm_fd, (off_t)sizeof(perctrl_shm_t)) != 0) {
+        LOG_DEBUG_WAR("resize perctrl shared memory failed, errno %d, use pipes only.", errno);
+        perctrl_free_shm(perctrl);
+        return;
+    }
+    void *addr = mmap(NULL, sizeof(perctrl_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, perctrl->shm_fd, 0);
+    if (addr == MAP_FAILED) {
+        LOG_DEBUG_WAR("map perctrl shared memory failed, errno %d, use pipes only.", errno);
+        perctrl_free_shm(perctrl);
+        return;
+    }
+    perctrl->shm = (perctrl_shm_t *)addr;
+    perctrl_shm_init(perctrl->shm);
+
+    GS_INIT_SPIN_LOCK(g_free_slots.lock);
+    cm_park_init(&g_free_slots.park);
+    g_free_slots.count = PERCTRL_SLOT_COUNT;
+    for (uint32 i = 0; i < PERCTRL_SLOT_COUNT; i++) {
+        g_free_slots.ids[i] = i;
+    }
+}
+
 status_t perctrl_init(perctrl_pipes_t *perctrl, const char* name)
 {
     uint32 wait_time = 10;
@@ -136,25 +204,34 @@ status_t perctrl_init(perctrl_pipes_t *perctrl, const char* name)
     if (pipe(perctrl->res_pipe.fds) == -1) {
         return CM_ERROR;
     }
+    perctrl_create_shm(perctrl);
 
     perctrl->pid = fork();
     if (perctrl->pid < 0) {
         LOG_DEBUG_ERR("fork pertctrl fail.");
+        perctrl_free_shm(perctrl);
         return CM_ERROR;
     } else if (perctrl->pid == 0) { // child process
         g_is_init = CM_FALSE;
         char req_fd[MAX_FD_LEN];
         char ack_fd[MAX_FD_LEN];
+        char shm_fd[MAX_FD_LEN];
         (void)prctl(PR_SET_PDEATHSIG, SIGKILL);
         int32 ret = snprintf_s(req_fd, sizeof(req_fd), sizeof(req_fd) - 1, "%d", perctrl->req_pipe.rfd);
         PRTS_RETURN_IFERR(ret);
         ret = snprintf_s(ack_fd, sizeof(ack_fd), sizeof(ack_fd) - 1, "%d", perctrl->res_pipe.wfd);
         PRTS_RETURN_IFERR(ret);
-        
+        ret = snprintf_s(shm_fd, sizeof(shm_fd), sizeof(shm_fd) - 1, "%d", perctrl->shm_fd);
+        PRTS_RETURN_IFERR(ret);
+
         (void)close(perctrl->res_pipe.rfd);
         (void)close(perctrl->req_pipe.wfd);
+        // shm_open sets FD_CLOEXEC, perctrl needs the fd after exec
+        if (perctrl->shm_fd >= 0) {
+            (void)fcntl(perctrl->shm_fd, F_SETFD, 0);
+        }
 
-        if (execlp("perctrl", "perctrl", req_fd, ack_fd, NULL) == -1) {
+        if (execlp("perctrl", "perctrl", req_fd, ack_fd, shm_fd, NULL) == -1) {
             LOG_DEBUG_ERR("execl pertctrl fail.");
             exit(1); // exit child process
         }
@@ -167,13 +244,107 @@ status_t perctrl_init(perctrl_pipes_t *perctrl, const char* name)
     return CM_SUCCESS;
 }
 
-status_t exec_perctrl_cmd(perctrl_packet_t *req, perctrl_packet_t *ack)
+static uint32 perctrl_alloc_slot(bool32 wait)
+{
+    for (;;) {
+        cm_spin_lock(&g_free_slots.lock, NULL);
+        if (g_free_slots.count > 0) {
+            uint32 id = g_free_slots.ids[--g_free_slots.count];
+            cm_spin_unlock(&g_free_slots.lock);
+            return id;
+        }
+        if (!wait) {
+            cm_spin_unlock(&g_free_slots.lock);
+            return CM_INVALID_ID32;
+        }
+        uint32 seq = cm_park_prepare(&g_free_slots.park);
+        cm_spin_unlock(&g_free_slots.lock);
+        cm_park_wait(&g_free_slots.park, seq, PERCTRL_WAIT_SLICE);
+    }
+}
+
+static void perctrl_release_slot(uint32 id)
+{
+    cm_spin_lock(&g_free_slots.lock, NULL);
+    g_free_slots.ids[g_free_slots.count++] = id;
+    cm_spin_unlock(&g_free_slots.lock);
+    cm_park_wake(&g_free_slots.park, 1);
+}
+
+/*
+ * perctrl holds the write end of the ack pipe until it exits, and nothing is written to it in shm mode.
+ * Never reap here, the child belongs to perctrl_uninit and SIGCHLD may be ignored by the host.
+ */
+static bool32 perctrl_server_alive(perctrl_pipes_t *perctrl)
+{
+    struct pollfd pfd = {.fd = perctrl->res_pipe.rfd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, 0) < 0) {
+        return CM_TRUE;
+    }
+    return (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) == 0;
+}
+
+/* *id is CM_INVALID_ID32 when all slots are taken and the caller does not want to wait */
+static status_t perctrl_submit_slot(perctrl_pipes_t *perctrl, const perctrl_packet_t *req, bool32 wait, uint32 *id)
+{
+    perctrl_shm_t *shm = perctrl->shm;
+    if (g_perctrl_gone) {
+        return CM_PIPECLOSED;
+    }
+    *id = perctrl_alloc_slot(wait);
+    if (*id == CM_INVALID_ID32) {
+        return CM_SUCCESS;
+    }
+    perctrl_slot_t *slot = &shm->slots[*id];
+
+    errno_t errcode = memcpy_sp(slot->req, MAX_PACKET_LEN, req->buf, req->head->size);
+    if (errcode != EOK) {
+        perctrl_release_slot(*id);
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+        return CM_ERROR;
+    }
+    (void)cm_atomic32_cas(&slot->state, PERCTRL_SLOT_FREE, PERCTRL_SLOT_SUBMITTED);
+    perctrl_sq_push(shm, *id);
+    cm_park_wake(&shm->doorbell, 1);
+    return CM_SUCCESS;
+}
+
+static status_t perctrl_wait_slot(perctrl_pipes_t *perctrl, uint32 id, perctrl_packet_t *ack)
+{
+    perctrl_slot_t *slot = &perctrl->shm->slots[id];
+
+    while (cm_atomic32_get(&slot->state) != PERCTRL_SLOT_DONE) {
+        uint32 seq = cm_park_prepare(&slot->park);
+        if (cm_atomic32_get(&slot->state) == PERCTRL_SLOT_DONE) {
+            cm_park_cancel(&slot->park);
+            break;
+        }
+        cm_park_wait(&slot->park, seq, PERCTRL_WAIT_SLICE);
+        if (cm_atomic32_get(&slot->state) != PERCTRL_SLOT_DONE && !perctrl_server_alive(perctrl)) {
+            // the slot is left taken, perctrl may be gone in the middle of it
+            g_perctrl_gone = CM_TRUE;
+            LOG_DEBUG_ERR("perctrl exited with requests in flight.");
+            return CM_PIPECLOSED;
+        }
+    }
+
+    uint32 size = ((perctrl_cmd_head_t *)slot->ack)->size;
+    errno_t errcode = memcpy_sp(ack->buf, MAX_PACKET_LEN, slot->ack, MIN(size, MAX_PACKET_LEN));
+    (void)cm_atomic32_cas(&slot->state, PERCTRL_SLOT_DONE, PERCTRL_SLOT_FREE);
+    perctrl_release_slot(id);
+    if (errcode != EOK) {
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+        return CM_ERROR;
+    }
+    return CM_SUCCESS;
+}
+
+static status_t perctrl_ensure_init(void)
 {
-    status_t status;
     if (!g_is_init) {
         cm_spin_lock(&g_init_lock, NULL);
         if (!g_is_init) {
-            status = perctrl_init(&g_perctrl, NULL);
+            status_t status = perctrl_init(&g_perctrl, NULL);
             if (status != CM_SUCCESS) {
                 cm_spin_unlock(&g_init_lock);
                 return status;
@@ -182,6 +353,20 @@ status_t exec_perctrl_cmd(perctrl_packet_t *req, perctrl_packet_t *ack)
         }
         cm_spin_unlock(&g_init_lock);
     }
+    return CM_SUCCESS;
+}
+
+status_t exec_perctrl_cmd(perctrl_packet_t *req, perctrl_packet_t *ack)
+{
+    status_t status;
+    uint32 id;
+
+    CM_RETURN_IFERR(perctrl_ensure_init());
+    if (g_perctrl.shm != NULL) {
+        // many threads may have requests in flight, each one sleeps on its own slot
+        CM_RETURN_IFERR(perctrl_submit_slot(&g_perctrl, req, CM_TRUE, &id));
+        return perctrl_wait_slot(&g_perctrl, id, ack);
+    }
 
     cm_spin_lock(&g_init_lock, NULL);
     status = perctrl_send(g_perctrl.req_pipe.wfd, req);
@@ -200,6 +385,57 @@ status_t exec_perctrl_cmd(perctrl_packet_t *req, perctrl_packet_t *ack)
     return CM_SUCCESS;
 }
 
+/* all requests are in flight together, acks[i] is valid when rets[i] is CM_SUCCESS */
+static void exec_perctrl_cmd_batch(perctrl_packet_t *reqs, perctrl_packet_t *acks, status_t *rets, uint32 count)
+{
+    uint32 ids[PERCTRL_BATCH_MAX];
+    status_t status = perctrl_ensure_init();
+
+    for (uint32 i = 0; i < count; i++) {
+        rets[i] = (status == CM_SUCCESS) ? CM_ERROR : status;
+    }
+    if (status != CM_SUCCESS) {
+        return;
+    }
+    if (g_perctrl.shm == NULL) {
+        for (uint32 i = 0; i < count && status != CM_PIPECLOSED; i++) {
+            status = exec_perctrl_cmd(&reqs[i], &acks[i]);
+            rets[i] = status;
+        }
+        return;
+    }
+
+    for (uint32 done = 0; done < count && status != CM_PIPECLOSED;) {
+        uint32 batch = MIN(count - done, PERCTRL_BATCH_MAX);
+        uint32 taken = 0;
+        uint32 submitted = 0;
+        while (taken < batch) {
+            // only wait for a slot while holding none, other batches may be holding the rest
+            status = perctrl_submit_slot(&g_perctrl, &reqs[done + taken], submitted == 0, &ids[taken]);
+            if (status == CM_PIPECLOSED || (status == CM_SUCCESS && ids[taken] == CM_INVALID_ID32)) {
+                break;
+            }
+            if (status != CM_SUCCESS) {
+                // this request alone failed to go out
+                rets[done + taken] = status;
+                ids[taken] = CM_INVALID_ID32;
+            } else {
+                submitted++;
+            }
+            taken++;
+        }
+        // collect every submitted one, their slots are not reusable before that
+        for (uint32 i = 0; i < taken; i++) {
+            if (ids[i] == CM_INVALID_ID32) {
+                continue;
+            }
+            rets[done + i] = perctrl_wait_slot(&g_perctrl, ids[i], &acks[done + i]);
+            status = (rets[done + i] == CM_PIPECLOSED) ? CM_PIPECLOSED : status;
+        }
+        done += taken;
+    }
+}
+
 __attribute__((destructor)) status_t perctrl_uninit();
 
 status_t perctrl_uninit()
@@ -218,6 +454,7 @@ status_t perctrl_uninit()
                 return CM_ERROR;
             }
             (void)waitpid(g_perctrl.pid, NULL, 0);
+            perctrl_free_shm(&g_perctrl);
         }
         g_is_init = CM_FALSE;
         cm_spin_unlock(&g_init_lock);
@@ -418,19 +655,22 @@ status_t perctrl_scsi3_preempt(const char *iof_dev, int64 rk, int64 sark)
     return perctrl_preempt_impl(iof_dev, rk, sark, &req, &ack);
 }
 
-int32 perctrl_caw_impl(const char *scsi_dev, ctrl_params_t *params, uint64 block_addr, perctrl_packet_t *req,
-    perctrl_packet_t *ack)
+static status_t perctrl_encode_caw(perctrl_packet_t *req, const char *scsi_dev, uint64 block_addr, char *buff,
+    int32 buff_len)
 {
-    int32 errcode = -1;
-    char *errmsg = NULL;
-    req->head->cmd = PERCTRL_CMD_CAW;
     text_t text;
-    text.str = params->buff;
-    text.len = (uint32)params->buff_len;
+    text.str = buff;
+    text.len = (uint32)buff_len;
+    req->head->cmd = PERCTRL_CMD_CAW;
     CM_RETURN_IFERR(ddes_put_str(req, scsi_dev));
     CM_RETURN_IFERR(ddes_put_int64(req, block_addr));
-    CM_RETURN_IFERR(ddes_put_text(req, &text));
-    CM_RETURN_IFERR(exec_perctrl_cmd(req, ack));
+    return ddes_put_text(req, &text);
+}
+
+static int32 perctrl_decode_caw(perctrl_packet_t *ack)
+{
+    int32 errcode = -1;
+    char *errmsg = NULL;
     ddes_init_get(ack);
 
     if (ack->head->result == CM_ERROR) {
@@ -444,6 +684,14 @@ int32 perctrl_caw_impl(const char *scsi_dev, ctrl_params_t *params, uint64 block
     return ack->head->result;
 }
 
+int32 perctrl_caw_impl(const char *scsi_dev, ctrl_params_t *params, uint64 block_addr, perctrl_packet_t *req,
+    perctrl_packet_t *ack)
+{
+    CM_RETURN_IFERR(perctrl_encode_caw(req, scsi_dev, block_addr, params->buff, params->buff_len));
+    CM_RETURN_IFERR(exec_perctrl_cmd(req, ack));
+    return perctrl_decode_caw(ack);
+}
+
 int32 perctrl_scsi3_caw(const char *scsi_dev, uint64 block_addr, char *buff, int32 buff_len)
 {
     perctrl_packet_t req = {0};
@@ -458,6 +706,42 @@ int32 perctrl_scsi3_caw(const char *scsi_dev, uint64 block_addr, char *buff, int
     return perctrl_caw_impl(scsi_dev, &params, block_addr, &req, &ack);
 }
 
+status_t perctrl_scsi3_caw_batch(const char *scsi_dev, perctrl_caw_t *caws, uint32 count)
+{
+    if (count == 0) {
+        return CM_SUCCESS;
+    }
+    // the packets are too big for the stack, they are only used once per batch
+    uint32 size = count * (2 * (uint32)sizeof(perctrl_packet_t) + (uint32)sizeof(status_t) + (uint32)sizeof(uint32));
+    perctrl_packet_t *reqs = (perctrl_packet_t *)malloc(size);
+    if (reqs == NULL) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, size, "perctrl caw batch");
+        return CM_ERROR;
+    }
+    perctrl_packet_t *acks = reqs + count;
+    status_t *rets = (status_t *)(acks + count);
+    uint32 *caw_ids = (uint32 *)(rets + count);
+
+    // a caw that cannot be encoded fails alone, the others go out packed at the front
+    uint32 encoded = 0;
+    for (uint32 i = 0; i < count; i++) {
+        caws[i].ret = init_req_and_ack(&reqs[encoded], &acks[encoded]);
+        if (caws[i].ret == CM_SUCCESS) {
+            caws[i].ret =
+                perctrl_encode_caw(&reqs[encoded], scsi_dev, caws[i].block_addr, caws[i].buff, caws[i].buff_len);
+        }
+        if (caws[i].ret == CM_SUCCESS) {
+            caw_ids[encoded++] = i;
+        }
+    }
+    exec_perctrl_cmd_batch(reqs, acks, rets, encoded);
+    for (uint32 i = 0; i < encoded; i++) {
+        caws[caw_ids[i]].ret = (rets[i] == CM_SUCCESS) ? perctrl_decode_caw(&acks[i]) : rets[i];
+    }
+    free(reqs);
+    return CM_SUCCESS;
+}
+
 status_t perctrl_read_impl(ctrl_params_t *params, const char *iof_dev, perctrl_packet_t *req, perctrl_packet_t *ack)
 {
     int32 errcode = -1;
@@ -42,6 +42,13 @@ typedef struct st_ctrl_params {
     uint32 generation;
 } ctrl_params_t;
 
+typedef struct st_perctrl_caw {
+    uint64 block_addr;
+    char *buff; // compare data followed by write data
+    int32 buff_len;
+    int32 ret; // same as the result of perctrl_scsi3_caw
+} perctrl_caw_t;
+
 status_t perctrl_receive(int32 fd, perctrl_packet_t *msg);
 status_t perctrl_send(int32 fd, perctrl_packet_t *msg);
 
@@ -53,6 +60,8 @@ status_t perctrl_scsi3_release(const char *iof_dev, int64 rk);
 status_t perctrl_scsi3_clear(const char *iof_dev, int64 rk);
 status_t perctrl_scsi3_preempt(const char *iof_dev, int64 rk, int64 sark);
 int32 perctrl_scsi3_caw(const char *scsi_dev, uint64 block_addr, char *buff, int32 buff_len);
+// all caws are in flight at once, each caws[i].ret is set on its own even when others fail
+status_t perctrl_scsi3_caw_batch(const char *scsi_dev, perctrl_caw_t *caws, uint32 count);
 status_t perctrl_scsi3_read(const char *iof_dev, int32 block_addr, uint16 block_count, char *buff, int32 buff_len);
 status_t perctrl_scsi3_write(const char *iof_dev, int32 block_addr, uint16 block_count, char *buff, int32 buff_len);
 status_t perctrl_scsi3_inql(const char *iof_dev, inquiry_data_t *inquiry_data);
@@ -36,6 +36,9 @@
 #include "cm_text.h"
 #include "cm_types.h"
 #include "cm_spinlock.h"
+#include "cm_atomic.h"
+#include "cm_sync.h"
+#include "cm_ring.h"
 
 #define MAX_PACKET_LEN 2048
 #define MAX_FD_LEN 128
@@ -51,10 +54,14 @@ typedef union st_pipe {
     int32 fds[2];
 } pipe_t;
 
+struct st_perctrl_shm;
+
 typedef struct st_perctrl_pipes {
     pipe_t req_pipe; // for sending request
     pipe_t res_pipe; // for receiving response
     pid_t pid;
+    int32 shm_fd;
+    struct st_perctrl_shm *shm; // NULL when only the pipes are usable
 } perctrl_pipes_t;
 
 typedef enum {
@@ -87,6 +94,103 @@ typedef struct st_perctrl_packet {
     char buf_init[MAX_PACKET_LEN];
 } perctrl_packet_t;
 
+/*
+ * perctrl v2: requests travel through memory shared with the perctrl process instead of the pipes.
+ * Clients fill a slot, push its id to the submission ring and sleep on the slot, server workers
+ * pop ids, run the command in place and wake the slot owner. The pipes stay for EXIT and
+ * for telling the server that its parent is gone.
+ */
+#define PERCTRL_SLOT_COUNT   64 // max in-flight requests, power of 2
+#define PERCTRL_WORKER_COUNT 4
+#define PERCTRL_BATCH_MAX    (PERCTRL_SLOT_COUNT / 2) // max slots one batch holds at a time
+#define PERCTRL_SHM_MAGIC    0x32524350 // "PCR2"
+#define PERCTRL_WAIT_SLICE   1000       // ms, waiters re-check the server liveness this often
+
+typedef enum {
+    PERCTRL_SLOT_FREE,
+    PERCTRL_SLOT_SUBMITTED,
+    PERCTRL_SLOT_DONE,
+} perctrl_slot_state_e;
+
+typedef struct st_perctrl_slot {
+    atomic32_t state;
+    cm_park_t park; // the client thread waiting for the result
+    char req[MAX_PACKET_LEN];
+    char ack[MAX_PACKET_LEN];
+} perctrl_slot_t;
+
+typedef struct st_perctrl_sq_cell {
+    atomic_t seq;
+    uint32 slot;
+} perctrl_sq_cell_t;
+
+typedef struct st_perctrl_shm {
+    uint32 magic;
+    uint32 slot_count;
+    char pad0[CM_RING_PAD_SIZE];
+    atomic_t enq_pos;
+    char pad1[CM_RING_PAD_SIZE - sizeof(atomic_t)];
+    atomic_t deq_pos;
+    char pad2[CM_RING_PAD_SIZE - sizeof(atomic_t)];
+    cm_park_t doorbell; // idle server workers
+    perctrl_sq_cell_t cells[PERCTRL_SLOT_COUNT];
+    perctrl_slot_t slots[PERCTRL_SLOT_COUNT];
+} perctrl_shm_t;
+
+static inline void perctrl_shm_init(perctrl_shm_t *shm)
+{
+    shm->magic = PERCTRL_SHM_MAGIC;
+    shm->slot_count = PERCTRL_SLOT_COUNT;
+    shm->enq_pos = 0;
+    shm->deq_pos = 0;
+    cm_park_init_shared(&shm->doorbell);
+    for (uint32 i = 0; i < PERCTRL_SLOT_COUNT; i++) {
+        shm->cells[i].seq = (int64)i;
+        shm->slots[i].state = PERCTRL_SLOT_FREE;
+        cm_park_init_shared(&shm->slots[i].park);
+    }
+}
+
+/* same protocol as cm_ring_t, cells are embedded since the mapping address differs per process */
+static inline void perctrl_sq_push(perctrl_shm_t *shm, uint32 slot)
+{
+    perctrl_sq_cell_t *cell = NULL;
+    int64 pos = cm_atomic_get(&shm->enq_pos);
+
+    // never full, a slot is in the ring at most once
+    for (;;) {
+        cell = &shm->cells[pos & (PERCTRL_SLOT_COUNT - 1)];
+        if (cm_atomic_get(&cell->seq) == pos && cm_atomic_cas(&shm->enq_pos, pos, pos + 1)) {
+            break;
+        }
+        pos = cm_atomic_get(&shm->enq_pos);
+    }
+    cell->slot = slot;
+    (void)cm_atomic_set(&cell->seq, pos + 1);
+}
+
+static inline bool32 perctrl_sq_pop(perctrl_shm_t *shm, uint32 *slot)
+{
+    perctrl_sq_cell_t *cell = NULL;
+    int64 pos = cm_atomic_get(&shm->deq_pos);
+
+    for (;;) {
+        cell = &shm->cells[pos & (PERCTRL_SLOT_COUNT - 1)];
+        int64 diff = cm_atomic_get(&cell->seq) - (pos + 1);
+        if (diff == 0) {
+            if (cm_atomic_cas(&shm->deq_pos, pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return CM_FALSE;
+        }
+        pos = cm_atomic_get(&shm->deq_pos);
+    }
+    *slot = cell->slot;
+    (void)cm_atomic_set(&cell->seq, pos + PERCTRL_SLOT_COUNT);
+    return CM_TRUE;
+}
+
 #define DDES_WRITE_ADDR(pack) ((pack)->buf + (pack)->head->size)
 #define DDES_REMAIN_SIZE(pack) (MAX_PACKET_LEN - ((pack)->head->size))
 #define DDES_READ_ADDR(pack) ((pack)->buf + (pack)->offset)
@@ -23,7 +23,13 @@
  */
 
 #include "cm_signal.h"
+#include "cm_thread.h"
+#include "cm_hash.h"
 #include "ddes_perctrl_server.h"
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 static int req_fd = 0;
 static int ack_fd = 0;
@@ -32,34 +38,168 @@ static int ack_fd = 0;
 #define PERCTRL_ARG_COUNT_1 1
 #define PERCTRL_ARG_COUNT_2 2
 #define PERCTRL_ARG_COUNT_3 3
+#define PERCTRL_ARG_COUNT_4 4
+
+#define PERCTRL_FD_BUCKETS 64
+#define PERCTRL_FD_MAX_CACHED 256
 
 #ifndef WIN32
-static status_t ddes_open_scsi_dev(const char *scsi_dev, int32 *fd)
+/*
+ * Devices stay open between requests. An entry is dropped when a command on it fails
+ * or when the path no longer names the device it was opened on.
+ */
+typedef struct st_perctrl_dev {
+    char path[CM_FILE_NAME_BUFFER_SIZE];
+    int32 flags;
+    int32 fd;
+    dev_t rdev;
+    ino_t ino;
+    uint32 refs;
+    bool32 cached;
+    struct st_perctrl_dev *next;
+} perctrl_dev_t;
+
+static spinlock_t g_dev_lock = 0;
+static perctrl_dev_t *g_dev_cache[PERCTRL_FD_BUCKETS];
+static uint32 g_dev_count = 0;
+static thread_local_var char g_align_buf[MAX_PACKET_LEN] __attribute__((aligned(PERCTRL_ALIGN_SIZE)));
+
+static inline uint32 ddes_dev_bucket(const char *path)
+{
+    return cm_hash_bytes((const uint8 *)path, (uint32)strlen(path), PERCTRL_FD_BUCKETS);
+}
+
+// caller holds g_dev_lock
+static void ddes_unlink_dev(perctrl_dev_t *dev)
+{
+    perctrl_dev_t **prev = &g_dev_cache[ddes_dev_bucket(dev->path)];
+    while (*prev != NULL) {
+        if (*prev == dev) {
+            *prev = dev->next;
+            dev->cached = CM_FALSE;
+            g_dev_count--;
+            return;
+        }
+        prev = &(*prev)->next;
+    }
+}
+
+static perctrl_dev_t *ddes_find_dev(const char *path, int32 flags, const struct stat *st)
 {
-    if (scsi_dev == NULL) {
+    perctrl_dev_t *dev = NULL;
+
+    cm_spin_lock(&g_dev_lock, NULL);
+    for (dev = g_dev_cache[ddes_dev_bucket(path)]; dev != NULL; dev = dev->next) {
+        if (dev->flags == flags && strcmp(dev->path, path) == 0) {
+            break;
+        }
+    }
+    if (dev != NULL && (dev->rdev != st->st_rdev || dev->ino != st->st_ino)) {
+        // the path was pointed to another device, retire the old fd
+        ddes_unlink_dev(dev);
+        if (dev->refs == 0) {
+            (void)close(dev->fd);
+            free(dev);
+        }
+        dev = NULL;
+    }
+    if (dev != NULL) {
+        dev->refs++;
+    }
+    cm_spin_unlock(&g_dev_lock);
+    return dev;
+}
+
+static status_t ddes_open_dev(const char *path, int32 flags, perctrl_dev_t **result)
+{
+    struct stat st;
+    if (path == NULL || stat(path, &st) != 0) {
+        LOG_DEBUG_ERR("Stat dev %s failed, errno %d.", path == NULL ? "" : path, errno);
+        return CM_ERROR;
+    }
+    *result = ddes_find_dev(path, flags, &st);
+    if (*result != NULL) {
+        return CM_SUCCESS;
+    }
+
+    perctrl_dev_t *dev = (perctrl_dev_t *)malloc(sizeof(perctrl_dev_t));
+    if (dev == NULL) {
+        CM_THROW_ERROR(ERR_ALLOC_MEMORY, (uint64)sizeof(perctrl_dev_t), "perctrl device");
         return CM_ERROR;
     }
-    *fd = open(scsi_dev, O_RDWR | O_DIRECT | O_SYNC);
-    if (*fd < 0) {
-        LOG_DEBUG_ERR("Open dev %s failed, errno %d.", scsi_dev, errno);
+    if (strcpy_s(dev->path, sizeof(dev->path), path) != EOK) {
+        free(dev);
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "device path");
         return CM_ERROR;
     }
+    dev->fd = open(path, flags);
+    if (dev->fd < 0) {
+        LOG_DEBUG_ERR("Open dev %s failed, errno %d.", path, errno);
+        free(dev);
+        return CM_ERROR;
+    }
+    dev->flags = flags;
+    dev->rdev = st.st_rdev;
+    dev->ino = st.st_ino;
+    dev->refs = 1;
+    dev->cached = CM_FALSE;
+    dev->next = NULL;
+
+    cm_spin_lock(&g_dev_lock, NULL);
+    if (g_dev_count < PERCTRL_FD_MAX_CACHED) {
+        uint32 bucket = ddes_dev_bucket(path);
+        dev->next = g_dev_cache[bucket];
+        g_dev_cache[bucket] = dev;
+        dev->cached = CM_TRUE;
+        g_dev_count++;
+    }
+    cm_spin_unlock(&g_dev_lock);
+    *result = dev;
     return CM_SUCCESS;
 }
 
-static int32 ddes_open_iof_dev(const char *iof_dev, int32 *fd)
+static void ddes_close_dev(perctrl_dev_t *dev, int32 ret)
 {
-    if (iof_dev == NULL) {
-        return CM_ERROR;
+    cm_spin_lock(&g_dev_lock, NULL);
+    if (ret == CM_ERROR && dev->cached) {
+        ddes_unlink_dev(dev);
     }
+    dev->refs--;
+    bool32 release = (!dev->cached && dev->refs == 0);
+    cm_spin_unlock(&g_dev_lock);
 
-    *fd = open(iof_dev, O_RDWR);
-    if (*fd < 0) {
-        LOG_DEBUG_ERR("Open dev %s failed, errno %d.", iof_dev, errno);
-        return CM_ERROR;
+    if (release) {
+        (void)close(dev->fd);
+        free(dev);
     }
+}
 
-    return CM_SUCCESS;
+static inline status_t ddes_open_scsi_dev(const char *scsi_dev, perctrl_dev_t **dev)
+{
+    return ddes_open_dev(scsi_dev, O_RDWR | O_DIRECT | O_SYNC, dev);
+}
+
+static inline status_t ddes_open_iof_dev(const char *iof_dev, perctrl_dev_t **dev)
+{
+    return ddes_open_dev(iof_dev, O_RDWR, dev);
+}
+
+/* O_DIRECT wants an aligned buffer, requests never exceed one packet */
+static char *ddes_get_align_buf(const text_t *text)
+{
+    if (text->len > MAX_PACKET_LEN) {
+        CM_THROW_ERROR(ERR_INVALID_PARAM, "perctrl buffer length");
+        return NULL;
+    }
+    if (text->len == 0) {
+        return g_align_buf;
+    }
+    errno_t errcode = memcpy_sp(g_align_buf, MAX_PACKET_LEN, text->str, text->len);
+    if (errcode != EOK) {
+        CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
+        return NULL;
+    }
+    return g_align_buf;
 }
 
 static void ddes_return_error(perctrl_packet_t *req, perctrl_packet_t *ack)
@@ -84,98 +224,98 @@ static void ddes_return_success(perctrl_packet_t *req, perctrl_packet_t *ack, in
 
 int32 exec_register(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 sark;
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
     CM_RETURN_IFERR(ddes_get_int64(req, &sark));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    int32 ret = cm_scsi3_register(fd, sark);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    int32 ret = cm_scsi3_register(dev->fd, sark);
     LOG_DEBUG_INF("Exec register ret %d.\n", ret);
-    (void)close(fd);
+    ddes_close_dev(dev, ret);
     return ret;
 }
 
 int32 exec_unregister(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 rk;
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
     CM_RETURN_IFERR(ddes_get_int64(req, &rk));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    int32 ret = cm_scsi3_unregister(fd, rk);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    int32 ret = cm_scsi3_unregister(dev->fd, rk);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec unregister ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_reserve(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 rk;
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
     CM_RETURN_IFERR(ddes_get_int64(req, &rk));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_reserve(fd, rk);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_reserve(dev->fd, rk);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec reserve ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_release(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 rk;
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
     CM_RETURN_IFERR(ddes_get_int64(req, &rk));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_release(fd, rk);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_release(dev->fd, rk);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec release ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_clear(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 rk;
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
     CM_RETURN_IFERR(ddes_get_int64(req, &rk));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_clear(fd, rk);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_clear(dev->fd, rk);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec clear ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_preempt(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 rk, sark;
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
     CM_RETURN_IFERR(ddes_get_int64(req, &rk));
     CM_RETURN_IFERR(ddes_get_int64(req, &sark));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_preempt(fd, rk, sark);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_preempt(dev->fd, rk, sark);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec preempt ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_caw(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     uint64 block_addr;
     text_t text = CM_NULL_TEXT;
     char *scsi_dev = NULL;
@@ -184,33 +324,22 @@ int32 exec_caw(perctrl_packet_t *req, perctrl_packet_t *ack)
     CM_RETURN_IFERR(ddes_get_int64(req, (int64 *)&block_addr));
     CM_RETURN_IFERR(ddes_get_text(req, &text));
 
-    char *buff = (char *)ddes_malloc_align(PERCTRL_ALIGN_SIZE, text.len);
+    char *buff = ddes_get_align_buf(&text);
     if (buff == NULL) {
-        LOG_DEBUG_ERR("Failed to alloc memory.\n");
-        return CM_ERROR;
-    }
-    errno_t errcode = memcpy_sp(buff, text.len, text.str, text.len);
-    if (errcode != EOK) {
-        free(buff);
-        CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
         return CM_ERROR;
     }
 
-    int32 ret = ddes_open_scsi_dev(scsi_dev, &fd);
-    if (ret != CM_SUCCESS) {
-        free(buff);
-        return CM_ERROR;
-    }
-    ret = cm_scsi3_caw(fd, block_addr, buff, (int32)text.len);
+    CM_RETURN_IFERR(ddes_open_scsi_dev(scsi_dev, &dev));
+    int32 ret = cm_scsi3_caw(dev->fd, block_addr, buff, (int32)text.len);
     LOG_DEBUG_INF("Exec caw ret %d.\n", ret);
-    free(buff);
-    (void)close(fd);
+    ddes_close_dev(dev, ret);
     return ret;
 }
 
 int32 exec_read(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd, block_addr;
+    perctrl_dev_t *dev = NULL;
+    int32 block_addr;
     uint16 block_count;
     text_t text = CM_NULL_TEXT;
     char *iof_dev = NULL;
@@ -219,34 +348,22 @@ int32 exec_read(perctrl_packet_t *req, perctrl_packet_t *ack)
     CM_RETURN_IFERR(ddes_get_int32(req, &block_addr));
     CM_RETURN_IFERR(ddes_get_int32(req, (int32 *)&block_count));
     CM_RETURN_IFERR(ddes_get_text(req, &text));
-    char *buff = (char *)ddes_malloc_align(PERCTRL_ALIGN_SIZE, text.len);
+    char *buff = ddes_get_align_buf(&text);
     if (buff == NULL) {
-        LOG_DEBUG_ERR("Failed to alloc memory.\n");
-        return CM_ERROR;
-    }
-
-    errno_t errcode = memcpy_sp(buff, text.len, text.str, text.len);
-    if (errcode != EOK) {
-        free(buff);
-        CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
         return CM_ERROR;
     }
 
-    status_t ret = ddes_open_scsi_dev(iof_dev, &fd);
-    if (ret != CM_SUCCESS) {
-        free(buff);
-        return CM_ERROR;
-    }
-    ret = cm_scsi3_read(fd, block_addr, block_count, buff, (int32)text.len);
-    free(buff);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_scsi_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_read(dev->fd, block_addr, block_count, buff, (int32)text.len);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec read ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_write(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd, block_addr;
+    perctrl_dev_t *dev = NULL;
+    int32 block_addr;
     uint16 block_count;
     text_t text = CM_NULL_TEXT;
     char *iof_dev = NULL;
@@ -255,34 +372,21 @@ int32 exec_write(perctrl_packet_t *req, perctrl_packet_t *ack)
     CM_RETURN_IFERR(ddes_get_int32(req, &block_addr));
     CM_RETURN_IFERR(ddes_get_int32(req, (int32 *)&block_count));
     CM_RETURN_IFERR(ddes_get_text(req, &text));
-    char *buff = (char *)ddes_malloc_align(PERCTRL_ALIGN_SIZE, text.len);
+    char *buff = ddes_get_align_buf(&text);
     if (buff == NULL) {
-        LOG_DEBUG_ERR("Failed to alloc memory.\n");
         return CM_ERROR;
     }
 
-    errno_t errcode = memcpy_sp(buff, text.len, text.str, text.len);
-    if (errcode != EOK) {
-        free(buff);
-        CM_THROW_ERROR(ERR_SYSTEM_CALL, errcode);
-        return CM_ERROR;
-    }
-
-    status_t ret = ddes_open_scsi_dev(iof_dev, &fd);
-    if (ret != CM_SUCCESS) {
-        free(buff);
-        return CM_ERROR;
-    }
-    ret = cm_scsi3_write(fd, block_addr, block_count, buff, (int32)text.len);
-    free(buff);
-    (void)close(fd);
+    CM_RETURN_IFERR(ddes_open_scsi_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_write(dev->fd, block_addr, block_count, buff, (int32)text.len);
+    ddes_close_dev(dev, ret);
     LOG_DEBUG_INF("Exec write ret %d.\n", ret);
     return ret;
 }
 
 int32 exec_inql(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     inquiry_data_t inquiry_data;
     errno_t errcode = memset_sp(&inquiry_data, sizeof(inquiry_data), 0, sizeof(inquiry_data));
     securec_check_ret(errcode);
@@ -292,15 +396,14 @@ int32 exec_inql(perctrl_packet_t *req, perctrl_packet_t *ack)
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_inql(fd, &inquiry_data);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_inql(dev->fd, &inquiry_data);
     LOG_DEBUG_INF("Exec inql ret %d.\n", ret);
+    ddes_close_dev(dev, ret);
     if (ret != CM_SUCCESS) {
-        (void)close(fd);
         return ret;
     }
 
-    (void)close(fd);
     errcode = memcpy_sp(text.str, MAX_PACKET_LEN, (char *)&inquiry_data, sizeof(inquiry_data_t));
     MEMS_RETURN_IFERR(errcode);
     text.len = sizeof(inquiry_data_t);
@@ -310,7 +413,7 @@ int32 exec_inql(perctrl_packet_t *req, perctrl_packet_t *ack)
 
 int32 exec_rkeys(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int32 key_count = (int32)CM_MAX_RKEY_COUNT;
     uint32 generation;
     int64 reg_keys[CM_MAX_RKEY_COUNT] = {0};
@@ -320,15 +423,14 @@ int32 exec_rkeys(perctrl_packet_t *req, perctrl_packet_t *ack)
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_rkeys(fd, reg_keys, &key_count, &generation);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_rkeys(dev->fd, reg_keys, &key_count, &generation);
     LOG_DEBUG_INF("Exec rkeys ret %d.\n", ret);
+    ddes_close_dev(dev, ret);
     if (ret != CM_SUCCESS) {
-        (void)close(fd);
         return ret;
     }
 
-    (void)close(fd);
     errno_t errcode = memcpy_sp(text.str, sizeof(reg_keys), (char *)reg_keys, sizeof(reg_keys));
     MEMS_RETURN_IFERR(errcode);
     text.len = sizeof(reg_keys);
@@ -346,7 +448,7 @@ int32 exec_rkeys(perctrl_packet_t *req, perctrl_packet_t *ack)
 
 int32 exec_rres(perctrl_packet_t *req, perctrl_packet_t *ack)
 {
-    int32 fd;
+    perctrl_dev_t *dev = NULL;
     int64 rk = 0;
     uint32 generation;
     text_t text;
@@ -355,15 +457,14 @@ int32 exec_rres(perctrl_packet_t *req, perctrl_packet_t *ack)
     char *iof_dev = NULL;
     ddes_init_get(req);
     CM_RETURN_IFERR(ddes_get_str(req, &iof_dev));
-    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &fd));
-    status_t ret = cm_scsi3_rres(fd, &rk, &generation);
+    CM_RETURN_IFERR(ddes_open_iof_dev(iof_dev, &dev));
+    status_t ret = cm_scsi3_rres(dev->fd, &rk, &generation);
     LOG_DEBUG_INF("Exec rres ret %d.\n", ret);
+    ddes_close_dev(dev, ret);
     if (ret != CM_SUCCESS) {
-        (void)close(fd);
         return ret;
     }
 
-    (void)close(fd);
     *(int64 *)text.str = rk;
     text.len = sizeof(int64);
     CM_RETURN_IFERR(ddes_put_text(ack, &text));
@@ -442,6 +543,71 @@ static inline void reset_req_ack(perctrl_packet_t *req, perctrl_packet_t *ack)
     ack->head->cmd = 0;
 }
 
+static perctrl_shm_t *g_shm = NULL;
+static thread_t g_workers[PERCTRL_WORKER_COUNT];
+
+static void perctrl_worker_proc(thread_t *thread)
+{
+    perctrl_packet_t req = {0};
+    perctrl_packet_t ack = {0};
+    uint32 id;
+
+    cm_set_thread_name("perctrl_worker");
+    for (;;) {
+        if (!perctrl_sq_pop(g_shm, &id)) {
+            uint32 seq = cm_park_prepare(&g_shm->doorbell);
+            if (!perctrl_sq_pop(g_shm, &id)) {
+                cm_park_wait(&g_shm->doorbell, seq, PERCTRL_WAIT_SLICE);
+                continue;
+            }
+            cm_park_cancel(&g_shm->doorbell);
+        }
+
+        perctrl_slot_t *slot = &g_shm->slots[id % PERCTRL_SLOT_COUNT];
+        req.buf = slot->req;
+        req.head = (perctrl_cmd_head_t *)req.buf;
+        ack.buf = slot->ack;
+        ack.head = (perctrl_cmd_head_t *)ack.buf;
+        ack.head->size = (uint32)sizeof(perctrl_cmd_head_t);
+        ack.head->cmd = 0;
+        if (req.head->cmd == PERCTRL_CMD_EXIT) {
+            LOG_DEBUG_ERR("EXIT is only accepted from the pipe.");
+            ddes_return_error(&req, &ack);
+        } else if (exec_perctrl_req(&req, &ack) == CM_ERROR) {
+            LOG_DEBUG_ERR("Failed to exec perctrl req.");
+        }
+
+        (void)cm_atomic32_cas(&slot->state, PERCTRL_SLOT_SUBMITTED, PERCTRL_SLOT_DONE);
+        cm_park_wake(&slot->park, 1);
+    }
+}
+
+static status_t perctrl_start_workers(int32 shm_fd)
+{
+    if (shm_fd < 0) {
+        return CM_SUCCESS; // the client could not create it, serve the pipe only
+    }
+    void *addr = mmap(NULL, sizeof(perctrl_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    (void)close(shm_fd);
+    if (addr == MAP_FAILED) {
+        LOG_RUN_ERR("Failed to map the shared memory, errno %d.", errno);
+        return CM_ERROR;
+    }
+    g_shm = (perctrl_shm_t *)addr;
+    if (g_shm->magic != PERCTRL_SHM_MAGIC || g_shm->slot_count != PERCTRL_SLOT_COUNT) {
+        LOG_RUN_ERR("The shared memory does not match this perctrl.");
+        return CM_ERROR;
+    }
+
+    for (uint32 i = 0; i < PERCTRL_WORKER_COUNT; i++) {
+        if (cm_create_thread(perctrl_worker_proc, 0, NULL, &g_workers[i]) != CM_SUCCESS) {
+            LOG_RUN_ERR("Failed to create perctrl worker %u.", i);
+            return CM_ERROR;
+        }
+    }
+    return CM_SUCCESS;
+}
+
 static int32 perctrl_proc()
 {
     perctrl_packet_t req = {0};
@@ -492,14 +658,17 @@ int main(int argc, char **argv)
         return CM_ERROR;
     }
 
-    if (argc != PERCTRL_ARG_COUNT_3) {
+    if (argc != PERCTRL_ARG_COUNT_3 && argc != PERCTRL_ARG_COUNT_4) {
         (void)printf("Invalid parameters count:%d.\n", argc);
-        (void)printf("perctrl <req_fd> <ack_fd>\n");
+        (void)printf("perctrl <req_fd> <ack_fd> [shm_fd]\n");
         return CM_ERROR;
     }
 
     req_fd = atoi(argv[PERCTRL_ARG_COUNT_1]);
     ack_fd = atoi(argv[PERCTRL_ARG_COUNT_2]);
+    if (argc == PERCTRL_ARG_COUNT_4 && perctrl_start_workers(atoi(argv[PERCTRL_ARG_COUNT_3])) != CM_SUCCESS) {
+        return CM_ERROR;
+    }
     return perctrl_proc();
 #else
     return CM_SUCCESS;
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2022 Huawei Technologies Co.,Ltd.
+ *
+ * CBB is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * -------------------------------------------------------------------------
+ *
+ * ddes_trace_decode.c
+ *
+ *
+ * IDENTIFICATION
+ *    src/ddes_trace/ddes_trace_decode.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cm_log.h"
+#include "cm_date.h"
+
+/* renders binary trace files written by cm_trace_start as text, one line per record like the debug log */
+#define TRACE_SPEC_LEN      32
+#define TRACE_MAX_RECORD    (uint32)(sizeof(cm_trace_head_t) + sizeof(cm_trace_define_t) + 2 * UINT16_MAX)
+#define TRACE_MAX_POINTS    65536
+
+typedef struct st_decode_site {
+    cm_trace_define_t define;
+    char *file;
+    char *format;
+} decode_site_t;
+
+typedef struct st_decode_ctx {
+    cm_trace_file_t file;
+    bool32 has_file;
+    decode_site_t *sites[TRACE_MAX_POINTS + 1];
+    char *buf;
+} decode_ctx_t;
+
+static decode_ctx_t g_decode;
+
+static void trace_reset_sites(void)
+{
+    for (uint32 i = 0; i <= TRACE_MAX_POINTS; i++) {
+        CM_FREE_PTR(g_decode.sites[i]);
+    }
+}
+
+static void trace_decode_file_head(const char *body, uint32 size)
+{
+    if (size < sizeof(cm_trace_file_t) || ((const cm_trace_file_t *)body)->magic != CM_TRACE_MAGIC) {
+        (void)fprintf(stderr, "bad trace file head\n");
+        return;
+    }
+    trace_reset_sites();
+    (void)memcpy_s(&g_decode.file, sizeof(cm_trace_file_t), body, sizeof(cm_trace_file_t));
+    g_decode.file.module[CM_MAX_LOG_MODULE_NAME - 1] = '\0';
+    g_decode.has_file = CM_TRUE;
+}
+
+static void trace_decode_define(const cm_trace_head_t *head, const char *body, uint32 size)
+{
+    const cm_trace_define_t *define = (const cm_trace_define_t *)body;
+    if (head->id == 0 || head->id > TRACE_MAX_POINTS || size < sizeof(cm_trace_define_t) ||
+        size < sizeof(cm_trace_define_t) + define->file_len + define->format_len) {
+        (void)fprintf(stderr, "bad trace definition %u\n", head->id);
+        return;
+    }
+
+    decode_site_t *site = (decode_site_t *)malloc(sizeof(decode_site_t) + define->file_len + define->format_len + 2);
+    if (site == NULL) {
+        return;
+    }
+    site->define = *define;
+    site->file = (char *)(site + 1);
+    site->format = site->file + define->file_len + 1;
+    body += sizeof(cm_trace_define_t);
+    (void)memcpy_s(site->file, define->file_len + 1, body, define->file_len);
+    site->file[define->file_len] = '\0';
+    (void)memcpy_s(site->format, define->format_len + 1, body + define->file_len, define->format_len);
+    site->format[define->format_len] = '\0';
+
+    CM_FREE_PTR(g_decode.sites[head->id]);
+    g_decode.sites[head->id] = site;
+}
+
+static void trace_print_time(uint64 tick)
+{
+    char date[CM_MAX_TIME_STRLEN];
+    struct tm tm;
+    int64 usec = 0;
+
+    if (g_decode.has_file && g_decode.file.tick_hz != 0) {
+        int64 diff = (int64)(tick - g_decode.file.base_tick);
+        int64 hz = (int64)g_decode.file.tick_hz;
+        usec = diff / hz * (int64)MICROSECS_PER_SECOND + diff % hz * (int64)MICROSECS_PER_SECOND / hz;
+    }
+    usec += (int64)g_decode.file.base_usec;
+
+    time_t sec = (time_t)(usec / (int64)MICROSECS_PER_SECOND);
+    (void)localtime_r(&sec, &tm);
+    (void)strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+    (void)printf("%s.%06lld|", date, (long long)(usec % (int64)MICROSECS_PER_SECOND));
+}
+
+// prints one conversion, returns the bytes of body it consumed or -1 when the arguments run out
+static int32 trace_print_arg(const char *spec, uint8 type, const char *arg, const char *end)
+{
+    char str[CM_TRACE_MAX_STR + 1];
+
+    switch (type) {
+        case CM_TRACE_ARG_INT32:
+            if (end - arg < (int64)sizeof(int32)) {
+                return -1;
+            }
+            (void)printf(spec, *(const int32 *)arg);
+            return (int32)sizeof(int32);
+        case CM_TRACE_ARG_INT64:
+            if (end - arg < (int64)sizeof(int64)) {
+                return -1;
+            }
+            (void)printf(spec, *(const int64 *)arg);
+            return (int32)sizeof(int64);
+        case CM_TRACE_ARG_DOUBLE:
+            if (end - arg < (int64)sizeof(double)) {
+                return -1;
+            }
+            (void)printf(spec, *(const double *)arg);
+            return (int32)sizeof(double);
+        case CM_TRACE_ARG_PTR:
+            if (end - arg < (int64)sizeof(uint64)) {
+                return -1;
+            }
+            (void)printf(spec, (void *)(uintptr_t)*(const uint64 *)arg);
+            return (int32)sizeof(uint64);
+        case CM_TRACE_ARG_STR: {
+            if (end - arg < (int64)sizeof(uint16)) {
+                return -1;
+            }
+            uint16 len = *(const uint16 *)arg;
+            if (len > CM_TRACE_MAX_STR || end - arg < (int64)sizeof(uint16) + len) {
+                return -1;
+            }
+            if (len > 0) {
+                (void)memcpy_s(str, sizeof(str), arg + sizeof(uint16), len);
+            }
+            str[len] = '\0';
+            (void)printf(spec, str);
+            return (int32)sizeof(uint16) + len;
+        }
+        default:
+            return -1;
+    }
+}
+
+static void trace_print_message(const decode_site_t *site, const char *arg, const char *end)
+{
+    const char *ptr = site->format;
+    char spec[TRACE_SPEC_LEN];
+    uint32 argi = 0;
+
+    while (*ptr != '\0') {
+        if (*ptr != '%' || argi >= site->define.argc) {
+            (void)putchar(*ptr++);
+            continue;
+        }
+        if (ptr[1] == '%') {
+            (void)putchar('%');
+            ptr += 2;
+            continue;
+        }
+
+        // copy one conversion spec, a '*' is replaced by the recorded int
+        uint32 len = 0;
+        spec[len++] = *ptr++;
+        while (*ptr != '\0' && strchr("diuxXoceEfFgGsp", *ptr) == NULL && len < TRACE_SPEC_LEN - 12) {
+            if (*ptr == '*' && argi < site->define.argc && end - arg >= (int64)sizeof(int32)) {
+                int ret = snprintf_s(spec + len, TRACE_SPEC_LEN - len, TRACE_SPEC_LEN - len - 1, "%d",
+                    *(const int32 *)arg);
+                len += (ret > 0) ? (uint32)ret : 0;
+                arg += sizeof(int32);
+                argi++;
+                ptr++;
+                continue;
+            }
+            spec[len++] = *ptr++;
+        }
+        if (*ptr == '\0' || argi >= site->define.argc) {
+            spec[len] = '\0';
+            (void)fputs(spec, stdout);
+            continue;
+        }
+        spec[len++] = *ptr++;
+        spec[len] = '\0';
+
+        int32 used = trace_print_arg(spec, site->define.arg_type[argi++], arg, end);
+        if (used < 0) {
+            (void)fputs("<truncated>", stdout);
+            return;
+        }
+        arg += used;
+    }
+}
+
+static void trace_decode_event(const cm_trace_head_t *head, const char *body, uint32 size)
+{
+    static const char *level_str[] = { "ERROR", "WARN", "INFO" };
+    const decode_site_t *site = (head->id <= TRACE_MAX_POINTS) ? g_decode.sites[head->id] : NULL;
+
+    trace_print_time(head->tick);
+    if (site == NULL) {
+        (void)printf("%s|%u|?>unknown trace point %u\n", g_decode.file.module, head->tid, head->id);
+        return;
+    }
+    (void)printf("%s|%u|%s>", g_decode.file.module, head->tid,
+        site->define.level <= LEVEL_INFO ? level_str[site->define.level] : "INFO");
+    trace_print_message(site, body, body + size);
+    (void)printf(" [%s:%u]\n", site->file, site->define.line);
+}
+
+static int32 trace_decode(const char *name)
+{
+    cm_trace_head_t head;
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL) {
+        (void)fprintf(stderr, "can not open %s\n", name);
+        return CM_ERROR;
+    }
+
+    while (fread(&head, sizeof(head), 1, fp) == 1) {
+        if (head.size < sizeof(head) || head.size > TRACE_MAX_RECORD) {
+            (void)fprintf(stderr, "%s: bad record size %u, stop\n", name, head.size);
+            (void)fclose(fp);
+            return CM_ERROR;
+        }
+        uint32 size = head.size - (uint32)sizeof(head);
+        if (size > 0 && fread(g_decode.buf, size, 1, fp) != 1) {
+            (void)fprintf(stderr, "%s: truncated record\n", name);
+            break;
+        }
+
+        switch (head.kind) {
+            case CM_TRACE_FILE:
+                trace_decode_file_head(g_decode.buf, size);
+                break;
+            case CM_TRACE_DEFINE:
+                trace_decode_define(&head, g_decode.buf, size);
+                break;
+            case CM_TRACE_EVENT:
+                trace_decode_event(&head, g_decode.buf, size);
+                break;
+            default:
+                (void)fprintf(stderr, "%s: unknown record kind %u\n", name, (uint32)head.kind);
+                break;
+        }
+    }
+
+    (void)fclose(fp);
+    return CM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    int32 ret = CM_SUCCESS;
+
+    if (argc < 2) {
+        (void)printf("trace_decode <trace file> [<trace file> ...]\n");
+        (void)printf("  files of one run are decoded in the given order\n");
+        return CM_ERROR;
+    }
+
+    g_decode.buf = (char *)malloc(TRACE_MAX_RECORD);
+    if (g_decode.buf == NULL) {
+        return CM_ERROR;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (trace_decode(argv[i]) != CM_SUCCESS) {
+            ret = CM_ERROR;
+        }
+    }
+    trace_reset_sites();
+    CM_FREE_PTR(g_decode.buf);
+    return ret;
+}